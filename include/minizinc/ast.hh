@@ -768,7 +768,11 @@ namespace MiniZinc {
     /// Access TypeInst
     TypeInst* ti(void) const { return _ti; }
     /// Set TypeInst
-    void ti(TypeInst* t) { _ti=t; }
+    void ti(TypeInst* t) {
+      if (_ti != NULL && _ti != t)
+        GC::newEpoch();
+      _ti=t;
+    }
     /// Access identifier
     Id* id(void) const { return _id; }
     /// Access initialisation expression
@@ -862,7 +866,11 @@ namespace MiniZinc {
     /// Access domain
     Expression* domain(void) const { return _domain; }
     //// Set domain
-    void domain(Expression* d) { _domain = d; }
+    void domain(Expression* d) {
+      if (_domain != NULL && _domain != d)
+        GC::newEpoch();
+      _domain = d;
+    }
     
     /// Set ranges to \a ranges
     void setRanges(const std::vector<TypeInst*>& ranges);
@@ -1435,6 +1443,7 @@ namespace MiniZinc {
       } solver_output;
       struct {
         ASTString fail_limit;
+        ASTString memory_limit_mb;
         ASTString node_limit;
         ASTString solution_limit;
         ASTString supports_maximize;
@@ -1508,6 +1517,7 @@ namespace MiniZinc {
         ASTString oznToFile;
         ASTString oznToStdout;
         ASTString rangeDomainsOnly;
+        ASTString solutionFormat;
         ASTString statistics;
         ASTString stdlib;
         ASTString typecheck;
@@ -1535,6 +1545,8 @@ namespace MiniZinc {
       UNORDERED_NAMESPACE::unordered_map<FloatVal, WeakRef> floatMap;
       /// Constructor
       Constants(void);
+      /// Destructor
+      ~Constants(void);
       /// Return shared BoolLit
       BoolLit* boollit(bool b) {
         return b ? lit_true : lit_false;
@@ -1542,7 +1554,7 @@ namespace MiniZinc {
       static const int max_array_size = INT_MAX / 2;
   };
     
-  /// Return static instance
+  /// Return the instance for the current thread
   Constants& constants(void);
 
 }
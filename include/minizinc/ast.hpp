@@ -422,6 +422,8 @@ namespace MiniZinc {
 
   inline void
   VarDecl::e(Expression* rhs) {
+    if (e() != NULL && e() != rhs)
+      GC::newEpoch();
     _e = rhs;
   }
   
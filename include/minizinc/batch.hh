@@ -0,0 +1,164 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __MINIZINC_BATCH_HH__
+#define __MINIZINC_BATCH_HH__
+
+#include <minizinc/model.hh>
+#include <minizinc/flatten.hh>
+#include <minizinc/parser.hh>
+
+#include <functional>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace MiniZinc {
+
+  /**
+   * \brief An instance of a batch
+   *
+   * The solutions of an instance are written to \a outputFile, which is
+   * opened when the instance is processed. If \a outputFile is empty,
+   * the output of the instance is collected and written to \a out in one
+   * piece (preceded by a comment line naming the data files) when the
+   * instance has been solved, so that instances processed in parallel
+   * can share a stream.
+   */
+  struct BatchInstance {
+    /// Data files (or command line data prefixed with "cmd:/")
+    std::vector<std::string> datafiles;
+    /// File that the solutions of this instance are written to
+    std::string outputFile;
+    /// Stream that the solutions are written to if there is no output file
+    std::ostream* out;
+    /// Constructor
+    BatchInstance(void) : out(&std::cout) {}
+  };
+
+  /// Options for solving a batch of instances
+  struct BatchOptions {
+    /// Include paths
+    std::vector<std::string> includePaths;
+    /// Options for flattening
+    FlatteningOptions fopts;
+    /// Do not include the standard library
+    bool ignoreStdlib;
+    /// Print progress statements
+    bool verbose;
+    /// Optimize the flat model
+    bool optimize;
+    /// Keep the new FlatZinc format (do not convert to old FlatZinc)
+    bool newfzn;
+    /// Number of worker threads (each holds its own copy of the model)
+    unsigned int workers;
+    /// Time limit per instance in milliseconds (0 for no limit)
+    long long int timeLimit;
+    /// Number of threads for flattening an instance (0 to flatten sequentially)
+    unsigned int flattenThreads;
+    /// Minimum number of constraints in a chunk that is flattened by one thread
+    unsigned int flattenChunkSize;
+    /// Default constructor
+    BatchOptions(void)
+      : ignoreStdlib(false), verbose(false), optimize(true), newfzn(false),
+        workers(1), timeLimit(0), flattenThreads(0), flattenChunkSize(1000) {}
+  };
+
+  /**
+   * \brief Function that solves a flattened instance
+   *
+   * Called with the environment of the instance, its output stream and
+   * the time remaining for the instance in milliseconds (0 if there is no
+   * time limit). Called from the worker thread that flattened the instance.
+   */
+  typedef std::function<void(Env& env, std::ostream& out, long long int timeLimit)> BatchSolveFn;
+
+  /**
+   * \brief A model that is parsed and type checked once and solved for many sets of data
+   *
+   * For each instance, the user model is copied (sharing the library and
+   * its function table), and only the data files are parsed and type
+   * checked before the instance is flattened. Like all objects that refer
+   * to the AST, a prepared model must only be used by the thread that
+   * created it.
+   */
+  class PreparedModel {
+  protected:
+    /// The model file
+    std::string _filename;
+    /// Options for parsing and type checking
+    BatchOptions _opts;
+    /// Sources shared with other threads (or NULL)
+    SharedSources* _sources;
+    /// The type checked model
+    Model* _base;
+    /// Environment for type checking the model
+    Env* _baseEnv;
+    /// Library models shared by all instances
+    std::set<Model*> _library;
+    /// Top-level declarations of the library
+    std::vector<VarDecl*> _libraryDecls;
+  public:
+    /// Constructor
+    PreparedModel(const std::string& filename, const BatchOptions& opts,
+                  SharedSources* sources = NULL);
+    /// Destructor
+    ~PreparedModel(void);
+    /// Parse and type check the model, returns false and prints the errors to \a err on failure
+    bool prepare(std::ostream& err);
+    /**
+     * \brief Create the instance given by \a datafiles
+     *
+     * Returns an environment for a copy of the model with the data added
+     * and type checked, or NULL after printing the errors to \a err. The
+     * flattening options of the environment refer to \a opts. Only one
+     * instance can exist at a time, it has to be released before the
+     * next one is created.
+     */
+    Env* instantiate(const std::vector<std::string>& datafiles, const BatchOptions& opts,
+                     std::ostream& err);
+    /// Release instance \a env created by instantiate()
+    void release(Env* env);
+    /**
+     * \brief Solve the instance given by \a datafiles
+     *
+     * The instance is flattened using the options in \a opts (of which
+     * the include paths must be the ones the model was prepared with),
+     * and passed to \a solve with output stream \a out. Errors and
+     * warnings are printed to \a err. Returns whether the instance was
+     * solved without errors.
+     */
+    bool solve(const std::vector<std::string>& datafiles, const BatchOptions& opts,
+               const BatchSolveFn& solve, std::ostream& out, std::ostream& err);
+    /// Return the model file
+    const std::string& filename(void) const { return _filename; }
+    /// Return the sources shared with other threads (or NULL)
+    SharedSources* sources(void) const { return _sources; }
+  };
+
+  /**
+   * \brief Solve the model in \a filename for each of the \a instances
+   *
+   * The model is prepared (see PreparedModel) once per worker, and each
+   * instance is flattened and passed to \a solve. Instances are distributed over \a opts.workers threads.
+   * Errors are printed to \a err, prefixed with the data files of the
+   * instance. Returns the number of instances that failed.
+   */
+  unsigned int solveBatch(const std::string& filename,
+                          const std::vector<BatchInstance>& instances,
+                          const BatchOptions& opts,
+                          const BatchSolveFn& solve,
+                          std::ostream& err);
+
+}
+
+#endif
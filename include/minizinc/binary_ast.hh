@@ -0,0 +1,197 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __MINIZINC_BINARY_AST_HH__
+#define __MINIZINC_BINARY_AST_HH__
+
+#include <minizinc/ast.hh>
+#include <minizinc/hash.hh>
+
+#include <string>
+#include <vector>
+
+namespace MiniZinc {
+
+  /**
+   * \brief Append-only byte buffer
+   *
+   * Integers are written as variable-length (LEB128) numbers, signed
+   * integers use zig-zag encoding. The encoding does not depend on the
+   * endianness of the machine.
+   */
+  class BinaryWriter {
+  protected:
+    /// The buffer
+    std::string _buf;
+  public:
+    /// Append a single byte
+    void writeByte(unsigned char c) { _buf.push_back(static_cast<char>(c)); }
+    /// Append unsigned integer \a i
+    void writeUInt(unsigned long long int i);
+    /// Append signed integer \a i
+    void writeInt(long long int i);
+    /// Append integer value \a v (which may be infinite)
+    void writeIntVal(const IntVal& v);
+    /// Append floating point value \a d
+    void writeFloat(double d);
+    /// Append \a n raw bytes
+    void writeBytes(const char* b, size_t n) { _buf.append(b,n); }
+    /// Append length-prefixed string \a s
+    void writeString(const std::string& s);
+    /// Append type \a t
+    void writeType(const Type& t);
+    /// Append contents of \a w
+    void append(const BinaryWriter& w) { _buf.append(w._buf); }
+    /// Return current size
+    size_t size(void) const { return _buf.size(); }
+    /// Return buffer contents
+    const std::string& str(void) const { return _buf; }
+  };
+
+  /**
+   * \brief Reader for data written by a BinaryWriter
+   *
+   * The reader does not copy or own the data. All read operations
+   * throw an InternalError if the data is truncated.
+   */
+  class BinaryReader {
+  protected:
+    /// Current position
+    const char* _p;
+    /// End of data
+    const char* _end;
+  public:
+    /// Construct reader for the \a n bytes starting at \a b
+    BinaryReader(const char* b, size_t n) : _p(b), _end(b+n) {}
+    /// Read a single byte
+    unsigned char readByte(void);
+    /// Read unsigned integer
+    unsigned long long int readUInt(void);
+    /// Read signed integer
+    long long int readInt(void);
+    /// Read integer value
+    IntVal readIntVal(void);
+    /// Read floating point value
+    double readFloat(void);
+    /// Skip \a n bytes and return pointer to the first one
+    const char* readBytes(size_t n);
+    /// Read length-prefixed string
+    std::string readString(void);
+    /// Read type
+    Type readType(void);
+    /// Return current position
+    const char* pos(void) const { return _p; }
+    /// Return whether all data has been read
+    bool done(void) const { return _p==_end; }
+  };
+
+  /**
+   * \brief Serialise expressions and items
+   *
+   * Strings are interned into a string table that has to be stored
+   * alongside the serialised data (see strings()). Identifiers that refer
+   * to a variable declaration are stored as references to the declaration,
+   * which may occur before or after the identifier.
+   */
+  class ASTWriter {
+  protected:
+    /// Output
+    BinaryWriter& _w;
+    /// String table
+    std::vector<std::string> _strings;
+    /// Map from strings to their index in the string table
+    UNORDERED_NAMESPACE::unordered_map<std::string,unsigned int> _stringMap;
+    /// Map from declarations to their reference number
+    UNORDERED_NAMESPACE::unordered_map<const VarDecl*,unsigned int> _decls;
+    /// Return index of \a s in the string table
+    unsigned int str(const std::string& s);
+    /// Return index of \a s in the string table
+    unsigned int str(const ASTString& s);
+    /// Return reference number of \a vd
+    unsigned int declRef(const VarDecl* vd);
+    /// Write annotation \a ann
+    void writeAnn(const Annotation& ann);
+  public:
+    /// Constructor
+    ASTWriter(BinaryWriter& w) : _w(w) {}
+    /// Write location \a loc
+    void write(const Location& loc);
+    /// Write expression \a e (which may be NULL)
+    void write(Expression* e);
+    /// Write item \a i
+    void write(Item* i);
+    /// Return string table
+    const std::vector<std::string>& strings(void) const { return _strings; }
+    /// Return number of declarations written or referenced
+    unsigned int nDecls(void) const { return static_cast<unsigned int>(_decls.size()); }
+    /**
+     * \brief Assign the next reference number to \a vd without writing it
+     *
+     * The reader has to be given the corresponding declaration using
+     * ASTReader::external, in the same order.
+     */
+    void external(const VarDecl* vd) { (void) declRef(vd); }
+  };
+
+  /**
+   * \brief Reconstruct expressions and items written by an ASTWriter
+   *
+   * All objects are allocated in the heap of the calling thread, which
+   * has to hold a GCLock while the reader is in use.
+   */
+  class ASTReader {
+  protected:
+    /// Input
+    BinaryReader& _r;
+    /// Raw string table
+    const std::vector<std::pair<const char*,size_t> >& _strings;
+    /// Strings already allocated in the heap
+    std::vector<ASTString> _astStrings;
+    /// Declarations by reference number
+    std::vector<VarDecl*> _decls;
+    /// Identifiers whose declaration has not been read yet
+    std::vector<std::pair<Id*,unsigned int> > _fixups;
+    /// Smallest numeric identifier that is renumbered
+    long long int _renumberMin;
+    /// Offset added to renumbered identifiers
+    long long int _renumberOffset;
+    /// Return numeric identifier \a idn after renumbering
+    long long int renumbered(long long int idn) const {
+      return idn >= _renumberMin ? idn+_renumberOffset : idn;
+    }
+    /// Return string number \a i
+    ASTString str(unsigned long long int i);
+    /// Read annotations into \a ann
+    void readAnn(Annotation& ann);
+  public:
+    /// Constructor
+    ASTReader(BinaryReader& r,
+              const std::vector<std::pair<const char*,size_t> >& strings);
+    /// Read a location
+    Location readLocation(void);
+    /// Read an expression (may return NULL)
+    Expression* readExpression(void);
+    /// Read an item
+    Item* readItem(void);
+    /// Resolve references to declarations that were read after their use
+    void finish(void);
+    /// Use \a vd for the next reference number (see ASTWriter::external)
+    void external(VarDecl* vd) { _decls.push_back(vd); }
+    /// Add \a offset to all numeric identifiers of at least \a min that are read
+    void renumber(long long int min, long long int offset) {
+      _renumberMin = min;
+      _renumberOffset = offset;
+    }
+  };
+
+}
+
+#endif
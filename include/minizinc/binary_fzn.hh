@@ -0,0 +1,55 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __MINIZINC_BINARY_FZN_HH__
+#define __MINIZINC_BINARY_FZN_HH__
+
+#include <minizinc/model.hh>
+
+#include <iostream>
+
+namespace MiniZinc {
+
+  /**
+   * \brief Write flat model \a m in binary FlatZinc format to \a os
+   *
+   * The format consists of a string table of interned identifiers, a
+   * table of variable declarations and an item table. Arrays of integer,
+   * Boolean and float literals and of variables are stored in packed
+   * form, all integers are variable-length encoded. Search combinator
+   * annotations are omitted, as they are when the model is printed for a
+   * FlatZinc solver. Throws an InternalError if \a m contains
+   * expressions that are not FlatZinc.
+   */
+  void writeBinaryFlatZinc(Model* m, std::ostream& os);
+
+  /// Return whether the \a n bytes at \a data start with a binary FlatZinc header
+  bool isBinaryFlatZinc(const char* data, size_t n);
+
+  /**
+   * \brief Read binary FlatZinc from the \a n bytes at \a data
+   *
+   * Returns a new model containing the items. Throws an InternalError
+   * if the data is malformed.
+   */
+  Model* readBinaryFlatZinc(const char* data, size_t n);
+
+  /**
+   * \brief Read binary FlatZinc from the \a n bytes at \a data into the flat model of \a env
+   *
+   * Items are added using the same bookkeeping as the flattener, so the
+   * resulting flat model can be optimised or passed to a solver instance.
+   */
+  void readBinaryFlatZinc(Env& env, const char* data, size_t n);
+
+}
+
+#endif
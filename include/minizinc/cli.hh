@@ -13,6 +13,7 @@
 #define __MINIZINC_CLI_HH__
 
 #include <minizinc/options.hh>
+#include <minizinc/exception.hh>
 
 namespace MiniZinc {
  
@@ -26,6 +27,16 @@ namespace MiniZinc {
     std::vector<std::string> getStringVectorParam(const std::string& name, std::vector<std::string>& def) const; 
   };
   
+  /// Exception thrown by the CLIParser for invalid command lines
+  class CLIError : public Exception {
+  public:
+    CLIError(const std::string& msg) : Exception(msg) {}
+    ~CLIError(void) throw() {}
+    virtual const char* what(void) const throw() {
+      return "MiniZinc: command line error";
+    }
+  };
+  
   class CLIOption;
   
   /// parser for command line arguments for standard MiniZinc (does not recognize solver options)
@@ -53,8 +64,8 @@ namespace MiniZinc {
     bool knowsOption(const std::string& opt) const;
     /// returns pointer to the CLIOption object that represents CLI option \a name
     CLIOption* getCLIOption(const std::string& name) const;
-    /// default functionality that will be executed when a CLI error occurred
-    void error(void);
+    /// default functionality that will be executed when a CLI error occurred: throws a CLIError with message \a msg
+    void error(const std::string& msg);
     /// set the options that were not assigned by the command line to their default values
     void setDefaultOptionValues(CLIOptions* opt);
     /// applies the option \a arg given the argument vector and the next working index \a idx
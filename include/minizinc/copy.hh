@@ -14,13 +14,48 @@
 
 #include <minizinc/model.hh>
 
+#include <vector>
+
 namespace MiniZinc {
 
+  /**
+   * \brief Map from nodes to their copies
+   *
+   * An open addressing table of pointers (an empty slot has a NULL key),
+   * so that inserting does not allocate a node, and copying a map (as
+   * the EnvI of a copied environment does) copies a single array.
+   * Entries cannot be removed.
+   */
   class CopyMap {
   protected:
-    typedef UNORDERED_NAMESPACE::unordered_map<void*,void*> MyMap;
-    MyMap m;
+    /// Slot of the table
+    struct Slot {
+      void* k;
+      void* v;
+    };
+    /// The slots (size is zero or a power of two)
+    std::vector<Slot> _slots;
+    /// Number of entries
+    size_t _size;
+    /// Return first slot to probe for key \a k
+    size_t slot(const void* k) const {
+      // Fibonacci hashing, as the low bits of node addresses are always zero
+      unsigned long long x = static_cast<unsigned long long>(reinterpret_cast<size_t>(k)) * 0x9E3779B97F4A7C15ULL;
+      return static_cast<size_t>(x >> 32) & (_slots.size()-1);
+    }
+    /// Rebuild the table with \a n slots
+    void rehash(size_t n);
+    /// Insert mapping from \a k to \a v (unless \a k is already bound)
+    void insertPtr(void* k, void* v);
+    /// Return the value of \a k, or NULL
+    void* findPtr(const void* k) const;
   public:
+    /// Constructor
+    CopyMap(void) : _size(0) {}
+    /// Make room for \a n entries
+    void reserve(size_t n);
+    /// Return the number of entries
+    size_t size(void) const { return _size; }
     void insert(Expression* e0, Expression* e1);
     Expression* find(Expression* e);
     void insert(Item* e0, Item* e1);
@@ -33,13 +68,11 @@ namespace MiniZinc {
     IntSetVal* find(IntSetVal* e);
     template<class T>
     void insert(ASTExprVec<T> e0, ASTExprVec<T> e1) {
-      m.insert(std::pair<void*,void*>(e0.vec(),e1.vec()));
+      insertPtr(e0.vec(),e1.vec());
     }
     template<class T>
     ASTExprVecO<T*>* find(ASTExprVec<T> e) {
-      MyMap::iterator it = m.find(e.vec());
-      if (it==m.end()) return NULL;
-      return static_cast<ASTExprVecO<T*>*>(it->second);
+      return static_cast<ASTExprVecO<T*>*>(findPtr(e.vec()));
     }
   };
   class EnvI;
@@ -57,6 +90,8 @@ namespace MiniZinc {
   Item* copy(EnvI& env, CopyMap& map, Item* i, bool followIds=false, bool copyFundecls=false, bool followIncludes=true, bool isFlatModel=false);
   /// Create a deep copy of model \a m
   Model* copy(EnvI& env, CopyMap& map, Model* m, bool followIncludes, bool isFlatModel=false);
+  /// Register copies of the functions of model \a m in model \a c
+  void copyFunctions(EnvI& env, CopyMap& map, Model* m, Model* c, bool isFlatModel=false);
 
 }
 
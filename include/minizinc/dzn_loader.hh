@@ -0,0 +1,40 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __MINIZINC_DZN_LOADER_HH__
+#define __MINIZINC_DZN_LOADER_HH__
+
+#include <minizinc/model.hh>
+
+#include <string>
+
+namespace MiniZinc {
+
+  /**
+   * \brief Add the assignments of data file \a filename to \a m
+   *
+   * This is a fast path for large data files. It accepts only files
+   * that consist of assignments of simple expressions: integer, float
+   * and Boolean literals (possibly negated), identifiers, ranges, set
+   * literals, one- and two-dimensional array literals, and calls such
+   * as array2d whose arguments are simple expressions. Comments are
+   * allowed. The items are the same as the ones created by the parser,
+   * including their locations.
+   *
+   * Returns false without changing \a m if the \a size bytes at \a data
+   * contain anything else, in which case the file has to be parsed.
+   * The caller has to hold a GCLock.
+   */
+  bool loadDzn(Model* m, const std::string& filename, const char* data, size_t size);
+
+}
+
+#endif
@@ -40,6 +40,21 @@ namespace MiniZinc {
   std::string eval_string(EnvI& env, Expression* e, bool om = false);
   /// Evaluate a par expression \a e and return it wrapped in a literal; \a om is true if if \a e is part of the output model
   Expression* eval_par(EnvI& env, Expression* e, bool om = false);
+  /**
+   * \brief Evaluate par int comprehension \a e into \a a
+   *
+   * Only applies to array comprehensions whose generators range over par
+   * integer sets, and whose where clause is par. The elements are computed
+   * without allocating literals. Returns false (leaving \a a empty) if
+   * \a e is not of this form.
+   */
+  bool eval_comp_int(EnvI& env, Comprehension* e, std::vector<IntVal>& a, bool om = false);
+  /// Evaluate par float comprehension \a e into \a a (see eval_comp_int)
+  bool eval_comp_float(EnvI& env, Comprehension* e, std::vector<FloatVal>& a, bool om = false);
+  /// Evaluate par bool comprehension \a e into \a a (see eval_comp_int)
+  bool eval_comp_bool(EnvI& env, Comprehension* e, std::vector<bool>& a, bool om = false);
+  /// Return whether the result of calling \a fi only depends on its (par) arguments
+  bool isPureFunction(EnvI& env, FunctionI* fi);
   
   /// Representation for bounds of an integer expression
   struct IntBounds {
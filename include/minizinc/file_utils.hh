@@ -13,6 +13,7 @@
 #define __MINIZINC_FILE_UTILS_HH__
 
 #include <string>
+#include <cstddef>
 
 namespace MiniZinc { namespace FileUtils {
 
@@ -24,6 +25,41 @@ namespace MiniZinc { namespace FileUtils {
   bool directory_exists(const std::string& dirname);
   /// Return full path to file
   std::string file_path(const std::string& filename);
+
+  /**
+   * \brief Read-only contents of a file
+   *
+   * The file is mapped into memory where the platform supports it,
+   * and read into a buffer otherwise. The contents are not terminated
+   * by a null character.
+   */
+  class FileContents {
+  protected:
+    /// The contents
+    const char* _data;
+    /// The size of the contents
+    size_t _size;
+    /// Whether \a _data is a memory mapping
+    bool _mapped;
+    /// Buffer holding the contents if they are not mapped
+    std::string _buffer;
+  private:
+    FileContents(const FileContents&);
+    FileContents& operator =(const FileContents&);
+  public:
+    /// Constructor
+    FileContents(void);
+    /// Destructor
+    ~FileContents(void);
+    /// Open \a filename, return false if it cannot be read
+    bool open(const std::string& filename);
+    /// Release the contents
+    void close(void);
+    /// Return the contents
+    const char* data(void) const { return _data; }
+    /// Return the size of the contents
+    size_t size(void) const { return _size; }
+  };
 }}
 
 #endif
@@ -36,14 +36,51 @@ namespace MiniZinc {
     bool onlyRangeDomains;
     /// Keep output in resulting flat model
     bool keepOutputInFzn;
+    /// Memoise the results of calls to pure par functions
+    bool memoizeParCalls;
     /// Default constructor
-    FlatteningOptions(void) : keepOutputInFzn(false) {}
+    FlatteningOptions(void) : keepOutputInFzn(false), memoizeParCalls(false) {}
   };
   
   /// Flatten model \a m
   void flatten(Env& m, FlatteningOptions opt = FlatteningOptions());
 
-  /// Translate \a m into old FlatZinc syntax
+  /**
+   * \brief Flatten the declarations and the solve item of model \a m
+   *
+   * Together with flattenConstraint and flattenFinish, this splits
+   * flattening into phases that are used for flattening in parallel:
+   * all declarations are flattened first, then the constraint items
+   * (possibly in parts), and finally the output model is created and
+   * the remaining redefinitions are flattened.
+   */
+  void flattenDecls(Env& m);
+
+  /**
+   * \brief Return the number of parts of constraint item \a ci
+   *
+   * A constraint that is a forall over a comprehension with parameter
+   * generators consists of one part per element of the comprehension,
+   * which can be flattened independently. Returns 0 for all other
+   * constraints.
+   */
+  unsigned int constraintPartCount(Env& m, ConstraintI* ci);
+
+  /// Flatten parts \a begin to \a end-1 of constraint item \a ci (all of it if it has no parts)
+  void flattenConstraint(Env& m, ConstraintI* ci, unsigned int begin = 0, unsigned int end = 0);
+
+  /// Create the output model and flatten the remaining redefinitions in \a m
+  void flattenFinish(Env& m, FlatteningOptions opt = FlatteningOptions());
+
+  /**
+   * \brief Translate \a m into old FlatZinc syntax
+   *
+   * After the first call, only the items added since the previous call
+   * are translated and merged into the sorted items. Items of the previous
+   * calls are only translated again if adding the new items changed them.
+   * Removed items are kept until more than an eighth of the items have
+   * been removed.
+   */
   void oldflatzinc(Env& m);
   
   void oldflatzinc_basic(Env& m);
@@ -70,10 +107,20 @@ namespace MiniZinc {
     int n_float_ct;
     /// Number of set constraints
     int n_set_ct;
+    /// Number of par function calls whose result was memoised
+    long long int n_par_call_hits;
+    /// Number of par function calls that were evaluated and memoised
+    long long int n_par_call_misses;
+    /// Number of variable bounds taken from the bounds cache
+    long long int n_bounds_hits;
+    /// Number of variable bounds that were computed and cached
+    long long int n_bounds_misses;
     /// Constructor
     FlatModelStatistics(void)
     : n_int_vars(0), n_bool_vars(0), n_float_vars(0), n_set_vars(0),
-      n_bool_ct(0), n_int_ct(0), n_float_ct(0), n_set_ct(0) {}
+      n_bool_ct(0), n_int_ct(0), n_float_ct(0), n_set_ct(0),
+      n_par_call_hits(0), n_par_call_misses(0),
+      n_bounds_hits(0), n_bounds_misses(0) {}
   };
   
   /// Compute statistics for flat model in \a m
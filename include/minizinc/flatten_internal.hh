@@ -23,6 +23,8 @@
 
 namespace MiniZinc {
 
+  class LazyTypecheck;
+
   /// Result of evaluation
   class EE {
   public:
@@ -89,6 +91,40 @@ namespace MiniZinc {
     std::vector<int> modifiedVarDecls;
     const FlatteningOptions& fopt;
     int in_redundant_constraint;
+    /// Results of calls to pure par functions, keyed by the call with evaluated arguments
+    KeepAliveMap<KeepAlive> parCallMemo;
+    /// Whether a function is known to be pure (see FlatteningOptions::memoizeParCalls)
+    UNORDERED_NAMESPACE::unordered_map<FunctionI*,bool> pureFunctions;
+    /// Number of par calls answered from parCallMemo
+    long long int parCallHits;
+    /// Number of par calls added to parCallMemo
+    long long int parCallMisses;
+    /// Bounds of top-level variables without a domain, computed by compute_int_bounds
+    UNORDERED_NAMESPACE::unordered_map<VarDecl*,IntBounds> intBoundsCache;
+    /// Bounds of top-level variables without a domain, computed by compute_float_bounds
+    UNORDERED_NAMESPACE::unordered_map<VarDecl*,FloatBounds> floatBoundsCache;
+    /// GC epoch in which the bounds caches were filled
+    unsigned long long int boundsEpoch;
+    /// Number of variable bounds found in the bounds caches
+    long long int boundsHits;
+    /// Number of variable bounds added to the bounds caches
+    long long int boundsMisses;
+    /// Clear the bounds caches if the GC epoch has changed
+    void checkBoundsCache(void) {
+      if (boundsEpoch != GC::epoch()) {
+        if (!intBoundsCache.empty())
+          intBoundsCache.clear();
+        if (!floatBoundsCache.empty())
+          floatBoundsCache.clear();
+        boundsEpoch = GC::epoch();
+      }
+    }
+    /// If not NULL, items removed using flat_removeItem are appended here
+    std::vector<Item*>* removedItems;
+    /// Function bodies that are type checked on demand (NULL if all bodies have been checked)
+    LazyTypecheck* lazyTypecheck;
+    /// Number of entries of the copy map of the last copy of this environment
+    size_t copyMapSize;
   protected:
     Map map;
     Model* _flat;
@@ -106,6 +142,8 @@ namespace MiniZinc {
         ); 
     ~EnvI(void);
     long long int genId(void);
+    /// Reserve \a n consecutive identifiers and return the first one
+    long long int genIds(unsigned int n);
     void map_insert(Expression* e, const EE& ee);
     void map_insert(Expression* e, const WW& ww);
     Map::iterator map_find(Expression* e);
@@ -259,43 +297,24 @@ namespace MiniZinc {
     }
     static bool domain_empty(Domain dom) { return dom->size()==0; }
     static Domain limit_domain(BinOpType bot, Domain dom, Val v) {
-      IntSetRanges dr(dom);
-      IntSetVal* ndomain;
       switch (bot) {
         case BOT_LE:
           v -= 1;
           // fall through
         case BOT_LQ:
-        {
-          Ranges::Bounded<IntSetRanges> b = Ranges::Bounded<IntSetRanges>::maxiter(dr,v);
-          ndomain = IntSetVal::ai(b);
-        }
-          break;
+          return IntSetVal::intersect(dom,-IntVal::infinity(),v);
         case BOT_GR:
           v += 1;
           // fall through
         case BOT_GQ:
-        {
-          Ranges::Bounded<IntSetRanges> b = Ranges::Bounded<IntSetRanges>::miniter(dr,v);
-          ndomain = IntSetVal::ai(b);
-        }
-          break;
+          return IntSetVal::intersect(dom,v,IntVal::infinity());
         case BOT_NQ:
-        {
-          Ranges::Const c(v,v);
-          Ranges::Diff<IntSetRanges,Ranges::Const> d(dr,c);
-          ndomain = IntSetVal::ai(d);
-        }
-          break;
+          return IntSetVal::diff(dom,IntSetVal::a(v,v));
         default: assert(false); return NULL;
       }
-      return ndomain;
     }
     static Domain intersect_domain(Domain dom, Val v0, Val v1) {
-      IntSetRanges dr(dom);
-      Ranges::Const c(v0,v1);
-      Ranges::Inter<IntSetRanges,Ranges::Const> inter(dr,c);
-      return IntSetVal::ai(inter);
+      return IntSetVal::intersect(dom,v0,v1);
     }
     static Val floor_div(Val v0, Val v1) {
       return static_cast<long long int>(floor(static_cast<FloatVal>(v0.toInt()) / static_cast<FloatVal>(v1.toInt())));
@@ -0,0 +1,47 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __MINIZINC_FLATTEN_PARALLEL_HH__
+#define __MINIZINC_FLATTEN_PARALLEL_HH__
+
+#include <minizinc/batch.hh>
+
+#include <string>
+#include <vector>
+
+namespace MiniZinc {
+
+  /**
+   * \brief Flatten instance \a env of \a pm using \a opts.flattenThreads threads
+   *
+   * The declarations and the solve item are flattened first. The
+   * constraint items are then split into at most 64 chunks of at least
+   * \a opts.flattenChunkSize constraints, where a forall over a
+   * comprehension counts as one constraint per element. Each worker
+   * thread prepares its own copy of the model, and flattens each chunk
+   * in a fresh instance for \a datafiles with its own heap and common
+   * subexpression table. The new flat items of the chunks are added to
+   * \a env in the order of the chunks, so the same constraints are
+   * generated for any number of threads (the order of the arguments of
+   * some Boolean constraints depends on memory addresses, as it does
+   * for flatten()).
+   *
+   * Chunks that change existing declarations (other than by restricting
+   * the domain of an integer or Boolean variable), cause warnings, fail
+   * or throw an error are flattened again by the calling thread in
+   * \a env. Errors are therefore reported as by flatten().
+   */
+  void flattenParallel(Env& env, PreparedModel& pm, const std::vector<std::string>& datafiles,
+                       const BatchOptions& opts);
+
+}
+
+#endif
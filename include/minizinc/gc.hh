@@ -12,10 +12,20 @@
 #ifndef __MINIZINC_GC_HH__
 #define __MINIZINC_GC_HH__
 
+#include <minizinc/config.hh>
+
 #include <cstdlib>
 #include <cassert>
 #include <new>
 
+#if defined(HAS_DECLSPEC_THREAD)
+#define MZN_THREAD_LOCAL __declspec(thread)
+#elif defined(HAS_ATTR_THREAD)
+#define MZN_THREAD_LOCAL __thread
+#else
+#error Need thread-local storage
+#endif
+
 namespace MiniZinc {
   
   /**
@@ -109,7 +119,22 @@ namespace MiniZinc {
   class KeepAlive;
   class WeakRef;
 
-  /// Garbage collector
+  /**
+   * \brief Garbage collector
+   *
+   * Each thread owns a separate heap, which is created on the first call
+   * to GC::lock in that thread. All state that refers to garbage collected
+   * objects (the constants(), the integer and float literal caches, the
+   * random number generator used by the builtins, the optimisation registry)
+   * is thread-local as well. Several independent Env and SolverInstance
+   * pipelines can therefore run concurrently, one per thread.
+   *
+   * Garbage collected objects (expressions, items, Model, KeepAlive,
+   * WeakRef, ASTString) must never be passed between threads. Read-only
+   * data that should be shared between threads has to be handed over as
+   * plain bytes (see SharedSources), and each thread builds its own
+   * objects from it.
+   */
   class GC {
     friend class ASTNode;
     friend class ASTVec;
@@ -134,7 +159,11 @@ namespace MiniZinc {
     static void removeKeepAlive(KeepAlive* e);
     static void addWeakRef(WeakRef* e);
     static void removeWeakRef(WeakRef* e);
+    /// Counter returned by epoch()
+    static MZN_THREAD_LOCAL unsigned long long int _epoch;
   public:
+    /// Function that releases thread-local state
+    typedef void (*cleanup_fn)(void);
     /// Acquire garbage collector lock for this thread
     static void lock(void);
     /// Release garbage collector lock for this thread
@@ -155,6 +184,31 @@ namespace MiniZinc {
     
     /// Return maximum allocated memory (high water mark)
     static size_t maxMem(void);
+
+    /**
+     * \brief Return the epoch of this thread
+     *
+     * The epoch changes when garbage is collected (so addresses of
+     * objects can be reused), when the trail is undone, and when the
+     * type-inst, domain or right hand side of a declaration is replaced.
+     * Caches keyed by the address of an expression are valid as long as
+     * the epoch does not change.
+     */
+    static unsigned long long int epoch(void) { return _epoch; }
+    /// Start a new epoch
+    static void newEpoch(void) { _epoch++; }
+
+    /// Register \a f to be called when the heap of this thread is released
+    static void atRelease(cleanup_fn f);
+    /**
+     * \brief Release the heap of this thread
+     *
+     * Runs all functions registered using atRelease (in reverse order)
+     * and frees all memory. All models, KeepAlive and WeakRef objects
+     * of this thread must have been destroyed before. A new heap is
+     * created if the thread uses the garbage collector again.
+     */
+    static void release(void);
   };
 
   /// Automatic garbage collection lock
@@ -16,6 +16,9 @@
 
 #include <minizinc/stl_map_set.hh>
 
+#include <deque>
+#include <vector>
+
 namespace MiniZinc {
   
   /// Hash class for expressions
@@ -127,33 +130,164 @@ namespace MiniZinc {
   };
 
 
-  /// Hash map from KeepAlive to \a T
+  /**
+   * \brief Hash map from KeepAlive to \a T
+   *
+   * This map is used as the common subexpression table of the flattener,
+   * so it is implemented as an open addressing table with linear probing
+   * instead of a node-based map. The index stores the hash of each key
+   * next to its entry number, so that probing only touches the index, and
+   * Expression::equal is only called when the full hashes agree. Growing
+   * the table rehashes the index from the stored hashes without touching
+   * the keys.
+   *
+   * Entries are kept in a deque, so that iterators and references remain
+   * valid when other entries are inserted or removed. The slots of removed
+   * entries are reused by later insertions.
+   */
   template<class T>
   class KeepAliveMap {
+  public:
+    /// Type of the entries
+    typedef std::pair<KeepAlive,T> value_type;
   protected:
-    /// The underlying map implementation
-    UNORDERED_NAMESPACE::unordered_map<KeepAlive,T,KAHash,KAEq> _m;
+    /// Slot of the index
+    struct Slot {
+      /// Hash of the key
+      size_t hash;
+      /// Entry number, or EMPTY or REMOVED
+      unsigned int idx;
+    };
+    static const unsigned int EMPTY = 0xFFFFFFFFu;
+    static const unsigned int REMOVED = 0xFFFFFFFEu;
+    /// The entries (removed entries have a NULL key)
+    std::deque<value_type> _entries;
+    /// Numbers of removed entries that can be reused
+    std::vector<unsigned int> _free;
+    /// The index (size is zero or a power of two)
+    std::vector<Slot> _index;
+    /// Number of slots that are not EMPTY
+    size_t _used;
+    /// Return first slot to probe for hash \a h
+    size_t slot(size_t h) const {
+      // Fibonacci hashing, as the low bits of expression hashes are weak
+      unsigned long long x = static_cast<unsigned long long>(h) * 0x9E3779B97F4A7C15ULL;
+      return static_cast<size_t>(x >> 32) & (_index.size()-1);
+    }
+    /// Return the slot for key \a e with hash \a h, or EMPTY
+    size_t findSlot(Expression* e, size_t h) const {
+      if (_index.empty())
+        return EMPTY;
+      size_t mask = _index.size()-1;
+      for (size_t i = slot(h);; i = (i+1) & mask) {
+        const Slot& s = _index[i];
+        if (s.idx == EMPTY)
+          return EMPTY;
+        if (s.idx != REMOVED && s.hash == h &&
+            Expression::equal(_entries[s.idx].first(), e))
+          return i;
+      }
+    }
+    /// Rebuild the index with \a n slots
+    void rehash(size_t n) {
+      std::vector<Slot> old;
+      old.swap(_index);
+      Slot empty;
+      empty.hash = 0;
+      empty.idx = EMPTY;
+      _index.assign(n, empty);
+      _used = 0;
+      size_t mask = n-1;
+      for (size_t j=0; j<old.size(); j++) {
+        if (old[j].idx < REMOVED) {
+          size_t i = slot(old[j].hash);
+          while (_index[i].idx != EMPTY)
+            i = (i+1) & mask;
+          _index[i] = old[j];
+          _used++;
+        }
+      }
+    }
   public:
-    /// Iterator type
-    typedef typename UNORDERED_NAMESPACE::unordered_map<KeepAlive,T,
-      KAHash,KAEq>::iterator iterator;
-    /// Insert mapping from \a e to \a t
+    /// Iterator over the entries
+    class iterator {
+    protected:
+      KeepAliveMap* _m;
+      size_t _i;
+      void skip(void) {
+        while (_i < _m->_entries.size() && _m->_entries[_i].first() == NULL)
+          _i++;
+      }
+    public:
+      iterator(void) : _m(NULL), _i(0) {}
+      iterator(KeepAliveMap* m, size_t i, bool doSkip) : _m(m), _i(i) {
+        if (doSkip)
+          skip();
+      }
+      value_type& operator *(void) const { return _m->_entries[_i]; }
+      value_type* operator ->(void) const { return &_m->_entries[_i]; }
+      iterator& operator ++(void) { _i++; skip(); return *this; }
+      iterator operator ++(int) { iterator r(*this); ++(*this); return r; }
+      bool operator ==(const iterator& it) const { return _i == it._i; }
+      bool operator !=(const iterator& it) const { return _i != it._i; }
+    };
+    /// Constructor
+    KeepAliveMap(void) : _used(0) {}
+    /// Insert mapping from \a e to \a t (unless \a e is already bound)
     void insert(KeepAlive& e, const T& t) {
       assert(e() != NULL);
-      _m.insert(std::pair<KeepAlive,T>(e,t));
+      size_t h = Expression::hash(e());
+      if (findSlot(e(),h) != EMPTY)
+        return;
+      // Keep the load factor (including removed slots) below 1/2
+      if ((_used+1)*2 > _index.size()) {
+        size_t n = 16;
+        while (n < (_entries.size()-_free.size()+1)*4)
+          n *= 2;
+        rehash(n);
+      }
+      unsigned int idx;
+      if (_free.empty()) {
+        idx = static_cast<unsigned int>(_entries.size());
+        _entries.push_back(value_type(e,t));
+      } else {
+        idx = _free.back();
+        _free.pop_back();
+        _entries[idx].first = e;
+        _entries[idx].second = t;
+      }
+      size_t mask = _index.size()-1;
+      size_t i = slot(h);
+      while (_index[i].idx < REMOVED)
+        i = (i+1) & mask;
+      if (_index[i].idx == EMPTY)
+        _used++;
+      _index[i].hash = h;
+      _index[i].idx = idx;
     }
     /// Find \a e in map
-    iterator find(KeepAlive& e) { return _m.find(e); }
+    iterator find(KeepAlive& e) {
+      size_t i = findSlot(e(), Expression::hash(e()));
+      return i == EMPTY ? end() : iterator(this, _index[i].idx, false);
+    }
     /// Begin of iterator
-    iterator begin(void) { return _m.begin(); }
+    iterator begin(void) { return iterator(this, 0, true); }
     /// End of iterator
-    iterator end(void) { return _m.end(); }
+    iterator end(void) { return iterator(this, _entries.size(), false); }
     /// Remove binding of \a e from map
     void remove(KeepAlive& e) {
-      _m.erase(e);
+      size_t i = findSlot(e(), Expression::hash(e()));
+      if (i == EMPTY)
+        return;
+      unsigned int idx = _index[i].idx;
+      _index[i].idx = REMOVED;
+      _entries[idx].first = KeepAlive();
+      _free.push_back(idx);
     }
+    /// Return number of entries
+    size_t size(void) const { return _entries.size()-_free.size(); }
     template <class D> void dump(void) {
-      for (iterator i = _m.begin(); i != _m.end(); ++i) {
+      for (iterator i = begin(); i != end(); ++i) {
         std::cerr << i->first() << ": " << D::d(i->second) << std::endl;
       }
     }
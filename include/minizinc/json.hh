@@ -0,0 +1,69 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __MINIZINC_JSON_HH__
+#define __MINIZINC_JSON_HH__
+
+#include <minizinc/exception.hh>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace MiniZinc {
+
+  /// Exception thrown for malformed JSON
+  class JSONError : public Exception {
+  public:
+    JSONError(const std::string& msg) : Exception(msg) {}
+    ~JSONError(void) throw() {}
+    virtual const char* what(void) const throw() {
+      return "MiniZinc: JSON error";
+    }
+  };
+
+  /**
+   * \brief A JSON value
+   *
+   * Plain value type, independent of the MiniZinc AST, so that it can be
+   * used by any thread.
+   */
+  class JSONValue {
+  public:
+    /// The type of a JSON value
+    enum Kind { JV_NULL, JV_BOOL, JV_NUMBER, JV_STRING, JV_ARRAY, JV_OBJECT };
+    /// The type of this value
+    Kind kind;
+    /// Boolean value
+    bool b;
+    /// Numeric value
+    double n;
+    /// String value
+    std::string s;
+    /// Array elements
+    std::vector<JSONValue> a;
+    /// Object members in the order in which they appear
+    std::vector<std::pair<std::string,JSONValue> > o;
+    /// Constructor for null value
+    JSONValue(void) : kind(JV_NULL), b(false), n(0.0) {}
+    /// Return member \a key of an object, or NULL if it does not exist
+    const JSONValue* get(const std::string& key) const;
+  };
+
+  /// Parse the JSON text \a text, throws a JSONError if it is malformed
+  JSONValue parseJSON(const std::string& text);
+
+  /// Return \a s as a quoted JSON string literal
+  std::string jsonString(const std::string& s);
+
+}
+
+#endif
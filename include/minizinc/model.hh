@@ -32,6 +32,7 @@ namespace MiniZinc {
   class Model {
     friend class GC;
     friend Model* copy(EnvI& env, CopyMap& cm, Model* m, bool followIncludes, bool isFlatModel);
+    friend void copyFunctions(EnvI& env, CopyMap& cm, Model* m, Model* c, bool isFlatModel);
 
   protected:
     /// Previous model in root set list
@@ -39,10 +40,41 @@ namespace MiniZinc {
     /// Next model in root set list
     Model* _roots_next;
 
+    /// Hash function for argument type signatures
+    struct SignatureHash {
+      size_t operator()(const std::vector<int>& s) const {
+        size_t h = s.size();
+        for (unsigned int i=0; i<s.size(); i++)
+          h = h*31 + static_cast<size_t>(s[i]);
+        return h;
+      }
+    };
+    /// Map from argument type signatures to the matching declaration (or NULL)
+    typedef UNORDERED_NAMESPACE::unordered_map<std::vector<int>,FunctionI*,SignatureHash> DispatchCache;
+    /// Function declarations with the same identifier
+    struct FnEntry {
+      /// The overloaded declarations
+      std::vector<FunctionI*> fns;
+      /// Results of matchFn for the argument types seen so far
+      mutable DispatchCache cache;
+    };
     /// Type of map from identifiers to function declarations
-    typedef ASTStringMap<std::vector<FunctionI*> >::t FnMap;
+    typedef ASTStringMap<FnEntry>::t FnMap;
     /// Map from identifiers to function declarations
     FnMap fnmap;
+    /**
+     * \brief Whether matchFn uses the dispatch caches
+     *
+     * The types of the parameters are only final once the model has been
+     * type checked, so the caches are disabled by registerFn and enabled
+     * by sortFn (which the type checker calls at the end).
+     */
+    bool _fnCacheEnabled;
+    /// Buffer for the signature of the arguments of a call
+    mutable std::vector<int> _signature;
+    /// Return declaration in \a fe matching \a args, using the dispatch cache if enabled
+    template<class Args>
+    FunctionI* matchArgs(EnvI& env, const FnEntry& fe, const Args& args) const;
 
     /// Filename of the model
     ASTString _filename;
@@ -60,6 +92,8 @@ namespace MiniZinc {
     std::string _docComment;
     /// Flag whether model is failed
     bool _failed;
+    /// Number of leading items that have been converted to FlatZinc
+    unsigned int _normalised;
   public:
     
     /// Construct empty model
@@ -99,7 +133,7 @@ namespace MiniZinc {
 
     /// Register a builtin function item
     void registerFn(EnvI& env, FunctionI* fi);
-    /// Sort functions by type
+    /// Sort functions by type and enable the dispatch caches
     void sortFn(void);
     /// Return function declaration for \a id matching \a args
     FunctionI* matchFn(EnvI& env, const ASTString& id,
@@ -146,6 +180,11 @@ namespace MiniZinc {
     
     /// Remove all items marked as removed
     void compact(void);
+
+    /// Return number of leading items that have been converted to FlatZinc (see oldflatzinc)
+    unsigned int normalised(void) const { return _normalised; }
+    /// Set number of leading items that have been converted to FlatZinc to \a n
+    void setNormalised(unsigned int n) { _normalised = n; }
     
     /// Make model failed
     void fail(EnvI& env);
@@ -260,7 +299,8 @@ namespace MiniZinc {
     void clearWarnings(void);
     unsigned int maxCallStack(void) const;
     std::ostream& evalOutput(std::ostream& os);
-    Expression* combinator;
+    /// The search combinator (kept alive, as it is not part of any model)
+    KeepAlive combinator;
     Env* copyEnv(CopyMap& cmap);    
   };
 
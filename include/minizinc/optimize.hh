@@ -16,14 +16,50 @@
 #include <minizinc/hash.hh>
 #include <minizinc/stl_map_set.hh>
 
+#include <deque>
+#include <vector>
+
 namespace MiniZinc {
 
+  /**
+   * \brief Index of the declarations and occurrences of variables
+   *
+   * Each variable that occurs in an item is given a dense number when
+   * its first occurrence is added. The occurrences of a variable are
+   * kept in a vector in the order in which they were added. Removing an
+   * occurrence replaces it by NULL, and the vectors are compacted by
+   * compact() and rebuild(). Long vectors have an additional index from
+   * items to their positions, so that all operations take constant time.
+   */
   class VarOccurrences {
   public:
-    typedef UNORDERED_NAMESPACE::unordered_set<Item*> Items;
-    IdMap<Items> _m;
+    /// Occurrences of a variable (entries can be NULL, see items())
+    typedef std::vector<Item*> Items;
     IdMap<int> idx;
-
+  protected:
+    /// Occurrences of one variable
+    struct Occurrences {
+      /// The identifier of the variable (NULL if the entry is unused)
+      Id* id;
+      /// Items in which the variable occurs
+      Items items;
+      /// Number of entries of \a items that are not NULL
+      unsigned int n;
+      /// Index into _pos, or -1 if the vector is short
+      int pos;
+      Occurrences(Id* id0) : id(id0), n(0), pos(-1) {}
+    };
+    /// Number of each variable
+    IdMap<unsigned int> _var;
+    /// Occurrences by variable number
+    std::deque<Occurrences> _occ;
+    /// Positions of items in long occurrence vectors
+    std::vector<UNORDERED_NAMESPACE::unordered_map<Item*,unsigned int> > _pos;
+    /// Return occurrences of \a v, or NULL if there are none
+    Occurrences* findOccurrences(VarDecl* v);
+    /// Return occurrences of \a v, creating an entry if necessary
+    Occurrences& getOccurrences(VarDecl* v);
+  public:
     /// Add \a to the index
     void add(VarDeclI* i, int idx_i);
     /// Add \a to the index
@@ -41,15 +77,40 @@ namespace MiniZinc {
     
     /// Return number of occurrences of \a v
     int occurrences(VarDecl* v);
+
+    /**
+     * \brief Return the items in which \a v occurs, or NULL
+     *
+     * The vector contains NULL entries for occurrences that have been
+     * removed. It stays valid while occurrences are added or removed, but
+     * not across calls to unify, compact or rebuild.
+     */
+    const Items* items(VarDecl* v);
     
     /// Unify \a v0 and \a v1 (removing \a v0)
     void unify(EnvI& env, Model* m, Id* id0, Id* id1);
     
-    /// Rebuild index map after removing items from \a m
+    /// Remove occurrences in removed items, and renumber the variables
+    void compact(void);
+
+    /// Rebuild index map after removing items from \a m (also compacts the occurrences)
     void rebuild(Model* m);
     
     /// Clear all entries
     void clear(void);
+
+    /// Call \a f(id,item) for all occurrences
+    template<class F>
+    void forEach(F& f) {
+      for (unsigned int i=0; i<_occ.size(); i++) {
+        if (_occ[i].id==NULL)
+          continue;
+        for (unsigned int j=0; j<_occ[i].items.size(); j++) {
+          if (_occ[i].items[j])
+            f(_occ[i].id, _occ[i].items[j]);
+        }
+      }
+    }
   };
   
   class CollectOccurrencesE : public EVisitor {
@@ -106,6 +167,18 @@ namespace MiniZinc {
   
   /// Simplyfy models in \a env
   void optimize(Env& env);
+
+  /**
+   * \brief Simplify the items appended to the flat model of \a env from index \a first
+   *
+   * The items before \a first must have been simplified before (and
+   * passed to a solver). Fixed variables and unifications found in the
+   * new items are propagated only through the constraints that depend on
+   * them, using the occurrences in \a env. Variables declared before
+   * \a first are never unified away. The items before \a first that are
+   * removed are appended to \a removed.
+   */
+  void optimizeIncremental(Env& env, unsigned int first, std::vector<Item*>& removed);
   
 }
 
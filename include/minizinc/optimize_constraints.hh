@@ -23,11 +23,18 @@ namespace MiniZinc {
     typedef ConstraintStatus (*optimizer) (EnvI& env, Item* i, Call* c, Expression*& rewrite);
   protected:
     ASTStringMap<optimizer>::t _m;
+    /// Root set for the identifiers used as keys
+    Model* _keepAlive;
+    /// Constructor (registers the built-in optimizers)
+    OptimizeRegistry(void);
   public:
+    /// Destructor
+    ~OptimizeRegistry(void);
     
     void reg(const ASTString& call, optimizer);
     ConstraintStatus process(EnvI& env, Item* i, Call* c, Expression*& rewrite);
     
+    /// Return the registry for the current thread
     static OptimizeRegistry& registry(void);
   };
   
@@ -33,12 +33,16 @@ extern "C" int isatty(int);
 #endif
 
 #include <minizinc/model.hh>
+#include <minizinc/file_utils.hh>
 #include <minizinc/parser.tab.hh>
 
 #include <string>
 #include <vector>
 #include <map>
 #include <iostream>
+#include <fstream>
+#include <memory>
+#include <mutex>
 #include <algorithm>
 #include <cstdlib>
 #include <cstring>
@@ -49,12 +53,12 @@ namespace MiniZinc {
   class ParserState {
   public:
     ParserState(const std::string& f,
-                const std::string& b, std::ostream& err0,
+                const char* b, size_t len, std::ostream& err0,
                 std::vector<std::pair<std::string,Model*> >& files0,
                 std::map<std::string,Model*>& seenModels0,
                 MiniZinc::Model* model0,
                 bool isDatafile0, bool isFlatZinc0, bool parseDocComments0)
-    : filename(f.c_str()), buf(b.c_str()), pos(0), length(b.size()),
+    : filename(f.c_str()), buf(b), pos(0), length(len),
       lineno(1), lineStartPos(0), nTokenNextStart(1),
       files(files0), seenModels(seenModels0), model(model0),
       isDatafile(isDatafile0), isFlatZinc(isFlatZinc0), parseDocComments(parseDocComments0),
@@ -63,12 +67,13 @@ namespace MiniZinc {
     const char* filename;
   
     void* yyscanner;
+    /// Source text (not null-terminated)
     const char* buf;
-    unsigned int pos, length;
+    size_t pos, length;
 
     int lineno;
 
-    int lineStartPos;
+    size_t lineStartPos;
     int nTokenNextStart;
 
     std::vector<std::pair<std::string,Model*> >& files;
@@ -84,43 +89,75 @@ namespace MiniZinc {
     std::string stringBuffer;
 
     void printCurrentLine(void) {
-      const char* eol_c = strchr(buf+lineStartPos,'\n');
-      if (eol_c) {
-        err << std::string(buf+lineStartPos,eol_c-(buf+lineStartPos));
-      } else {
-        err << buf+lineStartPos;
-      }
-      err << std::endl;
+      size_t eol = std::min(lineStartPos, length);
+      while (eol < length && buf[eol] != '\n' && buf[eol] != '\0')
+        eol++;
+      err << std::string(buf+lineStartPos,buf+eol) << std::endl;
     }
   
     int fillBuffer(char* lexBuf, unsigned int lexBufSize) {
       if (pos >= length)
         return 0;
-      int num = std::min(length - pos, lexBufSize);
+      size_t num = std::min(length - pos, static_cast<size_t>(lexBufSize));
       memcpy(lexBuf,buf+pos,num);
       pos += num;
-      return num;    
+      return static_cast<int>(num);
     }
 
   };
 
+  /**
+   * \brief Source files shared between threads
+   *
+   * Models are allocated in the heap of the thread that parses them and
+   * cannot be shared. Threads that parse the same files (e.g. the standard
+   * library) can share a SharedSources object instead, so that each file
+   * is read from disk only once, and each thread builds its own Model from
+   * the shared, immutable file contents. All member functions are thread-safe.
+   */
+  class SharedSources {
+  public:
+    /// Immutable contents of a file (mapped into memory where possible)
+    typedef std::shared_ptr<const FileUtils::FileContents> Text;
+  protected:
+    /// Mutex protecting the cache
+    mutable std::mutex _mutex;
+    /// Map from full file names to contents
+    std::map<std::string,Text> _files;
+  public:
+    /// Return contents of \a fullname, reading them if not cached yet (NULL if it cannot be read)
+    Text get(const std::string& fullname);
+    /// Return number of cached files
+    size_t size(void) const;
+    /// Remove all files from the cache
+    void clear(void);
+  };
+
+  /**
+   * \brief Parse model \a filename and data files \a datafiles
+   *
+   * If \a nThreads is greater than one, included files are also parsed
+   * by \a nThreads-1 worker threads. The result is the same as when
+   * parsing sequentially.
+   */
   Model* parse(const std::string& filename,
                const std::vector<std::string>& datafiles,
                const std::vector<std::string>& includePaths,
                bool ignoreStdlib, bool parseDocComments, bool verbose,
-               std::ostream& err);
+               std::ostream& err, SharedSources* sources = NULL,
+               unsigned int nThreads = 1);
 
   Model* parseFromString(const std::string& model,
                          const std::string& filename,
                          const std::vector<std::string>& includePaths,
                          bool ignoreStdlib, bool parseDocComments, bool verbose,
-                         std::ostream& err);
+                         std::ostream& err, SharedSources* sources = NULL);
 
   Model* parseData(Model* m,
                    const std::vector<std::string>& datafiles,
                    const std::vector<std::string>& includePaths,
                    bool ignoreStdlib, bool parseDocComments, bool verbose,
-                   std::ostream& err);
+                   std::ostream& err, SharedSources* sources = NULL);
 
 }
 
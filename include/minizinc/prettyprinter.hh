@@ -14,6 +14,7 @@
 #define __MINIZINC_PRETTYPRINTER_HH__
 
 #include <iostream>
+#include <string>
 
 #include <minizinc/ast.hh>
 
@@ -30,6 +31,8 @@ namespace MiniZinc {
     std::ostream& _os;
     int _width;
     bool _flatZinc;
+    /// Output buffer of the plain printer (width 0), reused between calls
+    std::string _buf;
     
     void init(void);
     void p(Document* d);
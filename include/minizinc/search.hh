@@ -15,6 +15,9 @@
 #include <minizinc/flatten.hh>
 #include <minizinc/solver_instance_base.hh>
 #include <minizinc/flatten_internal.hh>
+#include <minizinc/solution_record.hh>
+#include <minizinc/solution_writer.hh>
+#include <minizinc/timer.hh>
 
 namespace MiniZinc {
   
@@ -33,8 +36,19 @@ namespace MiniZinc {
     std::vector<int> _localVarsToAdd;
     // the list of variables (per scope) that are added locally
     std::vector<std::vector<VarDecl*> > _localVars;
+    // the stream that solutions are printed to
+    std::ostream* _out;
+    // the writer for _out during a search (solutions are written from a separate thread)
+    SolutionWriter* _writer;
+    // the format in which solutions are written
+    SolutionFormat _format;
+    // the time since the start of the search
+    Timer _searchTime;
   public:
-    SearchHandler() : _timeoutIndex(-1) {}
+    SearchHandler(std::ostream& out = std::cout) : _timeoutIndex(-1), _out(&out), _writer(NULL), _format(SF_TEXT) {}
+    
+    /// set an overall time limit of \a ms milliseconds (from now) for the search
+    void setTimeLimit(long long int ms);
     
     /// perform search on the flat model in the environement using the specified solver
     template<class SolverInstanceBase>
@@ -43,6 +57,12 @@ namespace MiniZinc {
       solver->processFlatZinc();
       
       bool verbose = opt.getBoolParam(constants().opts.verbose.str(),false);
+      _format = solutionFormat(opt.getStringParam(constants().opts.solutionFormat.str(),"text"));
+      _searchTime.reset();
+      
+      // writes everything that is still pending when the search returns or throws
+      SolutionWriter writer(*_out);
+      _writer = &writer;
       
       SolverInstance::Status status;    
       Expression* combinator = NULL;
@@ -56,6 +76,8 @@ namespace MiniZinc {
             }
           }  
         }
+        // the combinator is not part of the model after removing the annotation
+        KeepAlive keepCombinator(combinator);
         ann.removeCall(constants().ann.combinator);
         pushScope(solver);
         combinator = removeRedundantScopeCombinator(combinator,solver,verbose);
@@ -65,20 +87,21 @@ namespace MiniZinc {
         popScope();
       }
       else { // solve using normal solve call
+        setCurrentTimeout(solver);
         status = solver->solve();
-        env.evalOutput(std::cout); // print solution
+        // the text output is printed even without a solution
+        if(_format==SF_TEXT || status==SolverInstance::SUCCESS)
+          writeSolution(solver, false, verbose); // print solution
       }    
-      switch(status) {
-        case SolverInstance::SUCCESS:
-          std::cout << constants().solver_output.sat << std::endl;
-          break;
-        case SolverInstance::FAILURE:
-          std::cout << constants().solver_output.unsat << std::endl;
-          break;        
-      }
+      writeOutput(statusRecord(status, _format), verbose);
+      _writer = NULL;
     }
     
   private:
+    /// write \a s to the output stream (waiting until it has been written if \a verbose, so that it is ordered with the verbose messages)
+    void writeOutput(const std::string& s, bool verbose);
+    /// write the current solution of \a solver (followed by the solution delimiter if \a delimiter is true and the format is text)
+    void writeSolution(SolverInstanceBase* solver, bool delimiter, bool verbose);
     /// interpret and execute the given combinator  
   SolverInstance::Status interpretCombinator(Expression* comb, SolverInstanceBase* solver, bool verbose);
   /// interpret and execute an AND combinator
@@ -0,0 +1,92 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __MINIZINC_SOLUTION_RECORD_HH__
+#define __MINIZINC_SOLUTION_RECORD_HH__
+
+#include <minizinc/model.hh>
+#include <minizinc/solver_instance.hh>
+#include <minizinc/statistics.hh>
+
+#include <string>
+
+namespace MiniZinc {
+
+  /// Formats in which solutions are written
+  enum SolutionFormat {
+    SF_TEXT,   ///< the output item, followed by the solution delimiter
+    SF_JSON,   ///< one JSON object per line
+    SF_BINARY  ///< length-prefixed binary records
+  };
+
+  /// Return the solution format called \a name (text, json or binary), throws an InternalError for other names
+  SolutionFormat solutionFormat(const std::string& name);
+
+  /// Kinds of records
+  enum SolutionRecordKind {
+    SR_SOLUTION, ///< a solution
+    SR_STATUS,   ///< the final status of the search
+    SR_MESSAGE   ///< a string printed by the search
+  };
+
+  /**
+   * \brief Return the record for the current solution of \a env in format \a f
+   *
+   * In text format, this is the output of the output item followed by
+   * the solution delimiter. The other formats are built from the values
+   * of the solution variables, i.e. the declarations of the output model
+   * that have a flat variable, without evaluating the output item. They
+   * also contain the value of the objective of the flat model (if it is
+   * an output variable), the time \a elapsed in milliseconds (unless it
+   * is negative), and the nodes and failures of \a stats (if not NULL).
+   *
+   * A JSON record is an object on a single line, such as
+   * {"type":"solution","solution":{"x":1,"q":[1,3]},"objective":1,
+   * "time":12.5,"statistics":{"nodes":5,"failures":2}}
+   * (omitting the parts that are unknown). Sets are written as
+   * {"set":[...]} with ranges as two-element arrays, arrays of several
+   * dimensions as nested arrays.
+   *
+   * A binary record is its length followed by the record itself, using
+   * the variable-length integers of the BinaryWriter. A solution record
+   * consists of the kind, the number of variables, the name and value of
+   * each variable, and a flag followed by the value for each of the
+   * objective, the time, and the nodes and failures. Values are tagged
+   * with a SolutionValueTag.
+   */
+  std::string solutionRecord(Env& env, SolutionFormat f, double elapsed, Statistics* stats);
+
+  /**
+   * \brief Return the record for the final status \a status of a search in format \a f
+   *
+   * In JSON, the status is COMPLETE (the search has finished after
+   * finding at least one solution) or UNSATISFIABLE. In a binary record,
+   * it is the status as a byte.
+   */
+  std::string statusRecord(SolverInstance::Status status, SolutionFormat f);
+
+  /// Return the record for string \a s printed by the search in format \a f
+  std::string messageRecord(const std::string& s, SolutionFormat f);
+
+  /**
+   * \brief Tags of the values in binary records
+   *
+   * Arrays whose elements are all finite integers are written as
+   * SV_ARRAY_INT, with untagged elements.
+   */
+  enum SolutionValueTag {
+    SV_NULL, SV_FALSE, SV_TRUE, SV_INT, SV_INFINITY, SV_MINUS_INFINITY, SV_FLOAT,
+    SV_STRING, SV_SET_INT, SV_SET, SV_ARRAY, SV_ARRAY_INT
+  };
+
+}
+
+#endif
@@ -0,0 +1,55 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __MINIZINC_SOLUTION_WRITER_HH__
+#define __MINIZINC_SOLUTION_WRITER_HH__
+
+#include <iostream>
+#include <string>
+
+namespace MiniZinc {
+
+  /**
+   * \brief Writes the output of a search to a stream from a separate thread
+   *
+   * The text passed to write is appended to a buffer, and a writer thread
+   * writes and flushes everything that has accumulated since its last
+   * write. Text is written in the order in which it was passed to write.
+   * Solutions have to be formatted by the caller, because expressions
+   * must not be shared between threads.
+   *
+   * The destructor writes all remaining text before it returns, so the
+   * stream can be used again once the writer has been destroyed.
+   */
+  class SolutionWriter {
+  protected:
+    class Impl;
+    /// The buffer and the writer thread
+    Impl* _impl;
+  public:
+    /// Create a writer for stream \a os
+    SolutionWriter(std::ostream& os);
+    /// Write all remaining text and stop the writer thread
+    ~SolutionWriter(void);
+    /// Append \a s to the text to be written
+    void write(const std::string& s);
+    /// Wait until all text passed to write has been written and flushed
+    void flush(void);
+  private:
+    /// Disabled copy constructor
+    SolutionWriter(const SolutionWriter&);
+    /// Disabled assignment operator
+    SolutionWriter& operator =(const SolutionWriter&);
+  };
+
+}
+
+#endif
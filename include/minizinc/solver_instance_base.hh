@@ -29,6 +29,7 @@ namespace MiniZinc {
     
     typedef void (*poster) (SolverInstanceBase&, const Call* call);
 
+    /// Constraint posters of a solver instance (confined to the thread that created the instance)
     class Registry {
     protected:
       ASTStringMap<poster>::t _registry;
@@ -71,6 +72,10 @@ namespace MiniZinc {
     virtual bool postConstraints(std::vector<Call*> cts) { return false; }    
     /// add variables during search (after next() has been called)
     virtual bool addVariables(const std::vector<VarDecl*>& vars) { return false; }
+    /// remove items from the flat model that became redundant when posting constraints during search (the default keeps them in the solver)
+    virtual bool removeItems(const std::vector<Item*>& items) { return true; }
+    /// return the search statistics of the solver, or NULL if the solver does not collect any
+    virtual Statistics* statistics(void) { return NULL; }
     /// update the bounds of the given variables to the new integer bounds during search (after next() has been called)
     //bool updateFloatBounds(VarDecl* vd, float lb, float ub) { return false; }
     void setOptions(Options& o) { _options = o; }
@@ -119,6 +124,8 @@ namespace MiniZinc {
     virtual bool postConstraints(std::vector<Call*> cts);
    /// add variables during search (after next() has been called)
     virtual bool addVariables(const std::vector<VarDecl*>& vars);
+    /// remove items during search (after next() has been called)
+    virtual bool removeItems(const std::vector<Item*>& items);
     /// retrieve the next solution
     virtual Status next(void);
   };
@@ -162,6 +162,8 @@ namespace MiniZinc {
     virtual Status best(VarDecl* obj, bool minimize, bool print);
     virtual void processFlatZinc(void);    
     virtual Status solve(void);
+    /// return the node and failure count of the search engine
+    virtual Statistics* statistics(void);
     /// this is the version that the combinator interpreter calls which will evoke the search engine
     virtual bool updateIntBounds(VarDecl* vd, int lb, int ub);
     /// this is the version that is called by the Gecode engine and applied to each space
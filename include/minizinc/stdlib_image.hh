@@ -0,0 +1,102 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __MINIZINC_STDLIB_IMAGE_HH__
+#define __MINIZINC_STDLIB_IMAGE_HH__
+
+#include <minizinc/model.hh>
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace MiniZinc {
+
+  /// Return MD5 digest of \a s (ignoring carriage returns) as a hex string
+  std::string md5hex(const std::string& s);
+  /// Return MD5 digest of the \a n bytes at \a s (ignoring carriage returns) as a hex string
+  std::string md5hex(const char* s, size_t n);
+
+  /**
+   * \brief Precompiled image of the library files
+   *
+   * An image contains the parsed items of all library files reachable
+   * from the standard library, globals.mzn and minisearch.mzn for a
+   * given list of include paths, together with the MD5 checksum of each
+   * source file (computed the same way as in md5_gen.cmake). The parser
+   * uses the items from the image instead of parsing a file if the
+   * checksum of the file on disk matches.
+   *
+   * Images are immutable once loaded and shared between all threads.
+   */
+  class StdlibImage {
+  public:
+    /// Shared pointer to an image
+    typedef std::shared_ptr<const StdlibImage> Ptr;
+  protected:
+    /// Entry for a source file
+    struct FileEntry {
+      /// Checksum of the source file
+      std::string md5;
+      /// Offset of the serialised items
+      size_t offset;
+      /// Length of the serialised items
+      size_t length;
+    };
+    /// Image data
+    const char* _data;
+    /// Size of the image data
+    size_t _size;
+    /// Whether the image data is memory mapped
+    bool _mapped;
+    /// Image data if it is not memory mapped
+    std::string _buf;
+    /// String table (pointing into the image data)
+    std::vector<std::pair<const char*,size_t> > _strings;
+    /// Files by full path name
+    std::map<std::string,FileEntry> _files;
+    /// Constructor
+    StdlibImage(void);
+    /// Read image from \a filename
+    bool read(const std::string& filename);
+  public:
+    /// Destructor
+    ~StdlibImage(void);
+    /// Return file name of the image for \a includePaths (empty if stdlib.mzn cannot be found)
+    static std::string filename(const std::vector<std::string>& includePaths);
+    /// Return the image for \a includePaths, or an empty pointer if there is none
+    static Ptr load(const std::vector<std::string>& includePaths);
+    /**
+     * \brief Create the image for \a includePaths
+     *
+     * Returns false and prints a message to \a err if the library cannot
+     * be parsed or the image cannot be written.
+     */
+    static bool write(const std::vector<std::string>& includePaths, std::ostream& err);
+    /**
+     * \brief Add items of \a fullname to \a m
+     *
+     * Returns false if \a fullname is not part of the image or if its
+     * \a size bytes of contents at \a data do not match the checksum
+     * stored in the image. The caller has to hold a GCLock.
+     */
+    bool decode(const std::string& fullname, const char* data, size_t size, Model* m) const;
+    /// Return whether \a fullname with \a size bytes of contents at \a data is part of the image
+    bool contains(const std::string& fullname, const char* data, size_t size) const;
+    /// Return number of files in the image
+    size_t size(void) const { return _files.size(); }
+  };
+
+}
+
+#endif
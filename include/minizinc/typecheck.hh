@@ -45,13 +45,59 @@ namespace MiniZinc {
     void run(EnvI& env, Expression* e);
   };
   
-  /// Type check the model \a m
+  /**
+   * \brief Function bodies whose type checking has been deferred
+   *
+   * The bodies of library functions are type checked when a call is
+   * first resolved to them (Model::matchFn calls check), so that only
+   * the functions that a model actually uses are checked. Created by
+   * typecheck and owned by the EnvI.
+   */
+  class LazyTypecheck {
+  public:
+    /// The type checked model
+    Model* m;
+    /// The topological sorter of the model (the scope of the toplevel declarations)
+    TopoSorter ts;
+    /// Functions whose bodies have not been type checked yet
+    UNORDERED_NAMESPACE::unordered_set<FunctionI*> pending;
+    /// Whether the toplevel declarations have been type checked
+    bool ready;
+    /// Pending functions that calls were resolved to before the toplevel declarations were ready
+    std::vector<FunctionI*> deferred;
+    /// Constructor
+    LazyTypecheck(Model* m0) : m(m0), ready(false) {}
+    /// Type check the body of \a fi if it is pending, throw the first type error
+    void check(EnvI& env, FunctionI* fi);
+    /// Type check all pending bodies
+    void checkAll(EnvI& env);
+  };
+
+  /**
+   * \brief Type check the model \a m
+   *
+   * If \a libraryPaths is not NULL, the bodies of the functions defined in
+   * files below one of the \a libraryPaths are type checked on demand (see
+   * LazyTypecheck), and errors in functions that are never called are not
+   * reported. Their signatures are always checked.
+   */
   void typecheck(Env& env, Model* m, std::vector<TypeError>& typeErrors,
-                 bool ignoreUndefinedParameters = false);
+                 bool ignoreUndefinedParameters = false,
+                 const std::vector<std::string>* libraryPaths = NULL);
 
   /// Type check new assign item \a ai in model \a m
   void typecheck(Env& env, Model* m, AssignI* ai);
 
+  /**
+   * \brief Type check data assign items \a ais added to the type checked model \a m
+   *
+   * The model must have been type checked with undefined parameters
+   * ignored. Binds each assigned declaration to its (coerced) value,
+   * removes the assign items and checks that all parameters are defined.
+   */
+  void typecheck_data(Env& env, Model* m, const std::vector<AssignI*>& ais,
+                      std::vector<TypeError>& typeErrors);
+
   /// Typecheck FlatZinc variable declarations
   void typecheck_fzn(Env& env, Model* m);
   
@@ -12,15 +12,25 @@
 #ifndef __MINIZINC_VALUES_HH__
 #define __MINIZINC_VALUES_HH__
 
+#include <minizinc/config.hh>
 #include <minizinc/gc.hh>
 #include <minizinc/exception.hh>
 #include <minizinc/stl_map_set.hh>
+
+#if !defined(HAS_BUILTIN_OVERFLOW) && !defined(MZN_USE_SAFEINT)
+#define MZN_USE_SAFEINT
+#endif
+
+#ifdef MZN_USE_SAFEINT
 #include <minizinc/thirdparty/SafeInt3.hpp>
+#endif
+
 #include <algorithm>
 #include <functional>
 #include <vector>
 #include <string>
 #include <limits.h>
+#include <stdint.h>
 
 
 namespace MiniZinc {
@@ -38,6 +48,7 @@ namespace std {
 #define MZN_NORETURN_ATTR __attribute__((__noreturn__))
 #endif
 
+#ifdef MZN_USE_SAFEINT
 namespace MiniZinc {
   
   class MiniZincSafeIntExceptionHandler
@@ -54,6 +65,7 @@ namespace MiniZinc {
     }
   };
 }
+#endif
 
 #undef MZN_NORETURN
 
@@ -71,9 +83,16 @@ namespace MiniZinc {
     long long int _v;
     bool _infinity;
     IntVal(long long int v, bool infinity) : _v(v), _infinity(infinity) {}
-    typedef SafeInt<long long int, MiniZincSafeIntExceptionHandler> SI;
-    SI toSafeInt(void) const { return _v; }
-    IntVal(SI v) : _v(v), _infinity(false) {}
+    /// Return \a x + \a y, throw ArithmeticError on overflow
+    static long long int safePlus(long long int x, long long int y);
+    /// Return \a x - \a y, throw ArithmeticError on overflow
+    static long long int safeMinus(long long int x, long long int y);
+    /// Return \a x * \a y, throw ArithmeticError on overflow
+    static long long int safeMult(long long int x, long long int y);
+    /// Return \a x / \a y, throw ArithmeticError on overflow or division by zero
+    static long long int safeDiv(long long int x, long long int y);
+    /// Return -\a x, throw ArithmeticError on overflow
+    static long long int safeNegate(long long int x);
   public:
     IntVal(void) : _v(0), _infinity(false) {}
     IntVal(long long int v) : _v(v), _infinity(false) {}
@@ -91,56 +110,56 @@ namespace MiniZinc {
     IntVal& operator +=(const IntVal& x) {
       if (! (isFinite() && x.isFinite()))
         throw ArithmeticError("arithmetic operation on infinite value");
-      _v = toSafeInt() + x.toSafeInt();
+      _v = safePlus(_v,x._v);
       return *this;
     }
     IntVal& operator -=(const IntVal& x) {
       if (! (isFinite() && x.isFinite()))
         throw ArithmeticError("arithmetic operation on infinite value");
-      _v = toSafeInt() - x.toSafeInt();
+      _v = safeMinus(_v,x._v);
       return *this;
     }
     IntVal& operator *=(const IntVal& x) {
       if (! (isFinite() && x.isFinite()))
         throw ArithmeticError("arithmetic operation on infinite value");
-      _v = toSafeInt() * x.toSafeInt();
+      _v = safeMult(_v,x._v);
       return *this;
     }
     IntVal& operator /=(const IntVal& x) {
       if (! (isFinite() && x.isFinite()))
         throw ArithmeticError("arithmetic operation on infinite value");
-      _v = toSafeInt() / x.toSafeInt();
+      _v = safeDiv(_v,x._v);
       return *this;
     }
     IntVal operator -() const {
       IntVal r = *this;
-      r._v = -r.toSafeInt();
+      r._v = safeNegate(r._v);
       return r;
     }
     IntVal& operator ++() {
       if (!isFinite())
         throw ArithmeticError("arithmetic operation on infinite value");
-      _v = toSafeInt() + 1;
+      _v = safePlus(_v,1);
       return *this;
     }
     IntVal operator ++(int) {
       if (!isFinite())
         throw ArithmeticError("arithmetic operation on infinite value");
       IntVal ret = *this;
-      _v = toSafeInt() + 1;
+      _v = safePlus(_v,1);
       return ret;
     }
     IntVal& operator --() {
       if (!isFinite())
         throw ArithmeticError("arithmetic operation on infinite value");
-      _v = toSafeInt() - 1;
+      _v = safeMinus(_v,1);
       return *this;
     }
     IntVal operator --(int) {
       if (!isFinite())
         throw ArithmeticError("arithmetic operation on infinite value");
       IntVal ret = *this;
-      _v = toSafeInt() - 1;
+      _v = safeMinus(_v,1);
       return ret;
     }
     static const IntVal minint(void);
@@ -150,14 +169,14 @@ namespace MiniZinc {
     /// Infinity-safe addition
     IntVal plus(int x) {
       if (isFinite())
-        return toSafeInt()+x;
+        return safePlus(_v,x);
       else
         return *this;
     }
     /// Infinity-safe subtraction
     IntVal minus(int x) {
       if (isFinite())
-        return toSafeInt()-x;
+        return safeMinus(_v,x);
       else
         return *this;
     }
@@ -169,6 +188,65 @@ namespace MiniZinc {
     
   };
 
+#ifdef MZN_USE_SAFEINT
+  inline long long int
+  IntVal::safePlus(long long int x, long long int y) {
+    return SafeInt<long long int, MiniZincSafeIntExceptionHandler>(x) + y;
+  }
+  inline long long int
+  IntVal::safeMinus(long long int x, long long int y) {
+    return SafeInt<long long int, MiniZincSafeIntExceptionHandler>(x) - y;
+  }
+  inline long long int
+  IntVal::safeMult(long long int x, long long int y) {
+    return SafeInt<long long int, MiniZincSafeIntExceptionHandler>(x) * y;
+  }
+  inline long long int
+  IntVal::safeDiv(long long int x, long long int y) {
+    return SafeInt<long long int, MiniZincSafeIntExceptionHandler>(x) / y;
+  }
+  inline long long int
+  IntVal::safeNegate(long long int x) {
+    return -SafeInt<long long int, MiniZincSafeIntExceptionHandler>(x);
+  }
+#else
+  inline long long int
+  IntVal::safePlus(long long int x, long long int y) {
+    long long int r;
+    if (__builtin_add_overflow(x,y,&r))
+      throw ArithmeticError("integer overflow");
+    return r;
+  }
+  inline long long int
+  IntVal::safeMinus(long long int x, long long int y) {
+    long long int r;
+    if (__builtin_sub_overflow(x,y,&r))
+      throw ArithmeticError("integer overflow");
+    return r;
+  }
+  inline long long int
+  IntVal::safeMult(long long int x, long long int y) {
+    long long int r;
+    if (__builtin_mul_overflow(x,y,&r))
+      throw ArithmeticError("integer overflow");
+    return r;
+  }
+  inline long long int
+  IntVal::safeDiv(long long int x, long long int y) {
+    if (y==0)
+      throw ArithmeticError("integer division by zero");
+    if (x==LLONG_MIN && y==-1)
+      throw ArithmeticError("integer overflow");
+    return x / y;
+  }
+  inline long long int
+  IntVal::safeNegate(long long int x) {
+    if (x==LLONG_MIN)
+      throw ArithmeticError("integer overflow");
+    return -x;
+  }
+#endif
+
   inline
   bool operator ==(const IntVal& x, const IntVal& y) {
     return x._infinity==y._infinity && x._v == y._v;
@@ -200,19 +278,19 @@ namespace MiniZinc {
   IntVal operator +(const IntVal& x, const IntVal& y) {
     if (! (x.isFinite() && y.isFinite()))
       throw ArithmeticError("arithmetic operation on infinite value");
-    return x.toSafeInt()+y.toSafeInt();
+    return IntVal::safePlus(x._v,y._v);
   }
   inline
   IntVal operator -(const IntVal& x, const IntVal& y) {
     if (! (x.isFinite() && y.isFinite()))
       throw ArithmeticError("arithmetic operation on infinite value");
-    return x.toSafeInt()-y.toSafeInt();
+    return IntVal::safeMinus(x._v,y._v);
   }
   inline
   IntVal operator *(const IntVal& x, const IntVal& y) {
     if (! (x.isFinite() && y.isFinite()))
       throw ArithmeticError("arithmetic operation on infinite value");
-    return x.toSafeInt()*y.toSafeInt();
+    return IntVal::safeMult(x._v,y._v);
   }
   inline
   IntVal operator /(const IntVal& x, const IntVal& y) {
@@ -243,8 +321,7 @@ namespace std {
   inline
   MiniZinc::IntVal abs(const MiniZinc::IntVal& x) {
     if (!x.isFinite()) return MiniZinc::IntVal::infinity();
-    MiniZinc::IntVal::SI y(x.toInt());
-    return y < 0 ? MiniZinc::IntVal(static_cast<long long int>(-y)) : x;
+    return x._v < 0 ? MiniZinc::IntVal(MiniZinc::IntVal::safeNegate(x._v)) : x;
   }
   
   inline
@@ -282,7 +359,13 @@ namespace MiniZinc {
 
   typedef double FloatVal;
 
-  /// An integer set value
+  /**
+   * \brief An integer set value
+   *
+   * The ranges are followed by the cardinality of the set, which is
+   * computed when the set is constructed (flag 1 is set if it could be
+   * computed without overflow).
+   */
   class IntSetVal : public ASTChunk {
   public:
     /// Contiguous range
@@ -305,16 +388,57 @@ namespace MiniZinc {
     const Range& get(int i) const {
       return reinterpret_cast<const Range*>(_data)[i];
     }
+    /// Return cached cardinality
+    IntVal& cachedCard(void) {
+      // Computed via an integer, as compilers otherwise warn about writing past _data
+      return *reinterpret_cast<IntVal*>(reinterpret_cast<uintptr_t>(_data)+_size-sizeof(IntVal));
+    }
+    /// Return cached cardinality
+    const IntVal& cachedCard(void) const {
+      return *reinterpret_cast<const IntVal*>(reinterpret_cast<uintptr_t>(_data)+_size-sizeof(IntVal));
+    }
+    /// Return number of bytes needed for \a n ranges
+    static size_t rangesSize(size_t n) {
+      return sizeof(Range)*n+sizeof(IntVal);
+    }
+    /// Compute cardinality, throw ArithmeticError on overflow
+    IntVal computeCard(void) const {
+      IntVal c = 0;
+      for (unsigned int i=size(); i--;) {
+        if (width(i).isFinite())
+          c += width(i);
+        else
+          return IntVal::infinity();
+      }
+      return c;
+    }
+    /// Cache the cardinality unless it overflows
+    void initCard(void);
     /// Construct empty set
-    IntSetVal(void) : ASTChunk(0) {}
+    IntSetVal(void) : ASTChunk(rangesSize(0)) {
+      cachedCard() = 0;
+      _flag_1 = true;
+    }
     /// Construct set of single range
     IntSetVal(IntVal m, IntVal n);
+    /// Construct set of \a n uninitialised ranges
+    explicit IntSetVal(size_t n) : ASTChunk(rangesSize(n)) {}
     /// Construct set from \a s
     IntSetVal(const std::vector<Range>& s)
-      : ASTChunk(sizeof(Range)*s.size()) {
+      : ASTChunk(rangesSize(s.size())) {
       for (unsigned int i=s.size(); i--;)
         get(i) = s[i];
+      initCard();
     }
+    /// Allocate set of \a n uninitialised ranges
+    static IntSetVal* alloc(size_t n) {
+      IntSetVal* r = static_cast<IntSetVal*>(ASTChunk::alloc(rangesSize(n)));
+      new (r) IntSetVal(n);
+      return r;
+    }
+    /// Merge \a x and \a y using merge kernel \a M
+    template<class M>
+    static IntSetVal* merge(IntSetVal* x, IntSetVal* y);
 
     /// Disabled
     IntSetVal(const IntSetVal& r);
@@ -322,7 +446,7 @@ namespace MiniZinc {
     IntSetVal& operator =(const IntSetVal& r);
   public:
     /// Return number of ranges
-    int size(void) const { return _size / sizeof(Range); }
+    int size(void) const { return (_size-sizeof(IntVal)) / sizeof(Range); }
     /// Return minimum, or infinity if set is empty
     IntVal min(void) const { return size()==0 ? IntVal::infinity() : get(0).min; }
     /// Return maximum, or minus infinity if set is empty
@@ -341,19 +465,12 @@ namespace MiniZinc {
     }
     /// Return cardinality
     IntVal card(void) const {
-      IntVal c = 0;
-      for (unsigned int i=size(); i--;) {
-        if (width(i).isFinite())
-          c += width(i);
-        else
-          return IntVal::infinity();
-      }
-      return c;
+      return _flag_1 ? cachedCard() : computeCard();
     }
 
     /// Allocate empty set from context
     static IntSetVal* a(void) {
-      IntSetVal* r = static_cast<IntSetVal*>(ASTChunk::alloc(0));
+      IntSetVal* r = static_cast<IntSetVal*>(ASTChunk::alloc(rangesSize(0)));
       new (r) IntSetVal();
       return r;
     }
@@ -364,7 +481,7 @@ namespace MiniZinc {
         return a();
       } else {
         IntSetVal* r =
-          static_cast<IntSetVal*>(ASTChunk::alloc(sizeof(Range)));
+          static_cast<IntSetVal*>(ASTChunk::alloc(rangesSize(1)));
         new (r) IntSetVal(m,n);
         return r;
       }
@@ -377,7 +494,7 @@ namespace MiniZinc {
       for (; i(); ++i)
         s.push_back(Range(i.min(),i.max()));
       IntSetVal* r = static_cast<IntSetVal*>(
-          ASTChunk::alloc(sizeof(Range)*s.size()));
+          ASTChunk::alloc(rangesSize(s.size())));
       new (r) IntSetVal(s);
       return r;
     }
@@ -401,15 +518,36 @@ namespace MiniZinc {
       }
       ranges.push_back(Range(min,max));
       IntSetVal* r = static_cast<IntSetVal*>(
-          ASTChunk::alloc(sizeof(Range)*ranges.size()));
+          ASTChunk::alloc(rangesSize(ranges.size())));
       new (r) IntSetVal(ranges);
       return r;
     }
     static IntSetVal* a(const std::vector<Range>& ranges) {
-      IntSetVal* r = static_cast<IntSetVal*>(ASTChunk::alloc(sizeof(Range)*ranges.size()));
+      IntSetVal* r = static_cast<IntSetVal*>(ASTChunk::alloc(rangesSize(ranges.size())));
       new (r) IntSetVal(ranges);
       return r;
     }
+
+    /**
+     * \name Set operations
+     *
+     * The result is computed in a single merge over the ranges of the
+     * arguments and written directly into a new set of the right size.
+     * If the result is equal to an argument, that argument is returned
+     * and nothing is allocated.
+     */
+    //@{
+    /// Return the union of \a x and \a y
+    static IntSetVal* unite(IntSetVal* x, IntSetVal* y);
+    /// Return the intersection of \a x and \a y
+    static IntSetVal* intersect(IntSetVal* x, IntSetVal* y);
+    /// Return the intersection of \a x and the range from \a min to \a max
+    static IntSetVal* intersect(IntSetVal* x, IntVal min, IntVal max);
+    /// Return the difference of \a x and \a y
+    static IntSetVal* diff(IntSetVal* x, IntSetVal* y);
+    /// Return the symmetric difference of \a x and \a y
+    static IntSetVal* symdiff(IntSetVal* x, IntSetVal* y);
+    //@}
     
     /// Check if set contains \a v
     bool contains(const IntVal& v) {
@@ -468,10 +468,25 @@ namespace MiniZinc {
         rootSetModel->addItem(new ConstraintI(Location(), new ArrayLit(Location(),rootSet)));
       }
             
-      static OpToString& o(void) {
-        static OpToString _o;
+      ~OpToString(void) {
+        delete rootSetModel;
+      }
+
+      static OpToString*& instance(void) {
+        static MZN_THREAD_LOCAL OpToString* _o = NULL;
         return _o;
       }
+      static void release(void) {
+        delete instance();
+        instance() = NULL;
+      }
+      static OpToString& o(void) {
+        if (instance()==NULL) {
+          instance() = new OpToString();
+          GC::atRelease(&OpToString::release);
+        }
+        return *instance();
+      }
       
     };
   }
@@ -1127,6 +1142,7 @@ namespace MiniZinc {
     solver_output.unbounded = ASTString("=====UNBOUNDED====="); 
     
     solver_options.fail_limit = ASTString("fail_limit");
+    solver_options.memory_limit_mb = ASTString("memory_limit_mb");
     solver_options.node_limit = ASTString("node_limit");
     solver_options.solution_limit = ASTString("solution_limit");
     solver_options.supports_maximize = ASTString("supports_maximize");
@@ -1194,6 +1210,7 @@ namespace MiniZinc {
     opts.oznToFile = ASTString("oznToFile");
     opts.oznToStdout = ASTString("oznToStdout");
     opts.rangeDomainsOnly = ASTString("rangeDomainsOnly");
+    opts.solutionFormat = ASTString("solutionFormat");
     opts.statistics = ASTString("statistics");
     opts.stdlib = ASTString("stdlib");
     opts.typecheck = ASTString("typecheck");
@@ -1351,6 +1368,7 @@ namespace MiniZinc {
     v.push_back(new StringLit(Location(), solver_output.unsat));
     
     v.push_back(new StringLit(Location(), solver_options.fail_limit));
+    v.push_back(new StringLit(Location(), solver_options.memory_limit_mb));
     v.push_back(new StringLit(Location(), solver_options.node_limit));
     v.push_back(new StringLit(Location(), solver_options.solution_limit));
     v.push_back(new StringLit(Location(), solver_options.supports_maximize));
@@ -1415,6 +1433,7 @@ namespace MiniZinc {
     v.push_back(new StringLit(Location(),opts.oznToFile));
     v.push_back(new StringLit(Location(),opts.oznToStdout));
     v.push_back(new StringLit(Location(),opts.rangeDomainsOnly));
+    v.push_back(new StringLit(Location(),opts.solutionFormat));
     v.push_back(new StringLit(Location(),opts.statistics));
     v.push_back(new StringLit(Location(),opts.stdlib));
     v.push_back(new StringLit(Location(),opts.typecheck));
@@ -1436,9 +1455,24 @@ namespace MiniZinc {
   
   const int Constants::max_array_size;
   
+  Constants::~Constants(void) {
+    delete m;
+  }
+
+  namespace {
+    MZN_THREAD_LOCAL Constants* _constants = NULL;
+    void releaseConstants(void) {
+      delete _constants;
+      _constants = NULL;
+    }
+  }
+
   Constants& constants(void) {
-    static Constants _c;
-    return _c;
+    if (_constants==NULL) {
+      _constants = new Constants();
+      GC::atRelease(&releaseConstants);
+    }
+    return *_constants;
   }
 
 
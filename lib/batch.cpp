@@ -0,0 +1,414 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// <thread> has to be included before SafeInt3.hpp, which redefines nullptr
+#include <thread>
+
+#include <minizinc/batch.hh>
+#include <minizinc/astexception.hh>
+#include <minizinc/builtins.hh>
+#include <minizinc/copy.hh>
+#include <minizinc/flatten_parallel.hh>
+#include <minizinc/optimize.hh>
+#include <minizinc/parser.hh>
+#include <minizinc/timer.hh>
+#include <minizinc/typecheck.hh>
+
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+namespace MiniZinc {
+
+  namespace {
+
+    /// State shared by the workers of a batch
+    class BatchState {
+    public:
+      const std::string& filename;
+      const std::vector<BatchInstance>& instances;
+      const BatchOptions& opts;
+      const BatchSolveFn& solve;
+      /// Library sources shared by all workers
+      SharedSources sources;
+      /// Index of the next instance to be processed
+      std::atomic<size_t> next;
+      /// Number of instances that were solved without errors
+      std::atomic<unsigned int> solved;
+      /// Whether an error in the model has been reported
+      std::atomic<bool> modelError;
+    protected:
+      std::ostream& _err;
+      /// Mutex protecting the error stream and the shared output streams
+      std::mutex _mutex;
+    public:
+      BatchState(const std::string& filename0,
+                 const std::vector<BatchInstance>& instances0,
+                 const BatchOptions& opts0, const BatchSolveFn& solve0,
+                 std::ostream& err0)
+        : filename(filename0), instances(instances0), opts(opts0), solve(solve0),
+          next(0), solved(0), modelError(false), _err(err0) {}
+      /// Print error message \a msg for instance \a i (or for the model if \a i is negative)
+      void error(int i, const std::string& msg) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (i < 0) {
+          _err << filename << ":" << std::endl;
+        } else {
+          const std::vector<std::string>& df = instances[i].datafiles;
+          _err << "Instance";
+          for (unsigned int j=0; j<df.size(); j++)
+            _err << " " << df[j];
+          _err << ":" << std::endl;
+        }
+        _err << msg;
+        _err.flush();
+      }
+      /// Write the output \a s of instance \a i to its shared output stream
+      void output(int i, const std::string& s) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::ostream& out = *instances[i].out;
+        const std::vector<std::string>& df = instances[i].datafiles;
+        out << "%";
+        for (unsigned int j=0; j<df.size(); j++)
+          out << " " << df[j];
+        out << std::endl << s;
+        out.flush();
+      }
+    };
+
+    /// Format the exception \a e as an error message
+    std::string errorMessage(LocationException& e, Env* env) {
+      std::ostringstream oss;
+      if (env) {
+        oss << e.what() << ": " << std::endl;
+        env->dumpErrorStack(oss);
+        oss << "  " << e.msg() << std::endl;
+      } else {
+        oss << e.loc() << ":" << std::endl;
+        oss << e.what() << ": " << e.msg() << std::endl;
+      }
+      return oss.str();
+    }
+
+    /// Format the type errors \a typeErrors as an error message
+    std::string errorMessage(const std::vector<TypeError>& typeErrors) {
+      std::ostringstream oss;
+      for (unsigned int i=0; i<typeErrors.size(); i++) {
+        oss << typeErrors[i].loc() << ":" << std::endl;
+        oss << typeErrors[i].what() << ": " << typeErrors[i].msg() << std::endl;
+      }
+      return oss.str();
+    }
+
+    /// Add the library models included by \a m to \a library
+    void collectLibrary(Model* m, const std::vector<std::string>& includePaths,
+                        std::set<Model*>& library, std::set<Model*>& seen) {
+      if (!seen.insert(m).second)
+        return;
+      if (m->parent()) {
+        std::string path = m->filepath().str();
+        for (unsigned int i=0; i<includePaths.size(); i++) {
+          if (path.compare(0,includePaths[i].size(),includePaths[i])==0) {
+            library.insert(m);
+            break;
+          }
+        }
+      }
+      for (unsigned int i=0; i<m->size(); i++) {
+        if (IncludeI* ii = (*m)[i]->dyn_cast<IncludeI>()) {
+          if (ii->m())
+            collectLibrary(ii->m(), includePaths, library, seen);
+        }
+      }
+    }
+
+    /**
+     * \brief Copy the user model \a m, sharing the \a library models
+     *
+     * The copy map \a cm must map the items of the library to themselves.
+     */
+    Model* copyUserModel(EnvI& env, CopyMap& cm, Model* m, const std::set<Model*>& library) {
+      Model* c = new Model;
+      c->setFilename(m->filename().str());
+      c->setFilepath(m->filepath().str());
+      for (unsigned int i=0; i<m->size(); i++) {
+        if (IncludeI* ii = (*m)[i]->dyn_cast<IncludeI>()) {
+          IncludeI* ci = new IncludeI(ii->loc(),ii->f());
+          if (ii->m() && library.find(ii->m()) == library.end()) {
+            Model* cim = copyUserModel(env, cm, ii->m(), library);
+            cim->setParent(c);
+            ci->m(cim,true);
+          } else {
+            ci->m(ii->m(),false);
+          }
+          c->addItem(ci);
+        } else {
+          c->addItem(copy(env,cm,(*m)[i],false,true,false));
+        }
+      }
+      return c;
+    }
+
+  }
+
+  PreparedModel::PreparedModel(const std::string& filename, const BatchOptions& opts,
+                               SharedSources* sources)
+    : _filename(filename), _opts(opts), _sources(sources), _base(NULL), _baseEnv(NULL) {}
+
+  PreparedModel::~PreparedModel(void) {
+    delete _baseEnv;
+    delete _base;
+  }
+
+  bool
+  PreparedModel::prepare(std::ostream& err) {
+    std::stringstream errstream;
+    _base = parse(_filename, std::vector<std::string>(), _opts.includePaths,
+                  _opts.ignoreStdlib, false, _opts.verbose, errstream, _sources);
+    if (_base==NULL) {
+      err << errstream.str();
+      return false;
+    }
+    _baseEnv = new Env(_base,_opts.fopts);
+    try {
+      std::vector<TypeError> typeErrors;
+      typecheck(*_baseEnv, _base, typeErrors, true);
+      if (!typeErrors.empty()) {
+        err << errorMessage(typeErrors);
+        return false;
+      }
+      registerBuiltins(*_baseEnv, _base);
+    } catch (LocationException& e) {
+      err << errorMessage(e,NULL);
+      return false;
+    } catch (Exception& e) {
+      err << e.what() << ": " << e.msg() << std::endl;
+      return false;
+    }
+    std::set<Model*> seen;
+    collectLibrary(_base, _opts.includePaths, _library, seen);
+    for (std::set<Model*>::iterator it = _library.begin(); it != _library.end(); ++it) {
+      for (unsigned int i=0; i<(*it)->size(); i++) {
+        if (VarDeclI* vdi = (**it)[i]->dyn_cast<VarDeclI>())
+          _libraryDecls.push_back(vdi->e());
+      }
+    }
+    return true;
+  }
+
+  Env*
+  PreparedModel::instantiate(const std::vector<std::string>& datafiles, const BatchOptions& opts,
+                             std::ostream& err) {
+    Model* m;
+    {
+      GCLock lock;
+      CopyMap cm;
+      for (std::set<Model*>::iterator it = _library.begin(); it != _library.end(); ++it) {
+        cm.insert(*it,*it);
+        for (unsigned int j=0; j<(*it)->size(); j++) {
+          Item* item = (**it)[j];
+          if (item->isa<FunctionI>()) {
+            cm.insert(item,item);
+          } else if (VarDeclI* vdi = item->dyn_cast<VarDeclI>()) {
+            cm.insert(item,item);
+            cm.insert(vdi->e(),vdi->e());
+          }
+        }
+      }
+      m = copyUserModel(_baseEnv->envi(), cm, _base, _library);
+      copyFunctions(_baseEnv->envi(), cm, _base, m);
+    }
+    std::stringstream errstream;
+    // Data files are only read once, so they are not added to the shared sources
+    if (!parseData(m, datafiles, _opts.includePaths, true, false,
+                   opts.verbose, errstream)) {
+      err << errstream.str();
+      delete m;
+      return NULL;
+    }
+    Env* env = new Env(m,opts.fopts);
+    std::vector<AssignI*> ais;
+    for (unsigned int j=0; j<m->size(); j++) {
+      if (AssignI* ai = (*m)[j]->dyn_cast<AssignI>())
+        if (!ai->removed())
+          ais.push_back(ai);
+    }
+    std::vector<TypeError> typeErrors;
+    try {
+      typecheck_data(*env, m, ais, typeErrors);
+    } catch (LocationException& e) {
+      err << errorMessage(e,NULL);
+      release(env);
+      return NULL;
+    } catch (Exception& e) {
+      err << e.what() << ": " << e.msg() << std::endl;
+      release(env);
+      return NULL;
+    }
+    if (!typeErrors.empty()) {
+      err << errorMessage(typeErrors);
+      release(env);
+      return NULL;
+    }
+    return env;
+  }
+
+  void
+  PreparedModel::release(Env* env) {
+    Model* m = env->model();
+    delete env;
+    // Reset flattening state of the shared library
+    for (unsigned int j=0; j<_libraryDecls.size(); j++)
+      _libraryDecls[j]->flat(NULL);
+    delete m;
+  }
+
+  namespace {
+
+    /// Flatten the type checked instance \a env of \a pm and pass it to \a solve
+    bool flattenAndSolve(Env& env, PreparedModel& pm, const std::vector<std::string>& datafiles,
+                         const BatchOptions& opts, const BatchSolveFn& solve,
+                         const Timer& timer, std::ostream& out, std::ostream& err) {
+      try {
+        if (opts.flattenThreads > 0)
+          flattenParallel(env, pm, datafiles, opts);
+        else
+          flatten(env,opts.fopts);
+      } catch (LocationException& e) {
+        err << errorMessage(e,&env);
+        return false;
+      }
+      for (unsigned int j=0; j<env.warnings().size(); j++)
+        err << "Warning: " << env.warnings()[j];
+      if (opts.optimize)
+        optimize(env);
+      if (!opts.newfzn) {
+        oldflatzinc(env);
+      } else {
+        env.flat()->compact();
+      }
+      long long int timeLimit = 0;
+      if (opts.timeLimit > 0) {
+        timeLimit = opts.timeLimit - static_cast<long long int>(timer.ms());
+        if (timeLimit <= 0) {
+          err << "Error: time limit reached before search" << std::endl;
+          return false;
+        }
+      }
+      solve(env, out, timeLimit);
+      return true;
+    }
+
+  }
+
+  bool
+  PreparedModel::solve(const std::vector<std::string>& datafiles, const BatchOptions& opts,
+                       const BatchSolveFn& solve, std::ostream& out, std::ostream& err) {
+    Timer timer;
+    Env* env = instantiate(datafiles, opts, err);
+    if (env==NULL)
+      return false;
+    bool ok = false;
+    try {
+      ok = flattenAndSolve(*env, *this, datafiles, opts, solve, timer, out, err);
+    } catch (LocationException& e) {
+      err << errorMessage(e,NULL);
+    } catch (Exception& e) {
+      err << e.what() << ": " << e.msg() << std::endl;
+    }
+    release(env);
+    return ok;
+  }
+
+  namespace {
+
+    /// Worker that processes instances until none are left
+    class BatchWorker {
+    protected:
+      BatchState& _s;
+      /// The model of the batch
+      PreparedModel _pm;
+      /// Process instance \a i, returns whether it was solved without errors
+      bool process(int i);
+    public:
+      /// Constructor
+      BatchWorker(BatchState& s) : _s(s), _pm(s.filename,s.opts,&s.sources) {}
+      /// Process instances
+      void run(void);
+    };
+
+    bool
+    BatchWorker::process(int i) {
+      const BatchInstance& inst = _s.instances[i];
+      bool ok = false;
+      std::ostringstream err;
+      std::ofstream file;
+      std::ostringstream buf;
+      if (!inst.outputFile.empty())
+        file.open(inst.outputFile.c_str());
+      if (!inst.outputFile.empty() && !file.is_open()) {
+        err << "Error: cannot open output file '" << inst.outputFile << "'." << std::endl;
+      } else {
+        ok = _pm.solve(inst.datafiles, _s.opts, _s.solve,
+                       inst.outputFile.empty() ? static_cast<std::ostream&>(buf) : file, err);
+      }
+      if (!err.str().empty())
+        _s.error(i, err.str());
+      if (inst.outputFile.empty() && !buf.str().empty())
+        _s.output(i, buf.str());
+      return ok;
+    }
+
+    void
+    BatchWorker::run(void) {
+      std::ostringstream err;
+      if (!_pm.prepare(err)) {
+        if (!_s.modelError.exchange(true))
+          _s.error(-1, err.str());
+        return;
+      }
+      for (size_t i = _s.next++; i < _s.instances.size(); i = _s.next++) {
+        if (process(static_cast<int>(i)))
+          _s.solved++;
+      }
+    }
+
+  }
+
+  unsigned int solveBatch(const std::string& filename,
+                          const std::vector<BatchInstance>& instances,
+                          const BatchOptions& opts,
+                          const BatchSolveFn& solve,
+                          std::ostream& err) {
+    BatchState s(filename, instances, opts, solve, err);
+    if (opts.workers <= 1) {
+      BatchWorker w(s);
+      w.run();
+    } else {
+      std::vector<std::thread> threads;
+      for (unsigned int i=0; i<opts.workers; i++) {
+        threads.push_back(std::thread([&s] {
+          {
+            BatchWorker w(s);
+            w.run();
+          }
+          GC::release();
+        }));
+      }
+      for (unsigned int i=0; i<threads.size(); i++)
+        threads[i].join();
+    }
+    return static_cast<unsigned int>(instances.size()) - s.solved;
+  }
+
+}
@@ -0,0 +1,786 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <minizinc/binary_ast.hh>
+#include <minizinc/exception.hh>
+
+#include <cstring>
+
+namespace MiniZinc {
+
+  namespace {
+    /// Tags for expressions that are not identified by their ExpressionId
+    enum SpecialTag { ST_NULL = 0, ST_BOOLCONST = 1, ST_ABSENT = 2 };
+    /// How an identifier refers to its declaration
+    enum IdMode { IM_NODECL = 0, IM_DECLID = 1, IM_DECL = 2 };
+    /// Flags for variable declarations
+    enum VarDeclFlags { VF_TOPLEVEL = 1, VF_INTRODUCED = 2, VF_EVALUATED = 4, VF_FLATSELF = 8 };
+  }
+
+  void
+  BinaryWriter::writeUInt(unsigned long long int i) {
+    while (i >= 0x80) {
+      _buf.push_back(static_cast<char>((i & 0x7F) | 0x80));
+      i >>= 7;
+    }
+    _buf.push_back(static_cast<char>(i));
+  }
+  void
+  BinaryWriter::writeInt(long long int i) {
+    unsigned long long int u = static_cast<unsigned long long int>(i);
+    writeUInt((u << 1) ^ (i < 0 ? ~0ULL : 0ULL));
+  }
+  void
+  BinaryWriter::writeIntVal(const IntVal& v) {
+    if (v.isFinite()) {
+      writeByte(0);
+      writeInt(v.toInt());
+    } else {
+      writeByte(v.isPlusInfinity() ? 1 : 2);
+    }
+  }
+  void
+  BinaryWriter::writeFloat(double d) {
+    unsigned long long int u;
+    memcpy(&u, &d, sizeof(double));
+    for (unsigned int i=0; i<8; i++) {
+      _buf.push_back(static_cast<char>(u & 0xFF));
+      u >>= 8;
+    }
+  }
+  void
+  BinaryWriter::writeString(const std::string& s) {
+    writeUInt(s.size());
+    _buf.append(s);
+  }
+
+  void
+  BinaryWriter::writeType(const Type& t) {
+    writeUInt(static_cast<unsigned int>(t.ti()) |
+              (static_cast<unsigned int>(t.bt()) << 1) |
+              (static_cast<unsigned int>(t.st()) << 5) |
+              (static_cast<unsigned int>(t.ot()) << 6) |
+              ((t.cv() ? 1u : 0u) << 7));
+    writeInt(t.dim());
+  }
+
+  unsigned char
+  BinaryReader::readByte(void) {
+    if (_p == _end)
+      throw InternalError("unexpected end of binary data");
+    return static_cast<unsigned char>(*_p++);
+  }
+  unsigned long long int
+  BinaryReader::readUInt(void) {
+    unsigned long long int ret = 0;
+    unsigned int shift = 0;
+    for (;;) {
+      unsigned char c = readByte();
+      ret |= static_cast<unsigned long long int>(c & 0x7F) << shift;
+      if ((c & 0x80)==0)
+        return ret;
+      shift += 7;
+      if (shift >= 64)
+        throw InternalError("invalid integer in binary data");
+    }
+  }
+  long long int
+  BinaryReader::readInt(void) {
+    unsigned long long int u = readUInt();
+    return static_cast<long long int>((u >> 1) ^ (~(u & 1) + 1));
+  }
+  IntVal
+  BinaryReader::readIntVal(void) {
+    switch (readByte()) {
+    case 0: return IntVal(readInt());
+    case 1: return IntVal::infinity();
+    case 2: return -IntVal::infinity();
+    default: throw InternalError("invalid integer value in binary data");
+    }
+  }
+  double
+  BinaryReader::readFloat(void) {
+    const char* b = readBytes(8);
+    unsigned long long int u = 0;
+    for (unsigned int i=8; i--;)
+      u = (u << 8) | static_cast<unsigned char>(b[i]);
+    double d;
+    memcpy(&d, &u, sizeof(double));
+    return d;
+  }
+  const char*
+  BinaryReader::readBytes(size_t n) {
+    if (static_cast<size_t>(_end-_p) < n)
+      throw InternalError("unexpected end of binary data");
+    const char* ret = _p;
+    _p += n;
+    return ret;
+  }
+  std::string
+  BinaryReader::readString(void) {
+    size_t n = static_cast<size_t>(readUInt());
+    const char* b = readBytes(n);
+    return std::string(b,n);
+  }
+
+  Type
+  BinaryReader::readType(void) {
+    unsigned long long int b = readUInt();
+    Type t;
+    t.ti(static_cast<Type::TypeInst>(b & 1));
+    t.bt(static_cast<Type::BaseType>((b >> 1) & 0xF));
+    t.st(static_cast<Type::SetType>((b >> 5) & 1));
+    t.ot(static_cast<Type::OptType>((b >> 6) & 1));
+    t.cv(((b >> 7) & 1) != 0);
+    t.dim(static_cast<int>(readInt()));
+    return t;
+  }
+
+  unsigned int
+  ASTWriter::str(const std::string& s) {
+    UNORDERED_NAMESPACE::unordered_map<std::string,unsigned int>::iterator it = _stringMap.find(s);
+    if (it != _stringMap.end())
+      return it->second;
+    unsigned int idx = static_cast<unsigned int>(_strings.size());
+    _strings.push_back(s);
+    _stringMap.insert(std::make_pair(s,idx));
+    return idx;
+  }
+  unsigned int
+  ASTWriter::str(const ASTString& s) {
+    return str(s.str());
+  }
+  unsigned int
+  ASTWriter::declRef(const VarDecl* vd) {
+    UNORDERED_NAMESPACE::unordered_map<const VarDecl*,unsigned int>::iterator it = _decls.find(vd);
+    if (it != _decls.end())
+      return it->second;
+    unsigned int idx = static_cast<unsigned int>(_decls.size());
+    _decls.insert(std::make_pair(vd,idx));
+    return idx;
+  }
+  void
+  ASTWriter::writeAnn(const Annotation& ann) {
+    unsigned int n = 0;
+    for (ExpressionSetIter it = ann.begin(); it != ann.end(); ++it)
+      n++;
+    _w.writeUInt(n);
+    for (ExpressionSetIter it = ann.begin(); it != ann.end(); ++it)
+      write(*it);
+  }
+  void
+  ASTWriter::write(const Location& loc) {
+    if (loc.filename.size()==0)
+      _w.writeUInt(0);
+    else
+      _w.writeUInt(str(loc.filename)+1);
+    _w.writeUInt(loc.first_line);
+    _w.writeUInt(loc.first_column);
+    _w.writeUInt(loc.last_line);
+    _w.writeUInt(loc.last_column);
+    _w.writeByte(loc.is_introduced ? 1 : 0);
+  }
+
+  void
+  ASTWriter::write(Expression* e) {
+    if (e==NULL) {
+      _w.writeByte(ST_NULL);
+      return;
+    }
+    if (e==constants().lit_true || e==constants().lit_false) {
+      _w.writeByte(ST_BOOLCONST);
+      _w.writeByte(e==constants().lit_true ? 1 : 0);
+      return;
+    }
+    if (e==constants().absent) {
+      _w.writeByte(ST_ABSENT);
+      return;
+    }
+    _w.writeByte(static_cast<unsigned char>(e->eid()));
+    write(e->loc());
+    _w.writeType(e->type());
+    writeAnn(e->ann());
+    switch (e->eid()) {
+    case Expression::E_INTLIT:
+      _w.writeIntVal(e->cast<IntLit>()->v());
+      break;
+    case Expression::E_FLOATLIT:
+      _w.writeFloat(e->cast<FloatLit>()->v());
+      break;
+    case Expression::E_SETLIT:
+      {
+        SetLit* sl = e->cast<SetLit>();
+        if (IntSetVal* isv = sl->isv()) {
+          _w.writeByte(1);
+          _w.writeUInt(isv->size());
+          for (int i=0; i<isv->size(); i++) {
+            _w.writeIntVal(isv->min(i));
+            _w.writeIntVal(isv->max(i));
+          }
+        } else {
+          _w.writeByte(0);
+          _w.writeUInt(sl->v().size());
+          for (unsigned int i=0; i<sl->v().size(); i++)
+            write(sl->v()[i]);
+        }
+      }
+      break;
+    case Expression::E_BOOLLIT:
+      _w.writeByte(e->cast<BoolLit>()->v() ? 1 : 0);
+      break;
+    case Expression::E_STRINGLIT:
+      _w.writeUInt(str(e->cast<StringLit>()->v()));
+      break;
+    case Expression::E_ID:
+      {
+        Id* id = e->cast<Id>();
+        VarDecl* vd = id->decl();
+        if (vd==NULL) {
+          _w.writeByte(IM_NODECL);
+        } else {
+          _w.writeByte(vd->id()==id ? IM_DECLID : IM_DECL);
+          _w.writeUInt(declRef(vd));
+        }
+        if (id->idn() != -1) {
+          _w.writeByte(1);
+          _w.writeInt(id->idn());
+        } else {
+          _w.writeByte(0);
+          _w.writeUInt(str(id->v()));
+        }
+      }
+      break;
+    case Expression::E_ANON:
+      break;
+    case Expression::E_ARRAYLIT:
+      {
+        ArrayLit* al = e->cast<ArrayLit>();
+        _w.writeByte(al->flat() ? 1 : 0);
+        _w.writeUInt(al->dims());
+        for (int i=0; i<al->dims(); i++) {
+          _w.writeInt(al->min(i));
+          _w.writeInt(al->max(i));
+        }
+        _w.writeUInt(al->v().size());
+        for (unsigned int i=0; i<al->v().size(); i++)
+          write(al->v()[i]);
+      }
+      break;
+    case Expression::E_ARRAYACCESS:
+      {
+        ArrayAccess* aa = e->cast<ArrayAccess>();
+        write(aa->v());
+        _w.writeUInt(aa->idx().size());
+        for (unsigned int i=0; i<aa->idx().size(); i++)
+          write(aa->idx()[i]);
+      }
+      break;
+    case Expression::E_COMP:
+      {
+        Comprehension* c = e->cast<Comprehension>();
+        _w.writeByte(c->set() ? 1 : 0);
+        _w.writeUInt(c->n_generators());
+        for (int i=0; i<c->n_generators(); i++) {
+          _w.writeUInt(c->n_decls(i));
+          for (int j=0; j<c->n_decls(i); j++)
+            write(c->decl(i,j));
+          write(c->in(i));
+        }
+        write(c->where());
+        write(c->e());
+      }
+      break;
+    case Expression::E_ITE:
+      {
+        ITE* ite = e->cast<ITE>();
+        _w.writeUInt(ite->size());
+        for (int i=0; i<ite->size(); i++) {
+          write(ite->e_if(i));
+          write(ite->e_then(i));
+        }
+        write(ite->e_else());
+      }
+      break;
+    case Expression::E_BINOP:
+      {
+        BinOp* bo = e->cast<BinOp>();
+        _w.writeByte(static_cast<unsigned char>(bo->op()));
+        write(bo->lhs());
+        write(bo->rhs());
+      }
+      break;
+    case Expression::E_UNOP:
+      {
+        UnOp* uo = e->cast<UnOp>();
+        _w.writeByte(static_cast<unsigned char>(uo->op()));
+        write(uo->e());
+      }
+      break;
+    case Expression::E_CALL:
+      {
+        Call* c = e->cast<Call>();
+        _w.writeUInt(str(c->id()));
+        _w.writeUInt(c->args().size());
+        for (unsigned int i=0; i<c->args().size(); i++)
+          write(c->args()[i]);
+      }
+      break;
+    case Expression::E_VARDECL:
+      {
+        VarDecl* vd = e->cast<VarDecl>();
+        _w.writeUInt(declRef(vd));
+        if (vd->id()->idn() != -1) {
+          _w.writeByte(1);
+          _w.writeInt(vd->id()->idn());
+        } else {
+          _w.writeByte(0);
+          _w.writeUInt(str(vd->id()->v()));
+        }
+        unsigned int flags = 0;
+        if (vd->toplevel()) flags |= VF_TOPLEVEL;
+        if (vd->introduced()) flags |= VF_INTRODUCED;
+        if (vd->evaluated()) flags |= VF_EVALUATED;
+        if (vd->flat()==vd) flags |= VF_FLATSELF;
+        _w.writeByte(static_cast<unsigned char>(flags));
+        _w.writeInt(vd->payload());
+        write(vd->ti());
+        write(vd->e());
+      }
+      break;
+    case Expression::E_LET:
+      {
+        Let* let = e->cast<Let>();
+        _w.writeUInt(let->let().size());
+        for (unsigned int i=0; i<let->let().size(); i++)
+          write(let->let()[i]);
+        write(let->in());
+      }
+      break;
+    case Expression::E_TI:
+      {
+        TypeInst* ti = e->cast<TypeInst>();
+        _w.writeByte(ti->computedDomain() ? 1 : 0);
+        _w.writeUInt(ti->ranges().size());
+        for (unsigned int i=0; i<ti->ranges().size(); i++)
+          write(ti->ranges()[i]);
+        write(ti->domain());
+      }
+      break;
+    case Expression::E_TIID:
+      _w.writeUInt(str(e->cast<TIId>()->v()));
+      break;
+    default:
+      throw InternalError("cannot serialise expression");
+    }
+  }
+
+  void
+  ASTWriter::write(Item* i) {
+    _w.writeByte(static_cast<unsigned char>(i->iid()));
+    write(i->loc());
+    _w.writeByte(i->removed() ? 1 : 0);
+    switch (i->iid()) {
+    case Item::II_INC:
+      _w.writeUInt(str(i->cast<IncludeI>()->f()));
+      break;
+    case Item::II_VD:
+      _w.writeByte(i->cast<VarDeclI>()->flag() ? 1 : 0);
+      write(i->cast<VarDeclI>()->e());
+      break;
+    case Item::II_ASN:
+      {
+        AssignI* ai = i->cast<AssignI>();
+        _w.writeUInt(str(ai->id()));
+        write(ai->e());
+        if (ai->decl())
+          _w.writeUInt(declRef(ai->decl())+1);
+        else
+          _w.writeUInt(0);
+      }
+      break;
+    case Item::II_CON:
+      _w.writeByte(i->cast<ConstraintI>()->flag() ? 1 : 0);
+      write(i->cast<ConstraintI>()->e());
+      break;
+    case Item::II_SOL:
+      {
+        SolveI* si = i->cast<SolveI>();
+        _w.writeByte(static_cast<unsigned char>(si->st()));
+        write(si->e());
+        writeAnn(si->ann());
+      }
+      break;
+    case Item::II_OUT:
+      write(i->cast<OutputI>()->e());
+      break;
+    case Item::II_FUN:
+      {
+        FunctionI* fi = i->cast<FunctionI>();
+        _w.writeUInt(str(fi->id()));
+        write(fi->ti());
+        _w.writeUInt(fi->params().size());
+        for (unsigned int j=0; j<fi->params().size(); j++)
+          write(fi->params()[j]);
+        writeAnn(fi->ann());
+        write(fi->e());
+      }
+      break;
+    }
+  }
+
+  ASTReader::ASTReader(BinaryReader& r,
+                       const std::vector<std::pair<const char*,size_t> >& strings)
+    : _r(r), _strings(strings), _astStrings(strings.size()),
+      _renumberMin(0), _renumberOffset(0) {}
+
+  ASTString
+  ASTReader::str(unsigned long long int i) {
+    if (i >= _strings.size())
+      throw InternalError("invalid string reference in binary data");
+    if (_astStrings[i].aststr()==NULL)
+      _astStrings[i] = ASTString(std::string(_strings[i].first,_strings[i].second));
+    return _astStrings[i];
+  }
+  void
+  ASTReader::readAnn(Annotation& ann) {
+    unsigned long long int n = _r.readUInt();
+    for (unsigned long long int i=0; i<n; i++)
+      ann.add(readExpression());
+  }
+  Location
+  ASTReader::readLocation(void) {
+    Location loc;
+    unsigned long long int f = _r.readUInt();
+    if (f != 0)
+      loc.filename = str(f-1);
+    loc.first_line = static_cast<unsigned int>(_r.readUInt());
+    loc.first_column = static_cast<unsigned int>(_r.readUInt());
+    loc.last_line = static_cast<unsigned int>(_r.readUInt());
+    loc.last_column = static_cast<unsigned int>(_r.readUInt());
+    loc.is_introduced = _r.readByte();
+    return loc;
+  }
+
+  Expression*
+  ASTReader::readExpression(void) {
+    unsigned char tag = _r.readByte();
+    switch (tag) {
+    case ST_NULL:
+      return NULL;
+    case ST_BOOLCONST:
+      return constants().boollit(_r.readByte()!=0);
+    case ST_ABSENT:
+      return constants().absent;
+    default:
+      break;
+    }
+    Location loc = readLocation();
+    Type t = _r.readType();
+    std::vector<Expression*> ann;
+    unsigned long long int n_ann = _r.readUInt();
+    for (unsigned long long int i=0; i<n_ann; i++)
+      ann.push_back(readExpression());
+    Expression* ret = NULL;
+    bool setType = true;
+    switch (tag) {
+    case Expression::E_INTLIT:
+      ret = new IntLit(loc,_r.readIntVal());
+      break;
+    case Expression::E_FLOATLIT:
+      ret = new FloatLit(loc,_r.readFloat());
+      break;
+    case Expression::E_SETLIT:
+      {
+        if (_r.readByte()) {
+          std::vector<IntSetVal::Range> ranges(static_cast<size_t>(_r.readUInt()));
+          for (unsigned int i=0; i<ranges.size(); i++) {
+            ranges[i].min = _r.readIntVal();
+            ranges[i].max = _r.readIntVal();
+          }
+          ret = new SetLit(loc,IntSetVal::a(ranges));
+        } else {
+          std::vector<Expression*> elems(static_cast<size_t>(_r.readUInt()));
+          for (unsigned int i=0; i<elems.size(); i++)
+            elems[i] = readExpression();
+          ret = new SetLit(loc,elems);
+        }
+      }
+      break;
+    case Expression::E_BOOLLIT:
+      ret = new BoolLit(loc,_r.readByte()!=0);
+      break;
+    case Expression::E_STRINGLIT:
+      ret = new StringLit(loc,str(_r.readUInt()));
+      break;
+    case Expression::E_ID:
+      {
+        unsigned char mode = _r.readByte();
+        unsigned long long int ref = 0;
+        if (mode != IM_NODECL)
+          ref = _r.readUInt();
+        Id* id;
+        if (_r.readByte()) {
+          id = new Id(loc,renumbered(_r.readInt()),NULL);
+        } else {
+          id = new Id(loc,str(_r.readUInt()),NULL);
+        }
+        if (mode != IM_NODECL) {
+          VarDecl* vd = ref < _decls.size() ? _decls[static_cast<size_t>(ref)] : NULL;
+          if (vd && mode==IM_DECLID) {
+            id = vd->id();
+            setType = false;
+          } else {
+            id->type(t);
+            setType = false;
+            if (vd)
+              id->decl(vd);
+            else
+              _fixups.push_back(std::make_pair(id,static_cast<unsigned int>(ref)));
+          }
+        }
+        ret = id;
+      }
+      break;
+    case Expression::E_ANON:
+      ret = new AnonVar(loc);
+      break;
+    case Expression::E_ARRAYLIT:
+      {
+        bool flat = _r.readByte()!=0;
+        std::vector<std::pair<int,int> > dims(static_cast<size_t>(_r.readUInt()));
+        for (unsigned int i=0; i<dims.size(); i++) {
+          dims[i].first = static_cast<int>(_r.readInt());
+          dims[i].second = static_cast<int>(_r.readInt());
+        }
+        std::vector<Expression*> elems(static_cast<size_t>(_r.readUInt()));
+        for (unsigned int i=0; i<elems.size(); i++)
+          elems[i] = readExpression();
+        ArrayLit* al = new ArrayLit(loc,elems,dims);
+        al->flat(flat);
+        ret = al;
+      }
+      break;
+    case Expression::E_ARRAYACCESS:
+      {
+        Expression* v = readExpression();
+        std::vector<Expression*> idx(static_cast<size_t>(_r.readUInt()));
+        for (unsigned int i=0; i<idx.size(); i++)
+          idx[i] = readExpression();
+        ret = new ArrayAccess(loc,v,idx);
+      }
+      break;
+    case Expression::E_COMP:
+      {
+        bool set = _r.readByte()!=0;
+        Generators g;
+        unsigned long long int n_gen = _r.readUInt();
+        for (unsigned long long int i=0; i<n_gen; i++) {
+          std::vector<VarDecl*> vds(static_cast<size_t>(_r.readUInt()));
+          for (unsigned int j=0; j<vds.size(); j++)
+            vds[j] = Expression::cast<VarDecl>(readExpression());
+          Expression* in = readExpression();
+          g._g.push_back(Generator(vds,in));
+        }
+        g._w = readExpression();
+        Expression* body = readExpression();
+        ret = new Comprehension(loc,body,g,set);
+      }
+      break;
+    case Expression::E_ITE:
+      {
+        std::vector<Expression*> ifthen(static_cast<size_t>(2*_r.readUInt()));
+        for (unsigned int i=0; i<ifthen.size(); i++)
+          ifthen[i] = readExpression();
+        Expression* e_else = readExpression();
+        ret = new ITE(loc,ifthen,e_else);
+      }
+      break;
+    case Expression::E_BINOP:
+      {
+        BinOpType op = static_cast<BinOpType>(_r.readByte());
+        Expression* lhs = readExpression();
+        Expression* rhs = readExpression();
+        ret = new BinOp(loc,lhs,op,rhs);
+      }
+      break;
+    case Expression::E_UNOP:
+      {
+        UnOpType op = static_cast<UnOpType>(_r.readByte());
+        Expression* e0 = readExpression();
+        ret = new UnOp(loc,op,e0);
+      }
+      break;
+    case Expression::E_CALL:
+      {
+        ASTString id = str(_r.readUInt());
+        std::vector<Expression*> args(static_cast<size_t>(_r.readUInt()));
+        for (unsigned int i=0; i<args.size(); i++)
+          args[i] = readExpression();
+        ret = new Call(loc,id,args);
+      }
+      break;
+    case Expression::E_VARDECL:
+      {
+        size_t ref = static_cast<size_t>(_r.readUInt());
+        bool isIdn = _r.readByte()!=0;
+        long long int idn = -1;
+        ASTString name;
+        if (isIdn)
+          idn = renumbered(_r.readInt());
+        else
+          name = str(_r.readUInt());
+        unsigned char flags = _r.readByte();
+        int payload = static_cast<int>(_r.readInt());
+        TypeInst* ti = Expression::cast<TypeInst>(readExpression());
+        VarDecl* vd = isIdn ? new VarDecl(loc,ti,idn) : new VarDecl(loc,ti,name);
+        if (_decls.size() <= ref)
+          _decls.resize(ref+1,NULL);
+        _decls[ref] = vd;
+        vd->toplevel((flags & VF_TOPLEVEL) != 0);
+        vd->introduced((flags & VF_INTRODUCED) != 0);
+        vd->payload(payload);
+        if (flags & VF_FLATSELF)
+          vd->flat(vd);
+        vd->e(readExpression());
+        if (flags & VF_EVALUATED)
+          vd->evaluated(true);
+        ret = vd;
+      }
+      break;
+    case Expression::E_LET:
+      {
+        std::vector<Expression*> let(static_cast<size_t>(_r.readUInt()));
+        for (unsigned int i=0; i<let.size(); i++)
+          let[i] = readExpression();
+        Expression* in = readExpression();
+        ret = new Let(loc,let,in);
+      }
+      break;
+    case Expression::E_TI:
+      {
+        bool computedDomain = _r.readByte()!=0;
+        std::vector<TypeInst*> ranges(static_cast<size_t>(_r.readUInt()));
+        for (unsigned int i=0; i<ranges.size(); i++)
+          ranges[i] = Expression::cast<TypeInst>(readExpression());
+        Expression* domain = readExpression();
+        TypeInst* ti = new TypeInst(loc,t,ASTExprVec<TypeInst>(ranges),domain);
+        ti->setComputedDomain(computedDomain);
+        ret = ti;
+      }
+      break;
+    case Expression::E_TIID:
+      ret = new TIId(loc,str(_r.readUInt()).str());
+      break;
+    default:
+      throw InternalError("invalid expression in binary data");
+    }
+    if (setType)
+      ret->type(t);
+    if (!ann.empty())
+      ret->addAnnotations(ann);
+    return ret;
+  }
+
+  Item*
+  ASTReader::readItem(void) {
+    unsigned char tag = _r.readByte();
+    Location loc = readLocation();
+    bool removed = _r.readByte()!=0;
+    Item* ret = NULL;
+    switch (tag) {
+    case Item::II_INC:
+      ret = new IncludeI(loc,str(_r.readUInt()));
+      break;
+    case Item::II_VD:
+      {
+        bool flag = _r.readByte()!=0;
+        VarDeclI* vdi = new VarDeclI(loc,Expression::cast<VarDecl>(readExpression()));
+        vdi->flag(flag);
+        ret = vdi;
+      }
+      break;
+    case Item::II_ASN:
+      {
+        std::string id = str(_r.readUInt()).str();
+        Expression* e = readExpression();
+        AssignI* ai = new AssignI(loc,id,e);
+        size_t ref = static_cast<size_t>(_r.readUInt());
+        if (ref != 0) {
+          if (ref-1 >= _decls.size() || _decls[ref-1]==NULL)
+            throw InternalError("invalid declaration reference in binary data");
+          ai->decl(_decls[ref-1]);
+        }
+        ret = ai;
+      }
+      break;
+    case Item::II_CON:
+      {
+        bool flag = _r.readByte()!=0;
+        ConstraintI* ci = new ConstraintI(loc,readExpression());
+        ci->flag(flag);
+        ret = ci;
+      }
+      break;
+    case Item::II_SOL:
+      {
+        SolveI::SolveType st = static_cast<SolveI::SolveType>(_r.readByte());
+        Expression* e = readExpression();
+        SolveI* si;
+        switch (st) {
+        case SolveI::ST_MIN: si = SolveI::min(loc,e); break;
+        case SolveI::ST_MAX: si = SolveI::max(loc,e); break;
+        default: si = SolveI::sat(loc); break;
+        }
+        readAnn(si->ann());
+        ret = si;
+      }
+      break;
+    case Item::II_OUT:
+      ret = new OutputI(loc,readExpression());
+      break;
+    case Item::II_FUN:
+      {
+        std::string id = str(_r.readUInt()).str();
+        TypeInst* ti = Expression::cast<TypeInst>(readExpression());
+        std::vector<VarDecl*> params(static_cast<size_t>(_r.readUInt()));
+        for (unsigned int i=0; i<params.size(); i++)
+          params[i] = Expression::cast<VarDecl>(readExpression());
+        std::vector<Expression*> ann;
+        unsigned long long int n_ann = _r.readUInt();
+        for (unsigned long long int i=0; i<n_ann; i++)
+          ann.push_back(readExpression());
+        Expression* e = readExpression();
+        FunctionI* fi = new FunctionI(loc,id,ti,params,e);
+        for (unsigned int i=0; i<ann.size(); i++)
+          fi->ann().add(ann[i]);
+        ret = fi;
+      }
+      break;
+    default:
+      throw InternalError("invalid item in binary data");
+    }
+    if (removed)
+      ret->remove();
+    return ret;
+  }
+
+  void
+  ASTReader::finish(void) {
+    for (unsigned int i=0; i<_fixups.size(); i++) {
+      unsigned int ref = _fixups[i].second;
+      if (ref >= _decls.size() || _decls[ref]==NULL)
+        throw InternalError("invalid declaration reference in binary data");
+      _fixups[i].first->decl(_decls[ref]);
+    }
+    _fixups.clear();
+  }
+
+}
@@ -0,0 +1,562 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <minizinc/binary_fzn.hh>
+#include <minizinc/binary_ast.hh>
+#include <minizinc/flatten_internal.hh>
+#include <minizinc/exception.hh>
+
+#include <cstring>
+
+namespace MiniZinc {
+
+  namespace {
+
+    const char* const fznMagic = "MZNBFZN\x01";
+
+    /// Expression tags
+    enum FznTag {
+      FT_NULL, FT_FALSE, FT_TRUE, FT_INT, FT_INTVAL, FT_FLOAT, FT_STRING,
+      FT_ID, FT_NAME, FT_SET_INT, FT_SET, FT_ARRAY_INT, FT_ARRAY_BOOL,
+      FT_ARRAY_FLOAT, FT_ARRAY_ID, FT_ARRAY, FT_CALL
+    };
+
+    /// Flags for variable declarations
+    enum FznDeclFlags { FF_INTRODUCED = 1, FF_TOPLEVEL = 2, FF_FLATSELF = 4, FF_IDN = 8 };
+
+    /// Writer for flat expressions
+    class FznWriter {
+    protected:
+      /// String table
+      std::vector<std::string> _strings;
+      /// Map from strings to their index in the string table
+      UNORDERED_NAMESPACE::unordered_map<std::string,unsigned int> _stringMap;
+      /// Map from declarations to their index in the declaration table
+      UNORDERED_NAMESPACE::unordered_map<const VarDecl*,unsigned int> _decls;
+      /// Return declaration index of \a e, or -1 if \a e is not an identifier for a known declaration
+      long long int declIdx(Expression* e) {
+        if (Id* id = Expression::dyn_cast<Id>(e)) {
+          if (id->decl()) {
+            UNORDERED_NAMESPACE::unordered_map<const VarDecl*,unsigned int>::iterator it =
+              _decls.find(id->decl());
+            if (it != _decls.end())
+              return it->second;
+          }
+        }
+        return -1;
+      }
+    public:
+      /// Return index of \a s in the string table
+      unsigned int str(const std::string& s) {
+        UNORDERED_NAMESPACE::unordered_map<std::string,unsigned int>::iterator it = _stringMap.find(s);
+        if (it != _stringMap.end())
+          return it->second;
+        unsigned int idx = static_cast<unsigned int>(_strings.size());
+        _strings.push_back(s);
+        _stringMap.insert(std::make_pair(s,idx));
+        return idx;
+      }
+      /// Return string table
+      const std::vector<std::string>& strings(void) const { return _strings; }
+      /// Add declaration \a vd to the declaration table
+      void addDecl(const VarDecl* vd) {
+        unsigned int idx = static_cast<unsigned int>(_decls.size());
+        _decls.insert(std::make_pair(vd,idx));
+      }
+      /// Write annotation \a ann to \a w, omitting search combinators
+      void writeAnn(BinaryWriter& w, const Annotation& ann) {
+        std::vector<Expression*> anns;
+        for (ExpressionSetIter it = ann.begin(); it != ann.end(); ++it) {
+          Call* c = Expression::dyn_cast<Call>(*it);
+          if (c==NULL || c->id() != constants().ann.combinator)
+            anns.push_back(*it);
+        }
+        w.writeUInt(anns.size());
+        for (unsigned int i=0; i<anns.size(); i++)
+          write(w, anns[i]);
+      }
+      /// Write expression \a e to \a w
+      void write(BinaryWriter& w, Expression* e) {
+        if (e==NULL) {
+          w.writeByte(FT_NULL);
+          return;
+        }
+        switch (e->eid()) {
+        case Expression::E_BOOLLIT:
+          w.writeByte(e->cast<BoolLit>()->v() ? FT_TRUE : FT_FALSE);
+          break;
+        case Expression::E_INTLIT:
+          {
+            IntVal v = e->cast<IntLit>()->v();
+            if (v.isFinite()) {
+              w.writeByte(FT_INT);
+              w.writeInt(v.toInt());
+            } else {
+              w.writeByte(FT_INTVAL);
+              w.writeIntVal(v);
+            }
+          }
+          break;
+        case Expression::E_FLOATLIT:
+          w.writeByte(FT_FLOAT);
+          w.writeFloat(e->cast<FloatLit>()->v());
+          break;
+        case Expression::E_STRINGLIT:
+          w.writeByte(FT_STRING);
+          w.writeUInt(str(e->cast<StringLit>()->v().str()));
+          break;
+        case Expression::E_ID:
+          {
+            long long int idx = declIdx(e);
+            if (idx != -1) {
+              w.writeByte(FT_ID);
+              w.writeUInt(static_cast<unsigned long long int>(idx));
+            } else {
+              Id* id = e->cast<Id>();
+              w.writeByte(FT_NAME);
+              w.writeType(id->type());
+              if (id->idn() != -1) {
+                w.writeByte(1);
+                w.writeInt(id->idn());
+              } else {
+                w.writeByte(0);
+                w.writeUInt(str(id->v().str()));
+              }
+            }
+          }
+          break;
+        case Expression::E_SETLIT:
+          {
+            SetLit* sl = e->cast<SetLit>();
+            if (IntSetVal* isv = sl->isv()) {
+              w.writeByte(FT_SET_INT);
+              w.writeUInt(isv->size());
+              for (int i=0; i<isv->size(); i++) {
+                w.writeIntVal(isv->min(i));
+                w.writeIntVal(isv->max(i));
+              }
+            } else {
+              w.writeByte(FT_SET);
+              w.writeType(sl->type());
+              w.writeUInt(sl->v().size());
+              for (unsigned int i=0; i<sl->v().size(); i++)
+                write(w, sl->v()[i]);
+            }
+          }
+          break;
+        case Expression::E_ARRAYLIT:
+          writeArray(w, e->cast<ArrayLit>());
+          break;
+        case Expression::E_CALL:
+          {
+            Call* c = e->cast<Call>();
+            w.writeByte(FT_CALL);
+            w.writeUInt(str(c->id().str()));
+            w.writeType(c->type());
+            w.writeUInt(c->args().size());
+            for (unsigned int i=0; i<c->args().size(); i++)
+              write(w, c->args()[i]);
+            writeAnn(w, c->ann());
+          }
+          break;
+        default:
+          throw InternalError("cannot write non-FlatZinc expression in binary FlatZinc");
+        }
+      }
+      /// Write array literal \a al to \a w
+      void writeArray(BinaryWriter& w, ArrayLit* al) {
+        ASTExprVec<Expression> v = al->v();
+        bool allInt = true, allBool = true, allFloat = true, allId = true;
+        for (unsigned int i=0; i<v.size(); i++) {
+          Expression* ei = v[i];
+          allInt = allInt && ei->isa<IntLit>() && ei->cast<IntLit>()->v().isFinite();
+          allBool = allBool && ei->isa<BoolLit>();
+          allFloat = allFloat && ei->isa<FloatLit>();
+          allId = allId && declIdx(ei) != -1;
+        }
+        FznTag tag = v.size()==0 ? FT_ARRAY : allInt ? FT_ARRAY_INT : allBool ? FT_ARRAY_BOOL :
+          allFloat ? FT_ARRAY_FLOAT : allId ? FT_ARRAY_ID : FT_ARRAY;
+        w.writeByte(static_cast<unsigned char>(tag));
+        w.writeType(al->type());
+        if (al->dims()==1 && al->min(0)==1) {
+          w.writeUInt(0);
+        } else {
+          w.writeUInt(al->dims());
+          for (int i=0; i<al->dims(); i++) {
+            w.writeInt(al->min(i));
+            w.writeInt(al->max(i));
+          }
+        }
+        w.writeUInt(v.size());
+        switch (tag) {
+        case FT_ARRAY_INT:
+          for (unsigned int i=0; i<v.size(); i++)
+            w.writeInt(v[i]->cast<IntLit>()->v().toInt());
+          break;
+        case FT_ARRAY_BOOL:
+          for (unsigned int i=0; i<v.size(); i+=8) {
+            unsigned char b = 0;
+            for (unsigned int j=0; j<8 && i+j<v.size(); j++)
+              if (v[i+j]->cast<BoolLit>()->v())
+                b |= static_cast<unsigned char>(1 << j);
+            w.writeByte(b);
+          }
+          break;
+        case FT_ARRAY_FLOAT:
+          for (unsigned int i=0; i<v.size(); i++)
+            w.writeFloat(v[i]->cast<FloatLit>()->v());
+          break;
+        case FT_ARRAY_ID:
+          for (unsigned int i=0; i<v.size(); i++)
+            w.writeUInt(static_cast<unsigned long long int>(declIdx(v[i])));
+          break;
+        default:
+          for (unsigned int i=0; i<v.size(); i++)
+            write(w, v[i]);
+          break;
+        }
+      }
+    };
+
+    /// Reader for flat expressions
+    class FznReader {
+    protected:
+      /// String table
+      std::vector<ASTString> _strings;
+      /// Declarations by index
+      std::vector<VarDecl*> _decls;
+    public:
+      /// Read string table from \a r
+      void readStrings(BinaryReader& r) {
+        unsigned long long int n = r.readUInt();
+        _strings.resize(static_cast<size_t>(n));
+        for (unsigned long long int i=0; i<n; i++) {
+          size_t len = static_cast<size_t>(r.readUInt());
+          const char* b = r.readBytes(len);
+          _strings[static_cast<size_t>(i)] = ASTString(std::string(b,len));
+        }
+      }
+      /// Return string \a i
+      ASTString str(unsigned long long int i) {
+        if (i >= _strings.size())
+          throw InternalError("invalid string reference in binary FlatZinc");
+        return _strings[static_cast<size_t>(i)];
+      }
+      /// Add declaration \a vd
+      void addDecl(VarDecl* vd) { _decls.push_back(vd); }
+      /// Return declaration \a i
+      VarDecl* decl(unsigned long long int i) {
+        if (i >= _decls.size())
+          throw InternalError("invalid declaration reference in binary FlatZinc");
+        return _decls[static_cast<size_t>(i)];
+      }
+      /// Read annotations from \a r into \a ann
+      void readAnn(BinaryReader& r, Annotation& ann) {
+        unsigned long long int n = r.readUInt();
+        for (unsigned long long int i=0; i<n; i++)
+          ann.add(read(r));
+      }
+      /// Read an expression from \a r
+      Expression* read(BinaryReader& r) {
+        unsigned char tag = r.readByte();
+        switch (tag) {
+        case FT_NULL:
+          return NULL;
+        case FT_FALSE:
+          return constants().lit_false;
+        case FT_TRUE:
+          return constants().lit_true;
+        case FT_INT:
+          return new IntLit(Location(),IntVal(r.readInt()));
+        case FT_INTVAL:
+          return new IntLit(Location(),r.readIntVal());
+        case FT_FLOAT:
+          return new FloatLit(Location(),r.readFloat());
+        case FT_STRING:
+          return new StringLit(Location(),str(r.readUInt()));
+        case FT_ID:
+          return decl(r.readUInt())->id();
+        case FT_NAME:
+          {
+            Type t = r.readType();
+            Id* id;
+            if (r.readByte())
+              id = new Id(Location(),r.readInt(),NULL);
+            else
+              id = new Id(Location(),str(r.readUInt()),NULL);
+            id->type(t);
+            return id;
+          }
+        case FT_SET_INT:
+          {
+            std::vector<IntSetVal::Range> ranges(static_cast<size_t>(r.readUInt()));
+            for (unsigned int i=0; i<ranges.size(); i++) {
+              ranges[i].min = r.readIntVal();
+              ranges[i].max = r.readIntVal();
+            }
+            return new SetLit(Location(),IntSetVal::a(ranges));
+          }
+        case FT_SET:
+          {
+            Type t = r.readType();
+            std::vector<Expression*> elems(static_cast<size_t>(r.readUInt()));
+            for (unsigned int i=0; i<elems.size(); i++)
+              elems[i] = read(r);
+            SetLit* sl = new SetLit(Location(),elems);
+            sl->type(t);
+            return sl;
+          }
+        case FT_ARRAY_INT:
+        case FT_ARRAY_BOOL:
+        case FT_ARRAY_FLOAT:
+        case FT_ARRAY_ID:
+        case FT_ARRAY:
+          return readArray(r, tag);
+        case FT_CALL:
+          {
+            ASTString id = str(r.readUInt());
+            Type t = r.readType();
+            std::vector<Expression*> args(static_cast<size_t>(r.readUInt()));
+            for (unsigned int i=0; i<args.size(); i++)
+              args[i] = read(r);
+            Call* c = new Call(Location(),id,args);
+            c->type(t);
+            readAnn(r, c->ann());
+            return c;
+          }
+        default:
+          throw InternalError("invalid expression in binary FlatZinc");
+        }
+      }
+      /// Read an array literal with \a tag from \a r
+      ArrayLit* readArray(BinaryReader& r, unsigned char tag) {
+        Type t = r.readType();
+        std::vector<std::pair<int,int> > dims(static_cast<size_t>(r.readUInt()));
+        for (unsigned int i=0; i<dims.size(); i++) {
+          dims[i].first = static_cast<int>(r.readInt());
+          dims[i].second = static_cast<int>(r.readInt());
+        }
+        std::vector<Expression*> v(static_cast<size_t>(r.readUInt()));
+        switch (tag) {
+        case FT_ARRAY_INT:
+          for (unsigned int i=0; i<v.size(); i++)
+            v[i] = new IntLit(Location(),IntVal(r.readInt()));
+          break;
+        case FT_ARRAY_BOOL:
+          for (unsigned int i=0; i<v.size(); i+=8) {
+            unsigned char b = r.readByte();
+            for (unsigned int j=0; j<8 && i+j<v.size(); j++)
+              v[i+j] = constants().boollit((b & (1 << j)) != 0);
+          }
+          break;
+        case FT_ARRAY_FLOAT:
+          for (unsigned int i=0; i<v.size(); i++)
+            v[i] = new FloatLit(Location(),r.readFloat());
+          break;
+        case FT_ARRAY_ID:
+          for (unsigned int i=0; i<v.size(); i++)
+            v[i] = decl(r.readUInt())->id();
+          break;
+        default:
+          for (unsigned int i=0; i<v.size(); i++)
+            v[i] = read(r);
+          break;
+        }
+        ArrayLit* al = dims.empty() ? new ArrayLit(Location(),v) : new ArrayLit(Location(),v,dims);
+        al->type(t);
+        return al;
+      }
+    };
+
+    /// Read items from \a data into \a items
+    void readItems(const char* data, size_t n, std::vector<Item*>& items) {
+      if (!isBinaryFlatZinc(data, n))
+        throw InternalError("not a binary FlatZinc file");
+      BinaryReader r(data+8, n-8);
+      FznReader fr;
+      fr.readStrings(r);
+
+      unsigned long long int n_decls = r.readUInt();
+      for (unsigned long long int i=0; i<n_decls; i++) {
+        unsigned char flags = r.readByte();
+        long long int idn = -1;
+        ASTString name;
+        if (flags & FF_IDN)
+          idn = r.readInt();
+        else
+          name = fr.str(r.readUInt());
+        Type t = r.readType();
+        std::vector<TypeInst*> ranges(static_cast<size_t>(r.readUInt()));
+        for (unsigned int j=0; j<ranges.size(); j++)
+          ranges[j] = new TypeInst(Location(),Type::parint(),fr.read(r));
+        Expression* domain = fr.read(r);
+        TypeInst* ti = new TypeInst(Location(),t,ASTExprVec<TypeInst>(ranges),domain);
+        VarDecl* vd = (flags & FF_IDN) ? new VarDecl(Location(),ti,idn) : new VarDecl(Location(),ti,name);
+        vd->introduced((flags & FF_INTRODUCED) != 0);
+        vd->toplevel((flags & FF_TOPLEVEL) != 0);
+        if (flags & FF_FLATSELF)
+          vd->flat(vd);
+        fr.addDecl(vd);
+      }
+      for (unsigned long long int i=0; i<n_decls; i++) {
+        VarDecl* vd = fr.decl(i);
+        vd->e(fr.read(r));
+        fr.readAnn(r, vd->ann());
+      }
+
+      unsigned long long int n_items = r.readUInt();
+      for (unsigned long long int i=0; i<n_items; i++) {
+        unsigned char iid = r.readByte();
+        switch (iid) {
+        case Item::II_VD:
+          items.push_back(new VarDeclI(Location(),fr.decl(r.readUInt())));
+          break;
+        case Item::II_CON:
+          items.push_back(new ConstraintI(Location(),fr.read(r)));
+          break;
+        case Item::II_SOL:
+          {
+            SolveI::SolveType st = static_cast<SolveI::SolveType>(r.readByte());
+            Expression* e = fr.read(r);
+            SolveI* si;
+            switch (st) {
+            case SolveI::ST_MIN: si = SolveI::min(Location(),e); break;
+            case SolveI::ST_MAX: si = SolveI::max(Location(),e); break;
+            default: si = SolveI::sat(Location()); break;
+            }
+            fr.readAnn(r, si->ann());
+            items.push_back(si);
+          }
+          break;
+        case Item::II_OUT:
+          items.push_back(new OutputI(Location(),fr.read(r)));
+          break;
+        default:
+          throw InternalError("invalid item in binary FlatZinc");
+        }
+      }
+    }
+
+  }
+
+  void
+  writeBinaryFlatZinc(Model* m, std::ostream& os) {
+    FznWriter fw;
+    std::vector<VarDecl*> decls;
+    for (unsigned int i=0; i<m->size(); i++) {
+      Item* item = (*m)[i];
+      if (!item->removed() && item->isa<VarDeclI>()) {
+        VarDecl* vd = item->cast<VarDeclI>()->e();
+        fw.addDecl(vd);
+        decls.push_back(vd);
+      }
+    }
+
+    BinaryWriter body;
+    body.writeUInt(decls.size());
+    for (unsigned int i=0; i<decls.size(); i++) {
+      VarDecl* vd = decls[i];
+      unsigned char flags = 0;
+      if (vd->introduced()) flags |= FF_INTRODUCED;
+      if (vd->toplevel()) flags |= FF_TOPLEVEL;
+      if (vd->flat()==vd) flags |= FF_FLATSELF;
+      if (vd->id()->idn() != -1) flags |= FF_IDN;
+      body.writeByte(flags);
+      if (flags & FF_IDN)
+        body.writeInt(vd->id()->idn());
+      else
+        body.writeUInt(fw.str(vd->id()->v().str()));
+      body.writeType(vd->ti()->type());
+      body.writeUInt(vd->ti()->ranges().size());
+      for (unsigned int j=0; j<vd->ti()->ranges().size(); j++)
+        fw.write(body, vd->ti()->ranges()[j]->domain());
+      fw.write(body, vd->ti()->domain());
+    }
+    for (unsigned int i=0; i<decls.size(); i++) {
+      fw.write(body, decls[i]->e());
+      fw.writeAnn(body, decls[i]->ann());
+    }
+
+    unsigned int n_items = 0;
+    for (unsigned int i=0; i<m->size(); i++)
+      if (!(*m)[i]->removed() && !(*m)[i]->isa<IncludeI>() && !(*m)[i]->isa<FunctionI>())
+        n_items++;
+    body.writeUInt(n_items);
+    unsigned int declIdx = 0;
+    for (unsigned int i=0; i<m->size(); i++) {
+      Item* item = (*m)[i];
+      if (item->removed())
+        continue;
+      switch (item->iid()) {
+      case Item::II_VD:
+        body.writeByte(Item::II_VD);
+        body.writeUInt(declIdx++);
+        break;
+      case Item::II_CON:
+        body.writeByte(Item::II_CON);
+        fw.write(body, item->cast<ConstraintI>()->e());
+        break;
+      case Item::II_SOL:
+        {
+          SolveI* si = item->cast<SolveI>();
+          body.writeByte(Item::II_SOL);
+          body.writeByte(static_cast<unsigned char>(si->st()));
+          fw.write(body, si->e());
+          fw.writeAnn(body, si->ann());
+        }
+        break;
+      case Item::II_OUT:
+        body.writeByte(Item::II_OUT);
+        fw.write(body, item->cast<OutputI>()->e());
+        break;
+      case Item::II_INC:
+      case Item::II_FUN:
+        break;
+      default:
+        throw InternalError("cannot write non-FlatZinc item in binary FlatZinc");
+      }
+    }
+
+    BinaryWriter header;
+    header.writeBytes(fznMagic, 8);
+    header.writeUInt(fw.strings().size());
+    for (unsigned int i=0; i<fw.strings().size(); i++)
+      header.writeString(fw.strings()[i]);
+    os.write(header.str().c_str(), header.size());
+    os.write(body.str().c_str(), body.size());
+  }
+
+  bool
+  isBinaryFlatZinc(const char* data, size_t n) {
+    return n >= 8 && memcmp(data, fznMagic, 8)==0;
+  }
+
+  Model*
+  readBinaryFlatZinc(const char* data, size_t n) {
+    GCLock lock;
+    std::vector<Item*> items;
+    readItems(data, n, items);
+    Model* m = new Model;
+    for (unsigned int i=0; i<items.size(); i++)
+      m->addItem(items[i]);
+    return m;
+  }
+
+  void
+  readBinaryFlatZinc(Env& env, const char* data, size_t n) {
+    GCLock lock;
+    std::vector<Item*> items;
+    readItems(data, n, items);
+    for (unsigned int i=0; i<items.size(); i++)
+      env.envi().flat_addItem(items[i]);
+  }
+
+}
@@ -379,6 +379,13 @@ namespace MiniZinc {
     ASTExprVec<Expression> args = call->args();
     assert(args.size()==1);
     GCLock lock;
+    std::vector<IntVal> vals;
+    if (args[0]->isa<Comprehension>() && eval_comp_int(env,args[0]->cast<Comprehension>(),vals)) {
+      IntVal m = 0;
+      for (unsigned int i=0; i<vals.size(); i++)
+        m += vals[i];
+      return m;
+    }
     ArrayLit* al = eval_array_lit(env,args[0]);
     if (al->v().size()==0)
       return 0;
@@ -392,6 +399,13 @@ namespace MiniZinc {
     ASTExprVec<Expression> args = call->args();
     assert(args.size()==1);
     GCLock lock;
+    std::vector<IntVal> vals;
+    if (args[0]->isa<Comprehension>() && eval_comp_int(env,args[0]->cast<Comprehension>(),vals)) {
+      IntVal m = 1;
+      for (unsigned int i=0; i<vals.size(); i++)
+        m *= vals[i];
+      return m;
+    }
     ArrayLit* al = eval_array_lit(env,args[0]);
     if (al->v().size()==0)
       return 1;
@@ -405,6 +419,13 @@ namespace MiniZinc {
     ASTExprVec<Expression> args = call->args();
     assert(args.size()==1);
     GCLock lock;
+    std::vector<FloatVal> vals;
+    if (args[0]->isa<Comprehension>() && eval_comp_float(env,args[0]->cast<Comprehension>(),vals)) {
+      FloatVal m = 1.0;
+      for (unsigned int i=0; i<vals.size(); i++)
+        m *= vals[i];
+      return m;
+    }
     ArrayLit* al = eval_array_lit(env,args[0]);
     if (al->v().size()==0)
       return 1;
@@ -548,6 +569,13 @@ namespace MiniZinc {
     ASTExprVec<Expression> args = call->args();
     assert(args.size()==1);
     GCLock lock;
+    std::vector<FloatVal> vals;
+    if (args[0]->isa<Comprehension>() && eval_comp_float(env,args[0]->cast<Comprehension>(),vals)) {
+      FloatVal m = 0;
+      for (unsigned int i=0; i<vals.size(); i++)
+        m += vals[i];
+      return m;
+    }
     ArrayLit* al = eval_array_lit(env,args[0]);
     if (al->v().size()==0)
       return 0;
@@ -749,12 +777,8 @@ namespace MiniZinc {
     if (al->v().size()==0)
       throw EvalError(env, Location(), "upper bound of empty array undefined");
     IntSetVal* ub = b_ub_set(env,al->v()[0]);
-    for (unsigned int i=1; i<al->v().size(); i++) {
-      IntSetRanges isr(ub);
-      IntSetRanges r(b_ub_set(env,al->v()[i]));
-      Ranges::Union<IntSetRanges,IntSetRanges> u(isr,r);
-      ub = IntSetVal::ai(u);
-    }
+    for (unsigned int i=1; i<al->v().size(); i++)
+      ub = IntSetVal::unite(ub, b_ub_set(env,al->v()[i]));
     return ub;
   }
 
@@ -888,12 +912,8 @@ namespace MiniZinc {
     if (al->v().size()==0)
       return IntSetVal::a();
     IntSetVal* isv = b_dom_varint(env,al->v()[0]);
-    for (unsigned int i=1; i<al->v().size(); i++) {
-      IntSetRanges isr(isv);
-      IntSetRanges r(b_dom_varint(env,al->v()[i]));
-      Ranges::Union<IntSetRanges,IntSetRanges> u(isr,r);
-      isv = IntSetVal::ai(u);
-    }
+    for (unsigned int i=1; i<al->v().size(); i++)
+      isv = IntSetVal::unite(isv, b_dom_varint(env,al->v()[i]));
     return isv;
   }
   IntSetVal* b_compute_div_bounds(EnvI& env, Call* call) {
@@ -1052,6 +1072,13 @@ namespace MiniZinc {
     if (args.size()!=1)
       throw EvalError(env, Location(), "forall needs exactly one argument");
     GCLock lock;
+    std::vector<bool> vals;
+    if (args[0]->isa<Comprehension>() && eval_comp_bool(env,args[0]->cast<Comprehension>(),vals)) {
+      for (unsigned int i=0; i<vals.size(); i++)
+        if (!vals[i])
+          return false;
+      return true;
+    }
     ArrayLit* al = eval_array_lit(env,args[0]);
     for (unsigned int i=al->v().size(); i--;)
       if (!eval_bool(env,al->v()[i]))
@@ -1063,6 +1090,13 @@ namespace MiniZinc {
     if (args.size()!=1)
       throw EvalError(env, Location(), "exists needs exactly one argument");
     GCLock lock;
+    std::vector<bool> vals;
+    if (args[0]->isa<Comprehension>() && eval_comp_bool(env,args[0]->cast<Comprehension>(),vals)) {
+      for (unsigned int i=0; i<vals.size(); i++)
+        if (vals[i])
+          return true;
+      return false;
+    }
     ArrayLit* al = eval_array_lit(env,args[0]);
     for (unsigned int i=al->v().size(); i--;)
       if (eval_bool(env,al->v()[i]))
@@ -1568,12 +1602,8 @@ namespace MiniZinc {
     if (al->v().size()==0)
       return IntSetVal::a();
     IntSetVal* isv = eval_intset(env,al->v()[0]);
-    for (unsigned int i=0; i<al->v().size(); i++) {
-      IntSetRanges i0(isv);
-      IntSetRanges i1(eval_intset(env,al->v()[i]));
-      Ranges::Union<IntSetRanges, IntSetRanges> u(i0,i1);
-      isv = IntSetVal::ai(u);
-    }
+    for (unsigned int i=1; i<al->v().size(); i++)
+      isv = IntSetVal::unite(isv, eval_intset(env,al->v()[i]));
     return isv;
   }
   
@@ -1703,10 +1733,21 @@ namespace MiniZinc {
     return al_sorted;
   }
   
+  namespace {
+    MZN_THREAD_LOCAL std::default_random_engine* _rnd_generator = NULL;
+    void release_rnd_generator(void) {
+      delete _rnd_generator;
+      _rnd_generator = NULL;
+    }
+  }
+
   std::default_random_engine& rnd_generator(void) {
     // TODO: initiate with seed if given as annotation/in command line
-    static std::default_random_engine g;
-    return g;
+    if (_rnd_generator==NULL) {
+      _rnd_generator = new std::default_random_engine();
+      GC::atRelease(&release_rnd_generator);
+    }
+    return *_rnd_generator;
   }
 
   FloatVal b_normal_float_float(EnvI& env, Call* call) {
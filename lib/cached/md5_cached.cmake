@@ -1,2 +1,2 @@
 set(lexer_lxx_md5_cached "798ca522b3c529c9b8173858230eb5f7")
-set(parser_yxx_md5_cached "c467a38538d3c09e537628bbe4984292")
\ No newline at end of file
+set(parser_yxx_md5_cached "c1813f0bf5bddab6d866ca9e21610286")
\ No newline at end of file
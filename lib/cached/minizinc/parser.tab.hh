@@ -1,4 +1,4 @@
-/* A Bison parser, made by GNU Bison 3.7.6.  */
+/* A Bison parser, made by GNU Bison 3.8.2.  */
 
 /* Bison interface for Yacc-like parsers in C
 
@@ -35,8 +35,8 @@
    especially those whose name start with YY_ or yy_.  They are
    private implementation details that can be changed or removed.  */
 
-#ifndef YY_YY_USERS_DEKKER1_CODE_GITHUB_COM_MINIZINC_LIBMINIZINC_BUILD_MINIZINC_PARSER_TAB_HH_INCLUDED
-# define YY_YY_USERS_DEKKER1_CODE_GITHUB_COM_MINIZINC_LIBMINIZINC_BUILD_MINIZINC_PARSER_TAB_HH_INCLUDED
+#ifndef YY_YY_ROOT_REPO_GATE_BUILD_MINIZINC_PARSER_TAB_HH_INCLUDED
+# define YY_YY_ROOT_REPO_GATE_BUILD_MINIZINC_PARSER_TAB_HH_INCLUDED
 /* Debug traces.  */
 #ifndef YYDEBUG
 # define YYDEBUG 0
@@ -226,6 +226,8 @@ struct YYLTYPE
 
 
 
+
 int yyparse (void *parm);
 
-#endif /* !YY_YY_USERS_DEKKER1_CODE_GITHUB_COM_MINIZINC_LIBMINIZINC_BUILD_MINIZINC_PARSER_TAB_HH_INCLUDED  */
+
+#endif /* !YY_YY_ROOT_REPO_GATE_BUILD_MINIZINC_PARSER_TAB_HH_INCLUDED  */
@@ -1,4 +1,4 @@
-/* A Bison parser, made by GNU Bison 3.7.6.  */
+/* A Bison parser, made by GNU Bison 3.8.2.  */
 
 /* Bison implementation for Yacc-like parsers in C
 
@@ -46,10 +46,10 @@
    USER NAME SPACE" below.  */
 
 /* Identify Bison output, and Bison version.  */
-#define YYBISON 30706
+#define YYBISON 30802
 
 /* Bison version string.  */
-#define YYBISON_VERSION "3.7.6"
+#define YYBISON_VERSION "3.8.2"
 
 /* Skeleton name.  */
 #define YYSKELETON_NAME "yacc.c"
@@ -69,10 +69,15 @@
 /* First part of user prologue.  */
 
 #define SCANNER static_cast<ParserState*>(parm)->yyscanner
+#include <condition_variable>
+#include <deque>
 #include <iostream>
 #include <fstream>
 #include <map>
-#include <cerrno>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
 
 namespace MiniZinc{ class Location; }
 #define YYLTYPE MiniZinc::Location
@@ -80,7 +85,10 @@ namespace MiniZinc{ class Location; }
 #define YYLTYPE_IS_TRIVIAL 0
 
 #include <minizinc/parser.hh>
+#include <minizinc/binary_ast.hh>
+#include <minizinc/dzn_loader.hh>
 #include <minizinc/file_utils.hh>
+#include <minizinc/stdlib_image.hh>
 
 using namespace std;
 using namespace MiniZinc;
@@ -138,23 +146,372 @@ void filepath(const string& f, string& dirname, string& basename) {
        ) {}
 }
 
-// fastest way to read a file into a string (especially big files)
-// see: http://insanecoding.blogspot.be/2011/11/how-to-read-in-file-in-c.html
-std::string get_file_contents(std::ifstream &in)
-{
-  if (in)
-  {
-    std::string contents;
-    in.seekg(0, std::ios::end);
-    contents.resize(static_cast<unsigned int>(in.tellg()));
-    in.seekg(0, std::ios::beg);
-    in.read(&contents[0], contents.size());
-    in.close();
-    return(contents);
+/// Return contents of \a fullname, or NULL if it cannot be read
+SharedSources::Text open_source(const std::string& fullname) {
+  std::shared_ptr<FileUtils::FileContents> t(new FileUtils::FileContents);
+  if (!t->open(fullname))
+    return SharedSources::Text();
+  return t;
+}
+
+namespace MiniZinc {
+
+  SharedSources::Text
+  SharedSources::get(const std::string& fullname) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      std::map<std::string,Text>::iterator it = _files.find(fullname);
+      if (it != _files.end())
+        return it->second;
+    }
+    Text t = open_source(fullname);
+    if (!t)
+      return t;
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _files.insert(std::make_pair(fullname,t)).first->second;
   }
-  throw(errno);
+
+  size_t
+  SharedSources::size(void) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _files.size();
+  }
+
+  void
+  SharedSources::clear(void) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _files.clear();
+  }
+
 }
 
+/// Return contents of \a fullname (NULL if it cannot be read), using the cache in \a sources if available
+SharedSources::Text read_source(SharedSources* sources, const std::string& fullname, std::ifstream& file) {
+  file.close();
+  if (sources)
+    return sources->get(fullname);
+  return open_source(fullname);
+}
+
+/**
+ * \brief Add the items of data file \a f to \a model, return false on error
+ *
+ * Files that only contain assignments of literals are loaded by loadDzn,
+ * all others are parsed. Data given as cmd:/... is treated the same way.
+ */
+bool parse_datafile(const string& f, Model* model,
+                    vector<pair<string,Model*> >& files,
+                    map<string,Model*>& seenModels,
+                    bool parseDocComments, bool verbose, ostream& err) {
+  std::string s;
+  FileUtils::FileContents contents;
+  const char* data;
+  size_t size;
+  if (f.size() > 5 && f.substr(0,5)=="cmd:/") {
+    s = f.substr(5);
+    data = s.c_str();
+    size = s.size();
+  } else {
+    if (!FileUtils::file_exists(f) || !contents.open(f)) {
+      err << "Error: cannot open data file '" << f << "'." << endl;
+      return false;
+    }
+    if (verbose)
+      std::cerr << "processing data file '" << f << "'" << endl;
+    data = contents.data();
+    size = contents.size();
+  }
+  if (loadDzn(model, f, data, size)) {
+    if (verbose)
+      std::cerr << "loaded data file '" << f << "' without parsing" << endl;
+    return true;
+  }
+
+  ParserState pp(f, data, size, err, files, seenModels, model, true, false, parseDocComments);
+  yylex_init(&pp.yyscanner);
+  yyset_extra(&pp, pp.yyscanner);
+  yyparse(&pp);
+  if (pp.yyscanner)
+    yylex_destroy(pp.yyscanner);
+  return !pp.hadError;
+}
+
+/// Register the model included by \a ii from file \a includer, so that it will be parsed
+void register_include(IncludeI* ii, const char* includer, Model* parent,
+                      vector<pair<string,Model*> >& files,
+                      map<string,Model*>& seenModels) {
+  string f(ii->f().str());
+  map<string,Model*>::iterator ret = seenModels.find(f);
+  if (ret == seenModels.end()) {
+    Model* im = new Model;
+    im->setParent(parent);
+    im->setFilename(f);
+    string fpath, fbase; filepath(includer, fpath, fbase);
+    if (fpath=="")
+      fpath="./";
+    pair<string,Model*> pm(fpath, im);
+    files.push_back(pm);
+    ii->m(im);
+    seenModels.insert(pair<string,Model*>(f,im));
+  } else {
+    ii->m(ret->second, false);
+  }
+}
+
+/// Register the models included by the items of \a m, which was read from \a fullname
+void register_includes(Model* m, const string& fullname,
+                       vector<pair<string,Model*> >& files,
+                       map<string,Model*>& seenModels) {
+  for (unsigned int i=0; i<m->size(); i++)
+    if (IncludeI* ii = (*m)[i]->dyn_cast<IncludeI>())
+      register_include(ii, fullname.c_str(), m, files, seenModels);
+}
+
+/// Library image, loaded when the first library file is processed
+class LibraryImage {
+protected:
+  const vector<string>& _includePaths;
+  bool _enabled;
+  bool _loaded;
+  StdlibImage::Ptr _image;
+public:
+  LibraryImage(const vector<string>& includePaths, bool enabled)
+    : _includePaths(includePaths), _enabled(enabled), _loaded(false) {}
+  /// Add items of \a fullname with \a contents to \a m, return false if not in the image
+  bool decode(const string& fullname, const FileUtils::FileContents& contents, Model* m,
+              vector<pair<string,Model*> >& files,
+              map<string,Model*>& seenModels, bool verbose) {
+    if (!_enabled)
+      return false;
+    if (!_loaded) {
+      _image = StdlibImage::load(_includePaths);
+      _loaded = true;
+    }
+    if (!_image || !_image->decode(fullname, contents.data(), contents.size(), m))
+      return false;
+    if (verbose)
+      std::cerr << "using precompiled image for '" << fullname << "'" << endl;
+    register_includes(m, fullname, files, seenModels);
+    return true;
+  }
+};
+
+/**
+ * \brief Parses included files in worker threads
+ *
+ * Models are allocated in the heap of the thread that creates them, so a
+ * worker parses a file into a Model of its own and serialises its items,
+ * which the main thread then reads into its heap (like the items of a
+ * library image). Files are queued as soon as an include of them has been
+ * seen, by the main thread or by a worker. The main thread still processes
+ * the files in the original order. It parses a file itself if no worker
+ * has started on it yet, or if the worker failed (so that errors are
+ * reported as usual).
+ */
+class IncludePool {
+protected:
+  /// State of a file
+  enum JobState { JS_QUEUED, JS_RUNNING, JS_DONE, JS_FAILED, JS_TAKEN };
+  /// A file to be parsed
+  struct Job {
+    JobState state;
+    /// Serialised string table and items
+    string data;
+    Job(void) : state(JS_QUEUED) {}
+  };
+  /// Include paths (a copy, since the main thread modifies its vector)
+  vector<string> _includePaths;
+  bool _parseDocComments;
+  SharedSources* _sources;
+  /// Library image, files in the image are not parsed by the workers
+  StdlibImage::Ptr _image;
+  /// Jobs by full file name
+  map<string,Job> _jobs;
+  /// Full names of the queued files
+  deque<string> _queue;
+  /// Models of the main thread's work list that have been queued
+  set<Model*> _queued;
+  /// Whether the workers should stop
+  bool _stop;
+  std::mutex _mutex;
+  /// Signalled when a file is queued or finished
+  std::condition_variable _cv;
+  std::vector<std::thread> _threads;
+
+  /// Return full name of include \a f from a file in \a parentPath (empty if not found)
+  string find(const string& f, const string& parentPath) const {
+    for (unsigned int i=0; i<=_includePaths.size(); i++) {
+      string fullname = (i<_includePaths.size() ? _includePaths[i] : parentPath)+f;
+      if (FileUtils::file_exists(fullname))
+        return fullname;
+    }
+    return "";
+  }
+  /// Queue \a fullname at the front or back of the queue unless already known (caller holds the mutex)
+  void queue(const string& fullname, bool front) {
+    if (fullname.empty() || _jobs.find(fullname) != _jobs.end())
+      return;
+    _jobs[fullname];
+    if (front)
+      _queue.push_front(fullname);
+    else
+      _queue.push_back(fullname);
+  }
+  /// Parse \a fullname into \a data, add the full names of its includes to \a includes
+  bool parseFile(const string& fullname, string& data, vector<string>& includes) {
+    SharedSources::Text s = _sources ? _sources->get(fullname) : open_source(fullname);
+    if (!s || (_image && _image->contains(fullname, s->data(), s->size())))
+      return false;
+    bool isFzn = (fullname.compare(fullname.length()-4,4,".fzn")==0);
+    isFzn |= (fullname.compare(fullname.length()-4,4,".ozn")==0);
+    isFzn |= (fullname.compare(fullname.length()-4,4,".szn")==0);
+    GCLock lock;
+    Model* m = new Model;
+    vector<pair<string,Model*> > files;
+    map<string,Model*> seenModels;
+    std::ostringstream err;
+    ParserState pp(fullname, s->data(), s->size(), err, files, seenModels, m, false, isFzn, _parseDocComments);
+    yylex_init(&pp.yyscanner);
+    yyset_extra(&pp, pp.yyscanner);
+    yyparse(&pp);
+    if (pp.yyscanner)
+      yylex_destroy(pp.yyscanner);
+    bool ok = !pp.hadError;
+    if (ok) {
+      string fpath, fbase; filepath(fullname, fpath, fbase);
+      if (fpath=="")
+        fpath="./";
+      try {
+        BinaryWriter body;
+        ASTWriter aw(body);
+        body.writeUInt(m->size());
+        for (unsigned int i=0; i<m->size(); i++) {
+          aw.write((*m)[i]);
+          if (IncludeI* ii = (*m)[i]->dyn_cast<IncludeI>())
+            includes.push_back(find(ii->f().str(), fpath));
+        }
+        BinaryWriter out;
+        out.writeUInt(aw.strings().size());
+        for (unsigned int i=0; i<aw.strings().size(); i++)
+          out.writeString(aw.strings()[i]);
+        out.append(body);
+        data = out.str();
+      } catch (InternalError&) {
+        ok = false;
+      }
+    }
+    delete m;
+    return ok;
+  }
+  /// Parse queued files until stopped
+  void run(void) {
+    for (;;) {
+      string fullname;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!_stop && _queue.empty())
+          _cv.wait(lock);
+        if (_stop)
+          return;
+        fullname = _queue.front();
+        _queue.pop_front();
+        Job& j = _jobs[fullname];
+        if (j.state != JS_QUEUED)
+          continue;
+        j.state = JS_RUNNING;
+      }
+      string data;
+      vector<string> includes;
+      bool ok;
+      try {
+        ok = parseFile(fullname, data, includes);
+      } catch (...) {
+        ok = false;
+      }
+      std::lock_guard<std::mutex> lock(_mutex);
+      Job& j = _jobs[fullname];
+      j.state = ok ? JS_DONE : JS_FAILED;
+      j.data.swap(data);
+      for (unsigned int i=0; i<includes.size(); i++)
+        queue(includes[i], false);
+      _cv.notify_all();
+    }
+  }
+public:
+  /// Constructor, uses \a nThreads-1 workers (none if \a nThreads<2 or when parsing doc comments)
+  IncludePool(const vector<string>& includePaths, bool parseDocComments,
+              SharedSources* sources, unsigned int nThreads)
+    : _includePaths(includePaths), _parseDocComments(parseDocComments),
+      _sources(sources), _stop(false) {
+    if (parseDocComments || nThreads < 2)
+      return;
+    _image = StdlibImage::load(_includePaths);
+    for (unsigned int i=1; i<nThreads; i++)
+      _threads.push_back(std::thread([this] {
+        run();
+        GC::release();
+      }));
+  }
+  /// Destructor, waits for the workers
+  ~IncludePool(void) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+      _cv.notify_all();
+    }
+    for (unsigned int i=0; i<_threads.size(); i++)
+      _threads[i].join();
+  }
+  /// Queue the included files in \a files that have not been queued yet
+  void prefetch(const vector<pair<string,Model*> >& files) {
+    if (_threads.empty())
+      return;
+    std::lock_guard<std::mutex> lock(_mutex);
+    // The main thread takes files from the back, so they are queued at the front in that order
+    for (unsigned int i=0; i<files.size(); i++) {
+      if (files[i].first=="" || !_queued.insert(files[i].second).second)
+        continue;
+      queue(find(files[i].second->filename().str(), files[i].first), true);
+    }
+    _cv.notify_all();
+  }
+  /// Add items of \a fullname parsed by a worker to \a m, return false if it has to be parsed by the caller
+  bool take(const string& fullname, Model* m,
+            vector<pair<string,Model*> >& files,
+            map<string,Model*>& seenModels, bool verbose) {
+    if (_threads.empty())
+      return false;
+    string data;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      // Files that are not known yet are marked as taken so that no worker parses them
+      Job& j = _jobs[fullname];
+      while (j.state==JS_RUNNING)
+        _cv.wait(lock);
+      bool done = j.state==JS_DONE;
+      j.state = JS_TAKEN;
+      if (!done)
+        return false;
+      data.swap(j.data);
+    }
+    BinaryReader r(data.c_str(), data.size());
+    vector<pair<const char*,size_t> > strings(static_cast<size_t>(r.readUInt()));
+    for (unsigned int i=0; i<strings.size(); i++) {
+      strings[i].second = static_cast<size_t>(r.readUInt());
+      strings[i].first = r.readBytes(strings[i].second);
+    }
+    ASTReader ar(r, strings);
+    unsigned long long int n = r.readUInt();
+    for (unsigned long long int i=0; i<n; i++)
+      m->addItem(ar.readItem());
+    ar.finish();
+    if (verbose)
+      std::cerr << "using items parsed in parallel for '" << fullname << "'" << endl;
+    register_includes(m, fullname, files, seenModels);
+    return true;
+  }
+};
+
 Expression* createDocComment(const Location& loc, const std::string& s) {
   std::vector<Expression*> args(1);
   args[0] = new StringLit(loc, s);
@@ -179,7 +536,8 @@ namespace MiniZinc {
                          bool ignoreStdlib,
                          bool parseDocComments,
                          bool verbose,
-                         ostream& err) {
+                         ostream& err,
+                         SharedSources* sources) {
     GCLock lock;
 
     vector<string> includePaths;
@@ -188,6 +546,7 @@ namespace MiniZinc {
 
     vector<pair<string,Model*> > files;
     map<string,Model*> seenModels;
+    LibraryImage image(includePaths, !parseDocComments);
 
     Model* model = new Model();
     model->setFilename(filename);
@@ -212,7 +571,7 @@ namespace MiniZinc {
       isFzn |= (filename.compare(filename.length()-4,4,".ozn")==0);
       isFzn |= (filename.compare(filename.length()-4,4,".szn")==0);
     }
-		ParserState pp(filename,text, err, files, seenModels, model, false, isFzn, parseDocComments);
+		ParserState pp(filename, text.c_str(), text.size(), err, files, seenModels, model, false, isFzn, parseDocComments);
     yylex_init(&pp.yyscanner);
     yyset_extra(&pp, pp.yyscanner);
     yyparse(&pp);
@@ -263,13 +622,19 @@ namespace MiniZinc {
       }
       if (verbose)
         std::cerr << "processing file '" << fullname << "'" << endl;
-      std::string s = get_file_contents(file);
+      SharedSources::Text s = read_source(sources, fullname, file);
+      if (!s) {
+        err << "Error: cannot open file '" << f << "'." << endl;
+        goto error;
+      }
 
       m->setFilepath(fullname);
+      if (parentPath!="" && image.decode(fullname, *s, m, files, seenModels, verbose))
+        continue;
       bool isFzn = (fullname.compare(fullname.length()-4,4,".fzn")==0);
       isFzn |= (fullname.compare(fullname.length()-4,4,".ozn")==0);
       isFzn |= (fullname.compare(fullname.length()-4,4,".szn")==0);
-      ParserState pp(fullname,s, err, files, seenModels, m, false, isFzn, parseDocComments);
+      ParserState pp(fullname, s->data(), s->size(), err, files, seenModels, m, false, isFzn, parseDocComments);
       yylex_init(&pp.yyscanner);
       yyset_extra(&pp, pp.yyscanner);
       yyparse(&pp);
@@ -293,7 +658,9 @@ namespace MiniZinc {
                bool ignoreStdlib,
                bool parseDocComments,
                bool verbose,
-               ostream& err) {
+               ostream& err,
+               SharedSources* sources,
+               unsigned int nThreads) {
     GCLock lock;
     string fileDirname; string fileBasename;
     filepath(filename, fileDirname, fileBasename);
@@ -304,6 +671,7 @@ namespace MiniZinc {
 
     vector<pair<string,Model*> > files;
     map<string,Model*> seenModels;
+    LibraryImage image(includePaths, !parseDocComments);
 
     Model* model = new Model();
     model->setFilename(fileBasename);
@@ -322,12 +690,14 @@ namespace MiniZinc {
     }
 
     files.push_back(pair<string,Model*>("",model));
+    IncludePool pool(includePaths, parseDocComments, sources, nThreads);
 
     while (!files.empty()) {
       pair<string,Model*>& np = files.back();
       string parentPath = np.first;
       Model* m = np.second;
       files.pop_back();
+      pool.prefetch(files);
       string f(m->filename().str());
 
       for (Model* p=m->parent(); p; p=p->parent()) {
@@ -364,13 +734,21 @@ namespace MiniZinc {
       }
       if (verbose)
         std::cerr << "processing file '" << fullname << "'" << endl;
-      std::string s = get_file_contents(file);
+      SharedSources::Text s = read_source(sources, fullname, file);
+      if (!s) {
+        err << "Error: cannot open file '" << f << "'." << endl;
+        goto error;
+      }
 
       m->setFilepath(fullname);
+      if (parentPath!="" && image.decode(fullname, *s, m, files, seenModels, verbose))
+        continue;
+      if (parentPath!="" && pool.take(fullname, m, files, seenModels, verbose))
+        continue;
       bool isFzn = (fullname.compare(fullname.length()-4,4,".fzn")==0);
       isFzn |= (fullname.compare(fullname.length()-4,4,".ozn")==0);
       isFzn |= (fullname.compare(fullname.length()-4,4,".szn")==0);
-      ParserState pp(fullname,s, err, files, seenModels, m, false, isFzn, parseDocComments);
+      ParserState pp(fullname, s->data(), s->size(), err, files, seenModels, m, false, isFzn, parseDocComments);
       yylex_init(&pp.yyscanner);
       yyset_extra(&pp, pp.yyscanner);
       yyparse(&pp);
@@ -382,31 +760,8 @@ namespace MiniZinc {
     }
 
     for (unsigned int i=0; i<datafiles.size(); i++) {
-      string f = datafiles[i];
-      std::string s;
-      if (f.size() > 5 && f.substr(0,5)=="cmd:/") {
-        s = f.substr(5);
-      } else {
-        std::ifstream file;
-        file.open(f.c_str(), std::ios::binary);
-        if (!FileUtils::file_exists(f) || !file.is_open()) {
-          err << "Error: cannot open data file '" << f << "'." << endl;
-          goto error;
-        }
-        if (verbose)
-          std::cerr << "processing data file '" << f << "'" << endl;
-        s = get_file_contents(file);
-      }
-
-      ParserState pp(f, s, err, files, seenModels, model, true, false, parseDocComments);
-      yylex_init(&pp.yyscanner);
-      yyset_extra(&pp, pp.yyscanner);
-      yyparse(&pp);
-      if (pp.yyscanner)
-        yylex_destroy(pp.yyscanner);
-      if (pp.hadError) {
+      if (!parse_datafile(datafiles[i], model, files, seenModels, parseDocComments, verbose, err))
         goto error;
-      }
     }
 
     return model;
@@ -422,11 +777,13 @@ namespace MiniZinc {
                    bool ignoreStdlib,
                    bool parseDocComments,
                    bool verbose,
-                   ostream& err) {
+                   ostream& err,
+                   SharedSources* sources) {
   GCLock lock;
 
   vector<pair<string,Model*> > files;
   map<string,Model*> seenModels;
+  LibraryImage image(includePaths, !parseDocComments);
 
   if (!ignoreStdlib) {
     Model* stdlib = new Model;
@@ -476,13 +833,19 @@ namespace MiniZinc {
     }
     if (verbose)
       std::cerr << "processing file '" << fullname << "'" << endl;
-    std::string s = get_file_contents(file);
+    SharedSources::Text s = read_source(sources, fullname, file);
+    if (!s) {
+      err << "Error: cannot open file '" << f << "'." << endl;
+      goto error;
+    }
 
     m->setFilepath(fullname);
+    if (image.decode(fullname, *s, m, files, seenModels, verbose))
+      continue;
     bool isFzn = (fullname.compare(fullname.length()-4,4,".fzn")==0);
     isFzn |= (fullname.compare(fullname.length()-4,4,".ozn")==0);
     isFzn |= (fullname.compare(fullname.length()-4,4,".szn")==0);
-    ParserState pp(fullname,s, err, files, seenModels, m, false, isFzn, parseDocComments);
+    ParserState pp(fullname, s->data(), s->size(), err, files, seenModels, m, false, isFzn, parseDocComments);
     yylex_init(&pp.yyscanner);
     yyset_extra(&pp, pp.yyscanner);
     yyparse(&pp);
@@ -494,31 +857,8 @@ namespace MiniZinc {
   }
 
   for (unsigned int i=0; i<datafiles.size(); i++) {
-    string f = datafiles[i];
-    std::string s;
-    if (f.size() > 5 && f.substr(0,5)=="cmd:/") {
-      s = f.substr(5);
-    } else {
-      std::ifstream file;
-      file.open(f.c_str(), std::ios::binary);
-      if (!FileUtils::file_exists(f) || !file.is_open()) {
-        err << "Error: cannot open data file '" << f << "'." << endl;
-        goto error;
-      }
-      if (verbose)
-        std::cerr << "processing data file '" << f << "'" << endl;
-      s = get_file_contents(file);
-    }
-
-    ParserState pp(f, s, err, files, seenModels, model, true, false, parseDocComments);
-    yylex_init(&pp.yyscanner);
-    yyset_extra(&pp, pp.yyscanner);
-    yyparse(&pp);
-    if (pp.yyscanner)
-    yylex_destroy(pp.yyscanner);
-    if (pp.hadError) {
+    if (!parse_datafile(datafiles[i], model, files, seenModels, parseDocComments, verbose, err))
       goto error;
-    }
   }
 
   return model;
@@ -913,12 +1253,18 @@ typedef int yy_state_fast_t;
 # define YY_USE(E) /* empty */
 #endif
 
-#if defined __GNUC__ && ! defined __ICC && 407 <= __GNUC__ * 100 + __GNUC_MINOR__
 /* Suppress an incorrect diagnostic about yylval being uninitialized.  */
-# define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                            \
+#if defined __GNUC__ && ! defined __ICC && 406 <= __GNUC__ * 100 + __GNUC_MINOR__
+# if __GNUC__ * 100 + __GNUC_MINOR__ < 407
+#  define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                           \
+    _Pragma ("GCC diagnostic push")                                     \
+    _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")
+# else
+#  define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                           \
     _Pragma ("GCC diagnostic push")                                     \
     _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")              \
     _Pragma ("GCC diagnostic ignored \"-Wmaybe-uninitialized\"")
+# endif
 # define YY_IGNORE_MAYBE_UNINITIALIZED_END      \
     _Pragma ("GCC diagnostic pop")
 #else
@@ -1148,37 +1494,37 @@ static const yytype_uint8 yytranslate[] =
 };
 
 #if YYDEBUG
-  /* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
+/* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
 static const yytype_int16 yyrline[] =
 {
-       0,   656,   656,   658,   660,   663,   668,   673,   678,   683,
-     686,   694,   703,   703,   705,   721,   725,   727,   729,   730,
-     732,   734,   736,   738,   740,   744,   767,   773,   782,   788,
-     792,   797,   802,   807,   821,   825,   833,   843,   850,   859,
-     871,   879,   880,   885,   886,   888,   893,   894,   898,   902,
-     907,   907,   910,   912,   916,   921,   925,   927,   931,   932,
-     938,   947,   950,   958,   966,   975,   984,   993,  1006,  1007,
-    1011,  1013,  1015,  1017,  1019,  1021,  1023,  1029,  1032,  1034,
-    1040,  1041,  1043,  1045,  1047,  1049,  1058,  1067,  1069,  1071,
-    1073,  1075,  1077,  1079,  1081,  1083,  1089,  1091,  1106,  1107,
-    1109,  1111,  1113,  1115,  1117,  1119,  1121,  1123,  1125,  1127,
-    1129,  1131,  1133,  1135,  1137,  1139,  1141,  1143,  1145,  1154,
-    1163,  1165,  1167,  1169,  1171,  1173,  1175,  1177,  1179,  1185,
-    1187,  1194,  1205,  1211,  1219,  1221,  1223,  1225,  1228,  1230,
-    1233,  1235,  1237,  1239,  1241,  1242,  1244,  1245,  1248,  1249,
-    1252,  1253,  1256,  1257,  1260,  1261,  1264,  1265,  1268,  1269,
-    1270,  1275,  1277,  1283,  1288,  1296,  1303,  1312,  1314,  1319,
-    1325,  1327,  1330,  1333,  1335,  1339,  1342,  1345,  1347,  1351,
-    1353,  1357,  1359,  1370,  1381,  1421,  1424,  1429,  1436,  1441,
-    1445,  1451,  1467,  1468,  1472,  1474,  1476,  1478,  1480,  1482,
-    1484,  1486,  1488,  1490,  1492,  1494,  1496,  1498,  1500,  1502,
-    1504,  1506,  1508,  1510,  1512,  1514,  1516,  1518,  1520,  1522,
-    1524,  1528,  1536,  1570,  1572,  1573,  1584,  1627,  1633,  1641,
-    1648,  1657,  1659,  1667,  1669,  1678,  1678,  1681,  1687,  1698,
-    1699,  1702,  1706,  1710,  1712,  1714,  1716,  1718,  1720,  1722,
-    1724,  1726,  1728,  1730,  1732,  1734,  1736,  1738,  1740,  1742,
-    1744,  1746,  1748,  1750,  1752,  1754,  1756,  1758,  1760,  1762,
-    1764,  1766
+       0,   996,   996,   998,  1000,  1003,  1008,  1013,  1018,  1023,
+    1026,  1034,  1043,  1043,  1045,  1061,  1065,  1067,  1069,  1070,
+    1072,  1074,  1076,  1078,  1080,  1084,  1093,  1099,  1108,  1114,
+    1118,  1123,  1128,  1133,  1147,  1151,  1159,  1169,  1176,  1185,
+    1197,  1205,  1206,  1211,  1212,  1214,  1219,  1220,  1224,  1228,
+    1233,  1233,  1236,  1238,  1242,  1247,  1251,  1253,  1257,  1258,
+    1264,  1273,  1276,  1284,  1292,  1301,  1310,  1319,  1332,  1333,
+    1337,  1339,  1341,  1343,  1345,  1347,  1349,  1355,  1358,  1360,
+    1366,  1367,  1369,  1371,  1373,  1375,  1384,  1393,  1395,  1397,
+    1399,  1401,  1403,  1405,  1407,  1409,  1415,  1417,  1432,  1433,
+    1435,  1437,  1439,  1441,  1443,  1445,  1447,  1449,  1451,  1453,
+    1455,  1457,  1459,  1461,  1463,  1465,  1467,  1469,  1471,  1480,
+    1489,  1491,  1493,  1495,  1497,  1499,  1501,  1503,  1505,  1511,
+    1513,  1520,  1531,  1537,  1545,  1547,  1549,  1551,  1554,  1556,
+    1559,  1561,  1563,  1565,  1567,  1568,  1570,  1571,  1574,  1575,
+    1578,  1579,  1582,  1583,  1586,  1587,  1590,  1591,  1594,  1595,
+    1596,  1601,  1603,  1609,  1614,  1622,  1629,  1638,  1640,  1645,
+    1651,  1653,  1656,  1659,  1661,  1665,  1668,  1671,  1673,  1677,
+    1679,  1683,  1685,  1696,  1707,  1747,  1750,  1755,  1762,  1767,
+    1771,  1777,  1793,  1794,  1798,  1800,  1802,  1804,  1806,  1808,
+    1810,  1812,  1814,  1816,  1818,  1820,  1822,  1824,  1826,  1828,
+    1830,  1832,  1834,  1836,  1838,  1840,  1842,  1844,  1846,  1848,
+    1850,  1854,  1862,  1896,  1898,  1899,  1910,  1953,  1959,  1967,
+    1974,  1983,  1985,  1993,  1995,  2004,  2004,  2007,  2013,  2024,
+    2025,  2028,  2032,  2036,  2038,  2040,  2042,  2044,  2046,  2048,
+    2050,  2052,  2054,  2056,  2058,  2060,  2062,  2064,  2066,  2068,
+    2070,  2072,  2074,  2076,  2078,  2080,  2082,  2084,  2086,  2088,
+    2090,  2092
 };
 #endif
 
@@ -1248,28 +1594,6 @@ yysymbol_name (yysymbol_kind_t yysymbol)
 }
 #endif
 
-#ifdef YYPRINT
-/* YYTOKNUM[NUM] -- (External) token number corresponding to the
-   (internal) symbol number NUM (which must be that of a token).  */
-static const yytype_int16 yytoknum[] =
-{
-       0,   256,   257,   258,   259,   260,   261,   262,   263,   264,
-     265,   266,   267,   268,   269,   270,   271,   272,   273,   274,
-     275,   276,   277,   278,   279,   280,   281,   282,   283,   284,
-     285,   286,   287,   288,   289,   290,   291,   292,   293,   294,
-     295,   296,   297,   298,   299,   300,   301,   302,   303,   304,
-     305,   306,   307,   308,   309,   310,   311,   312,   313,   314,
-     315,   316,   317,   318,   319,   320,   321,   322,   323,   324,
-     325,   326,   327,   328,   329,   330,   331,   332,   333,   334,
-     335,   336,   337,   338,   339,   340,   341,   342,   343,   344,
-     345,   346,   347,   348,   349,   350,   351,   352,   353,   354,
-     355,   356,   357,   358,   359,   360,   361,   362,   363,   364,
-     365,   366,   367,   368,   369,   370,   371,   372,   373,   374,
-     375,   376,   377,   378,   379,   380,    59,    58,    40,    41,
-      44,   123,   125,   124
-};
-#endif
-
 #define YYPACT_NINF (-355)
 
 #define yypact_value_is_default(Yyn) \
@@ -1280,8 +1604,8 @@ static const yytype_int16 yytoknum[] =
 #define yytable_value_is_error(Yyn) \
   ((Yyn) == YYTABLE_NINF)
 
-  /* YYPACT[STATE-NUM] -- Index in YYTABLE of the portion describing
-     STATE-NUM.  */
+/* YYPACT[STATE-NUM] -- Index in YYTABLE of the portion describing
+   STATE-NUM.  */
 static const yytype_int16 yypact[] =
 {
      463,   -99,  -355,  -355,  -355,   -31,  -355,  3072,  -355,  1653,
@@ -1333,9 +1657,9 @@ static const yytype_int16 yypact[] =
     3951,   144,  -355,  3072,  -355,  3951
 };
 
-  /* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
-     Performed when YYTABLE does not specify something else to do.  Zero
-     means the default is an error.  */
+/* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
+   Performed when YYTABLE does not specify something else to do.  Zero
+   means the default is an error.  */
 static const yytype_int16 yydefact[] =
 {
        0,     0,   141,   140,   143,   136,   161,     0,    76,    68,
@@ -1387,7 +1711,7 @@ static const yytype_int16 yydefact[] =
      230,    41,   191,     0,    38,   193
 };
 
-  /* YYPGOTO[NTERM-NUM].  */
+/* YYPGOTO[NTERM-NUM].  */
 static const yytype_int16 yypgoto[] =
 {
     -355,  -355,  -355,  -355,   100,  -355,   -58,   228,  -355,  -355,
@@ -1399,7 +1723,7 @@ static const yytype_int16 yypgoto[] =
     -105,   -76,  -355,  -355
 };
 
-  /* YYDEFGOTO[NTERM-NUM].  */
+/* YYDEFGOTO[NTERM-NUM].  */
 static const yytype_int16 yydefgoto[] =
 {
        0,    68,    69,    70,    71,   154,    72,    73,    74,    75,
@@ -1411,9 +1735,9 @@ static const yytype_int16 yydefgoto[] =
      242,   132,   133,   365
 };
 
-  /* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
-     positive, shift that token.  If negative, reduce the rule whose
-     number is the opposite.  If YYTABLE_NINF, syntax error.  */
+/* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
+   positive, shift that token.  If negative, reduce the rule whose
+   number is the opposite.  If YYTABLE_NINF, syntax error.  */
 static const yytype_int16 yytable[] =
 {
      121,   243,   128,   124,   123,   137,   238,   157,   239,   257,
@@ -2232,8 +2556,8 @@ static const yytype_int16 yycheck[] =
       89,    90,    91,    92,    -1,    94,    95
 };
 
-  /* YYSTOS[STATE-NUM] -- The (internal number of the) accessing
-     symbol of state STATE-NUM.  */
+/* YYSTOS[STATE-NUM] -- The symbol kind of the accessing symbol of
+   state STATE-NUM.  */
 static const yytype_uint8 yystos[] =
 {
        0,     1,     3,     4,     5,     6,     8,     9,    12,    13,
@@ -2285,7 +2609,7 @@ static const yytype_uint8 yystos[] =
      167,   195,    28,    51,   151,   167
 };
 
-  /* YYR1[YYN] -- Symbol number of symbol that rule YYN derives.  */
+/* YYR1[RULE-NUM] -- Symbol kind of the left-hand side of rule RULE-NUM.  */
 static const yytype_uint8 yyr1[] =
 {
        0,   134,   135,   136,   136,   137,   137,   137,   137,   137,
@@ -2318,7 +2642,7 @@ static const yytype_uint8 yyr1[] =
      197,   197
 };
 
-  /* YYR2[YYN] -- Number of symbols on the right hand side of rule YYN.  */
+/* YYR2[RULE-NUM] -- Number of symbols on the right-hand side of rule RULE-NUM.  */
 static const yytype_int8 yyr2[] =
 {
        0,     2,     1,     0,     2,     1,     2,     3,     4,     3,
@@ -2360,6 +2684,7 @@ enum { YYENOMEM = -2 };
 #define YYACCEPT        goto yyacceptlab
 #define YYABORT         goto yyabortlab
 #define YYERROR         goto yyerrorlab
+#define YYNOMEM         goto yyexhaustedlab
 
 
 #define YYRECOVERING()  (!!yyerrstatus)
@@ -2427,12 +2752,19 @@ do {                                            \
 } while (0)
 
 
-/* YY_LOCATION_PRINT -- Print the location on the stream.
+/* YYLOCATION_PRINT -- Print the location on the stream.
    This macro was not mandated originally: define only if we know
    we won't break user code: when these are the locations we know.  */
 
-# ifndef YY_LOCATION_PRINT
-#  if defined YYLTYPE_IS_TRIVIAL && YYLTYPE_IS_TRIVIAL
+# ifndef YYLOCATION_PRINT
+
+#  if defined YY_LOCATION_PRINT
+
+   /* Temporary convenience wrapper in case some people defined the
+      undocumented and private YY_LOCATION_PRINT macros.  */
+#   define YYLOCATION_PRINT(File, Loc)  YY_LOCATION_PRINT(File, *(Loc))
+
+#  elif defined YYLTYPE_IS_TRIVIAL && YYLTYPE_IS_TRIVIAL
 
 /* Print *YYLOCP on YYO.  Private, do not rely on its existence. */
 
@@ -2460,15 +2792,23 @@ yy_location_print_ (FILE *yyo, YYLTYPE const * const yylocp)
         res += YYFPRINTF (yyo, "-%d", end_col);
     }
   return res;
- }
+}
 
-#   define YY_LOCATION_PRINT(File, Loc)          \
-  yy_location_print_ (File, &(Loc))
+#   define YYLOCATION_PRINT  yy_location_print_
+
+    /* Temporary convenience wrapper in case some people defined the
+       undocumented and private YY_LOCATION_PRINT macros.  */
+#   define YY_LOCATION_PRINT(File, Loc)  YYLOCATION_PRINT(File, &(Loc))
 
 #  else
-#   define YY_LOCATION_PRINT(File, Loc) ((void) 0)
+
+#   define YYLOCATION_PRINT(File, Loc) ((void) 0)
+    /* Temporary convenience wrapper in case some people defined the
+       undocumented and private YY_LOCATION_PRINT macros.  */
+#   define YY_LOCATION_PRINT  YYLOCATION_PRINT
+
 #  endif
-# endif /* !defined YY_LOCATION_PRINT */
+# endif /* !defined YYLOCATION_PRINT */
 
 
 # define YY_SYMBOL_PRINT(Title, Kind, Value, Location)                    \
@@ -2497,10 +2837,6 @@ yy_symbol_value_print (FILE *yyo,
   YY_USE (parm);
   if (!yyvaluep)
     return;
-# ifdef YYPRINT
-  if (yykind < YYNTOKENS)
-    YYPRINT (yyo, yytoknum[yykind], *yyvaluep);
-# endif
   YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
   YY_USE (yykind);
   YY_IGNORE_MAYBE_UNINITIALIZED_END
@@ -2518,7 +2854,7 @@ yy_symbol_print (FILE *yyo,
   YYFPRINTF (yyo, "%s %s (",
              yykind < YYNTOKENS ? "token" : "nterm", yysymbol_name (yykind));
 
-  YY_LOCATION_PRINT (yyo, *yylocationp);
+  YYLOCATION_PRINT (yyo, yylocationp);
   YYFPRINTF (yyo, ": ");
   yy_symbol_value_print (yyo, yykind, yyvaluep, yylocationp, parm);
   YYFPRINTF (yyo, ")");
@@ -2985,6 +3321,7 @@ YYLTYPE yylloc = yyloc_default;
 
   yychar = YYEMPTY; /* Cause a token to be read.  */
 
+
 /* User initialization code.  */
 {
   GCLock lock;
@@ -3018,7 +3355,7 @@ yysetstate:
 
   if (yyss + yystacksize - 1 <= yyssp)
 #if !defined yyoverflow && !defined YYSTACK_RELOCATE
-    goto yyexhaustedlab;
+    YYNOMEM;
 #else
     {
       /* Get the current used size of the three stacks, in elements.  */
@@ -3049,7 +3386,7 @@ yysetstate:
 # else /* defined YYSTACK_RELOCATE */
       /* Extend the stack our own way.  */
       if (YYMAXDEPTH <= yystacksize)
-        goto yyexhaustedlab;
+        YYNOMEM;
       yystacksize *= 2;
       if (YYMAXDEPTH < yystacksize)
         yystacksize = YYMAXDEPTH;
@@ -3060,7 +3397,7 @@ yysetstate:
           YY_CAST (union yyalloc *,
                    YYSTACK_ALLOC (YY_CAST (YYSIZE_T, YYSTACK_BYTES (yystacksize))));
         if (! yyptr)
-          goto yyexhaustedlab;
+          YYNOMEM;
         YYSTACK_RELOCATE (yyss_alloc, yyss);
         YYSTACK_RELOCATE (yyvs_alloc, yyvs);
         YYSTACK_RELOCATE (yyls_alloc, yyls);
@@ -3084,6 +3421,7 @@ yysetstate:
     }
 #endif /* !defined yyoverflow && !defined YYSTACK_RELOCATE */
 
+
   if (yystate == YYFINAL)
     YYACCEPT;
 
@@ -3303,23 +3641,9 @@ yyreduce:
 
   case 25: /* include_item: "include" "string literal"  */
       { ParserState* pp = static_cast<ParserState*>(parm);
-        map<string,Model*>::iterator ret = pp->seenModels.find((yyvsp[0].sValue));
         IncludeI* ii = new IncludeI((yyloc),ASTString((yyvsp[0].sValue)));
         (yyval.item) = ii;
-        if (ret == pp->seenModels.end()) {
-          Model* im = new Model;
-          im->setParent(pp->model);
-          im->setFilename((yyvsp[0].sValue));
-          string fpath, fbase; filepath(pp->filename, fpath, fbase);
-          if (fpath=="")
-            fpath="./";
-          pair<string,Model*> pm(fpath, im);
-          pp->files.push_back(pm);
-          ii->m(im);
-          pp->seenModels.insert(pair<string,Model*>((yyvsp[0].sValue),im));
-        } else {
-          ii->m(ret->second, false);
-        }
+        register_include(ii, pp->filename, pp->model, pp->files, pp->seenModels);
         free((yyvsp[0].sValue));
       }
     break;
@@ -4728,7 +5052,7 @@ yyerrlab:
           }
         yyerror (&yylloc, parm, yymsgp);
         if (yysyntax_error_status == YYENOMEM)
-          goto yyexhaustedlab;
+          YYNOMEM;
       }
     }
 
@@ -4765,6 +5089,7 @@ yyerrorlab:
      label yyerrorlab therefore never appears in user code.  */
   if (0)
     YYERROR;
+  ++yynerrs;
 
   /* Do not reclaim the symbols of the rule whose action triggered
      this YYERROR.  */
@@ -4828,7 +5153,7 @@ yyerrlab1:
 `-------------------------------------*/
 yyacceptlab:
   yyresult = 0;
-  goto yyreturn;
+  goto yyreturnlab;
 
 
 /*-----------------------------------.
@@ -4836,24 +5161,22 @@ yyacceptlab:
 `-----------------------------------*/
 yyabortlab:
   yyresult = 1;
-  goto yyreturn;
+  goto yyreturnlab;
 
 
-#if 1
-/*-------------------------------------------------.
-| yyexhaustedlab -- memory exhaustion comes here.  |
-`-------------------------------------------------*/
+/*-----------------------------------------------------------.
+| yyexhaustedlab -- YYNOMEM (memory exhaustion) comes here.  |
+`-----------------------------------------------------------*/
 yyexhaustedlab:
   yyerror (&yylloc, parm, YY_("memory exhausted"));
   yyresult = 2;
-  goto yyreturn;
-#endif
+  goto yyreturnlab;
 
 
-/*-------------------------------------------------------.
-| yyreturn -- parsing is finished, clean up and return.  |
-`-------------------------------------------------------*/
-yyreturn:
+/*----------------------------------------------------------.
+| yyreturnlab -- parsing is finished, clean up and return.  |
+`----------------------------------------------------------*/
+yyreturnlab:
   if (yychar != YYEMPTY)
     {
       /* Make sure we have latest lookahead translation.  See comments at
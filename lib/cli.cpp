@@ -349,15 +349,20 @@ namespace MiniZinc {
       const std::string arg = std::string(argv[idx]);
       idx++;     
       if(knowsOption(arg)) {        
-        applyOption(opts,argv,argc,idx,arg);
+        try {
+          applyOption(opts,argv,argc,idx,arg);
+        } catch (CLIError&) {
+          delete opts;
+          throw;
+        }
       }      
       else { 
         if(arg.length() > 4) {
           std::string extension = arg.substr(arg.length()-4,std::string::npos);
           if (extension == ".mzn") {
             if(model != "") {
-              std::cerr << "Error: Multiple .mzn files given." << std::endl;
-              error();
+              delete opts;
+              error("Multiple .mzn files given.");
             }
             model = arg;
             continue;
@@ -372,8 +377,8 @@ namespace MiniZinc {
       }
     }
     if(model==""){
-      std::cerr << "Error: No model file given." << std::endl;
-      error();
+      delete opts;
+      error("No model file given.");
     }
     opts->setStringParam(constants().opts.model.str(),model);
     if(datafiles.size() == 1)
@@ -381,7 +386,12 @@ namespace MiniZinc {
     else if (datafiles.size() > 1)
       opts->setStringVectorParam(constants().opts.datafiles.str(),datafiles);    
     // set default options in case they are not set
-    setDefaultOptionValues(opts);
+    try {
+      setDefaultOptionValues(opts);
+    } catch (CLIError&) {
+      delete opts;
+      throw;
+    }
     return opts;
   }
   
@@ -399,9 +409,8 @@ namespace MiniZinc {
     return (it->second);
   }
   
-  void CLIParser::error(void) {
-    // TODO: print proper error message, including help
-    exit(EXIT_FAILURE);
+  void CLIParser::error(const std::string& msg) {
+    throw CLIError(msg);
   }
   
   void CLIParser::setDefaultOptionValues(CLIOptions* opts) {
@@ -448,10 +457,9 @@ namespace MiniZinc {
       }
     }
     if (std_lib_dir=="") {
-      std::cerr << "Error: unknown minizinc standard library directory.\n"
-      << "Specify --stdlib-dir on the command line or set the\n"
-      << "MZN_STDLIB_DIR environment variable.\n";
-      std::exit(EXIT_FAILURE);
+      error("unknown minizinc standard library directory.\n"
+            "Specify --stdlib-dir on the command line or set the\n"
+            "MZN_STDLIB_DIR environment variable.");
     }
     opts->setStringParam(constants().opts.stdlib.str(),std_lib_dir);
     std::string output_fzn = opts->getStringParam(constants().opts.fznToFile.str());
@@ -483,11 +491,16 @@ namespace MiniZinc {
       }
       includePaths.push_back(globals_dir);
     }
+    std::string include_dir = opts->getStringParam(constants().opts.includeDir.str());
+    if (include_dir!="") {
+      if(include_dir.back() != '/')
+        include_dir = include_dir+"/";
+      includePaths.push_back(include_dir);
+    }
     includePaths.push_back(std_lib_dir+"/std/");  
     for (unsigned int i=0; i<includePaths.size(); i++) {
       if (!FileUtils::directory_exists(includePaths[i])) {
-        std::cerr << "Cannot access include directory " << includePaths[i] << "\n";
-        std::exit(EXIT_FAILURE);
+        error("Cannot access include directory "+includePaths[i]);
       }
     }
     opts->setStringVectorParam(constants().opts.includePaths.str(),includePaths);
@@ -506,8 +519,7 @@ namespace MiniZinc {
     }      
     else if(nbArgs == 1) {
       if(idx >= argc) {
-        std::cerr << "Error: Missing argument for option: " << arg << std::endl;
-        error();
+        error("Missing argument for option: "+arg);
       }
       std::string s = std::string(argv[idx]);
       if(o->func.str_arg == NULL) {
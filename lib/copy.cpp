@@ -14,46 +14,89 @@
 
 namespace MiniZinc {
 
+  void CopyMap::rehash(size_t n) {
+    std::vector<Slot> old;
+    old.swap(_slots);
+    Slot empty;
+    empty.k = NULL;
+    empty.v = NULL;
+    _slots.assign(n, empty);
+    size_t mask = n-1;
+    for (size_t j=0; j<old.size(); j++) {
+      if (old[j].k != NULL) {
+        size_t i = slot(old[j].k);
+        while (_slots[i].k != NULL)
+          i = (i+1) & mask;
+        _slots[i] = old[j];
+      }
+    }
+  }
+  void CopyMap::reserve(size_t n) {
+    // Keep the load factor below 1/2
+    size_t ns = 16;
+    while (ns < n*2)
+      ns *= 2;
+    if (ns > _slots.size())
+      rehash(ns);
+  }
+  void CopyMap::insertPtr(void* k, void* v) {
+    // (empty vectors can be represented by NULL)
+    if (k == NULL)
+      return;
+    if ((_size+1)*2 > _slots.size())
+      rehash(_slots.empty() ? 16 : _slots.size()*2);
+    size_t mask = _slots.size()-1;
+    size_t i = slot(k);
+    while (_slots[i].k != NULL) {
+      if (_slots[i].k == k)
+        return;
+      i = (i+1) & mask;
+    }
+    _slots[i].k = k;
+    _slots[i].v = v;
+    _size++;
+  }
+  void* CopyMap::findPtr(const void* k) const {
+    if (k == NULL || _slots.empty())
+      return NULL;
+    size_t mask = _slots.size()-1;
+    for (size_t i = slot(k); _slots[i].k != NULL; i = (i+1) & mask) {
+      if (_slots[i].k == k)
+        return _slots[i].v;
+    }
+    return NULL;
+  }
+
   void CopyMap::insert(Expression* e0, Expression* e1) {
-    m.insert(std::pair<void*,void*>(e0,e1));
-    m.insert(std::pair<void*,void*>(e1,e1));
+    insertPtr(e0,e1);
+    insertPtr(e1,e1);
   }
   Expression* CopyMap::find(Expression* e) {
-    MyMap::iterator it = m.find(e);
-    if (it==m.end()) return NULL;
-    return static_cast<Expression*>(it->second);
+    return static_cast<Expression*>(findPtr(e));
   }
   void CopyMap::insert(Item* e0, Item* e1) {
-    m.insert(std::pair<void*,void*>(e0,e1));
+    insertPtr(e0,e1);
   }
   Item* CopyMap::find(Item* e) {
-    MyMap::iterator it = m.find(e);
-    if (it==m.end()) return NULL;
-    return static_cast<Item*>(it->second);
+    return static_cast<Item*>(findPtr(e));
   }
   void CopyMap::insert(Model* e0, Model* e1) {
-    m.insert(std::pair<void*,void*>(e0,e1));
+    insertPtr(e0,e1);
   }
   Model* CopyMap::find(Model* e) {
-    MyMap::iterator it = m.find(e);
-    if (it==m.end()) return NULL;
-    return static_cast<Model*>(it->second);
+    return static_cast<Model*>(findPtr(e));
   }
   void CopyMap::insert(const ASTString& e0, const ASTString& e1) {
-    m.insert(std::pair<void*,void*>(e0.aststr(),e1.aststr()));
+    insertPtr(e0.aststr(),e1.aststr());
   }
   ASTStringO* CopyMap::find(const ASTString& e) {
-    MyMap::iterator it = m.find(e.aststr());
-    if (it==m.end()) return NULL;
-    return static_cast<ASTStringO*>(it->second);
+    return static_cast<ASTStringO*>(findPtr(e.aststr()));
   }
   void CopyMap::insert(IntSetVal* e0, IntSetVal* e1) {
-    m.insert(std::pair<void*,void*>(e0,e1));
+    insertPtr(e0,e1);
   }
   IntSetVal* CopyMap::find(IntSetVal* e) {
-    MyMap::iterator it = m.find(e);
-    if (it==m.end()) return NULL;
-    return static_cast<IntSetVal*>(it->second);
+    return static_cast<IntSetVal*>(findPtr(e));
   }
 
   Location copy_location(CopyMap& m, const Location& _loc) {
@@ -134,6 +177,7 @@ namespace MiniZinc {
             c->v(ce);
           }
         }
+        c->rehash();
         ret = c;
       }
       break;
@@ -249,6 +293,7 @@ namespace MiniZinc {
           v = ce.vec();
         }
         c->v(ASTExprVec<Expression>(v));
+        c->rehash();
         ret = c;
       }
       break;
@@ -271,6 +316,7 @@ namespace MiniZinc {
         }
         c->v(copy(env,m,aa->v(),followIds,copyFundecls,isFlatModel));
         c->idx(ASTExprVec<Expression>(idx));
+        c->rehash();
         ret = c;
       }
       break;
@@ -309,12 +355,32 @@ namespace MiniZinc {
       break;
     case Expression::E_BINOP:
       {
-        BinOp* b = e->cast<BinOp>();
-        BinOp* c = new BinOp(copy_location(m,e),NULL,b->op(),NULL);
-        m.insert(e,c);
-        c->lhs(copy(env,m,b->lhs(),followIds,copyFundecls,isFlatModel));
-        c->rhs(copy(env,m,b->rhs(),followIds,copyFundecls,isFlatModel));
-        ret = c;
+        // Copy chains of operators (such as long conjunctions) without
+        // recursing into their left operands
+        std::vector<BinOp*> chain;
+        Expression* cur = e;
+        do {
+          chain.push_back(cur->cast<BinOp>());
+          cur = chain.back()->lhs();
+        } while (cur && cur->isa<BinOp>() && m.find(cur)==NULL);
+        std::vector<BinOp*> cs(chain.size());
+        for (unsigned int i=0; i<chain.size(); i++) {
+          cs[i] = new BinOp(copy_location(m,chain[i]),NULL,chain[i]->op(),NULL);
+          m.insert(chain[i],cs[i]);
+        }
+        Expression* lhs = copy(env,m,cur,followIds,copyFundecls,isFlatModel);
+        for (unsigned int i=chain.size(); i--;) {
+          BinOp* c = cs[i];
+          c->lhs(lhs);
+          c->rhs(copy(env,m,chain[i]->rhs(),followIds,copyFundecls,isFlatModel));
+          c->rehash();
+          if (i > 0) {
+            c->type(chain[i]->type());
+            copy_ann(env,m,chain[i]->ann(),c->ann(),followIds,copyFundecls,isFlatModel);
+          }
+          lhs = c;
+        }
+        ret = cs[0];
       }
       break;
     case Expression::E_UNOP:
@@ -323,6 +389,7 @@ namespace MiniZinc {
         UnOp* c = new UnOp(copy_location(m,e),b->op(),NULL);
         m.insert(e,c);
         c->e(copy(env,m,b->e(),followIds,copyFundecls,isFlatModel));
+        c->rehash();
         ret = c;
       }
       break;
@@ -349,6 +416,7 @@ namespace MiniZinc {
         for (unsigned int i=ca->args().size(); i--;)
           args[i] = copy(env,m,ca->args()[i],followIds,copyFundecls,isFlatModel);
         c->args(args);
+        c->rehash();
         ret = c;
       }
       break;
@@ -380,6 +448,7 @@ namespace MiniZinc {
         c->e(copy(env,m,vd->e(),followIds,copyFundecls,isFlatModel));
         c->type(c->ti()->type());
         c->id()->type(c->type());
+        c->rehash();
         ret = c;
       }
       break;
@@ -556,16 +625,31 @@ namespace MiniZinc {
     if (Model* cached = cm.find(m))
       return cached;
     Model* c = new Model;
-    for (unsigned int i=0; i<m->size(); i++)
-      c->addItem(copy(env,cm,(*m)[i],false,true,followIncludes));
-
-    for (Model::FnMap::iterator it = m->fnmap.begin(); it != m->fnmap.end(); ++it) {
-      for (unsigned int i=0; i<it->second.size(); i++)
-        c->registerFn(env,copy(env,cm,it->second[i],false,true,isFlatModel)->cast<FunctionI>());
+    for (unsigned int i=0; i<m->size(); i++) {
+      Item* ci = copy(env,cm,(*m)[i],false,true,followIncludes);
+      if ((*m)[i]->removed())
+        ci->remove();
+      c->addItem(ci);
     }
+    c->_normalised = m->_normalised;
+
+    copyFunctions(env,cm,m,c,isFlatModel);
     cm.insert(m,c);
     return c;
   }
+  void copyFunctions(EnvI& env, CopyMap& cm, Model* m, Model* c, bool isFlatModel) {
+    for (Model::FnMap::iterator it = m->fnmap.begin(); it != m->fnmap.end(); ++it) {
+      for (unsigned int i=0; i<it->second.fns.size(); i++)
+        c->registerFn(env,copy(env,cm,it->second.fns[i],false,true,isFlatModel)->cast<FunctionI>());
+    }
+    if (m->_fnCacheEnabled) {
+      // The copies are registered in the same (sorted) order and already type checked
+      Model* r = c;
+      while (r->_parent)
+        r = r->_parent;
+      r->_fnCacheEnabled = true;
+    }
+  }
   Model* copy(EnvI& env, Model* m) {
     CopyMap cm;
     return copy(env,cm,m,true);
@@ -0,0 +1,434 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <minizinc/dzn_loader.hh>
+
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace MiniZinc {
+
+  namespace {
+
+    /// Keywords of the lexer that match the syntax of identifiers
+    const char* const keywords[] = {
+      "ann", "annotation", "any", "array", "bool", "case", "constraint",
+      "default", "diff", "div", "else", "elseif", "endif", "enum", "false",
+      "float", "function", "if", "in", "include", "infinity", "int",
+      "intersect", "let", "list", "maximize", "minimize", "mod", "not", "of",
+      "opt", "output", "par", "predicate", "record", "satisfy", "search",
+      "set", "solve", "string", "subset", "superset", "symdiff", "test",
+      "then", "true", "tuple", "type", "union", "var", "variant_record",
+      "where", "xor", NULL
+    };
+
+    /// Tokens of the data file subset
+    enum Token {
+      T_EOF, T_INT, T_FLOAT, T_TRUE, T_FALSE, T_ID,
+      T_LEFT_BRACKET, T_RIGHT_BRACKET, T_LEFT_2D_BRACKET, T_RIGHT_2D_BRACKET,
+      T_LEFT_BRACE, T_RIGHT_BRACE, T_LEFT_PAREN, T_RIGHT_PAREN,
+      T_COMMA, T_SEMI, T_BAR, T_EQ, T_DOTDOT, T_PLUS, T_MINUS,
+      /// Anything that is not part of the subset
+      T_OTHER
+    };
+
+    /// Thrown when the file has to be parsed by the full parser
+    class Unsupported {};
+
+    /**
+     * \brief Scanner and recursive descent parser for data files
+     *
+     * Lines and columns are counted in the same way as in the lexer,
+     * so that all locations are the same as the ones of the parser.
+     */
+    class DznLoader {
+    protected:
+      /// Current position
+      const char* _p;
+      /// End of the data
+      const char* _end;
+      /// Start of the current line
+      const char* _lineStart;
+      /// Current line
+      unsigned int _line;
+      /// Current token
+      Token _t;
+      /// Start of the current token
+      const char* _tStart;
+      /// Location of the current token
+      Location _tLoc;
+      /// Value of the current integer token
+      long long int _iv;
+      /// Value of the current float token
+      double _fv;
+
+      /// Skip white space and comments
+      void skipSpace(void) {
+        for (;;) {
+          if (_p == _end)
+            return;
+          char c = *_p;
+          if (c=='\n') {
+            ++_p;
+            ++_line;
+            _lineStart = _p;
+          } else if (c==' ' || c=='\t' || c=='\r' || c=='\f') {
+            ++_p;
+          } else if (c=='%') {
+            while (_p != _end && *_p != '\n') {
+              if (*_p=='\0')
+                throw Unsupported();
+              ++_p;
+            }
+          } else if (c=='/' && _p+1 != _end && _p[1]=='*') {
+            // Documentation comments are handled by the parser
+            if (_p+2 != _end && _p[2]=='*')
+              throw Unsupported();
+            _p += 2;
+            for (;;) {
+              if (_p == _end)
+                return;
+              if (*_p=='*' && _p+1 != _end && _p[1]=='/') {
+                _p += 2;
+                break;
+              }
+              if (*_p=='\n') {
+                ++_line;
+                _lineStart = _p+1;
+              } else if (*_p=='\0') {
+                throw Unsupported();
+              }
+              ++_p;
+            }
+          } else {
+            return;
+          }
+        }
+      }
+      static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+      static bool isAlpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+      /// Scan a number starting at the current position
+      Token scanNumber(void) {
+        const char* s = _p;
+        if (*s=='0' && s+1 != _end && (s[1]=='x' || s[1]=='X' || s[1]=='o'))
+          throw Unsupported();
+        long long int v = 0;
+        for (; _p != _end && isDigit(*_p); ++_p) {
+          int d = *_p - '0';
+          if (v > (LLONG_MAX - d) / 10)
+            throw Unsupported();
+          v = v*10 + d;
+        }
+        bool isFloat = false;
+        if (_p+1 < _end && *_p=='.' && isDigit(_p[1])) {
+          isFloat = true;
+          for (_p += 2; _p != _end && isDigit(*_p); ++_p) {}
+        }
+        if (_p != _end && (*_p=='e' || *_p=='E')) {
+          const char* e = _p+1;
+          if (e != _end && (*e=='+' || *e=='-'))
+            ++e;
+          if (e != _end && isDigit(*e)) {
+            isFloat = true;
+            for (_p = e+1; _p != _end && isDigit(*_p); ++_p) {}
+          }
+        }
+        if (!isFloat) {
+          _iv = v;
+          return T_INT;
+        }
+        std::string text(s, _p);
+        _fv = strtod(text.c_str(), NULL);
+        // The lexer rejects literals that overflow (but not ones that underflow)
+        if (_fv == HUGE_VAL)
+          throw Unsupported();
+        return T_FLOAT;
+      }
+      /// Scan an identifier starting at the current position
+      Token scanIdentifier(void) {
+        for (++_p; _p != _end && (isAlpha(*_p) || isDigit(*_p) || *_p=='_'); ++_p) {}
+        size_t len = _p-_tStart;
+        if (len==4 && strncmp(_tStart,"true",4)==0)
+          return T_TRUE;
+        if (len==5 && strncmp(_tStart,"false",5)==0)
+          return T_FALSE;
+        for (unsigned int i=0; keywords[i] != NULL; i++)
+          if (strlen(keywords[i])==len && strncmp(_tStart,keywords[i],len)==0)
+            throw Unsupported();
+        return T_ID;
+      }
+      /// Read the next token
+      void next(void) {
+        skipSpace();
+        _tStart = _p;
+        _tLoc.first_line = _tLoc.last_line = _line;
+        _tLoc.first_column = static_cast<unsigned int>(_p-_lineStart)+1;
+        if (_p == _end) {
+          _t = T_EOF;
+        } else {
+          char c = *_p;
+          if (isDigit(c)) {
+            _t = scanNumber();
+          } else if (isAlpha(c)) {
+            _t = scanIdentifier();
+          } else {
+            ++_p;
+            switch (c) {
+            case '[':
+              if (_p != _end && *_p=='|') {
+                ++_p;
+                _t = T_LEFT_2D_BRACKET;
+              } else {
+                _t = T_LEFT_BRACKET;
+              }
+              break;
+            case '|':
+              if (_p != _end && *_p==']') {
+                ++_p;
+                _t = T_RIGHT_2D_BRACKET;
+              } else {
+                _t = T_BAR;
+              }
+              break;
+            case '.':
+              if (_p != _end && *_p=='.') {
+                ++_p;
+                _t = T_DOTDOT;
+              } else {
+                _t = T_OTHER;
+              }
+              break;
+            case '=':
+              // == is an operator
+              _t = (_p != _end && *_p=='=') ? T_OTHER : T_EQ;
+              break;
+            case '+':
+              _t = (_p != _end && *_p=='+') ? T_OTHER : T_PLUS;
+              break;
+            case '-':
+              _t = (_p != _end && *_p=='>') ? T_OTHER : T_MINUS;
+              break;
+            case ']': _t = T_RIGHT_BRACKET; break;
+            case '{': _t = T_LEFT_BRACE; break;
+            case '}': _t = T_RIGHT_BRACE; break;
+            case '(': _t = T_LEFT_PAREN; break;
+            case ')': _t = T_RIGHT_PAREN; break;
+            case ',': _t = T_COMMA; break;
+            case ';': _t = T_SEMI; break;
+            default: _t = T_OTHER;
+            }
+          }
+        }
+        if (_t==T_OTHER)
+          throw Unsupported();
+        _tLoc.last_column = static_cast<unsigned int>(_p-_lineStart);
+      }
+      /// Check that the current token is \a t and read the next one
+      void expect(Token t) {
+        if (_t != t)
+          throw Unsupported();
+        next();
+      }
+      /// Return location from \a first to the end of \a last
+      static Location span(const Location& first, const Location& last) {
+        Location loc = first;
+        loc.last_line = last.last_line;
+        loc.last_column = last.last_column;
+        return loc;
+      }
+
+      /// A parsed expression and the location of the text it was parsed from
+      struct Parsed {
+        Expression* e;
+        Location loc;
+      };
+
+      /// Parse a list of expressions up to token \a close, allowing a trailing comma
+      void exprList(std::vector<Expression*>& v, Token close, bool allowEmpty) {
+        if (_t==close && allowEmpty)
+          return;
+        for (;;) {
+          v.push_back(expr().e);
+          if (_t != T_COMMA)
+            return;
+          next();
+          // The last row of a 2d array literal may also end in a comma
+          if (_t==close || (close==T_BAR && _t==T_RIGHT_2D_BRACKET))
+            return;
+        }
+      }
+      /// Parse an atomic expression
+      Parsed atom(void) {
+        Parsed r;
+        r.loc = _tLoc;
+        switch (_t) {
+        case T_INT:
+          r.e = new IntLit(_tLoc, _iv);
+          next();
+          break;
+        case T_FLOAT:
+          r.e = new FloatLit(_tLoc, _fv);
+          next();
+          break;
+        case T_TRUE:
+        case T_FALSE:
+          r.e = constants().boollit(_t==T_TRUE);
+          next();
+          break;
+        case T_PLUS:
+        case T_MINUS:
+          {
+            // Like the parser, negate the literal without changing its location or hash
+            bool neg = _t==T_MINUS;
+            next();
+            if (_t==T_INT) {
+              IntLit* il = new IntLit(_tLoc, _iv);
+              if (neg)
+                il->v(-il->v());
+              r.e = il;
+            } else if (_t==T_FLOAT) {
+              FloatLit* fl = new FloatLit(_tLoc, _fv);
+              if (neg)
+                fl->v(-fl->v());
+              r.e = fl;
+            } else {
+              throw Unsupported();
+            }
+            r.loc = span(r.loc, _tLoc);
+            next();
+          }
+          break;
+        case T_LEFT_BRACKET:
+          {
+            next();
+            std::vector<Expression*> v;
+            exprList(v, T_RIGHT_BRACKET, true);
+            r.loc = span(r.loc, _tLoc);
+            expect(T_RIGHT_BRACKET);
+            r.e = new ArrayLit(r.loc, v);
+          }
+          break;
+        case T_LEFT_2D_BRACKET:
+          {
+            next();
+            std::vector<std::vector<Expression*> > v;
+            while (_t != T_RIGHT_2D_BRACKET) {
+              v.push_back(std::vector<Expression*>());
+              exprList(v.back(), T_BAR, false);
+              if (v.size() > 1 && v.back().size() != v[v.size()-2].size())
+                throw Unsupported();
+              if (_t==T_BAR) {
+                next();
+              } else if (_t != T_RIGHT_2D_BRACKET) {
+                throw Unsupported();
+              }
+            }
+            r.loc = span(r.loc, _tLoc);
+            next();
+            r.e = new ArrayLit(r.loc, v);
+          }
+          break;
+        case T_LEFT_BRACE:
+          {
+            next();
+            std::vector<Expression*> v;
+            exprList(v, T_RIGHT_BRACE, true);
+            r.loc = span(r.loc, _tLoc);
+            expect(T_RIGHT_BRACE);
+            r.e = new SetLit(r.loc, v);
+          }
+          break;
+        case T_ID:
+          {
+            // An identifier or a call
+            std::string id(_tStart, _p);
+            next();
+            if (_t != T_LEFT_PAREN) {
+              r.e = new Id(r.loc, id, NULL);
+              break;
+            }
+            next();
+            std::vector<Expression*> args;
+            exprList(args, T_RIGHT_PAREN, true);
+            r.loc = span(r.loc, _tLoc);
+            expect(T_RIGHT_PAREN);
+            if (_t==T_LEFT_PAREN)
+              throw Unsupported();
+            r.e = new Call(r.loc, id, args);
+          }
+          break;
+        default:
+          throw Unsupported();
+        }
+        return r;
+      }
+      /// Parse an expression (an atom or a range)
+      Parsed expr(void) {
+        Parsed r = atom();
+        if (_t==T_DOTDOT) {
+          next();
+          Parsed ub = atom();
+          r.loc = span(r.loc, ub.loc);
+          if (r.e->isa<IntLit>() && ub.e->isa<IntLit>()) {
+            r.e = new SetLit(r.loc, IntSetVal::a(r.e->cast<IntLit>()->v(),
+                                                 ub.e->cast<IntLit>()->v()));
+          } else {
+            r.e = new BinOp(r.loc, r.e, BOT_DOTDOT, ub.e);
+          }
+        }
+        return r;
+      }
+    public:
+      DznLoader(const std::string& filename, const char* data, size_t size)
+        : _p(data), _end(data+size), _lineStart(data), _line(1),
+          _t(T_EOF), _tStart(data), _iv(0), _fv(0.0) {
+        _tLoc.filename = ASTString(filename);
+      }
+      /// Parse all items and append them to \a items
+      void items(std::vector<Item*>& items) {
+        next();
+        while (_t != T_EOF) {
+          if (_t != T_ID)
+            throw Unsupported();
+          Location loc = _tLoc;
+          std::string id(_tStart, _p);
+          next();
+          expect(T_EQ);
+          Parsed e = expr();
+          items.push_back(new AssignI(span(loc, e.loc), id, e.e));
+          if (_t==T_SEMI) {
+            next();
+          } else if (_t != T_EOF) {
+            throw Unsupported();
+          }
+        }
+      }
+    };
+
+  }
+
+  bool
+  loadDzn(Model* m, const std::string& filename, const char* data, size_t size) {
+    std::vector<Item*> items;
+    try {
+      DznLoader(filename, data, size).items(items);
+    } catch (Unsupported&) {
+      return false;
+    }
+    for (unsigned int i=0; i<items.size(); i++)
+      m->addItem(items[i]);
+    return true;
+  }
+
+}
@@ -16,6 +16,7 @@
 #include <minizinc/copy.hh>
 #include <minizinc/astiterator.hh>
 #include <minizinc/flatten.hh>
+#include <minizinc/flatten_internal.hh>
 
 namespace MiniZinc {
 
@@ -65,6 +66,7 @@ namespace MiniZinc {
   class EvalFloatVal {
   public:
     typedef FloatVal Val;
+    typedef FloatVal ArrayVal;
     static FloatVal e(EnvI& env, Expression* e) {
       return eval_float(env, e);
     }
@@ -109,6 +111,7 @@ namespace MiniZinc {
   class EvalBoolVal {
   public:
     typedef bool Val;
+    typedef bool ArrayVal;
     static bool e(EnvI& env, Expression* e) {
       return eval_bool(env, e);
     }
@@ -220,6 +223,68 @@ namespace MiniZinc {
     }
   }
   
+  namespace {
+    /// Return whether builtin \a id can return different results for the same arguments
+    bool isImpureBuiltin(const ASTString& id) {
+      static const char* impure[] = {
+        "bernoulli", "binomial", "cauchy", "chisquared", "discrete_distribution",
+        "exponential", "fdistribution", "gamma", "lognormal", "normal", "poisson",
+        "sol", "tdistribution", "trace", "uniform", "weibull"
+      };
+      for (unsigned int i=0; i<sizeof(impure)/sizeof(impure[0]); i++)
+        if (id == impure[i])
+          return true;
+      return false;
+    }
+
+    /// Check whether an expression only depends on par values and pure functions
+    class CheckPure : public EVisitor {
+    public:
+      EnvI& env;
+      /// The function whose body is checked (recursive calls are pure)
+      FunctionI* fi;
+      bool pure;
+      CheckPure(EnvI& env0, FunctionI* fi0) : env(env0), fi(fi0), pure(true) {}
+      void vId(const Id& id) {
+        if (id.decl() && id.decl()->type().isvar())
+          pure = false;
+      }
+      void vVarDecl(VarDecl& vd) {
+        if (vd.type().isvar())
+          pure = false;
+      }
+      void vCall(Call& c) {
+        if (c.decl() != fi && !isPureFunction(env, c.decl()))
+          pure = false;
+      }
+    };
+  }
+
+  bool isPureFunction(EnvI& env, FunctionI* fi) {
+    if (fi==NULL)
+      return false;
+    UNORDERED_NAMESPACE::unordered_map<FunctionI*,bool>::iterator it = env.pureFunctions.find(fi);
+    if (it != env.pureFunctions.end())
+      return it->second;
+    if (fi->e()==NULL) {
+      bool pure = !isImpureBuiltin(fi->id());
+      env.pureFunctions[fi] = pure;
+      return pure;
+    }
+    // Mutually recursive functions are conservatively considered impure
+    env.pureFunctions[fi] = false;
+    bool pure = fi->ti()->type().ispar();
+    for (unsigned int i=0; pure && i<fi->params().size(); i++)
+      pure = fi->params()[i]->type().ispar();
+    if (pure) {
+      CheckPure cp(env, fi);
+      topDown(cp, fi->e());
+      pure = cp.pure;
+    }
+    env.pureFunctions[fi] = pure;
+    return pure;
+  }
+
   template<class Eval>
   typename Eval::Val eval_call(EnvI& env, Call* ce, bool om) {
     std::vector<Expression*> previousParameters(ce->decl()->params().size());
@@ -252,7 +317,29 @@ namespace MiniZinc {
         }
       }
     }
-    typename Eval::Val ret = Eval::e(env,ce->decl()->e());
+    typename Eval::Val ret;
+    if (env.fopt.memoizeParCalls && ce->type().dim()==0 && isPureFunction(env, ce->decl())) {
+      KeepAlive key;
+      {
+        GCLock lock;
+        std::vector<Expression*> args(ce->decl()->params().size());
+        for (unsigned int i=0; i<args.size(); i++)
+          args[i] = ce->decl()->params()[i]->e();
+        key = new Call(Location(), ce->decl()->id(), args, ce->decl());
+      }
+      KeepAliveMap<KeepAlive>::iterator it = env.parCallMemo.find(key);
+      if (it != env.parCallMemo.end()) {
+        env.parCallHits++;
+        ret = Eval::e(env,it->second());
+      } else {
+        env.parCallMisses++;
+        KeepAlive result = eval_par(env,ce->decl()->e());
+        env.parCallMemo.insert(key, result);
+        ret = Eval::e(env,result());
+      }
+    } else {
+      ret = Eval::e(env,ce->decl()->e());
+    }
     for (unsigned int i=ce->decl()->params().size(); i--;) {
       VarDecl* vd = ce->decl()->params()[i];
       vd->e(previousParameters[i]);
@@ -261,14 +348,145 @@ namespace MiniZinc {
     return ret;
   }
   
+  namespace {
+    /// Determine the deepest generator variable that an expression refers to
+    class MaxLevel : public EVisitor {
+    public:
+      /// The level of each generator variable
+      const UNORDERED_NAMESPACE::unordered_map<const VarDecl*,unsigned int>& levels;
+      /// Number of levels plus one, if the expression does not refer to any
+      unsigned int level;
+      MaxLevel(const UNORDERED_NAMESPACE::unordered_map<const VarDecl*,unsigned int>& levels0)
+        : levels(levels0), level(0) {}
+      void vId(const Id& id) {
+        UNORDERED_NAMESPACE::unordered_map<const VarDecl*,unsigned int>::const_iterator it =
+          levels.find(id.decl());
+        if (it != levels.end())
+          level = std::max(level, it->second+1);
+      }
+    };
+
+    /**
+     * \brief Evaluator for par comprehensions over integer sets
+     *
+     * Each generator variable is one level of nested loops. The where
+     * clause is evaluated in the loop of the deepest variable it depends
+     * on, and the elements are evaluated using \a Eval into a vector.
+     */
+    template<class Eval>
+    class RangeComp {
+    protected:
+      EnvI& env;
+      Comprehension* e;
+      bool om;
+      std::vector<typename Eval::ArrayVal>& a;
+      /// Generator and identifier of each level
+      std::vector<std::pair<int,int> > gens;
+      /// Level after which the where clause is evaluated
+      unsigned int whereLevel;
+      /// Run loops of level \a k and deeper, where \a isv is the set of the previous level
+      void run(unsigned int k, IntSetVal* isv) {
+        if (k == whereLevel && e->where()) {
+          GCLock lock;
+          if (!eval_bool(env, e->where(), om))
+            return;
+        }
+        if (k == gens.size()) {
+          a.push_back(Eval::e(env, e->e()));
+          return;
+        }
+        int gen = gens[k].first;
+        int id = gens[k].second;
+        KeepAlive in;
+        if (id == 0) {
+          GCLock lock;
+          in = new SetLit(Location(), eval_intset(env, e->in(gen), om));
+          isv = in()->cast<SetLit>()->isv();
+        }
+        VarDecl* vd = e->decl(gen,id);
+        IntLit* il = vd->e()->cast<IntLit>();
+        CallStackItem csi(env, vd->id(), 0);
+        for (unsigned int r=0; r<isv->size(); r++) {
+          IntVal lo = isv->min(r);
+          IntVal hi = isv->max(r);
+          if (!lo.isFinite() || !hi.isFinite())
+            throw EvalError(env, e->in(gen)->loc(), "comprehension over infinite set");
+          for (IntVal v = lo; v <= hi; ++v) {
+            il->v(v);
+            run(k+1, isv);
+          }
+        }
+      }
+    public:
+      RangeComp(EnvI& env0, Comprehension* e0, bool om0, std::vector<typename Eval::ArrayVal>& a0)
+        : env(env0), e(e0), om(om0), a(a0), whereLevel(0) {}
+      /// Evaluate the comprehension, returns false if it is not over integer sets
+      bool eval(void) {
+        if (e->set() || (e->where() && e->where()->type().isvar()))
+          return false;
+        UNORDERED_NAMESPACE::unordered_map<const VarDecl*,unsigned int> levels;
+        for (int i=0; i<e->n_generators(); i++) {
+          if (e->in(i)->type().dim() != 0 || e->in(i)->type().isvar())
+            return false;
+          for (int j=0; j<e->n_decls(i); j++) {
+            if (e->decl(i,j)->e()==NULL || !e->decl(i,j)->e()->isa<IntLit>())
+              return false;
+            levels[e->decl(i,j)] = static_cast<unsigned int>(gens.size());
+            gens.push_back(std::make_pair(i,j));
+          }
+        }
+        if (e->where()) {
+          MaxLevel ml(levels);
+          topDown(ml, e->where());
+          whereLevel = ml.level;
+        }
+        run(0, NULL);
+        return true;
+      }
+    };
+  }
+
+  bool eval_comp_int(EnvI& env, Comprehension* e, std::vector<IntVal>& a, bool om) {
+    RangeComp<EvalIntVal> rc(env, e, om, a);
+    return rc.eval();
+  }
+
+  bool eval_comp_float(EnvI& env, Comprehension* e, std::vector<FloatVal>& a, bool om) {
+    RangeComp<EvalFloatVal> rc(env, e, om, a);
+    return rc.eval();
+  }
+
+  bool eval_comp_bool(EnvI& env, Comprehension* e, std::vector<bool>& a, bool om) {
+    RangeComp<EvalBoolVal> rc(env, e, om, a);
+    return rc.eval();
+  }
+
   ArrayLit* eval_array_comp(EnvI& env, Comprehension* e, bool om = false) {
     ArrayLit* ret;
-    if (e->type() == Type::parint(1)) {
+    std::vector<IntVal> iv;
+    std::vector<FloatVal> fv;
+    std::vector<bool> bv;
+    if (e->type() == Type::parint(1) && eval_comp_int(env,e,iv,om)) {
+      std::vector<Expression*> a(iv.size());
+      for (unsigned int i=0; i<iv.size(); i++)
+        a[i] = IntLit::a(iv[i]);
+      ret = new ArrayLit(e->loc(),a);
+    } else if (e->type() == Type::parint(1)) {
       std::vector<Expression*> a = eval_comp<EvalIntLit>(env,e, om);
       ret = new ArrayLit(e->loc(),a);
+    } else if (e->type() == Type::parbool(1) && eval_comp_bool(env,e,bv,om)) {
+      std::vector<Expression*> a(bv.size());
+      for (unsigned int i=0; i<bv.size(); i++)
+        a[i] = constants().boollit(bv[i]);
+      ret = new ArrayLit(e->loc(),a);
     } else if (e->type() == Type::parbool(1)) {
       std::vector<Expression*> a = eval_comp<EvalBoolLit>(env,e,om);
       ret = new ArrayLit(e->loc(),a);
+    } else if (e->type() == Type::parfloat(1) && eval_comp_float(env,e,fv,om)) {
+      std::vector<Expression*> a(fv.size());
+      for (unsigned int i=0; i<fv.size(); i++)
+        a[i] = FloatLit::a(fv[i]);
+      ret = new ArrayLit(e->loc(),a);
     } else if (e->type() == Type::parfloat(1)) {
       std::vector<Expression*> a = eval_comp<EvalFloatLit>(env,e,om);
       ret = new ArrayLit(e->loc(),a);
@@ -458,7 +676,9 @@ namespace MiniZinc {
     case Expression::E_COMP:
       {
         Comprehension* c = e->cast<Comprehension>();
-        std::vector<IntVal> a = eval_comp<EvalIntVal>(env,c,om);
+        std::vector<IntVal> a;
+        if (!eval_comp_int(env,c,a,om))
+          a = eval_comp<EvalIntVal>(env,c,om);
         return IntSetVal::a(a);
       }
     case Expression::E_ID:
@@ -491,32 +711,11 @@ namespace MiniZinc {
         if (lhs->type().isintset() && rhs->type().isintset()) {
           IntSetVal* v0 = eval_intset(env,lhs,om);
           IntSetVal* v1 = eval_intset(env,rhs,om);
-          IntSetRanges ir0(v0);
-          IntSetRanges ir1(v1);
           switch (bo->op()) {
-          case BOT_UNION:
-            {
-              Ranges::Union<IntSetRanges,IntSetRanges> u(ir0,ir1);
-              return IntSetVal::ai(u);
-            }
-          case BOT_DIFF:
-            {
-              Ranges::Diff<IntSetRanges,IntSetRanges> u(ir0,ir1);
-              return IntSetVal::ai(u);
-            }
-          case BOT_SYMDIFF:
-            {
-              Ranges::Union<IntSetRanges,IntSetRanges> u(ir0,ir1);
-              Ranges::Inter<IntSetRanges,IntSetRanges> i(ir0,ir1);
-              Ranges::Diff<Ranges::Union<IntSetRanges,IntSetRanges>,
-                           Ranges::Inter<IntSetRanges,IntSetRanges>> sd(u,i);
-              return IntSetVal::ai(sd);
-            }
-          case BOT_INTERSECT:
-            {
-              Ranges::Inter<IntSetRanges,IntSetRanges> u(ir0,ir1);
-              return IntSetVal::ai(u);
-            }
+          case BOT_UNION: return IntSetVal::unite(v0,v1);
+          case BOT_DIFF: return IntSetVal::diff(v0,v1);
+          case BOT_SYMDIFF: return IntSetVal::symdiff(v0,v1);
+          case BOT_INTERSECT: return IntSetVal::intersect(v0,v1);
           default: throw EvalError(env, e->loc(),"not a set of int expression", bo->opToString());
           }
         } else if (lhs->type().isint() && rhs->type().isint()) {
@@ -828,32 +1027,11 @@ namespace MiniZinc {
         if (lhs->type().isintset() && rhs->type().isintset()) {
           IntSetVal* v0 = eval_boolset(env,lhs,om);
           IntSetVal* v1 = eval_boolset(env,rhs,om);
-          IntSetRanges ir0(v0);
-          IntSetRanges ir1(v1);
           switch (bo->op()) {
-            case BOT_UNION:
-            {
-              Ranges::Union<IntSetRanges,IntSetRanges> u(ir0,ir1);
-              return IntSetVal::ai(u);
-            }
-            case BOT_DIFF:
-            {
-              Ranges::Diff<IntSetRanges,IntSetRanges> u(ir0,ir1);
-              return IntSetVal::ai(u);
-            }
-            case BOT_SYMDIFF:
-            {
-              Ranges::Union<IntSetRanges,IntSetRanges> u(ir0,ir1);
-              Ranges::Inter<IntSetRanges,IntSetRanges> i(ir0,ir1);
-              Ranges::Diff<Ranges::Union<IntSetRanges,IntSetRanges>,
-              Ranges::Inter<IntSetRanges,IntSetRanges>> sd(u,i);
-              return IntSetVal::ai(sd);
-            }
-            case BOT_INTERSECT:
-            {
-              Ranges::Inter<IntSetRanges,IntSetRanges> u(ir0,ir1);
-              return IntSetVal::ai(u);
-            }
+            case BOT_UNION: return IntSetVal::unite(v0,v1);
+            case BOT_DIFF: return IntSetVal::diff(v0,v1);
+            case BOT_SYMDIFF: return IntSetVal::symdiff(v0,v1);
+            case BOT_INTERSECT: return IntSetVal::intersect(v0,v1);
             default: throw EvalError(env, e->loc(),"not a set of bool expression", bo->opToString());
           }
         } else if (lhs->type().isbool() && rhs->type().isbool()) {
@@ -1485,8 +1663,29 @@ namespace MiniZinc {
         }
       } else {
         if (vd->e()) {
+          if (!vd->toplevel()) {
+            BottomUpIterator<ComputeIntBounds> cbi(*this);
+            cbi.run(vd->e());
+            return;
+          }
+          // The right hand side of a top-level variable does not change
+          // its meaning, so its bounds can be cached
+          UNORDERED_NAMESPACE::unordered_map<VarDecl*,IntBounds>::iterator it =
+            env.intBoundsCache.find(vd);
+          if (it != env.intBoundsCache.end()) {
+            env.boundsHits++;
+            valid = valid && it->second.valid;
+            _bounds.push_back(Bounds(it->second.l,it->second.u));
+            return;
+          }
+          bool wasValid = valid;
           BottomUpIterator<ComputeIntBounds> cbi(*this);
           cbi.run(vd->e());
+          if (wasValid) {
+            env.boundsMisses++;
+            env.intBoundsCache.insert(std::make_pair(vd, valid ? IntBounds(_bounds.back().first,_bounds.back().second,true)
+                                                             : IntBounds(0,0,false)));
+          }
         } else {
           _bounds.push_back(Bounds(-IntVal::infinity(),IntVal::infinity()));
         }
@@ -1769,6 +1968,8 @@ namespace MiniZinc {
   };
 
   IntBounds compute_int_bounds(EnvI& env, Expression* e) {
+    GCLock lock;
+    env.checkBoundsCache();
     ComputeIntBounds cb(env);
     BottomUpIterator<ComputeIntBounds> cbi(cb);
     cbi.run(e);
@@ -1842,8 +2043,27 @@ namespace MiniZinc {
         _bounds.push_back(FBounds(eval_float(env,bo->lhs()),eval_float(env,bo->rhs())));
       } else {
         if (vd->e()) {
+          if (!vd->toplevel()) {
+            BottomUpIterator<ComputeFloatBounds> cbi(*this);
+            cbi.run(vd->e());
+            return;
+          }
+          UNORDERED_NAMESPACE::unordered_map<VarDecl*,FloatBounds>::iterator it =
+            env.floatBoundsCache.find(vd);
+          if (it != env.floatBoundsCache.end()) {
+            env.boundsHits++;
+            valid = valid && it->second.valid;
+            _bounds.push_back(FBounds(it->second.l,it->second.u));
+            return;
+          }
+          bool wasValid = valid;
           BottomUpIterator<ComputeFloatBounds> cbi(*this);
           cbi.run(vd->e());
+          if (wasValid) {
+            env.boundsMisses++;
+            env.floatBoundsCache.insert(std::make_pair(vd, valid ? FloatBounds(_bounds.back().first,_bounds.back().second,true)
+                                                               : FloatBounds(0.0,0.0,false)));
+          }
         } else {
           valid = false;
           _bounds.push_back(FBounds(0,0));
@@ -2068,6 +2288,8 @@ namespace MiniZinc {
   };
   
   FloatBounds compute_float_bounds(EnvI& env, Expression* e) {
+    GCLock lock;
+    env.checkBoundsCache();
     ComputeFloatBounds cb(env);
     BottomUpIterator<ComputeFloatBounds> cbi(cb);
     cbi.run(e);
@@ -2108,16 +2330,13 @@ namespace MiniZinc {
 
       IntSetVal* isv = IntSetVal::a();
       for (unsigned int i=0; i<sl.v().size(); i++) {
-        IntSetRanges i0(isv);
         IntBounds ib = compute_int_bounds(env,sl.v()[i]);
         if (!ib.valid || !ib.l.isFinite() || !ib.u.isFinite()) {
           valid = false;
           _bounds.push_back(NULL);
           return;
         }
-        Ranges::Const cr(ib.l,ib.u);
-        Ranges::Union<IntSetRanges, Ranges::Const> u(i0,cr);
-        isv = IntSetVal::ai(u);
+        isv = IntSetVal::unite(isv, IntSetVal::a(ib.l,ib.u));
       }
       _bounds.push_back(isv);
     }
@@ -2193,12 +2412,7 @@ namespace MiniZinc {
         switch (bo.op()) {
         case BOT_INTERSECT:
         case BOT_UNION:
-          {
-            IntSetRanges b0r(b0);
-            IntSetRanges b1r(b1);
-            Ranges::Union<IntSetRanges,IntSetRanges> u(b0r,b1r);
-            _bounds.push_back(IntSetVal::ai(u));
-          }
+          _bounds.push_back(IntSetVal::unite(b0,b1));
           break;
         case BOT_DIFF:
           {
@@ -2247,10 +2461,7 @@ namespace MiniZinc {
       if (valid && (c.id() == "set_intersect" || c.id() == "set_union")) {
         IntSetVal* b0 = _bounds.back(); _bounds.pop_back();
         IntSetVal* b1 = _bounds.back(); _bounds.pop_back();
-        IntSetRanges b0r(b0);
-        IntSetRanges b1r(b1);
-        Ranges::Union<IntSetRanges,IntSetRanges> u(b0r,b1r);
-        _bounds.push_back(IntSetVal::ai(u));
+        _bounds.push_back(IntSetVal::unite(b0,b1));
       } else if (valid && c.id() == "set_diff") {
         IntSetVal* b0 = _bounds.back(); _bounds.pop_back();
         _bounds.pop_back(); // don't need bounds of right hand side
@@ -29,6 +29,12 @@
 #endif
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <fstream>
 
 namespace MiniZinc { namespace FileUtils {
   
@@ -127,5 +133,61 @@ namespace MiniZinc { namespace FileUtils {
     return rp_s;
 #endif
   }
+
+  FileContents::FileContents(void) : _data(""), _size(0), _mapped(false) {}
+
+  FileContents::~FileContents(void) {
+    close();
+  }
+
+  bool
+  FileContents::open(const std::string& filename) {
+    close();
+#ifndef _WIN32
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !(info.st_mode & S_IFREG)) {
+      ::close(fd);
+      return false;
+    }
+    if (info.st_size == 0) {
+      ::close(fd);
+      return true;
+    }
+    void* p = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p != MAP_FAILED) {
+      madvise(p, info.st_size, MADV_SEQUENTIAL);
+      _data = static_cast<const char*>(p);
+      _size = info.st_size;
+      _mapped = true;
+      return true;
+    }
+#endif
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if (!file.is_open())
+      return false;
+    file.seekg(0, std::ios::end);
+    _buffer.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0, std::ios::beg);
+    file.read(&_buffer[0], _buffer.size());
+    _data = _buffer.c_str();
+    _size = _buffer.size();
+    return true;
+  }
+
+  void
+  FileContents::close(void) {
+#ifndef _WIN32
+    if (_mapped)
+      munmap(const_cast<char*>(_data), _size);
+#endif
+    _buffer.clear();
+    _data = "";
+    _size = 0;
+    _mapped = false;
+  }
   
 }}
@@ -16,9 +16,12 @@
 #include <minizinc/astexception.hh>
 #include <minizinc/optimize.hh>
 #include <minizinc/astiterator.hh>
+#include <minizinc/typecheck.hh>
 
 #include <minizinc/stl_map_set.hh>
 
+#include <limits>
+
 #include <minizinc/flatten_internal.hh>
 
 // temporary
@@ -171,7 +174,7 @@ namespace MiniZinc {
 
 #define MZN_FILL_REIFY_MAP(T,ID) reifyMap.insert(std::pair<ASTString,ASTString>(constants().ids.T.ID,constants().ids.T ## reif.ID));
 
-  EnvI::EnvI(Model* orig0, const FlatteningOptions& fopt0) : orig(orig0), output(new Model), ignorePartial(false), maxCallStack(0), collect_vardecls(false), in_redundant_constraint(0), _flat(new Model), ids(0), fopt(fopt0) {
+  EnvI::EnvI(Model* orig0, const FlatteningOptions& fopt0) : orig(orig0), output(new Model), ignorePartial(false), maxCallStack(0), collect_vardecls(false), in_redundant_constraint(0), parCallHits(0), parCallMisses(0), boundsEpoch(0), boundsHits(0), boundsMisses(0), removedItems(NULL), lazyTypecheck(NULL), copyMapSize(0), _flat(new Model), ids(0), fopt(fopt0) {
     MZN_FILL_REIFY_MAP(int_,lin_eq);
     MZN_FILL_REIFY_MAP(int_,lin_le);
     MZN_FILL_REIFY_MAP(int_,lin_ne);
@@ -208,7 +211,7 @@ namespace MiniZinc {
   }
   EnvI::EnvI(Model* orig0, Model* output0, Model* flat0,  CopyMap& cmap0,
              IdMap<KeepAlive> reverseMappers0, unsigned int ids0, const FlatteningOptions& fopt0) : orig(orig0), output(output0), cmap(cmap0),
-                                                 reverseMappers(reverseMappers0), _flat(flat0), ids(ids0), fopt(fopt0) {  
+                                                 reverseMappers(reverseMappers0), parCallHits(0), parCallMisses(0), boundsEpoch(0), boundsHits(0), boundsMisses(0), removedItems(NULL), lazyTypecheck(NULL), copyMapSize(0), _flat(flat0), ids(ids0), fopt(fopt0) {  
     MZN_FILL_REIFY_MAP(int_,lin_eq);
     MZN_FILL_REIFY_MAP(int_,lin_le);
     MZN_FILL_REIFY_MAP(int_,lin_ne);
@@ -245,6 +248,7 @@ namespace MiniZinc {
   }
      
   EnvI::~EnvI(void) {
+    delete lazyTypecheck;
     delete _flat;
     delete output;
   }
@@ -252,6 +256,12 @@ namespace MiniZinc {
   EnvI::genId(void) {
       return ids++;
     }
+  long long int
+  EnvI::genIds(unsigned int n) {
+    long long int first = ids;
+    ids += n;
+    return first;
+  }
   void EnvI::map_insert(Expression* e, const EE& ee) {
       KeepAlive ka(e);
       map.insert(ka,WW(ee.r(),ee.b()));
@@ -378,9 +388,11 @@ namespace MiniZinc {
   
   void EnvI::flat_removeItem(MiniZinc::Item* i) {
     i->remove();
+    if (removedItems)
+      removedItems->push_back(i);
   }
   void EnvI::flat_removeItem(int i) {
-    (*_flat)[i]->remove();
+    flat_removeItem((*_flat)[i]);
   }
   
   void EnvI::collectVarDecls(bool b) {
@@ -506,34 +518,41 @@ namespace MiniZinc {
   Env::dumpErrorStack(std::ostream& os) {
     return e->dumpStack(os, true);
   }
+  namespace {
+    /// Add copies of the occurrences passed to operator() to a VarOccurrences index
+    class CopyOccurrences {
+    protected:
+      EnvI& _env;
+      CopyMap& _cmap;
+      VarOccurrences& _vo;
+    public:
+      CopyOccurrences(EnvI& env, CopyMap& cmap, VarOccurrences& vo)
+      : _env(env), _cmap(cmap), _vo(vo) {}
+      void operator()(Id* id, Item* item) {
+        _vo.add(copy(_env,_cmap,id)->cast<Id>()->decl(), copy(_env,_cmap,item));
+      }
+    };
+  }
+
   Env*
   Env::copyEnv(CopyMap& cmap) {
+    // The copy cannot check bodies on demand, since it has no type checker state
+    if (e->lazyTypecheck)
+      e->lazyTypecheck->checkAll(envi());
+    // The scopes of a search copy the same environment repeatedly
+    cmap.reserve(e->copyMapSize);
     Model* c_orig = copy(envi(),cmap, e->orig, false);
     Model* c_output = copy(envi(),cmap, e->output, false);
     Model* c_flat = copy(envi(),cmap, e->flat(), false);
     VarOccurrences c_vo;    
-    for(IdMap<UNORDERED_NAMESPACE::unordered_set<Item*> >::iterator it = e->vo._m.begin(); it!=e->vo._m.end(); it++) {
-      UNORDERED_NAMESPACE::unordered_set<Item*> items = it->second;
-      UNORDERED_NAMESPACE::unordered_set<Item*> c_items;
-      for(UNORDERED_NAMESPACE::unordered_set<Item*>::iterator iit = items.begin(); iit!=items.end(); iit++) {
-         c_items.insert(copy(envi(),cmap,*iit));
-      }
-      c_vo._m.insert(copy(envi(),cmap,it->first)->dyn_cast<Id>(),
-                     c_items);
-    }
+    CopyOccurrences copy_vo(envi(), cmap, c_vo);
+    e->vo.forEach(copy_vo);
     for(IdMap<int>::iterator it = e->vo.idx.begin(); it!=e->vo.idx.end(); it++) {
       c_vo.idx.insert(copy(envi(),cmap, it->first)->dyn_cast<Id>(), it->second);
     }
     VarOccurrences c_output_vo;    
-    for(IdMap<UNORDERED_NAMESPACE::unordered_set<Item*> >::iterator it = e->output_vo._m.begin(); it!=e->output_vo._m.end(); it++) {
-      UNORDERED_NAMESPACE::unordered_set<Item*> items = it->second;
-      UNORDERED_NAMESPACE::unordered_set<Item*> c_items;
-      for(UNORDERED_NAMESPACE::unordered_set<Item*>::iterator iit = items.begin(); iit!=items.end(); iit++) {
-         c_items.insert(copy(envi(),cmap,*iit));
-      }
-      c_output_vo._m.insert(copy(envi(),cmap,it->first)->dyn_cast<Id>(),
-                     c_items);
-    }
+    CopyOccurrences copy_output_vo(envi(), cmap, c_output_vo);
+    e->output_vo.forEach(copy_output_vo);
     for(IdMap<int>::iterator it = e->output_vo.idx.begin(); it!=e->output_vo.idx.end(); it++) {
       c_output_vo.idx.insert(copy(envi(),cmap, it->first)->dyn_cast<Id>(), it->second);
     }       
@@ -568,8 +587,8 @@ namespace MiniZinc {
     }
     unsigned int ids_c = e->get_ids();
     Env* c = new Env(c_orig, c_output, c_flat, cmap, c_reverseMappers, ids_c, e->fopt);
-    if (combinator)
-      c->combinator = copy(envi(),cmap, combinator);
+    if (combinator())
+      c->combinator = copy(envi(),cmap, combinator());
     else
       c->combinator = NULL;
     
@@ -593,6 +612,8 @@ namespace MiniZinc {
         c->e->map_insert(e,c_ww);
       }          
     }
+    e->copyMapSize = cmap.size();
+    c->e->copyMapSize = cmap.size();
     return c; 
     // the ASTStringMap<ASTString>::t reifyMap is set in the EnvI constructor and is not changed afterwards so we need not copy it
   }
@@ -931,10 +952,7 @@ namespace MiniZinc {
           IntSetVal* domain = eval_intset(env,id->decl()->ti()->domain());
           if (domain->min() >= lb)
             return false;
-          IntSetRanges dr(domain);
-          Ranges::Const cr(lb,IntVal::infinity());
-          Ranges::Inter<IntSetRanges,Ranges::Const> i(dr,cr);
-          IntSetVal* newibv = IntSetVal::ai(i);
+          IntSetVal* newibv = IntSetVal::intersect(domain,lb,IntVal::infinity());
           id->decl()->ti()->domain(new SetLit(Location().introduce(), newibv));
           id->decl()->ti()->setComputedDomain(false);
         } else {
@@ -949,10 +967,7 @@ namespace MiniZinc {
           IntSetVal* domain = eval_intset(env,id->decl()->ti()->domain());
           if (domain->max() <= ub)
             return false;
-          IntSetRanges dr(domain);
-          Ranges::Const cr(-IntVal::infinity(), ub);
-          Ranges::Inter<IntSetRanges,Ranges::Const> i(dr,cr);
-          IntSetVal* newibv = IntSetVal::ai(i);
+          IntSetVal* newibv = IntSetVal::intersect(domain,-IntVal::infinity(),ub);
           id->decl()->ti()->domain(new SetLit(Location().introduce(), newibv));
           id->decl()->ti()->setComputedDomain(false);
         } else {
@@ -980,10 +995,7 @@ namespace MiniZinc {
             IntSetVal* domain = eval_intset(env,id->decl()->ti()->domain());
             if (domain->max() <= ub && domain->min() >= lb)
               return false;
-            IntSetRanges dr(domain);
-            Ranges::Const cr(lb, ub);
-            Ranges::Inter<IntSetRanges,Ranges::Const> i(dr,cr);
-            IntSetVal* newibv = IntSetVal::ai(i);
+            IntSetVal* newibv = IntSetVal::intersect(domain,lb,ub);
             id->decl()->ti()->domain(new SetLit(Location().introduce(), newibv));
             id->decl()->ti()->setComputedDomain(false);
           } else {
@@ -1178,10 +1190,7 @@ namespace MiniZinc {
                 while (id != NULL) {
                   if (id->decl()->ti()->domain()) {
                     IntSetVal* domain = eval_intset(env,id->decl()->ti()->domain());
-                    IntSetRanges dr(domain);
-                    IntSetRanges ibr(ibv);
-                    Ranges::Inter<IntSetRanges,IntSetRanges> i(dr,ibr);
-                    IntSetVal* newibv = IntSetVal::ai(i);
+                    IntSetVal* newibv = IntSetVal::intersect(domain,ibv);
                     if (ibv->card() == newibv->card()) {
                       id->decl()->ti()->setComputedDomain(true);
                     } else {
@@ -1277,10 +1286,7 @@ namespace MiniZinc {
                         vdi->ti()->domain(vd->ti()->domain());
                       } else {
                         IntSetVal* vdi_dom = eval_intset(env, vdi->ti()->domain());
-                        IntSetRanges isvr(isv);
-                        IntSetRanges vdi_domr(vdi_dom);
-                        Ranges::Inter<IntSetRanges, IntSetRanges> inter(isvr,vdi_domr);
-                        IntSetVal* newdom = IntSetVal::ai(inter);
+                        IntSetVal* newdom = IntSetVal::intersect(isv,vdi_dom);
                         if (newdom->size()==0) {
                           env.flat()->fail(env);
                         } else {
@@ -1374,10 +1380,7 @@ namespace MiniZinc {
               if (ibv) {
                 if (vd->ti()->domain()) {
                   IntSetVal* domain = eval_intset(env,vd->ti()->domain());
-                  IntSetRanges dr(domain);
-                  IntSetRanges ibr(ibv);
-                  Ranges::Inter<IntSetRanges,IntSetRanges> i(dr,ibr);
-                  IntSetVal* newibv = IntSetVal::ai(i);
+                  IntSetVal* newibv = IntSetVal::intersect(domain,ibv);
                   if (ibv->card() == newibv->card()) {
                     vd->ti()->setComputedDomain(true);
                   } else {
@@ -2156,20 +2159,12 @@ namespace MiniZinc {
       IntSetVal* isv_else = compute_intset_bounds(env, ite->e_else());
       if (isv_else) {
         IntSetVal* isv = isv_else;
-        for (unsigned int i=0; i<r_bounds_set.size(); i++) {
-          IntSetRanges i0(isv);
-          IntSetRanges i1(r_bounds_set[i]);
-          Ranges::Union<IntSetRanges, IntSetRanges> u(i0,i1);
-          isv = IntSetVal::ai(u);
-        }
+        for (unsigned int i=0; i<r_bounds_set.size(); i++)
+          isv = IntSetVal::unite(isv,r_bounds_set[i]);
         if (r) {
           IntSetVal* orig_r_bounds = compute_intset_bounds(env,r->id());
-          if (orig_r_bounds) {
-            IntSetRanges i0(isv);
-            IntSetRanges i1(orig_r_bounds);
-            Ranges::Inter<IntSetRanges, IntSetRanges> inter(i0,i1);
-            isv = IntSetVal::ai(inter);
-          }
+          if (orig_r_bounds)
+            isv = IntSetVal::intersect(isv,orig_r_bounds);
         }
         SetLit* r_dom = new SetLit(Location().introduce(),isv);
         nr->ti()->domain(r_dom);
@@ -4292,10 +4287,7 @@ namespace MiniZinc {
                   bool changeDom = false;
                   if (id->decl()->ti()->domain()) {
                     IntSetVal* domain = eval_intset(env,id->decl()->ti()->domain());
-                    IntSetRanges dr(domain);
-                    IntSetRanges ibr(newdom);
-                    Ranges::Inter<IntSetRanges,IntSetRanges> i(dr,ibr);
-                    IntSetVal* newibv = IntSetVal::ai(i);
+                    IntSetVal* newibv = IntSetVal::intersect(domain,newdom);
                     if (domain->card() != newibv->card()) {
                       newdom = newibv;
                       changeDom = true;
@@ -5817,19 +5809,7 @@ namespace MiniZinc {
       }
     }
 
-    for (IdMap<VarOccurrences::Items>::iterator it = e.output_vo._m.begin();
-         it != e.output_vo._m.end(); ++it) {
-      std::vector<Item*> toRemove;
-      for (VarOccurrences::Items::iterator iit = it->second.begin();
-           iit != it->second.end(); ++iit) {
-        if ((*iit)->removed()) {
-          toRemove.push_back(*iit);
-        }
-      }
-      for (unsigned int i=0; i<toRemove.size(); i++) {
-        it->second.erase(toRemove[i]);
-      }
-    }
+    e.output_vo.compact();
   }
   
   void cleanupOutput(EnvI& env) {
@@ -6310,31 +6290,30 @@ namespace MiniZinc {
     return ee;
   }
   
-  void flatten(Env& e, FlatteningOptions opt) {
-    EnvI& env = e.envi();
+  namespace {
 
-    
+    /// Flatten declarations of arrays of variables that have no right hand side
     class ExpandArrayDecls : public ItemVisitor {
     public:
       EnvI& env;
       ExpandArrayDecls(EnvI& env0) : env(env0) {}
-      void vVarDeclI(VarDeclI* v) {       
-        if (v->e()->type().isvar() && v->e()->type().dim() > 0 && v->e()->e() == NULL) {         
-          (void) flat_exp(env,Ctx(),v->e()->id(),NULL,constants().var_true);          
-        }       
+      void vVarDeclI(VarDeclI* v) {
+        if (v->e()->type().isvar() && v->e()->type().dim() > 0 && v->e()->e() == NULL) {
+          (void) flat_exp(env,Ctx(),v->e()->id(),NULL,constants().var_true);
+        }
       }
-    } _ead(env);
-    iterItems<ExpandArrayDecls>(_ead,e.model());;
-    
-    bool hadSolveItem = false;
-    // Flatten main model
-    class FV : public ItemVisitor {
+    };
+
+    /// Flatten the items of the main model (constraint items only if \a withConstraints is set)
+    class FlattenItems : public ItemVisitor {
     public:
       EnvI& env;
-      bool& hadSolveItem;
-      FV(EnvI& env0, bool& hadSolveItem0) : env(env0), hadSolveItem(hadSolveItem0) {}
+      bool withConstraints;
+      bool hadSolveItem;
+      FlattenItems(EnvI& env0, bool withConstraints0)
+        : env(env0), withConstraints(withConstraints0), hadSolveItem(false) {}
       bool enter(Item* i) {
-        return !(i->isa<ConstraintI>()  && env.flat()->failed());
+        return !(i->isa<ConstraintI>() && (!withConstraints || env.flat()->failed()));
       }
       void vVarDeclI(VarDeclI* v) {
         if (v->e()->type().isvar() || v->e()->type().isann()) {
@@ -6374,9 +6353,9 @@ namespace MiniZinc {
         }
       }
       void vConstraintI(ConstraintI* ci) {
-        (void) flat_exp(env,Ctx(),ci->e(),constants().var_true,constants().var_true);        
+        (void) flat_exp(env,Ctx(),ci->e(),constants().var_true,constants().var_true);
       }
-      void vSolveI(SolveI* si) {        
+      void vSolveI(SolveI* si) {
         if (hadSolveItem)
           throw FlatteningError(env,si->loc(), "Only one solve item allowed");
         hadSolveItem = true;
@@ -6404,17 +6383,100 @@ namespace MiniZinc {
         }
         env.flat_addItem(nsi);
       }
-    } _fv(env,hadSolveItem);
-    iterItems<FV>(_fv,e.model());
-    
+    };
+
+    /// Flatten items of \a e, throws an error if the model has no solve item
+    void flattenItems(Env& e, bool withConstraints) {
+      EnvI& env = e.envi();
+      ExpandArrayDecls _ead(env);
+      iterItems<ExpandArrayDecls>(_ead,e.model());
 
-    if (!hadSolveItem) {
-      e.envi().errorStack.clear();
-      Location modelLoc;
-      modelLoc.filename = e.model()->filepath();
-      throw FlatteningError(e.envi(),modelLoc, "Model does not have a solve item");
+      FlattenItems _fv(env,withConstraints);
+      iterItems<FlattenItems>(_fv,e.model());
+
+      if (!_fv.hadSolveItem) {
+        e.envi().errorStack.clear();
+        Location modelLoc;
+        modelLoc.filename = e.model()->filepath();
+        throw FlatteningError(e.envi(),modelLoc, "Model does not have a solve item");
+      }
     }
-    
+
+    /// Return the comprehension of \a ci if it is a forall that can be flattened in parts, or NULL
+    Comprehension* constraintParts(EnvI& env, ConstraintI* ci) {
+      Call* c = ci->e()->dyn_cast<Call>();
+      if (c==NULL || c->id() != constants().ids.forall || c->args().size() != 1)
+        return NULL;
+      Comprehension* comp = c->args()[0]->dyn_cast<Comprehension>();
+      if (comp==NULL || comp->set() || comp->type().isopt() ||
+          !comp->e()->type().isbool() || comp->e()->type().isopt())
+        return NULL;
+      for (int i=0; i<comp->n_generators(); i++)
+        if (!comp->in(i)->type().ispar())
+          return NULL;
+      if (comp->where() && !comp->where()->type().ispar())
+        return NULL;
+      // Only the builtin forall posts its elements one by one in root context
+      FunctionI* decl = env.orig->matchFn(env,c);
+      if (decl==NULL || decl->e() != NULL)
+        return NULL;
+      return comp;
+    }
+
+    /// Count the elements of a comprehension, flattening those from \a begin to \a end-1 in root context
+    class FlattenParts {
+    public:
+      typedef bool ArrayVal;
+      unsigned int n;
+      unsigned int begin;
+      unsigned int end;
+      FlattenParts(unsigned int begin0, unsigned int end0) : n(0), begin(begin0), end(end0) {}
+      bool e(EnvI& env, Expression* e0) {
+        if (n >= begin && n < end)
+          (void) flat_exp(env,Ctx(),e0,constants().var_true,constants().var_true);
+        n++;
+        return true;
+      }
+    };
+
+  }
+
+  void flatten(Env& e, FlatteningOptions opt) {
+    flattenItems(e, true);
+    flattenFinish(e, opt);
+  }
+
+  void flattenDecls(Env& e) {
+    flattenItems(e, false);
+  }
+
+  unsigned int constraintPartCount(Env& e, ConstraintI* ci) {
+    EnvI& env = e.envi();
+    Comprehension* comp = constraintParts(env, ci);
+    if (comp==NULL)
+      return 0;
+    FlattenParts count(0,0);
+    (void) eval_comp<FlattenParts>(env,count,comp);
+    return count.n;
+  }
+
+  void flattenConstraint(Env& e, ConstraintI* ci, unsigned int begin, unsigned int end) {
+    EnvI& env = e.envi();
+    if (env.flat()->failed())
+      return;
+    Comprehension* comp = constraintParts(env, ci);
+    if (comp==NULL) {
+      (void) flat_exp(env,Ctx(),ci->e(),constants().var_true,constants().var_true);
+    } else {
+      CallStackItem _csi_call(env,ci->e());
+      CallStackItem _csi_comp(env,comp);
+      FlattenParts parts(begin,end);
+      (void) eval_comp<FlattenParts>(env,parts,comp);
+    }
+  }
+
+  void flattenFinish(Env& e, FlatteningOptions opt) {
+    EnvI& env = e.envi();
     // Create output model
     if (opt.keepOutputInFzn) {
       copyOutput(env);
@@ -6425,25 +6487,13 @@ namespace MiniZinc {
     flatten_loop(env, 0, opt);
   }
   
-  void oldflatzinc_basic(Env& e) {
-    Model* m = e.flat();
-    for (unsigned int i=0; i<m->size(); i++) {
-      Item* item = (*m)[i];
-      if (item->isa<VarDeclI>() &&
-          (item->cast<VarDeclI>()->e()->type().ot() == Type::OT_OPTIONAL ||
-           item->cast<VarDeclI>()->e()->type().bt() == Type::BT_ANN) ) {
-            e.envi().flat_removeItem(i);
-          }
-    }
+  namespace {
 
-    EnvI& env = e.envi();
-    
-    int msize = m->size();
-    UNORDERED_NAMESPACE::unordered_set<Item*> globals;
-    std::vector<int> declsWithIds;
-    for (int i=0; i<msize; i++) {
-      if ((*m)[i]->removed())
-        continue;
+    /// Convert item \a i of the flat model of \a e to old FlatZinc
+    void oldflatzinc_item(Env& e, int i, std::vector<int>* declsWithIds,
+                          UNORDERED_NAMESPACE::unordered_set<Item*>& globals) {
+      Model* m = e.flat();
+      EnvI& env = e.envi();
       if (VarDeclI* vdi = (*m)[i]->dyn_cast<VarDeclI>()) {
         GCLock lock;
         VarDecl* vd = vdi->e();
@@ -6458,8 +6508,8 @@ namespace MiniZinc {
         vd->ann().remove(constants().ctx.root);
         vd->ann().remove(constants().ann.promise_total);
         
-        if (vd->e() && vd->e()->isa<Id>()) {
-          declsWithIds.push_back(i);
+        if (declsWithIds && vd->e() && vd->e()->isa<Id>()) {
+          declsWithIds->push_back(i);
           vdi->e()->payload(-static_cast<int>(i)-1);
         } else {
           vdi->e()->payload(i);
@@ -6621,7 +6671,7 @@ namespace MiniZinc {
               vd->ti()->ranges()[0]->domain()->isa<SetLit>()) {
             IntSetVal* isv = vd->ti()->ranges()[0]->domain()->cast<SetLit>()->isv();
             if (isv && (isv->size()==0 || isv->min(0)==1))
-              continue;
+              return;
           }
           assert(vd->e() != NULL);
           ArrayLit* al = NULL;
@@ -6747,53 +6797,51 @@ namespace MiniZinc {
         }
       }
     }
-    
-    std::vector<VarDeclI*> sortedVarDecls(declsWithIds.size());
-    int vdCount = 0;
-    for (unsigned int i=0; i<declsWithIds.size(); i++) {
-      VarDecl* cur = (*m)[declsWithIds[i]]->cast<VarDeclI>()->e();
-      std::vector<int> stack;
-      while (cur && cur->payload() < 0) {
-        stack.push_back(cur->payload());
-        if (Id* id = cur->e()->dyn_cast<Id>()) {
-          cur = id->decl();
-        } else {
-          cur = NULL;
+
+    /**
+     * \brief Check whether item \a i needs to be converted again
+     *
+     * Flattening new items and simplifying them can fix or define
+     * Boolean variables and rewrite constraints that have already been
+     * converted to old FlatZinc.
+     */
+    bool oldflatzinc_changed(Item* i) {
+      if (VarDeclI* vdi = i->dyn_cast<VarDeclI>()) {
+        VarDecl* vd = vdi->e();
+        if (vd->type().isvar() && vd->type().dim()==0) {
+          if (vd->e() && vd->e()->isa<Call>())
+            return true;
+          if (vd->type().isbool()) {
+            if (vd->ti()->domain() != NULL)
+              return true;
+            // Boolean variables that are reused get context annotations
+            if (!vd->ann().isEmpty())
+              return vd->ann().contains(constants().ctx.pos) || vd->ann().contains(constants().ctx.neg) ||
+                     vd->ann().contains(constants().ctx.mix) || vd->ann().contains(constants().ctx.root);
+          }
         }
+      } else if (ConstraintI* ci = i->dyn_cast<ConstraintI>()) {
+        Call* c = ci->e()->dyn_cast<Call>();
+        return c==NULL || c->id()==constants().ids.exists || c->id()==constants().ids.forall ||
+               c->id()==constants().ids.clause ||
+               (c->id()==constants().ids.bool_xor && c->args().size()==2);
       }
-      for (unsigned int i=stack.size(); i--;) {
-        VarDeclI* vdi = (*m)[-stack[i]-1]->cast<VarDeclI>();
-        vdi->e()->payload(-vdi->e()->payload()-1);
-        sortedVarDecls[vdCount++] = vdi;
-      }
-    }
-    for (unsigned int i=0; i<declsWithIds.size(); i++) {
-      (*m)[declsWithIds[i]] = sortedVarDecls[i];
+      return false;
     }
 
-    for (IdMap<VarOccurrences::Items>::iterator it = env.vo._m.begin();
-         it != env.vo._m.end(); ++it) {
-      std::vector<Item*> toRemove;
-      for (VarOccurrences::Items::iterator iit = it->second.begin();
-           iit != it->second.end(); ++iit) {
-        if ((*iit)->removed()) {
-          toRemove.push_back(*iit);
+    /// Check whether item \a i at index \a idx declares an alias of a later variable
+    bool oldflatzinc_aliasesLater(EnvI& env, Item* i, unsigned int idx) {
+      if (VarDeclI* vdi = i->dyn_cast<VarDeclI>()) {
+        if (Id* id = Expression::dyn_cast<Id>(vdi->e()->e())) {
+          int target = env.vo.find(id->decl());
+          return target > static_cast<int>(idx);
         }
       }
-      for (unsigned int i=0; i<toRemove.size(); i++) {
-        it->second.erase(toRemove[i]);
-      }
+      return false;
     }
-  }
-  
-  void oldflatzinc_compact_sort(Env& e) {
-    Model* m = e.flat();
-    EnvI& env = e.envi();
-    m->compact();
-    env.vo.rebuild(m);
-    e.envi().output->compact();
 
-    class Cmp {
+    /// Order of items in old FlatZinc
+    class OldFlatZincOrder {
     public:
       bool operator() (Item* i, Item* j) {
         if (i->iid()==Item::II_FUN || j->iid()==Item::II_FUN) {
@@ -6835,8 +6883,147 @@ namespace MiniZinc {
         }
         return false;
       }
-    } _cmp;
-    std::stable_sort(m->begin(),m->end(),_cmp);     
+    };
+
+    /// Compact the flat model once more than one in this many items have been removed
+    const unsigned int oldflatzinc_compactRatio = 8;
+
+  }
+
+  void oldflatzinc_basic(Env& e) {
+    Model* m = e.flat();
+    EnvI& env = e.envi();
+    // The items before first have been converted by a previous call
+    unsigned int first = m->normalised();
+    for (unsigned int i=first; i<m->size(); i++) {
+      Item* item = (*m)[i];
+      if (item->isa<VarDeclI>() &&
+          (item->cast<VarDeclI>()->e()->type().ot() == Type::OT_OPTIONAL ||
+           item->cast<VarDeclI>()->e()->type().bt() == Type::BT_ANN) ) {
+            e.envi().flat_removeItem(i);
+          }
+    }
+
+    UNORDERED_NAMESPACE::unordered_set<Item*> globals;
+    for (unsigned int i=0; i<first && (*m)[i]->isa<FunctionI>(); i++)
+      globals.insert((*m)[i]);
+    
+    if (first > 0) {
+      // Convert the old items again that have been changed, and move
+      // declarations that now alias a later variable behind the old items
+      std::vector<Item*> moved;
+      unsigned int j = 0;
+      unsigned int k = 0;
+      for (unsigned int i=0; i<first; i++) {
+        Item* item = (*m)[i];
+        if (!item->removed()) {
+          if (oldflatzinc_aliasesLater(env, item, i)) {
+            if (moved.empty())
+              k = i;
+            moved.push_back(item);
+            continue;
+          }
+          if (j < i)
+            (*m)[j] = item;
+          if (oldflatzinc_changed(item))
+            oldflatzinc_item(e, j, NULL, globals);
+        } else if (j < i) {
+          (*m)[j] = item;
+        }
+        j++;
+      }
+      if (!moved.empty()) {
+        std::copy(moved.begin(), moved.end(), m->begin()+j);
+        for (unsigned int i=k; i<first; i++) {
+          if (VarDeclI* vdi = (*m)[i]->dyn_cast<VarDeclI>()) {
+            IdMap<int>::iterator it = env.vo.idx.find(vdi->e()->id());
+            if (it != env.vo.idx.end())
+              it->second = i;
+          }
+        }
+        first = j;
+        m->setNormalised(first);
+      }
+    }
+
+    int msize = m->size();
+    std::vector<int> declsWithIds;
+    for (int i=first; i<msize; i++) {
+      if (!(*m)[i]->removed())
+        oldflatzinc_item(e, i, &declsWithIds, globals);
+    }
+    
+    std::vector<VarDeclI*> sortedVarDecls(declsWithIds.size());
+    int vdCount = 0;
+    for (unsigned int i=0; i<declsWithIds.size(); i++) {
+      VarDecl* cur = (*m)[declsWithIds[i]]->cast<VarDeclI>()->e();
+      std::vector<int> stack;
+      while (cur && cur->payload() < 0) {
+        stack.push_back(cur->payload());
+        if (Id* id = cur->e()->dyn_cast<Id>()) {
+          cur = id->decl();
+        } else {
+          cur = NULL;
+        }
+      }
+      for (unsigned int i=stack.size(); i--;) {
+        VarDeclI* vdi = (*m)[-stack[i]-1]->cast<VarDeclI>();
+        vdi->e()->payload(-vdi->e()->payload()-1);
+        sortedVarDecls[vdCount++] = vdi;
+      }
+    }
+    for (unsigned int i=0; i<declsWithIds.size(); i++) {
+      (*m)[declsWithIds[i]] = sortedVarDecls[i];
+    }
+
+    if (first==0)
+      env.vo.compact();
+  }
+  
+  void oldflatzinc_compact_sort(Env& e) {
+    Model* m = e.flat();
+    EnvI& env = e.envi();
+    OldFlatZincOrder _cmp;
+    unsigned int first = m->normalised();
+    unsigned int nRemoved = 0;
+    for (unsigned int i=0; i<m->size(); i++) {
+      if ((*m)[i]->removed())
+        nRemoved++;
+    }
+    if (first==0 || nRemoved * oldflatzinc_compactRatio > m->size()) {
+      m->compact();
+      e.envi().output->compact();
+      std::stable_sort(m->begin(),m->end(),_cmp);
+      env.vo.rebuild(m);
+    } else if (first < m->size()) {
+      // The old items are in order already, so only the new items have to
+      // be sorted and merged into them
+      std::stable_sort(m->begin()+first,m->end(),_cmp);
+      unsigned int start = 0;
+      while (start < first && !_cmp((*m)[first],(*m)[start]))
+        start++;
+      std::vector<Item*> merged;
+      merged.reserve(m->size()-start);
+      unsigned int i = start;
+      unsigned int j = first;
+      while (i < first && j < m->size()) {
+        if (_cmp((*m)[j],(*m)[i]))
+          merged.push_back((*m)[j++]);
+        else
+          merged.push_back((*m)[i++]);
+      }
+      merged.insert(merged.end(), m->begin()+i, m->begin()+first);
+      merged.insert(merged.end(), m->begin()+j, m->end());
+      std::copy(merged.begin(), merged.end(), m->begin()+start);
+      for (unsigned int k=start; k<m->size(); k++) {
+        if (VarDeclI* vdi = (*m)[k]->dyn_cast<VarDeclI>()) {
+          IdMap<int>::iterator it = env.vo.idx.find(vdi->e()->id());
+          if (it != env.vo.idx.end())
+            it->second = k;
+        }
+      }
+    }
+    m->setNormalised(m->size());
   }
   
   void oldflatzinc(Env& e) {
@@ -6847,6 +7034,10 @@ namespace MiniZinc {
   FlatModelStatistics statistics(Env& m) {
     Model* flat = m.flat();
     FlatModelStatistics stats;
+    stats.n_par_call_hits = m.envi().parCallHits;
+    stats.n_par_call_misses = m.envi().parCallMisses;
+    stats.n_bounds_hits = m.envi().boundsHits;
+    stats.n_bounds_misses = m.envi().boundsMisses;
     for (unsigned int i=0; i<flat->size(); i++) {
       if (!(*flat)[i]->removed()) {
         if (VarDeclI* vdi = (*flat)[i]->dyn_cast<VarDeclI>()) {
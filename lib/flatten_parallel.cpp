@@ -0,0 +1,526 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// <thread> has to be included before SafeInt3.hpp, which redefines nullptr
+#include <thread>
+
+#include <minizinc/flatten_parallel.hh>
+#include <minizinc/astiterator.hh>
+#include <minizinc/binary_ast.hh>
+#include <minizinc/eval_par.hh>
+#include <minizinc/exception.hh>
+#include <minizinc/flatten_internal.hh>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+
+namespace MiniZinc {
+
+  namespace {
+
+    /// Maximum number of chunks the constraints are split into
+    const unsigned int maxChunks = 64;
+
+    /// Elements \a begin to \a end-1 of constraint item number \a item (see flattenConstraint)
+    struct ChunkPart {
+      unsigned int item;
+      unsigned int begin;
+      unsigned int end;
+      ChunkPart(unsigned int item0, unsigned int begin0, unsigned int end0)
+        : item(item0), begin(begin0), end(end0) {}
+    };
+
+    /// Status of a chunk
+    enum ChunkStatus { CS_PENDING, CS_DONE, CS_REJECTED };
+
+    /// Result of flattening a chunk in a worker
+    struct ChunkResult {
+      ChunkStatus status;
+      /// The serialised new flat items
+      std::string data;
+      ChunkResult(void) : status(CS_PENDING) {}
+    };
+
+    /// Collect the constraint items of a model in the order in which they are flattened
+    class CollectConstraints : public ItemVisitor {
+    public:
+      std::vector<ConstraintI*>& cs;
+      CollectConstraints(std::vector<ConstraintI*>& cs0) : cs(cs0) {}
+      void vConstraintI(ConstraintI* ci) { cs.push_back(ci); }
+    };
+
+    /// Return the constraint items of \a env
+    std::vector<ConstraintI*> constraintItems(Env& env) {
+      std::vector<ConstraintI*> cs;
+      CollectConstraints cc(cs);
+      iterItems<CollectConstraints>(cc,env.model());
+      return cs;
+    }
+
+    /**
+     * \brief Description of a flat model after flattenDecls
+     *
+     * Workers compare their flat model with the one of the main instance
+     * before flattening a chunk, so that declarations can be referred to
+     * by their position.
+     */
+    struct Baseline {
+      /// Identifier of each flat item (empty for items other than declarations)
+      std::vector<std::string> items;
+      /// Value of the identifier counter
+      unsigned int ids;
+      /// Number of constraint items in the original model
+      unsigned int nConstraints;
+      /// Number of warnings
+      unsigned int nWarnings;
+      /// Describe the flat model of \a env
+      void init(Env& env) {
+        Model* flat = env.flat();
+        items.resize(flat->size());
+        for (unsigned int i=0; i<flat->size(); i++) {
+          if (VarDeclI* vdi = (*flat)[i]->dyn_cast<VarDeclI>()) {
+            std::ostringstream oss;
+            oss << *vdi->e()->id();
+            items[i] = oss.str();
+          } else {
+            items[i].clear();
+          }
+        }
+        ids = env.envi().get_ids();
+        nConstraints = static_cast<unsigned int>(constraintItems(env).size());
+        nWarnings = static_cast<unsigned int>(env.warnings().size());
+      }
+      bool operator ==(const Baseline& b) const {
+        return ids==b.ids && nConstraints==b.nConstraints &&
+          nWarnings==b.nWarnings && items==b.items;
+      }
+    };
+
+    /// State of a flat item before a chunk is flattened
+    struct ItemState {
+      bool removed;
+      Expression* e;
+      TypeInst* ti;
+      Expression* domain;
+      VarDecl* flat;
+      unsigned int nAnn;
+      /// Record the state of \a item
+      explicit ItemState(Item* item)
+        : removed(item->removed()), e(NULL), ti(NULL), domain(NULL), flat(NULL), nAnn(0) {
+        if (VarDeclI* vdi = item->dyn_cast<VarDeclI>()) {
+          VarDecl* vd = vdi->e();
+          e = vd->e();
+          ti = vd->ti();
+          domain = ti->domain();
+          flat = vd->flat();
+          for (ExpressionSetIter it = vd->ann().begin(); it != vd->ann().end(); ++it)
+            nAnn++;
+        } else if (ConstraintI* ci = item->dyn_cast<ConstraintI>()) {
+          e = ci->e();
+        }
+      }
+      /// Return whether \a item is unchanged apart from its domain
+      bool sameExceptDomain(const ItemState& s) const {
+        return removed==s.removed && e==s.e && ti==s.ti && flat==s.flat && nAnn==s.nAnn;
+      }
+    };
+
+    /// Check that all identifiers refer to known declarations
+    class CheckDecls : public EVisitor {
+    public:
+      const UNORDERED_NAMESPACE::unordered_set<const VarDecl*>& known;
+      bool ok;
+      CheckDecls(const UNORDERED_NAMESPACE::unordered_set<const VarDecl*>& known0)
+        : known(known0), ok(true) {}
+      void vId(const Id& id) {
+        if (&id != constants().absent && id.decl() && known.find(id.decl())==known.end())
+          ok = false;
+      }
+    };
+
+    /// Set the declarations of all calls
+    class SetCallDecls : public EVisitor {
+    public:
+      EnvI& env;
+      SetCallDecls(EnvI& env0) : env(env0) {}
+      void vCall(Call& c) {
+        c.decl(env.orig->matchFn(env,&c));
+      }
+    };
+
+    /// State shared by the workers and the main thread
+    class ParallelState {
+    public:
+      const std::string& filename;
+      const std::vector<std::string>& datafiles;
+      /// Options for the worker instances
+      BatchOptions opts;
+      /// Sources shared by the workers
+      SharedSources* sources;
+      /// The flat model of the main instance after flattenDecls
+      Baseline baseline;
+      /// The chunks
+      std::vector<std::vector<ChunkPart> > chunks;
+      /// The results of the chunks
+      std::vector<ChunkResult> results;
+      /// Index of the next chunk to be flattened
+      std::atomic<size_t> next;
+      /// Whether the workers should stop
+      std::atomic<bool> stop;
+    protected:
+      /// Sources used if the prepared model does not share any
+      SharedSources _sources;
+      /// Mutex protecting the results
+      std::mutex _mutex;
+      /// Signalled when a result is available
+      std::condition_variable _cv;
+    public:
+      ParallelState(PreparedModel& pm, const std::vector<std::string>& datafiles0,
+                    const BatchOptions& opts0)
+        : filename(pm.filename()), datafiles(datafiles0), opts(opts0),
+          sources(pm.sources() ? pm.sources() : &_sources), next(0), stop(false) {
+        opts.verbose = false;
+        opts.flattenThreads = 0;
+      }
+      /// Store result \a data with status \a status for chunk \a i
+      void finish(size_t i, ChunkStatus status, std::string& data) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        results[i].status = status;
+        results[i].data.swap(data);
+        _cv.notify_all();
+      }
+      /// Wait for the result of chunk \a i
+      ChunkResult& wait(size_t i) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (results[i].status==CS_PENDING)
+          _cv.wait(lock);
+        return results[i];
+      }
+    };
+
+    /// Worker that flattens chunks until none are left
+    class FlatteningWorker {
+    protected:
+      ParallelState& _s;
+      /// The worker's copy of the model
+      PreparedModel _pm;
+      /// Flatten chunk \a i in \a env, returns false if it has to be flattened by the main thread
+      bool flattenChunk(Env& env, size_t i, std::string& data);
+    public:
+      /// Constructor
+      FlatteningWorker(ParallelState& s) : _s(s), _pm(s.filename,s.opts,s.sources) {}
+      /// Flatten chunks
+      void run(void);
+    };
+
+    bool
+    FlatteningWorker::flattenChunk(Env& env, size_t i, std::string& data) {
+      flattenDecls(env);
+      Baseline b;
+      b.init(env);
+      if (!(b==_s.baseline))
+        return false;
+
+      EnvI& envi = env.envi();
+      Model* flat = env.flat();
+      unsigned int nBase = flat->size();
+      std::vector<ItemState> before;
+      before.reserve(nBase);
+      for (unsigned int j=0; j<nBase; j++)
+        before.push_back(ItemState((*flat)[j]));
+      unsigned int nReverseMappers = 0;
+      for (IdMap<KeepAlive>::iterator it = envi.reverseMappers.begin(); it != envi.reverseMappers.end(); ++it)
+        nReverseMappers++;
+
+      std::vector<ConstraintI*> cs = constraintItems(env);
+      const std::vector<ChunkPart>& parts = _s.chunks[i];
+      for (unsigned int j=0; j<parts.size(); j++)
+        flattenConstraint(env, cs[parts[j].item], parts[j].begin, parts[j].end);
+
+      if (flat->failed() || envi.warnings.size() != b.nWarnings)
+        return false;
+      for (IdMap<KeepAlive>::iterator it = envi.reverseMappers.begin(); it != envi.reverseMappers.end(); ++it)
+        nReverseMappers--;
+      if (nReverseMappers != 0)
+        return false;
+
+      BinaryWriter body;
+      ASTWriter w(body);
+      UNORDERED_NAMESPACE::unordered_set<const VarDecl*> known;
+      std::vector<unsigned int> domains;
+      for (unsigned int j=0; j<nBase; j++) {
+        Item* item = (*flat)[j];
+        ItemState after(item);
+        if (!after.sameExceptDomain(before[j]))
+          return false;
+        if (VarDeclI* vdi = item->dyn_cast<VarDeclI>()) {
+          VarDecl* vd = vdi->e();
+          if (after.domain != before[j].domain) {
+            if (vd->type().dim() != 0 || !vd->type().isvar() ||
+                !(vd->type().isint() || vd->type().isbool()) || after.domain==NULL)
+              return false;
+            domains.push_back(j);
+          }
+          w.external(vd);
+          known.insert(vd);
+        }
+      }
+      for (unsigned int j=nBase; j<flat->size(); j++) {
+        Item* item = (*flat)[j];
+        if (VarDeclI* vdi = item->dyn_cast<VarDeclI>())
+          known.insert(vdi->e());
+        else if (!item->isa<ConstraintI>())
+          return false;
+      }
+      CheckDecls cd(known);
+      for (unsigned int j=nBase; j<flat->size() && cd.ok; j++) {
+        Item* item = (*flat)[j];
+        if (VarDeclI* vdi = item->dyn_cast<VarDeclI>())
+          topDown(cd, vdi->e());
+        else
+          topDown(cd, item->cast<ConstraintI>()->e());
+      }
+      if (!cd.ok)
+        return false;
+
+      body.writeUInt(envi.get_ids()-b.ids);
+      body.writeUInt(domains.size());
+      for (unsigned int j=0; j<domains.size(); j++) {
+        body.writeUInt(domains[j]);
+        w.write((*flat)[domains[j]]->cast<VarDeclI>()->e()->ti()->domain());
+      }
+      body.writeUInt(flat->size()-nBase);
+      for (unsigned int j=nBase; j<flat->size(); j++)
+        w.write((*flat)[j]);
+
+      BinaryWriter out;
+      out.writeUInt(w.strings().size());
+      for (unsigned int j=0; j<w.strings().size(); j++)
+        out.writeString(w.strings()[j]);
+      out.append(body);
+      data = out.str();
+      return true;
+    }
+
+    void
+    FlatteningWorker::run(void) {
+      std::ostringstream err;
+      bool prepared = _pm.prepare(err);
+      for (size_t i = _s.next++; i < _s.chunks.size() && !_s.stop; i = _s.next++) {
+        std::string data;
+        bool done = false;
+        if (prepared) {
+          if (Env* env = _pm.instantiate(_s.datafiles, _s.opts, err)) {
+            try {
+              done = flattenChunk(*env, i, data);
+            } catch (...) {
+              // The chunk is flattened again by the main thread, which reports the error
+              done = false;
+            }
+            _pm.release(env);
+          }
+        }
+        _s.finish(i, done ? CS_DONE : CS_REJECTED, data);
+      }
+    }
+
+    /// Split the constraint items \a cs of \a env into chunks of at least \a chunkSize constraints
+    void makeChunks(Env& env, const std::vector<ConstraintI*>& cs, unsigned int chunkSize,
+                    std::vector<std::vector<ChunkPart> >& chunks) {
+      std::vector<unsigned int> nParts(cs.size());
+      unsigned long long int total = 0;
+      for (unsigned int i=0; i<cs.size(); i++) {
+        if (env.flat()->failed())
+          break;
+        nParts[i] = constraintPartCount(env, cs[i]);
+        total += std::max(nParts[i], 1u);
+      }
+      unsigned long long int size = std::max(static_cast<unsigned long long int>(chunkSize),
+                                             (total+maxChunks-1)/maxChunks);
+      size = std::max(size, 1ull);
+      unsigned long long int fill = size;
+      for (unsigned int i=0; i<cs.size(); i++) {
+        unsigned int begin = 0;
+        do {
+          if (fill==size) {
+            chunks.push_back(std::vector<ChunkPart>());
+            fill = 0;
+          }
+          unsigned int end = nParts[i]==0 ? 0 :
+            static_cast<unsigned int>(std::min(static_cast<unsigned long long int>(nParts[i]),
+                                               begin+(size-fill)));
+          chunks.back().push_back(ChunkPart(i,begin,end));
+          fill += nParts[i]==0 ? 1 : end-begin;
+          begin = end;
+        } while (begin < nParts[i]);
+      }
+    }
+
+    /**
+     * \brief Return the domain of \a vd restricted to \a dom
+     *
+     * Returns the current domain if it is not changed, and NULL if the
+     * restricted domain is empty.
+     */
+    Expression* restrictedDomain(EnvI& env, VarDecl* vd, Expression* dom) {
+      Expression* cur = vd->ti()->domain();
+      if (vd->type().isbool()) {
+        if (cur==NULL)
+          return dom;
+        return Expression::equal(cur, dom) ? cur : NULL;
+      }
+      IntSetVal* isv = eval_intset(env, dom);
+      if (cur) {
+        IntSetVal* domain = eval_intset(env, cur);
+        isv = IntSetVal::intersect(domain,isv);
+        bool same = isv->size()==domain->size();
+        for (unsigned int j=0; same && j<isv->size(); j++)
+          same = isv->min(j)==domain->min(j) && isv->max(j)==domain->max(j);
+        if (same)
+          return cur;
+      }
+      if (isv->size()==0)
+        return NULL;
+      return new SetLit(Location().introduce(), isv);
+    }
+
+    /**
+     * \brief Add the flat items of chunk result \a data to \a env
+     *
+     * The declarations of the main instance that correspond to the ones of
+     * the worker instance after flattenDecls are given by \a baseDecls.
+     * Returns false (without changing \a env) if the data cannot be read
+     * or a domain would become empty.
+     */
+    bool mergeChunk(Env& env, const Baseline& baseline, const std::vector<VarDecl*>& baseDecls,
+                    const std::string& data) {
+      EnvI& envi = env.envi();
+      GCLock lock;
+      std::vector<std::pair<VarDecl*,Expression*> > domains;
+      std::vector<Item*> items;
+      unsigned int nIds;
+      try {
+        BinaryReader r(data.c_str(), data.size());
+        std::vector<std::pair<const char*,size_t> > strings(static_cast<size_t>(r.readUInt()));
+        for (unsigned int i=0; i<strings.size(); i++) {
+          size_t len = static_cast<size_t>(r.readUInt());
+          strings[i] = std::make_pair(r.readBytes(len), len);
+        }
+        ASTReader ar(r, strings);
+        for (unsigned int i=0; i<baseDecls.size(); i++)
+          ar.external(baseDecls[i]);
+        nIds = static_cast<unsigned int>(r.readUInt());
+        ar.renumber(baseline.ids, static_cast<long long int>(envi.get_ids())-baseline.ids);
+        unsigned long long int nDomains = r.readUInt();
+        for (unsigned long long int i=0; i<nDomains; i++) {
+          unsigned long long int idx = r.readUInt();
+          if (idx >= baseline.items.size())
+            throw InternalError("invalid declaration in flattened chunk");
+          VarDecl* vd = (*env.flat())[static_cast<unsigned int>(idx)]->cast<VarDeclI>()->e();
+          domains.push_back(std::make_pair(vd, ar.readExpression()));
+        }
+        unsigned long long int nItems = r.readUInt();
+        for (unsigned long long int i=0; i<nItems; i++)
+          items.push_back(ar.readItem());
+        ar.finish();
+        if (!r.done())
+          throw InternalError("unexpected data in flattened chunk");
+      } catch (InternalError&) {
+        return false;
+      }
+
+      // Chunks that empty a domain are flattened again so that the failure is reported as usual
+      for (unsigned int i=0; i<domains.size(); i++) {
+        domains[i].second = restrictedDomain(envi, domains[i].first, domains[i].second);
+        if (domains[i].second==NULL)
+          return false;
+      }
+      for (unsigned int i=0; i<domains.size(); i++) {
+        TypeInst* ti = domains[i].first->ti();
+        if (ti->domain() != domains[i].second) {
+          ti->domain(domains[i].second);
+          if (!domains[i].first->type().isbool())
+            ti->setComputedDomain(false);
+        }
+      }
+      (void) envi.genIds(nIds);
+      SetCallDecls scd(envi);
+      for (unsigned int i=0; i<items.size(); i++) {
+        if (VarDeclI* vdi = items[i]->dyn_cast<VarDeclI>())
+          topDown(scd, vdi->e());
+        else
+          topDown(scd, items[i]->cast<ConstraintI>()->e());
+        envi.flat_addItem(items[i]);
+      }
+      return true;
+    }
+
+  }
+
+  void
+  flattenParallel(Env& env, PreparedModel& pm, const std::vector<std::string>& datafiles,
+                  const BatchOptions& opts) {
+    flattenDecls(env);
+
+    ParallelState s(pm, datafiles, opts);
+    s.baseline.init(env);
+    std::vector<VarDecl*> baseDecls;
+    for (unsigned int i=0; i<env.flat()->size(); i++)
+      if (VarDeclI* vdi = (*env.flat())[i]->dyn_cast<VarDeclI>())
+        baseDecls.push_back(vdi->e());
+    std::vector<ConstraintI*> cs = constraintItems(env);
+    makeChunks(env, cs, opts.flattenChunkSize, s.chunks);
+    s.results.resize(s.chunks.size());
+
+    std::vector<std::thread> threads;
+    unsigned int nThreads = std::min(opts.flattenThreads,
+                                     static_cast<unsigned int>(s.chunks.size()));
+    if (env.flat()->failed())
+      nThreads = 0;
+    for (unsigned int i=0; i<nThreads; i++) {
+      threads.push_back(std::thread([&s] {
+        {
+          FlatteningWorker w(s);
+          w.run();
+        }
+        GC::release();
+      }));
+    }
+    try {
+      for (size_t i=0; i<s.chunks.size() && !env.flat()->failed(); i++) {
+        bool merged = false;
+        if (!threads.empty()) {
+          ChunkResult& r = s.wait(i);
+          merged = r.status==CS_DONE && mergeChunk(env, s.baseline, baseDecls, r.data);
+          std::string().swap(r.data);
+        }
+        if (!merged) {
+          const std::vector<ChunkPart>& parts = s.chunks[i];
+          for (unsigned int j=0; j<parts.size(); j++)
+            flattenConstraint(env, cs[parts[j].item], parts[j].begin, parts[j].end);
+        }
+      }
+    } catch (...) {
+      s.stop = true;
+      for (unsigned int i=0; i<threads.size(); i++)
+        threads[i].join();
+      throw;
+    }
+    s.stop = true;
+    for (unsigned int i=0; i<threads.size(); i++)
+      threads[i].join();
+
+    flattenFinish(env, opts.fopts);
+  }
+
+}
@@ -28,15 +28,11 @@ namespace MiniZinc {
   
   GC*&
   GC::gc(void) {
-#if defined(HAS_DECLSPEC_THREAD)
-    __declspec (thread) static GC* gc = NULL;
-#elif defined(HAS_ATTR_THREAD)
-    static __thread GC* gc = NULL;
-#else
-#error Need thread-local storage
-#endif
+    static MZN_THREAD_LOCAL GC* gc = NULL;
     return gc;
   }
+
+  MZN_THREAD_LOCAL unsigned long long int GC::_epoch = 0;
     
   bool
   GC::locked(void) {
@@ -127,6 +123,8 @@ namespace MiniZinc {
     };
     /// Trail
     std::vector<TItem> trail;
+    /// Functions to call when the heap is released
+    std::vector<GC::cleanup_fn> cleanup;
 
     Heap(void)
       : _page(NULL)
@@ -226,6 +224,7 @@ namespace MiniZinc {
 #endif
         mark();
         sweep();
+        GC::newEpoch();
         _gc_threshold = static_cast<size_t>(_alloced_mem * 1.5);
 #ifdef MINIZINC_GC_STATS
         std::cerr << "done\n\talloced " << (_alloced_mem/1024) << "\n\tfree " << (_free_mem/1024) << "\n\tdiff "
@@ -635,6 +634,7 @@ namespace MiniZinc {
   void
   GC::untrail(void) {
     GC* gc = GC::gc();
+    newEpoch();
     while (!gc->_heap->trail.empty() && !gc->_heap->trail.back().mark) {
       *gc->_heap->trail.back().l = gc->_heap->trail.back().v;
       gc->_heap->trail.pop_back();
@@ -647,6 +647,38 @@ namespace MiniZinc {
     GC* gc = GC::gc();
     return gc->_heap->_max_alloced_mem;
   }
+
+  void
+  GC::atRelease(cleanup_fn f) {
+    if (gc()==NULL) {
+      gc() = new GC();
+    }
+    gc()->_heap->cleanup.push_back(f);
+  }
+
+  void
+  GC::release(void) {
+    GC* gc = GC::gc();
+    if (gc==NULL)
+      return;
+    assert(gc->_lock_count==0);
+    while (!gc->_heap->cleanup.empty()) {
+      cleanup_fn f = gc->_heap->cleanup.back();
+      gc->_heap->cleanup.pop_back();
+      f();
+    }
+    // Nothing is marked, so sweeping destroys all remaining nodes
+    gc->_heap->sweep();
+    HeapPage* p = gc->_heap->_page;
+    while (p) {
+      HeapPage* pf = p;
+      p = p->next;
+      ::free(pf);
+    }
+    delete gc->_heap;
+    delete gc;
+    GC::gc() = NULL;
+  }
   
 
   void*
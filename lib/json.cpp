@@ -0,0 +1,251 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <minizinc/json.hh>
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+namespace MiniZinc {
+
+  const JSONValue*
+  JSONValue::get(const std::string& key) const {
+    for (unsigned int i=0; i<o.size(); i++) {
+      if (o[i].first==key)
+        return &o[i].second;
+    }
+    return NULL;
+  }
+
+  namespace {
+
+    /// Recursive descent parser for JSON text
+    class JSONParser {
+    protected:
+      const std::string& _text;
+      size_t _pos;
+      /// Throw an error at the current position
+      void error(const std::string& msg) {
+        std::ostringstream oss;
+        oss << msg << " at offset " << _pos;
+        throw JSONError(oss.str());
+      }
+      void skipSpace(void) {
+        while (_pos < _text.size() && std::strchr(" \t\r\n", _text[_pos]) != NULL)
+          _pos++;
+      }
+      /// Consume \a c, which must be the next non-space character
+      void expect(char c) {
+        skipSpace();
+        if (_pos >= _text.size() || _text[_pos] != c)
+          error(std::string("expected '")+c+"'");
+        _pos++;
+      }
+      /// Consume \a word if it comes next
+      bool accept(const char* word) {
+        size_t len = std::strlen(word);
+        if (_text.compare(_pos, len, word) != 0)
+          return false;
+        _pos += len;
+        return true;
+      }
+      /// Append the UTF-8 encoding of code point \a c to \a s
+      static void appendUTF8(std::string& s, unsigned int c) {
+        if (c < 0x80) {
+          s += static_cast<char>(c);
+        } else if (c < 0x800) {
+          s += static_cast<char>(0xC0 | (c >> 6));
+          s += static_cast<char>(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+          s += static_cast<char>(0xE0 | (c >> 12));
+          s += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+          s += static_cast<char>(0x80 | (c & 0x3F));
+        } else {
+          s += static_cast<char>(0xF0 | (c >> 18));
+          s += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+          s += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+          s += static_cast<char>(0x80 | (c & 0x3F));
+        }
+      }
+      unsigned int hex4(void) {
+        if (_pos+4 > _text.size())
+          error("unterminated unicode escape");
+        unsigned int c = 0;
+        for (unsigned int i=0; i<4; i++) {
+          char h = _text[_pos++];
+          c <<= 4;
+          if (h >= '0' && h <= '9')
+            c |= h-'0';
+          else if (h >= 'a' && h <= 'f')
+            c |= h-'a'+10;
+          else if (h >= 'A' && h <= 'F')
+            c |= h-'A'+10;
+          else
+            error("invalid unicode escape");
+        }
+        return c;
+      }
+      std::string parseString(void) {
+        expect('"');
+        std::string s;
+        for (;;) {
+          if (_pos >= _text.size())
+            error("unterminated string");
+          char c = _text[_pos++];
+          if (c=='"')
+            return s;
+          if (c != '\\') {
+            s += c;
+            continue;
+          }
+          if (_pos >= _text.size())
+            error("unterminated string");
+          switch (_text[_pos++]) {
+          case '"': s += '"'; break;
+          case '\\': s += '\\'; break;
+          case '/': s += '/'; break;
+          case 'b': s += '\b'; break;
+          case 'f': s += '\f'; break;
+          case 'n': s += '\n'; break;
+          case 'r': s += '\r'; break;
+          case 't': s += '\t'; break;
+          case 'u':
+            {
+              unsigned int cp = hex4();
+              if (cp >= 0xD800 && cp < 0xDC00 && accept("\\u")) {
+                unsigned int low = hex4();
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+              }
+              appendUTF8(s, cp);
+            }
+            break;
+          default:
+            _pos--;
+            error("invalid escape sequence");
+          }
+        }
+      }
+      JSONValue parseValue(void) {
+        skipSpace();
+        if (_pos >= _text.size())
+          error("unexpected end of input");
+        JSONValue v;
+        char c = _text[_pos];
+        if (c=='{') {
+          v.kind = JSONValue::JV_OBJECT;
+          _pos++;
+          skipSpace();
+          if (_pos < _text.size() && _text[_pos]=='}') {
+            _pos++;
+            return v;
+          }
+          for (;;) {
+            skipSpace();
+            std::string key = parseString();
+            expect(':');
+            v.o.push_back(std::make_pair(key, parseValue()));
+            skipSpace();
+            if (_pos < _text.size() && _text[_pos]==',') {
+              _pos++;
+            } else {
+              expect('}');
+              return v;
+            }
+          }
+        } else if (c=='[') {
+          v.kind = JSONValue::JV_ARRAY;
+          _pos++;
+          skipSpace();
+          if (_pos < _text.size() && _text[_pos]==']') {
+            _pos++;
+            return v;
+          }
+          for (;;) {
+            v.a.push_back(parseValue());
+            skipSpace();
+            if (_pos < _text.size() && _text[_pos]==',') {
+              _pos++;
+            } else {
+              expect(']');
+              return v;
+            }
+          }
+        } else if (c=='"') {
+          v.kind = JSONValue::JV_STRING;
+          v.s = parseString();
+        } else if (accept("true")) {
+          v.kind = JSONValue::JV_BOOL;
+          v.b = true;
+        } else if (accept("false")) {
+          v.kind = JSONValue::JV_BOOL;
+          v.b = false;
+        } else if (accept("null")) {
+          v.kind = JSONValue::JV_NULL;
+        } else if (c=='-' || (c >= '0' && c <= '9')) {
+          const char* begin = _text.c_str()+_pos;
+          char* end;
+          v.kind = JSONValue::JV_NUMBER;
+          v.n = std::strtod(begin, &end);
+          _pos += end-begin;
+        } else {
+          error("unexpected character");
+        }
+        return v;
+      }
+    public:
+      JSONParser(const std::string& text) : _text(text), _pos(0) {}
+      JSONValue parse(void) {
+        JSONValue v = parseValue();
+        skipSpace();
+        if (_pos != _text.size())
+          error("unexpected trailing characters");
+        return v;
+      }
+    };
+
+  }
+
+  JSONValue
+  parseJSON(const std::string& text) {
+    JSONParser p(text);
+    return p.parse();
+  }
+
+  std::string
+  jsonString(const std::string& s) {
+    std::string r;
+    r.reserve(s.size()+2);
+    r += '"';
+    for (size_t i=0; i<s.size(); i++) {
+      unsigned char c = static_cast<unsigned char>(s[i]);
+      switch (c) {
+      case '"': r += "\\\""; break;
+      case '\\': r += "\\\\"; break;
+      case '\n': r += "\\n"; break;
+      case '\r': r += "\\r"; break;
+      case '\t': r += "\\t"; break;
+      default:
+        if (c < 0x20) {
+          static const char* hex = "0123456789abcdef";
+          r += "\\u00";
+          r += hex[c >> 4];
+          r += hex[c & 0xF];
+        } else {
+          r += static_cast<char>(c);
+        }
+      }
+    }
+    r += '"';
+    return r;
+  }
+
+}
@@ -13,12 +13,13 @@
 #include <minizinc/flatten_internal.hh>
 #include <minizinc/astexception.hh>
 #include <minizinc/prettyprinter.hh>
+#include <minizinc/typecheck.hh>
 
 #undef MZN_DEBUG_FUNCTION_REGISTRY
 
 namespace MiniZinc {
   
-  Model::Model(void) : _parent(NULL), _solveItem(NULL), _outputItem(NULL), _failed(false) {
+  Model::Model(void) : _fnCacheEnabled(false), _parent(NULL), _solveItem(NULL), _outputItem(NULL), _failed(false), _normalised(0) {
     GC::add(this);
   }
 
@@ -67,14 +68,16 @@ namespace MiniZinc {
     Model* m = this;
     while (m->_parent)
       m = m->_parent;
+    m->_fnCacheEnabled = false;
     FnMap::iterator i_id = m->fnmap.find(fi->id());
     if (i_id == m->fnmap.end()) {
       // new element
-      std::vector<FunctionI*> v; v.push_back(fi);
-      m->fnmap.insert(std::pair<ASTString,std::vector<FunctionI*> >(fi->id(),v));
+      FnEntry fe; fe.fns.push_back(fi);
+      m->fnmap.insert(std::pair<ASTString,FnEntry>(fi->id(),fe));
     } else {
       // add to list of existing elements
-      std::vector<FunctionI*>& v = i_id->second;
+      i_id->second.cache.clear();
+      std::vector<FunctionI*>& v = i_id->second.fns;
       for (unsigned int i=0; i<v.size(); i++) {
         if (v[i]->params().size() == fi->params().size()) {
           bool alleq=true;
@@ -113,7 +116,18 @@ namespace MiniZinc {
     if (i_id == m->fnmap.end()) {
       return NULL;
     }
-    std::vector<FunctionI*>& v = i_id->second;
+    std::vector<int>& sig = m->_signature;
+    if (m->_fnCacheEnabled) {
+      sig.clear();
+      sig.push_back(-1);
+      for (unsigned int j=0; j<t.size(); j++)
+        sig.push_back(t[j].toInt());
+      DispatchCache::const_iterator ci = i_id->second.cache.find(sig);
+      if (ci != i_id->second.cache.end())
+        return ci->second;
+    }
+    FunctionI* ret = NULL;
+    std::vector<FunctionI*>& v = i_id->second.fns;
     for (unsigned int i=0; i<v.size(); i++) {
       FunctionI* fi = v[i];
 #ifdef MZN_DEBUG_FUNCTION_REGISTRY
@@ -132,11 +146,16 @@ namespace MiniZinc {
           }
         }
         if (match) {
-          return fi;
+          ret = fi;
+          break;
         }
       }
     }
-    return NULL;
+    if (m->_fnCacheEnabled)
+      i_id->second.cache.insert(std::make_pair(sig,ret));
+    if (ret && env.lazyTypecheck)
+      env.lazyTypecheck->check(env, ret);
+    return ret;
   }
 
   namespace {
@@ -165,25 +184,29 @@ namespace MiniZinc {
       m = m->_parent;
     FunSort funsort;
     for (FnMap::iterator it=m->fnmap.begin(); it!=m->fnmap.end(); ++it) {
-      std::sort(it->second.begin(),it->second.end(),funsort);
+      std::sort(it->second.fns.begin(),it->second.fns.end(),funsort);
+      it->second.cache.clear();
     }
+    m->_fnCacheEnabled = true;
   }
 
+  template<class Args>
   FunctionI*
-  Model::matchFn(EnvI& env, const ASTString& id,
-                 const std::vector<Expression*>& args) const {
-    if (id==constants().var_redef->id())
-      return constants().var_redef;
-    const Model* m = this;
-    while (m->_parent)
-      m = m->_parent;
-    FnMap::const_iterator it = m->fnmap.find(id);
-    if (it == m->fnmap.end()) {
-      return NULL;
+  Model::matchArgs(EnvI& env, const FnEntry& fe, const Args& args) const {
+    // The result only depends on the types of the arguments (a call
+    // with an ambiguous result throws before it is cached)
+    if (_fnCacheEnabled) {
+      _signature.clear();
+      for (unsigned int j=0; j<args.size(); j++)
+        _signature.push_back(args[j]->type().toInt());
+      DispatchCache::const_iterator ci = fe.cache.find(_signature);
+      if (ci != fe.cache.end())
+        return ci->second;
     }
-    const std::vector<FunctionI*>& v = it->second;
+    const std::vector<FunctionI*>& v = fe.fns;
     std::vector<FunctionI*> matched;
-    Expression* botarg = NULL;
+    const Expression* botarg = NULL;
+    FunctionI* ret = NULL;
     for (unsigned int i=0; i<v.size(); i++) {
       FunctionI* fi = v[i];
 #ifdef MZN_DEBUG_FUNCTION_REGISTRY
@@ -196,6 +219,7 @@ namespace MiniZinc {
 #ifdef MZN_DEBUG_FUNCTION_REGISTRY
             std::cerr << args[j]->type().toString() << " does not match "
             << fi->params()[j]->type().toString() << "\n";
+            std::cerr << "Wrong argument is " << *args[j];
 #endif
             match=false;
             break;
@@ -205,24 +229,44 @@ namespace MiniZinc {
           }
         }
         if (match) {
-          if (botarg)
-            matched.push_back(fi);
-          else
-            return fi;
+          if (!botarg) {
+            ret = fi;
+            break;
+          }
+          matched.push_back(fi);
         }
       }
     }
-    if (matched.empty())
+    if (ret==NULL && !matched.empty()) {
+      Type t = matched[0]->ti()->type();
+      t.ti(Type::TI_PAR);
+      for (unsigned int i=1; i<matched.size(); i++) {
+        if (!t.isSubtypeOf(matched[i]->ti()->type()))
+          throw TypeError(env, botarg->loc(), "ambiguous overloading on return type of function");
+      }
+      ret = matched[0];
+    }
+    if (_fnCacheEnabled)
+      fe.cache.insert(std::make_pair(_signature,ret));
+    // after inserting, since checking the body reuses _signature
+    if (ret && env.lazyTypecheck)
+      env.lazyTypecheck->check(env, ret);
+    return ret;
+  }
+
+  FunctionI*
+  Model::matchFn(EnvI& env, const ASTString& id,
+                 const std::vector<Expression*>& args) const {
+    if (id==constants().var_redef->id())
+      return constants().var_redef;
+    const Model* m = this;
+    while (m->_parent)
+      m = m->_parent;
+    FnMap::const_iterator it = m->fnmap.find(id);
+    if (it == m->fnmap.end()) {
       return NULL;
-    if (matched.size()==1)
-      return matched[0];
-    Type t = matched[0]->ti()->type();
-    t.ti(Type::TI_PAR);
-    for (unsigned int i=1; i<matched.size(); i++) {
-      if (!t.isSubtypeOf(matched[i]->ti()->type()))
-        throw TypeError(env, botarg->loc(), "ambiguous overloading on return type of function");
     }
-    return matched[0];
+    return m->matchArgs(env, it->second, args);
   }
   
   FunctionI*
@@ -236,49 +280,7 @@ namespace MiniZinc {
     if (it == m->fnmap.end()) {
       return NULL;
     }
-    const std::vector<FunctionI*>& v = it->second;
-    std::vector<FunctionI*> matched;
-    Expression* botarg = NULL;
-    for (unsigned int i=0; i<v.size(); i++) {
-      FunctionI* fi = v[i];
-#ifdef MZN_DEBUG_FUNCTION_REGISTRY
-      std::cerr << "try " << *fi;
-#endif
-      if (fi->params().size() == c->args().size()) {
-        bool match=true;
-        for (unsigned int j=0; j<c->args().size(); j++) {
-          if (!c->args()[j]->type().isSubtypeOf(fi->params()[j]->type())) {
-#ifdef MZN_DEBUG_FUNCTION_REGISTRY
-            std::cerr << c->args()[j]->type().toString() << " does not match "
-            << fi->params()[j]->type().toString() << "\n";
-            std::cerr << "Wrong argument is " << *c->args()[j];
-#endif
-            match=false;
-            break;
-          }
-          if (c->args()[j]->type().isbot() && fi->params()[j]->type().bt()!=Type::BT_TOP) {
-            botarg = c->args()[j];
-          }
-        }
-        if (match) {
-          if (botarg)
-            matched.push_back(fi);
-          else
-            return fi;
-        }
-      }
-    }
-    if (matched.empty())
-      return NULL;
-    if (matched.size()==1)
-      return matched[0];
-    Type t = matched[0]->ti()->type();
-    t.ti(Type::TI_PAR);
-    for (unsigned int i=1; i<matched.size(); i++) {
-      if (!t.isSubtypeOf(matched[i]->ti()->type()))
-        throw TypeError(env, botarg->loc(), "ambiguous overloading on return type of function");
-    }
-    return matched[0];
+    return m->matchArgs(env, it->second, c->args());
   }
 
   Item*&
@@ -305,6 +307,7 @@ namespace MiniZinc {
     struct { bool operator() (const Item* i) {
       return i->removed();
     }} isremoved;
+    _normalised -= std::count_if(_items.begin(),_items.begin()+_normalised,isremoved);
     _items.erase(remove_if(_items.begin(),_items.end(),isremoved),
                  _items.end());
   }
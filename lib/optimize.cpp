@@ -40,24 +40,117 @@ namespace MiniZinc {
   {
     idx.remove(vd->id());
   }
+
+  namespace {
+    /// Occurrence vectors longer than this get a position index
+    const unsigned int maxUnindexedOccurrences = 32;
+  }
+
+  VarOccurrences::Occurrences* VarOccurrences::findOccurrences(VarDecl* v) {
+    IdMap<unsigned int>::iterator vi = _var.find(v->id()->decl()->id());
+    return vi==_var.end() ? NULL : &_occ[vi->second];
+  }
+
+  VarOccurrences::Occurrences& VarOccurrences::getOccurrences(VarDecl* v) {
+    Id* id = v->id()->decl()->id();
+    IdMap<unsigned int>::iterator vi = _var.find(id);
+    if (vi != _var.end())
+      return _occ[vi->second];
+    _var.insert(id, static_cast<unsigned int>(_occ.size()));
+    _occ.push_back(Occurrences(id));
+    return _occ.back();
+  }
   
   void VarOccurrences::add(VarDecl* v, Item* i) {
-    IdMap<Items>::iterator vi = _m.find(v->id()->decl()->id());
-    if (vi==_m.end()) {
-      Items items; items.insert(i);
-      _m.insert(v->id()->decl()->id(), items);
+    Occurrences& o = getOccurrences(v);
+    if (!o.items.empty() && o.items.back()==i)
+      return;
+    if (o.pos >= 0) {
+      if (!_pos[o.pos].insert(std::make_pair(i,static_cast<unsigned int>(o.items.size()))).second)
+        return;
     } else {
-      vi->second.insert(i);
+      for (unsigned int j=static_cast<unsigned int>(o.items.size()); j--;)
+        if (o.items[j]==i)
+          return;
+      if (o.items.size() >= maxUnindexedOccurrences) {
+        o.pos = static_cast<int>(_pos.size());
+        _pos.push_back(UNORDERED_NAMESPACE::unordered_map<Item*,unsigned int>());
+        for (unsigned int j=0; j<o.items.size(); j++)
+          if (o.items[j])
+            _pos[o.pos].insert(std::make_pair(o.items[j],j));
+        _pos[o.pos].insert(std::make_pair(i,static_cast<unsigned int>(o.items.size())));
+      }
     }
+    o.items.push_back(i);
+    o.n++;
   }
   
   int VarOccurrences::remove(VarDecl* v, Item* i) {
-    IdMap<Items>::iterator vi = _m.find(v->id()->decl()->id());
-    assert(vi!=_m.end());
-    vi->second.erase(i);
-    return vi->second.size();
+    Occurrences* o = findOccurrences(v);
+    assert(o != NULL);
+    if (o==NULL)
+      return 0;
+    if (o->pos >= 0) {
+      UNORDERED_NAMESPACE::unordered_map<Item*,unsigned int>::iterator it = _pos[o->pos].find(i);
+      if (it != _pos[o->pos].end()) {
+        o->items[it->second] = NULL;
+        o->n--;
+        _pos[o->pos].erase(it);
+      }
+    } else {
+      for (unsigned int j=static_cast<unsigned int>(o->items.size()); j--;) {
+        if (o->items[j]==i) {
+          o->items[j] = NULL;
+          o->n--;
+          break;
+        }
+      }
+    }
+    return o->n;
+  }
+
+  const VarOccurrences::Items* VarOccurrences::items(VarDecl* v) {
+    Occurrences* o = findOccurrences(v);
+    return o==NULL ? NULL : &o->items;
   }
   
+  void VarOccurrences::compact(void) {
+    std::deque<Occurrences> occ;
+    std::vector<UNORDERED_NAMESPACE::unordered_map<Item*,unsigned int> > pos;
+    _var.clear();
+    for (unsigned int i=0; i<_occ.size(); i++) {
+      Occurrences& o = _occ[i];
+      if (o.id==NULL)
+        continue;
+      unsigned int n = 0;
+      for (unsigned int j=0; j<o.items.size(); j++) {
+        if (o.items[j] && !o.items[j]->removed())
+          o.items[n++] = o.items[j];
+      }
+      if (n==0)
+        continue;
+      _var.insert(o.id, static_cast<unsigned int>(occ.size()));
+      occ.push_back(Occurrences(o.id));
+      Occurrences& no = occ.back();
+      bool changed = n < o.items.size();
+      o.items.resize(n);
+      no.items.swap(o.items);
+      no.n = n;
+      if (n > maxUnindexedOccurrences) {
+        no.pos = static_cast<int>(pos.size());
+        pos.push_back(UNORDERED_NAMESPACE::unordered_map<Item*,unsigned int>());
+        if (o.pos >= 0 && !changed) {
+          pos.back().swap(_pos[o.pos]);
+        } else {
+          for (unsigned int j=0; j<n; j++)
+            pos.back().insert(std::make_pair(no.items[j],j));
+        }
+      }
+    }
+    _occ.swap(occ);
+    _pos.swap(pos);
+  }
+
   void VarOccurrences::rebuild(MiniZinc::Model *m) {
     idx.clear();
     for (unsigned int i=0; i<m->size(); i++) {
@@ -65,6 +158,7 @@ namespace MiniZinc {
         idx.insert(vdi->e()->id(), i);
       }
     }
+    compact();
   }
   
   void VarOccurrences::unify(EnvI& env, Model* m, Id* id0_0, Id *id1_0) {
@@ -81,15 +175,20 @@ namespace MiniZinc {
     assert(v0idx != -1);
     env.flat_removeItem(v0idx);
 
-    IdMap<Items>::iterator vi0 = _m.find(v0->id());
-    if (vi0 != _m.end()) {
-      IdMap<Items>::iterator vi1 = _m.find(v1->id());
-      if (vi1 == _m.end()) {
-        _m.insert(v1->id(), vi0->second);
-      } else {
-        vi1->second.insert(vi0->second.begin(), vi0->second.end());
+    IdMap<unsigned int>::iterator vi0 = _var.find(v0->id());
+    if (vi0 != _var.end()) {
+      Occurrences& o0 = _occ[vi0->second];
+      Items items0;
+      items0.swap(o0.items);
+      if (o0.pos >= 0)
+        _pos[o0.pos].clear();
+      o0.id = NULL;
+      o0.n = 0;
+      _var.remove(v0->id());
+      for (unsigned int j=0; j<items0.size(); j++) {
+        if (items0[j])
+          add(v1, items0[j]);
       }
-      _m.remove(v0->id());
     }
     
     id0->redirect(id1);
@@ -98,13 +197,15 @@ namespace MiniZinc {
   }
   
   void VarOccurrences::clear(void) {
-    _m.clear();
+    _var.clear();
+    _occ.clear();
+    _pos.clear();
     idx.clear();
   }
   
   int VarOccurrences::occurrences(VarDecl* v) {
-    IdMap<Items>::iterator vi = _m.find(v->id()->decl()->id());
-    return (vi==_m.end() ? 0 : vi->second.size());
+    Occurrences* o = findOccurrences(v);
+    return o==NULL ? 0 : o->n;
   }
   
   void CollectOccurrencesI::vVarDeclI(VarDeclI* v) {
@@ -167,10 +268,7 @@ namespace MiniZinc {
           if (id0->type().isint() || id0->type().isintset()) {
             IntSetVal* isv0 = eval_intset(env,id0->decl()->ti()->domain());
             IntSetVal* isv1 = eval_intset(env,id1->decl()->ti()->domain());
-            IntSetRanges isv0r(isv0);
-            IntSetRanges isv1r(isv1);
-            Ranges::Inter<IntSetRanges,IntSetRanges> inter(isv0r,isv1r);
-            IntSetVal* nd = IntSetVal::ai(inter);
+            IntSetVal* nd = IntSetVal::intersect(isv0,isv1);
             if (nd->size()==0) {
               env.flat()->fail(env);
             } else if (nd->card() != isv1->card()) {
@@ -227,6 +325,28 @@ namespace MiniZinc {
     }
   }
   
+  /// Return whether unify may remove the declaration of \a id when only items from \a first can be removed
+  bool canRemoveByUnify(EnvI& env, Id* id, unsigned int first) {
+    VarDecl* vd = id->decl();
+    return env.vo.find(vd) >= static_cast<int>(first) && vd->e()==NULL && !isOutput(vd);
+  }
+
+  /**
+   * \brief Return whether \a id0 and \a id1 can be unified when only items from \a first can be removed
+   *
+   * Swaps \a id0 and \a id1 if necessary so that unify removes the declaration
+   * of \a id0. All variables can be unified if \a first is 0.
+   */
+  bool unifiable(EnvI& env, Id*& id0, Id*& id1, unsigned int first) {
+    if (first==0 || canRemoveByUnify(env, id0, first))
+      return true;
+    if (canRemoveByUnify(env, id1, first)) {
+      std::swap(id0, id1);
+      return true;
+    }
+    return false;
+  }
+
   void substituteFixedVars(EnvI& env, Item* ii, std::vector<VarDecl*>& deletedVarDecls);
   void simplifyBoolConstraint(EnvI& env, Item* ii, VarDecl* vd, bool& remove,
                               std::vector<int>& vardeclQueue,
@@ -237,7 +357,8 @@ namespace MiniZinc {
   bool simplifyConstraint(EnvI& env, Item* ii,
                           std::vector<VarDecl*>& deletedVarDecls,
                           std::vector<Item*>& constraintQueue,
-                          std::vector<int>& vardeclQueue);
+                          std::vector<int>& vardeclQueue,
+                          unsigned int first);
   
   void pushVarDecl(EnvI& env, VarDeclI* vdi, int vd_idx, std::vector<int>& q) {
     if (!vdi->removed() && !vdi->flag()) {
@@ -250,15 +371,17 @@ namespace MiniZinc {
   }
   
   void pushDependentConstraints(EnvI& env, Id* id, std::vector<Item*>& q) {
-    IdMap<VarOccurrences::Items>::iterator it = env.vo._m.find(id->decl()->id());
-    if (it != env.vo._m.end()) {
-      for (VarOccurrences::Items::iterator item = it->second.begin(); item != it->second.end(); ++item) {
-        if (ConstraintI* ci = (*item)->dyn_cast<ConstraintI>()) {
+    if (const VarOccurrences::Items* items = env.vo.items(id->decl())) {
+      for (unsigned int i=0; i<items->size(); i++) {
+        Item* item = (*items)[i];
+        if (item==NULL)
+          continue;
+        if (ConstraintI* ci = item->dyn_cast<ConstraintI>()) {
           if (!ci->removed() && !ci->flag()) {
             ci->flag(true);
             q.push_back(ci);
           }
-        } else if (VarDeclI* vdi = (*item)->dyn_cast<VarDeclI>()) {
+        } else if (VarDeclI* vdi = item->dyn_cast<VarDeclI>()) {
           if (vdi->e()->id()->decl() != vdi->e()) {
             vdi = (*env.flat())[env.vo.find(vdi->e()->id()->decl())]->cast<VarDeclI>();
           }
@@ -272,7 +395,14 @@ namespace MiniZinc {
     
   }
   
-  void optimize(Env& env) {
+  /**
+   * \brief Simplify the flat model of \a env, starting from the items from index \a first
+   *
+   * Changes are propagated from these items to all dependent items. If
+   * \a first is not 0, the variables declared before \a first are never
+   * removed (see optimizeIncremental).
+   */
+  void optimize(Env& env, unsigned int first) {
     EnvI& envi = env.envi();
     Model& m = *envi.flat();
     std::vector<int> toAssignBoolVars;
@@ -286,7 +416,7 @@ namespace MiniZinc {
     
     GCLock lock;
 
-    for (unsigned int i=0; i<m.size(); i++) {
+    for (unsigned int i=first; i<m.size(); i++) {
       if (!m[i]->removed()) {
         if (ConstraintI* ci = m[i]->dyn_cast<ConstraintI>()) {
           ci->flag(false);
@@ -297,17 +427,20 @@ namespace MiniZinc {
     }
 
     
-    for (unsigned int i=0; i<m.size(); i++) {
+    for (unsigned int i=first; i<m.size(); i++) {
       if (m[i]->removed())
         continue;
       if (ConstraintI* ci = m[i]->dyn_cast<ConstraintI>()) {
         ci->flag(false);
         if (!ci->removed()) {
           if (Call* c = ci->e()->dyn_cast<Call>()) {
+            Id* id0 = NULL;
+            Id* id1 = NULL;
             if ( (c->id() == constants().ids.int_.eq || c->id() == constants().ids.bool_eq || c->id() == constants().ids.float_.eq || c->id() == constants().ids.set_eq) &&
-                c->args()[0]->isa<Id>() && c->args()[1]->isa<Id>() &&
-                (c->args()[0]->cast<Id>()->decl()->e()==NULL || c->args()[1]->cast<Id>()->decl()->e()==NULL) ) {
-              unify(envi, deletedVarDecls, c->args()[0]->cast<Id>(), c->args()[1]->cast<Id>());
+                (id0 = c->args()[0]->dyn_cast<Id>()) && (id1 = c->args()[1]->dyn_cast<Id>()) &&
+                (id0->decl()->e()==NULL || id1->decl()->e()==NULL) &&
+                unifiable(envi, id0, id1, first) ) {
+              unify(envi, deletedVarDecls, id0, id1);
               {
                 VarDecl* vd = c->args()[0]->cast<Id>()->decl();
                 int v0idx = envi.vo.find(vd);
@@ -350,10 +483,15 @@ namespace MiniZinc {
       } else if (VarDeclI* vdi = m[i]->dyn_cast<VarDeclI>()) {
         vdi->flag(false);
         if (vdi->e()->e() && vdi->e()->e()->isa<Id>() && vdi->e()->type().dim()==0) {
+          Id* id0 = vdi->e()->id();
           Id* id1 = vdi->e()->e()->cast<Id>();
           vdi->e()->e(NULL);
-          unify(envi, deletedVarDecls, vdi->e()->id(), id1);
-          pushDependentConstraints(envi, id1, constraintQueue);
+          if (unifiable(envi, id0, id1, first)) {
+            unify(envi, deletedVarDecls, id0, id1);
+            pushDependentConstraints(envi, id1, constraintQueue);
+          } else {
+            vdi->e()->e(id1);
+          }
         }
         if (vdi->e()->type().isbool() && vdi->e()->type().isvar() && vdi->e()->type().dim()==0
             && (vdi->e()->ti()->domain() == constants().lit_true || vdi->e()->ti()->domain() == constants().lit_false)) {
@@ -456,6 +594,8 @@ namespace MiniZinc {
         if (isConjunction) {
           if (bi->isa<ConstraintI>()) {
             env.envi().flat()->fail(env.envi());
+          } else if (bi->cast<VarDeclI>()->e()->ti()->domain()==constants().lit_true) {
+            env.envi().flat()->fail(env.envi());
           } else {
             CollectDecls cd(envi.vo,deletedVarDecls,bi);
             topDown(cd,bi->cast<VarDeclI>()->e()->e());
@@ -469,7 +609,9 @@ namespace MiniZinc {
           if (bi->isa<ConstraintI>()) {
             CollectDecls cd(envi.vo,deletedVarDecls,bi);
             topDown(cd,bi->cast<ConstraintI>()->e());
-            bi->remove();
+            envi.flat_removeItem(bi);
+          } else if (bi->cast<VarDeclI>()->e()->ti()->domain()==constants().lit_false) {
+            env.envi().flat()->fail(env.envi());
           } else {
             CollectDecls cd(envi.vo,deletedVarDecls,bi);
             topDown(cd,bi->cast<VarDeclI>()->e()->e());
@@ -488,7 +630,7 @@ namespace MiniZinc {
           finalId->decl()->e(constants().boollit(!finalIdNeg));
         CollectDecls cd(envi.vo,deletedVarDecls,bi);
         topDown(cd,bi->cast<ConstraintI>()->e());
-        bi->remove();
+        envi.flat_removeItem(bi);
         pushVarDecl(envi, envi.vo.idx.find(finalId->decl()->id())->second, vardeclQueue);
         pushDependentConstraints(envi, finalId, constraintQueue);
       }
@@ -564,23 +706,23 @@ namespace MiniZinc {
           }
           pushDependentConstraints(envi, vd->id(), constraintQueue);
           std::vector<Item*> toRemove;
-          IdMap<VarOccurrences::Items>::iterator it = envi.vo._m.find(vd->id()->decl()->id());
-          if (it != envi.vo._m.end()) {
-            for (VarOccurrences::Items::iterator item = it->second.begin(); item != it->second.end(); ++item) {
-              if ((*item)->removed())
+          if (const VarOccurrences::Items* items = envi.vo.items(vd)) {
+            for (unsigned int j=0; j<items->size(); j++) {
+              Item* item = (*items)[j];
+              if (item==NULL || item->removed())
                 continue;
-              if (VarDeclI* vdi = (*item)->dyn_cast<VarDeclI>()) {
+              if (VarDeclI* vdi = item->dyn_cast<VarDeclI>()) {
                 if (vdi->e()->e() && vdi->e()->e()->isa<ArrayLit>()) {
-                  IdMap<VarOccurrences::Items>::iterator ait = envi.vo._m.find(vdi->e()->id()->decl()->id());
-                  if (ait != envi.vo._m.end()) {
-                    for (VarOccurrences::Items::iterator aitem = ait->second.begin(); aitem != ait->second.end(); ++aitem) {
-                      simplifyBoolConstraint(envi,*aitem,vd,remove,vardeclQueue,constraintQueue,toRemove,nonFixedLiteralCount);
+                  if (const VarOccurrences::Items* aitems = envi.vo.items(vdi->e())) {
+                    for (unsigned int k=0; k<aitems->size(); k++) {
+                      if ((*aitems)[k])
+                        simplifyBoolConstraint(envi,(*aitems)[k],vd,remove,vardeclQueue,constraintQueue,toRemove,nonFixedLiteralCount);
                     }
                   }
                   continue;
                 }
               }
-              simplifyBoolConstraint(envi,*item,vd,remove,vardeclQueue,constraintQueue,toRemove,nonFixedLiteralCount);
+              simplifyBoolConstraint(envi,item,vd,remove,vardeclQueue,constraintQueue,toRemove,nonFixedLiteralCount);
             }
           }
           for (unsigned int i=toRemove.size(); i--;) {
@@ -598,13 +740,13 @@ namespace MiniZinc {
           if (remove) {
             deletedVarDecls.push_back(vd);
           } else {
-            simplifyConstraint(envi,m[var_idx],deletedVarDecls,constraintQueue,vardeclQueue);
+            simplifyConstraint(envi,m[var_idx],deletedVarDecls,constraintQueue,vardeclQueue,first);
           }
         }
         else if (vd->type().isint() && vd->ti()->domain()) {
           IntSetVal* isv = eval_intset(envi, vd->ti()->domain());
           if (isv->size()==1 && isv->card()==1) {
-            simplifyConstraint(envi,m[var_idx],deletedVarDecls,constraintQueue,vardeclQueue);
+            simplifyConstraint(envi,m[var_idx],deletedVarDecls,constraintQueue,vardeclQueue,first);
           }
         }
       }
@@ -629,7 +771,7 @@ namespace MiniZinc {
         } else if (!c || !(c->id()==constants().ids.forall || c->id()==constants().ids.exists ||
                            c->id()==constants().ids.clause) ) {
           substituteFixedVars(envi, item, deletedVarDecls);
-          handledConstraint = simplifyConstraint(envi,item,deletedVarDecls,constraintQueue,vardeclQueue);
+          handledConstraint = simplifyConstraint(envi,item,deletedVarDecls,constraintQueue,vardeclQueue,first);
         }
       }
     }
@@ -683,7 +825,7 @@ namespace MiniZinc {
       }
       if (subsumed) {
         if (isConjunction) {
-          if (bi->isa<ConstraintI>()) {
+          if (bi->isa<ConstraintI>() || bi->cast<VarDeclI>()->e()->ti()->domain()==constants().lit_true) {
             env.envi().flat()->fail(env.envi());
           } else {
             ArrayLit* al = follow_id(c->args()[0])->cast<ArrayLit>();
@@ -698,7 +840,9 @@ namespace MiniZinc {
           if (bi->isa<ConstraintI>()) {
             CollectDecls cd(envi.vo,deletedVarDecls,bi);
             topDown(cd,bi->cast<ConstraintI>()->e());
-            bi->remove();
+            envi.flat_removeItem(bi);
+          } else if (bi->cast<VarDeclI>()->e()->ti()->domain()==constants().lit_false) {
+            env.envi().flat()->fail(env.envi());
           } else {
             CollectDecls cd(envi.vo,deletedVarDecls,bi);
             topDown(cd,bi->cast<VarDeclI>()->e()->e());
@@ -734,7 +878,8 @@ namespace MiniZinc {
       //std::cerr << "DEBUG: cur = " << *cur << "\n"; // TODO: some variables are ignored here. uncomment and run
       if (envi.vo.occurrences(cur) == 0) {
         IdMap<int>::iterator cur_idx = envi.vo.idx.find(cur->id());
-        if (cur_idx != envi.vo.idx.end() && !m[cur_idx->second]->removed()) {
+        if (cur_idx != envi.vo.idx.end() && cur_idx->second >= static_cast<int>(first) &&
+            !m[cur_idx->second]->removed()) {
           if (isOutput(cur)) {
             Expression* val = NULL;
             if (cur->type().isbool() && cur->ti()->domain()) {
@@ -795,6 +940,31 @@ namespace MiniZinc {
     }
   }
 
+  void optimize(Env& env) {
+    optimize(env, 0);
+  }
+
+  void optimizeIncremental(Env& env, unsigned int first, std::vector<Item*>& removed) {
+    EnvI& envi = env.envi();
+    Model& m = *envi.flat();
+    UNORDERED_NAMESPACE::unordered_set<Item*> reported;
+    for (unsigned int i=first; i<m.size(); i++)
+      reported.insert(m[i]);
+    std::vector<Item*> removedItems;
+    envi.removedItems = &removedItems;
+    try {
+      optimize(env, first);
+    } catch (...) {
+      envi.removedItems = NULL;
+      throw;
+    }
+    envi.removedItems = NULL;
+    for (unsigned int i=0; i<removedItems.size(); i++) {
+      if (reported.insert(removedItems[i]).second)
+        removed.push_back(removedItems[i]);
+    }
+  }
+
   class SubstitutionVisitor : public EVisitor {
   protected:
     std::vector<VarDecl*> removed;
@@ -874,7 +1044,8 @@ namespace MiniZinc {
   bool simplifyConstraint(EnvI& env, Item* ii,
                           std::vector<VarDecl*>& deletedVarDecls,
                           std::vector<Item*>& constraintQueue,
-                          std::vector<int>& vardeclQueue) {
+                          std::vector<int>& vardeclQueue,
+                          unsigned int first) {
     Expression* con_e;
     bool is_true;
     bool is_false;
@@ -892,9 +1063,12 @@ namespace MiniZinc {
     if (Call* c = Expression::dyn_cast<Call>(con_e)) {
       if (c->id()==constants().ids.int_.eq || c->id()==constants().ids.bool_eq ||
           c->id()==constants().ids.float_.eq) {
-        if (is_true && c->args()[0]->isa<Id>() && c->args()[1]->isa<Id>() &&
-            (c->args()[0]->cast<Id>()->decl()->e()==NULL || c->args()[1]->cast<Id>()->decl()->e()==NULL) ) {
-          unify(env, deletedVarDecls, c->args()[0]->cast<Id>(), c->args()[1]->cast<Id>());
+        Id* id0 = c->args()[0]->dyn_cast<Id>();
+        Id* id1 = c->args()[1]->dyn_cast<Id>();
+        if (is_true && id0 && id1 &&
+            (id0->decl()->e()==NULL || id1->decl()->e()==NULL) &&
+            unifiable(env, id0, id1, first) ) {
+          unify(env, deletedVarDecls, id0, id1);
           pushDependentConstraints(env, c->args()[0]->cast<Id>(), constraintQueue);
           CollectDecls cd(env.vo,deletedVarDecls,ii);
           topDown(cd,c);
@@ -1054,7 +1228,7 @@ namespace MiniZinc {
             vdi->e()->ti()->setComputedDomain(true);
             pushDependentConstraints(env, ident, constraintQueue);
             if (env.vo.occurrences(vdi->e())==0) {
-              vdi->remove();
+              env.flat_removeItem(vdi);
             }
           }
         } else {
@@ -1142,10 +1316,15 @@ namespace MiniZinc {
               VarDeclI* vdi = ii->cast<VarDeclI>();
               vdi->e()->e(rewrite);
               if (vdi->e()->e() && vdi->e()->e()->isa<Id>() && vdi->e()->type().dim()==0) {
+                Id* id0 = vdi->e()->id();
                 Id* id1 = vdi->e()->e()->cast<Id>();
                 vdi->e()->e(NULL);
-                unify(env, deletedVarDecls, vdi->e()->id(), id1);
-                pushDependentConstraints(env, id1, constraintQueue);
+                if (unifiable(env, id0, id1, first)) {
+                  unify(env, deletedVarDecls, id0, id1);
+                  pushDependentConstraints(env, id1, constraintQueue);
+                } else {
+                  vdi->e()->e(id1);
+                }
               }
               pushVarDecl(env, vdi, env.vo.find(vdi->e()), vardeclQueue);
             }
@@ -29,12 +29,6 @@ namespace MiniZinc {
     return CS_NONE;
   }
   
-  OptimizeRegistry&
-  OptimizeRegistry::registry(void) {
-    static OptimizeRegistry reg;
-    return reg;
-  }
-  
   namespace Optimizers {
     
     OptimizeRegistry::ConstraintStatus o_linear(EnvI& env, Item* ii, Call* c, Expression*& rewrite) {
@@ -275,28 +269,50 @@ namespace MiniZinc {
       }
     }
     
-    class Register {
-    public:
-      Register(void) {
-        GCLock lock;
-        Model* m = new Model;
-        ASTString id_element("array_int_element");
-        ASTString id_var_element("array_var_int_element");
-        std::vector<Expression*> e;
-        e.push_back(new StringLit(Location(),id_element));
-        e.push_back(new StringLit(Location(),id_var_element));
-        m->addItem(new ConstraintI(Location(),new ArrayLit(Location(),e)));
-        OptimizeRegistry::registry().reg(constants().ids.int_.lin_eq, o_linear);
-        OptimizeRegistry::registry().reg(constants().ids.int_.lin_le, o_linear);
-        OptimizeRegistry::registry().reg(constants().ids.int_.lin_ne, o_linear);
-        OptimizeRegistry::registry().reg(id_element, o_element);
-        OptimizeRegistry::registry().reg(constants().ids.lin_exp, o_lin_exp);
-        OptimizeRegistry::registry().reg(id_var_element, o_element);
-        OptimizeRegistry::registry().reg(constants().ids.clause, o_clause);
-        OptimizeRegistry::registry().reg(constants().ids.bool_clause, o_clause);
-      }
-    } _r;
+    void registerOptimizers(OptimizeRegistry& reg, Model* m) {
+      ASTString id_element("array_int_element");
+      ASTString id_var_element("array_var_int_element");
+      std::vector<Expression*> e;
+      e.push_back(new StringLit(Location(),id_element));
+      e.push_back(new StringLit(Location(),id_var_element));
+      m->addItem(new ConstraintI(Location(),new ArrayLit(Location(),e)));
+      reg.reg(constants().ids.int_.lin_eq, o_linear);
+      reg.reg(constants().ids.int_.lin_le, o_linear);
+      reg.reg(constants().ids.int_.lin_ne, o_linear);
+      reg.reg(id_element, o_element);
+      reg.reg(constants().ids.lin_exp, o_lin_exp);
+      reg.reg(id_var_element, o_element);
+      reg.reg(constants().ids.clause, o_clause);
+      reg.reg(constants().ids.bool_clause, o_clause);
+    }
     
   }
   
-}
\ No newline at end of file
+  OptimizeRegistry::OptimizeRegistry(void) {
+    GCLock lock;
+    _keepAlive = new Model;
+    Optimizers::registerOptimizers(*this, _keepAlive);
+  }
+
+  OptimizeRegistry::~OptimizeRegistry(void) {
+    delete _keepAlive;
+  }
+
+  namespace {
+    MZN_THREAD_LOCAL OptimizeRegistry* _registry = NULL;
+    void releaseRegistry(void) {
+      delete _registry;
+      _registry = NULL;
+    }
+  }
+
+  OptimizeRegistry&
+  OptimizeRegistry::registry(void) {
+    if (_registry==NULL) {
+      _registry = new OptimizeRegistry();
+      GC::atRelease(&releaseRegistry);
+    }
+    return *_registry;
+  }
+
+}
@@ -13,6 +13,7 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <cstdio>
 #include <limits>
 #include <iomanip>
 #include <map>
@@ -159,11 +160,93 @@ namespace MiniZinc {
     return ret;
   }
   
+  /**
+   * \brief Output buffer for the plain printer
+   *
+   * Collects the output in a string that is written to the stream in
+   * large blocks (and when the buffer is destroyed), and formats numbers
+   * without going through the stream.
+   */
+  class PlainBuffer {
+  protected:
+    /// The buffer (reused between print calls)
+    std::string& _buf;
+    /// The stream to write to
+    std::ostream& _os;
+    /// Write the buffer to the stream once it exceeds this size
+    static const size_t limit = 1 << 16;
+    /// Write the buffer to the stream if it is full
+    void check(void) {
+      if (_buf.size() >= limit)
+        flush();
+    }
+  public:
+    PlainBuffer(std::string& buf, std::ostream& os) : _buf(buf), _os(os) {
+      _buf.clear();
+    }
+    ~PlainBuffer(void) { flush(); }
+    /// Write the buffer to the stream
+    void flush(void) {
+      if (!_buf.empty()) {
+        _os.write(_buf.data(), _buf.size());
+        _buf.clear();
+      }
+    }
+    PlainBuffer& operator <<(char c) {
+      _buf += c;
+      check();
+      return *this;
+    }
+    PlainBuffer& operator <<(const char* s) {
+      _buf += s;
+      check();
+      return *this;
+    }
+    PlainBuffer& operator <<(const std::string& s) {
+      _buf += s;
+      check();
+      return *this;
+    }
+    PlainBuffer& operator <<(const ASTString& s) {
+      if (s.size() != 0)
+        _buf.append(s.c_str(), s.size());
+      check();
+      return *this;
+    }
+    PlainBuffer& operator <<(long long int v) {
+      char d[24];
+      char* end = d+sizeof(d);
+      char* p = end;
+      unsigned long long int u = v < 0 ? 0ULL-static_cast<unsigned long long int>(v)
+                                       : static_cast<unsigned long long int>(v);
+      do {
+        *--p = static_cast<char>('0' + u % 10);
+        u /= 10;
+      } while (u != 0);
+      if (v < 0)
+        *--p = '-';
+      _buf.append(p, end-p);
+      check();
+      return *this;
+    }
+    PlainBuffer& operator <<(int v) {
+      return (*this) << static_cast<long long int>(v);
+    }
+    PlainBuffer& operator <<(const IntVal& v) {
+      if (v.isMinusInfinity())
+        return (*this) << "-infinity";
+      else if (v.isPlusInfinity())
+        return (*this) << "infinity";
+      else
+        return (*this) << v.toInt();
+    }
+  };
+
   class PlainPrinter {
   public:
-    std::ostream& os;
+    PlainBuffer os;
     bool _flatZinc;
-    PlainPrinter(std::ostream& os0, bool flatZinc) : os(os0), _flatZinc(flatZinc) {}
+    PlainPrinter(std::string& buf, std::ostream& os0, bool flatZinc) : os(buf,os0), _flatZinc(flatZinc) {}
 
     void p(const Type& type, const Expression* e) {
       switch (type.ti()) {
@@ -209,12 +292,13 @@ namespace MiniZinc {
         break;
       case Expression::E_FLOATLIT:
         {
-          std::ostringstream oss;
-          oss << std::setprecision(std::numeric_limits<double>::digits10+1);
-          oss << e->cast<FloatLit>()->v();
-          if (oss.str().find("e") == std::string::npos && oss.str().find(".") == std::string::npos)
-            oss << ".0";
-          os << oss.str();
+          char d[32];
+          int n = snprintf(d, sizeof(d), "%.*g", std::numeric_limits<double>::digits10+1,
+                           e->cast<FloatLit>()->v());
+          if (std::string(d,n).find_first_of("e.") == std::string::npos)
+            os << d << ".0";
+          else
+            os << d;
         }
         break;
       case Expression::E_SETLIT:
@@ -700,7 +784,7 @@ namespace MiniZinc {
         }
         break;
       }
-      os << ";" << std::endl;
+      os << ";\n";
     }
   };
 
@@ -1960,7 +2044,7 @@ namespace MiniZinc {
   void
   Printer::print(const Expression* e) {
     if (_width==0) {
-      PlainPrinter p(_os,_flatZinc); p.p(e);
+      PlainPrinter p(_buf,_os,_flatZinc); p.p(e);
     } else {
       init();
       Document* d = expressionToDocument(e);
@@ -1971,7 +2055,7 @@ namespace MiniZinc {
   void
   Printer::print(const Item* i) {
     if (_width==0) {
-      PlainPrinter p(_os,_flatZinc); p.p(i);
+      PlainPrinter p(_buf,_os,_flatZinc); p.p(i);
     } else {
       init();
       p(i);
@@ -1980,7 +2064,7 @@ namespace MiniZinc {
   void
   Printer::print(const Model* m) {
     if (_width==0) {
-      PlainPrinter p(_os,_flatZinc);
+      PlainPrinter p(_buf,_os,_flatZinc);
       for (unsigned int i = 0; i < m->size(); i++) {
         p.p((*m)[i]);
       }
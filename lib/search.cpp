@@ -16,6 +16,7 @@
 #include <minizinc/prettyprinter.hh> // for DEBUG only
 #include <minizinc/eval_par.hh>
 #include <minizinc/flatten_internal.hh>
+#include <minizinc/optimize.hh>
 
 namespace MiniZinc {
   
@@ -66,7 +67,8 @@ namespace MiniZinc {
         return interpretCommitCombinator(call, solver, verbose);
       }
       else {
-        std::vector<Expression*> previousParameters(call->decl()->params().size());
+        // the previous values are not reachable while the parameters are bound
+        std::vector<KeepAlive> previousParameters(call->decl()->params().size());
         for (unsigned int i=call->decl()->params().size(); i--;) {
           VarDecl* vd = call->decl()->params()[i];
           previousParameters[i] = vd->e();
@@ -120,7 +122,7 @@ namespace MiniZinc {
 
         for (unsigned int i=call->decl()->params().size(); i--;) {
           VarDecl* vd = call->decl()->params()[i];
-          vd->e(previousParameters[i]);
+          vd->e(previousParameters[i]());
           vd->flat(vd->e() ? vd : NULL);
         }
         return ret;
@@ -272,6 +274,7 @@ namespace MiniZinc {
         }
         else { // TODO : ArrayAccess??
           std::cerr << "TODO: array access" << std::endl;
+          _writer->flush();
           exit(EXIT_FAILURE);
         }
       }
@@ -281,6 +284,8 @@ namespace MiniZinc {
       ssm << "Expected identifier instead of " << *(call->args()[0]) << " in " << *call;
       throw TypeError(solver->env().envi(), call->args()[0]->loc(), ssm.str());
     }
+    if(print)
+      _writer->flush(); // the solver prints its solutions itself
     return solver->best(decl,minimize,print);
   }
   
@@ -410,13 +415,14 @@ namespace MiniZinc {
           }
           SolverInstance::Status status = SolverInstance::FAILURE;
           // repeat the argument a limited number of times
-          Expression* oldValue = compr->decl(0, 0)->e();
+          // the old value is not reachable while the generator is bound
+          KeepAlive oldValue(compr->decl(0, 0)->e());
           _repeat_break.push_back(false);
           for(unsigned int i = 0; i<nbIterations; i++) {
             GCLock lock;
             if(isTimeLimitViolated()) { // we have reached a timeout; set timeout index and stop
               setTimeoutIndex(getViolatedTimeLimitIndex());           
-              compr->decl(0, 0)->e(oldValue);             
+              compr->decl(0, 0)->e(oldValue());             
               return status;
             }
             if (_repeat_break.back()) {
@@ -429,7 +435,7 @@ namespace MiniZinc {
             status = interpretCombinator(compr->e(),solver,verbose);     
           }
           _repeat_break.pop_back();
-          compr->decl(0, 0)->e(oldValue);
+          compr->decl(0, 0)->e(oldValue());
           //std::cout << "REPEAT returning status: " << status << std::endl;
           return status;
         }            
@@ -490,7 +496,7 @@ namespace MiniZinc {
     solver_copy->env().envi().pushSolution(solver->env().envi().getCurrentSolution());
     //std::cerr << "DEBUG: Copied solver instance" << std::endl;
     pushScope(solver_copy);
-    SolverInstance::Status status = interpretCombinator(solver_copy->env().combinator, solver_copy, verbose);
+    SolverInstance::Status status = interpretCombinator(solver_copy->env().combinator(), solver_copy, verbose);
     if (solver->env().envi().nbSolutionScopes() > 1) {
       if (solver_copy->env().envi().getSolution(0) != NULL) {
         solver->env().envi().setSolution(solver->env().envi().nbSolutionScopes()-2,
@@ -883,15 +889,41 @@ namespace MiniZinc {
     }    
   }
   
+  void
+  SearchHandler::writeOutput(const std::string& s, bool verbose) {
+    _writer->write(s);
+    if(verbose)
+      _writer->flush();
+  }
+  
+  void
+  SearchHandler::writeSolution(SolverInstanceBase* solver, bool delimiter, bool verbose) {
+    if(_format != SF_TEXT) {
+      writeOutput(solutionRecord(solver->env(), _format, _searchTime.ms(), solver->statistics()), verbose);
+      return;
+    }
+    std::ostringstream oss;
+    try {
+      GCLock lock;
+      solver->env().evalOutput(oss);
+    } catch (...) {
+      // write the output up to the error, as if it had been printed directly
+      writeOutput(oss.str(), verbose);
+      throw;
+    }
+    if(delimiter)
+      oss << constants().solver_output.solution_delimiter << "\n";
+    // the writer thread flushes the stream, so solutions can be read from within Python as they are found
+    writeOutput(oss.str(), verbose);
+  }
+  
   SolverInstance::Status
   SearchHandler::interpretPrintCombinator(Call* call, SolverInstanceBase* solver, bool verbose) {
     //std::cerr << "DEBUG: PRINT combinator: " << *call << std::endl;
     if (call->args().size()==0) {        
       
       if(solver->env().envi().getCurrentSolution() != NULL) {
-        GCLock lock;        
-        solver->env().evalOutput(std::cout);
-        std::cout << constants().solver_output.solution_delimiter << std::endl;
+        writeSolution(solver, true, verbose);
         return SolverInstance::SUCCESS;
       }
       else {
@@ -901,7 +933,7 @@ namespace MiniZinc {
       }
     } else {      
       GCLock lock;
-      std::cout << eval_string(solver->env().envi(), call->args()[0]);
+      writeOutput(messageRecord(eval_string(solver->env().envi(), call->args()[0]), _format), verbose);
       return SolverInstance::SUCCESS;
     }
   }
@@ -909,10 +941,7 @@ namespace MiniZinc {
   SolverInstance::Status
   SearchHandler::interpretPrintCombinator(SolverInstanceBase* solver, bool verbose) {  
     if(solver->env().envi().getCurrentSolution() != NULL) {
-      GCLock lock;
-      solver->env().evalOutput(std::cout);      
-      std::cout << constants().solver_output.solution_delimiter << std::endl;
-      std::cout.flush(); // flush so we can read it from within Python
+      writeSolution(solver, true, verbose);
       return SolverInstance::SUCCESS;
     }
     else {
@@ -932,16 +961,14 @@ namespace MiniZinc {
     if(verbose)
       std::cerr << "DEBUG: BEGIN posting constraint: " << *cts << std::endl;
 
-    int nbCtsBefore = 0;
     int nbVarsBefore = 0;
     Model* flat = env.flat();
+    // all items from index first are added by flattening the constraints
+    unsigned int first = flat->size();
     for(unsigned int i=0; i < flat->size(); i++) {
       if(VarDeclI* vdi = (*flat)[i]->dyn_cast<VarDeclI>()) {
         if(!vdi->removed()) nbVarsBefore++;
       }
-      if(ConstraintI* ci = (*flat)[i]->dyn_cast<ConstraintI>()) {
-        if(!ci->removed()) nbCtsBefore++;
-      }      
     }
     nbVarsBefore = nbVarsBefore - _localVarsToAdd[_localVarsToAdd.size()-1]; // We've already added the local vars!   
            
@@ -958,17 +985,16 @@ namespace MiniZinc {
     FlatteningOptions fopt; 
     fopt.keepOutputInFzn = _localVarsToAdd[_localVarsToAdd.size()-1] > 0;  // keep the output vars since they are local vars
     (void) flatten(env.envi(), cts, constants().var_true, constants().var_true, fopt); //env.envi().fopt);    
+    // simplify the new items, and remove the old items that they make redundant
+    std::vector<Item*> removed;
+    optimizeIncremental(env, first, removed);
     oldflatzinc_basic(env);
     
     int nbVarsAfter = 0;
-    int nbCtsAfter = 0;
     for(unsigned int i=0; i < flat->size(); i++) {
       if(VarDeclI* vdi = (*flat)[i]->dyn_cast<VarDeclI>()) {
         if(!vdi->removed()) nbVarsAfter++;
       }
-      if(ConstraintI* ci = (*flat)[i]->dyn_cast<ConstraintI>()) {
-        if(!ci->removed()) nbCtsAfter++;
-      }      
     }   
     if(nbVarsBefore < nbVarsAfter) {
       std::vector<Id*> ids;
@@ -997,24 +1023,30 @@ namespace MiniZinc {
       success = success && solver->addVariables(vars);      
     }      
              
-    if(nbCtsBefore < nbCtsAfter) {       
-      std::vector<Call*> flat_cts;
-      int i = 0;
-      for(unsigned int j=0; j<flat->size(); j++) {
-        if(ConstraintI* ci = (*flat)[j]->dyn_cast<ConstraintI>()) {
-          if(!ci->removed()) {
-            if(i<nbCtsBefore) i++;
-            else {
-              flat_cts.push_back(ci->e()->cast<Call>());
-            }
+    std::vector<Call*> flat_cts;
+    for(unsigned int j=first; j<flat->size(); j++) {
+      if(ConstraintI* ci = (*flat)[j]->dyn_cast<ConstraintI>()) {
+        if(!ci->removed()) {
+          if(Call* c = ci->e()->dyn_cast<Call>()) {
+            flat_cts.push_back(c);
+          } else if(ci->e() == constants().lit_false) {
+            success = false;
           }
         }
       }
+    }
+    if(!flat_cts.empty()) {
       if(verbose)
         for(unsigned int i=0; i<flat_cts.size(); i++)
           std::cout << "DEBUG: adding new (flat) constraint to solver:" << *flat_cts[i] << std::endl;      
       success = success && solver->postConstraints(flat_cts);      
     }
+    if(!removed.empty()) {
+      if(verbose)
+        for(unsigned int i=0; i<removed.size(); i++)
+          std::cerr << "DEBUG: removing simplified item from solver:" << *removed[i] << std::endl;
+      success = success && solver->removeItems(removed);
+    }
     
     bool updateBoundsOnce = false;
     // check for variable domain updates
@@ -1044,10 +1076,34 @@ namespace MiniZinc {
           else {
           // TODO: check for boolean and floating point bounds
           }
+        } else if(domain) {
+          // the variable has been fixed when simplifying the new constraints
+          if(SetLit* sl_new = domain->dyn_cast<SetLit>()) {
+            if(sl_new->isv()->size() > 0 && sl_new->isv()->min().isFinite() && sl_new->isv()->max().isFinite()) {
+              int lb_new = sl_new->isv()->min().toInt();
+              int ub_new = sl_new->isv()->max().toInt();
+              updateBoundsOnce = true;
+              if(verbose)
+                std::cout << "DEBUG: updating intbounds of \"" << *(id->decl()) << "\" to new bounds: (" << lb_new << ", " << ub_new << ")"  << std::endl;
+              success = success && solver->updateIntBounds(id->decl(),lb_new,ub_new);
+            }
+          } else if(BoolLit* bl = domain->dyn_cast<BoolLit>()) {
+            std::vector<Expression*> args(2);
+            args[0] = id;
+            args[1] = bl;
+            Call* c = new Call(Location().introduce(),constants().ids.bool_eq,args);
+            c->type(Type::varbool());
+            c->decl(env.envi().orig->matchFn(env.envi(),c));
+            if(verbose)
+              std::cout << "DEBUG: adding new (flat) constraint to solver:" << *c << std::endl;
+            std::vector<Call*> fixed_cts(1, c);
+            updateBoundsOnce = true;
+            success = success && solver->postConstraints(fixed_cts);
+          }
         }
       }
     }
-    if(!updateBoundsOnce && nbCtsBefore == nbCtsAfter && nbVarsBefore == nbVarsAfter) {
+    if(!updateBoundsOnce && flat_cts.empty() && removed.empty() && nbVarsBefore == nbVarsAfter) {
       if(verbose)
         std::cerr << "WARNING: flat model did not change after posting constraint: " << *cts << std::endl;
     }       
@@ -1141,6 +1197,11 @@ namespace MiniZinc {
      return to;
    } */
    
+   void
+   SearchHandler::setTimeLimit(long long int ms) {
+     _timeouts.push_back(ms_now()+ms);
+   }
+   
    void 
    SearchHandler::setCurrentTimeout(SolverInstanceBase* solver) {
      if(_timeouts.size() == 0)
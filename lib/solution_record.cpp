@@ -0,0 +1,364 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <minizinc/solution_record.hh>
+#include <minizinc/binary_ast.hh>
+#include <minizinc/eval_par.hh>
+#include <minizinc/exception.hh>
+#include <minizinc/flatten_internal.hh>
+#include <minizinc/json.hh>
+#include <minizinc/prettyprinter.hh>
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <sstream>
+
+namespace MiniZinc {
+
+  SolutionFormat
+  solutionFormat(const std::string& name) {
+    if (name=="text")
+      return SF_TEXT;
+    if (name=="json")
+      return SF_JSON;
+    if (name=="binary")
+      return SF_BINARY;
+    throw InternalError("unknown solution format "+name+" (expected text, json or binary)");
+  }
+
+  namespace {
+
+    /// Return the solution model of \a env
+    Model* solutionModel(Env& env) {
+      Model* sol = env.envi().getCurrentSolution();
+      return sol==NULL ? env.output() : sol;
+    }
+
+    /// Return the flat declaration that \a vd stands for
+    VarDecl* reallyFlat(VarDecl* vd) {
+      VarDecl* f = vd->flat();
+      while (f && f != f->flat())
+        f = f->flat();
+      return f;
+    }
+
+    /// Return the value of the objective of the flat model of \a env in solution \a sol, or NULL if it is unknown
+    Expression* objectiveValue(Env& env, Model* sol) {
+      SolveI* si = env.flat()->solveItem();
+      if (si==NULL || si->st()==SolveI::ST_SAT || si->e()==NULL)
+        return NULL;
+      if (si->e()->type().ispar())
+        return eval_par(env.envi(), si->e());
+      Expression* obj = follow_id_to_decl(si->e());
+      if (obj==NULL || !obj->isa<VarDecl>())
+        return NULL;
+      for (VarDeclIterator it = sol->begin_vardecls(); it != sol->end_vardecls(); ++it) {
+        VarDecl* vd = it->e();
+        if (vd->type().dim()==0 && vd->e() && vd->flat() && follow_id_to_decl(reallyFlat(vd))==obj)
+          return eval_par(env.envi(), vd->e(), true);
+      }
+      return NULL;
+    }
+
+    /// Writer for JSON records
+    class JSONRecord {
+    public:
+      /// The record
+      std::string r;
+      /// Append integer \a v
+      void writeInt(const IntVal& v) {
+        if (v.isFinite()) {
+          char buf[24];
+          snprintf(buf, sizeof(buf), "%lld", v.toInt());
+          r += buf;
+        } else {
+          r += v.isPlusInfinity() ? "\"infinity\"" : "\"-infinity\"";
+        }
+      }
+      /// Append floating point number \a d
+      void writeFloat(double d) {
+        if (std::isfinite(d)) {
+          char buf[32];
+          snprintf(buf, sizeof(buf), "%.*g", std::numeric_limits<double>::digits10+1, d);
+          r += buf;
+        } else {
+          r += "null";
+        }
+      }
+      /// Append elements \a begin to \a begin+size of dimension \a d of \a al as nested arrays
+      void writeArray(ArrayLit* al, int d, int begin, int size) {
+        r += '[';
+        int n = al->max(d)-al->min(d)+1;
+        int step = n==0 ? 0 : size/n;
+        for (int i=0; i<n; i++) {
+          if (i > 0)
+            r += ',';
+          if (d+1 < al->dims())
+            writeArray(al, d+1, begin+i*step, step);
+          else
+            write(al->v()[begin+i]);
+        }
+        r += ']';
+      }
+      /// Append value \a e
+      void write(Expression* e) {
+        if (e==constants().absent) {
+          r += "null";
+          return;
+        }
+        switch (e->eid()) {
+          case Expression::E_INTLIT:
+            writeInt(e->cast<IntLit>()->v());
+            break;
+          case Expression::E_FLOATLIT:
+            writeFloat(e->cast<FloatLit>()->v());
+            break;
+          case Expression::E_BOOLLIT:
+            r += e->cast<BoolLit>()->v() ? "true" : "false";
+            break;
+          case Expression::E_STRINGLIT:
+            r += jsonString(e->cast<StringLit>()->v().str());
+            break;
+          case Expression::E_SETLIT:
+          {
+            SetLit* sl = e->cast<SetLit>();
+            r += "{\"set\":[";
+            if (IntSetVal* isv = sl->isv()) {
+              for (int i=0; i<isv->size(); i++) {
+                if (i > 0)
+                  r += ',';
+                if (isv->min(i)==isv->max(i)) {
+                  writeInt(isv->min(i));
+                } else {
+                  r += '[';
+                  writeInt(isv->min(i));
+                  r += ',';
+                  writeInt(isv->max(i));
+                  r += ']';
+                }
+              }
+            } else {
+              for (unsigned int i=0; i<sl->v().size(); i++) {
+                if (i > 0)
+                  r += ',';
+                write(sl->v()[i]);
+              }
+            }
+            r += "]}";
+          }
+            break;
+          case Expression::E_ARRAYLIT:
+          {
+            ArrayLit* al = e->cast<ArrayLit>();
+            writeArray(al, 0, 0, al->v().size());
+          }
+            break;
+          default:
+          {
+            std::ostringstream oss;
+            oss << "cannot write " << *e << " as a solution value";
+            throw InternalError(oss.str());
+          }
+        }
+      }
+    };
+
+    /// Append value \a e to binary record \a w
+    void writeBinaryValue(BinaryWriter& w, Expression* e) {
+      if (e==constants().absent) {
+        w.writeByte(SV_NULL);
+        return;
+      }
+      switch (e->eid()) {
+        case Expression::E_INTLIT:
+        {
+          IntVal v = e->cast<IntLit>()->v();
+          if (v.isFinite()) {
+            w.writeByte(SV_INT);
+            w.writeInt(v.toInt());
+          } else {
+            w.writeByte(v.isPlusInfinity() ? SV_INFINITY : SV_MINUS_INFINITY);
+          }
+        }
+          break;
+        case Expression::E_FLOATLIT:
+          w.writeByte(SV_FLOAT);
+          w.writeFloat(e->cast<FloatLit>()->v());
+          break;
+        case Expression::E_BOOLLIT:
+          w.writeByte(e->cast<BoolLit>()->v() ? SV_TRUE : SV_FALSE);
+          break;
+        case Expression::E_STRINGLIT:
+          w.writeByte(SV_STRING);
+          w.writeString(e->cast<StringLit>()->v().str());
+          break;
+        case Expression::E_SETLIT:
+        {
+          SetLit* sl = e->cast<SetLit>();
+          if (IntSetVal* isv = sl->isv()) {
+            w.writeByte(SV_SET_INT);
+            w.writeUInt(isv->size());
+            for (int i=0; i<isv->size(); i++) {
+              w.writeIntVal(isv->min(i));
+              w.writeIntVal(isv->max(i));
+            }
+          } else {
+            w.writeByte(SV_SET);
+            w.writeUInt(sl->v().size());
+            for (unsigned int i=0; i<sl->v().size(); i++)
+              writeBinaryValue(w, sl->v()[i]);
+          }
+        }
+          break;
+        case Expression::E_ARRAYLIT:
+        {
+          ArrayLit* al = e->cast<ArrayLit>();
+          bool allInt = true;
+          for (unsigned int i=0; allInt && i<al->v().size(); i++)
+            allInt = al->v()[i]->isa<IntLit>() && al->v()[i]->cast<IntLit>()->v().isFinite();
+          w.writeByte(allInt ? SV_ARRAY_INT : SV_ARRAY);
+          w.writeUInt(al->dims());
+          for (int i=0; i<al->dims(); i++) {
+            w.writeInt(al->min(i));
+            w.writeInt(al->max(i));
+          }
+          for (unsigned int i=0; i<al->v().size(); i++) {
+            if (allInt)
+              w.writeInt(al->v()[i]->cast<IntLit>()->v().toInt());
+            else
+              writeBinaryValue(w, al->v()[i]);
+          }
+        }
+          break;
+        default:
+        {
+          std::ostringstream oss;
+          oss << "cannot write " << *e << " as a solution value";
+          throw InternalError(oss.str());
+        }
+      }
+    }
+
+    /// Return binary record \a w preceded by its length
+    std::string lengthPrefixed(const BinaryWriter& w) {
+      BinaryWriter r;
+      r.writeUInt(w.size());
+      r.append(w);
+      return r.str();
+    }
+
+  }
+
+  std::string
+  solutionRecord(Env& env, SolutionFormat f, double elapsed, Statistics* stats) {
+    GCLock lock;
+    if (f==SF_TEXT) {
+      std::ostringstream oss;
+      env.evalOutput(oss);
+      oss << constants().solver_output.solution_delimiter << "\n";
+      return oss.str();
+    }
+    Model* sol = solutionModel(env);
+    std::vector<std::pair<VarDecl*,Expression*> > values;
+    for (VarDeclIterator it = sol->begin_vardecls(); it != sol->end_vardecls(); ++it) {
+      VarDecl* vd = it->e();
+      if (vd->flat() && vd->e() && !vd->introduced())
+        values.push_back(std::make_pair(vd, eval_par(env.envi(), vd->e(), true)));
+    }
+    Expression* obj = objectiveValue(env, sol);
+    if (f==SF_JSON) {
+      JSONRecord r;
+      r.r = "{\"type\":\"solution\",\"solution\":{";
+      for (unsigned int i=0; i<values.size(); i++) {
+        if (i > 0)
+          r.r += ',';
+        r.r += jsonString(values[i].first->id()->str().str());
+        r.r += ':';
+        r.write(values[i].second);
+      }
+      r.r += '}';
+      if (obj) {
+        r.r += ",\"objective\":";
+        r.write(obj);
+      }
+      if (elapsed >= 0.0) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), ",\"time\":%.3f", elapsed);
+        r.r += buf;
+      }
+      if (stats) {
+        std::ostringstream oss;
+        oss << ",\"statistics\":{\"nodes\":" << stats->nodes()
+            << ",\"failures\":" << stats->failures() << "}";
+        r.r += oss.str();
+      }
+      r.r += "}\n";
+      return r.r;
+    }
+    BinaryWriter w;
+    w.writeByte(SR_SOLUTION);
+    w.writeUInt(values.size());
+    for (unsigned int i=0; i<values.size(); i++) {
+      w.writeString(values[i].first->id()->str().str());
+      writeBinaryValue(w, values[i].second);
+    }
+    w.writeByte(obj ? 1 : 0);
+    if (obj)
+      writeBinaryValue(w, obj);
+    w.writeByte(elapsed >= 0.0 ? 1 : 0);
+    if (elapsed >= 0.0)
+      w.writeFloat(elapsed);
+    w.writeByte(stats ? 1 : 0);
+    if (stats) {
+      w.writeUInt(stats->nodes());
+      w.writeUInt(stats->failures());
+    }
+    return lengthPrefixed(w);
+  }
+
+  std::string
+  statusRecord(SolverInstance::Status status, SolutionFormat f) {
+    switch (f) {
+      case SF_TEXT:
+        return (status==SolverInstance::SUCCESS ? constants().solver_output.sat
+                                                : constants().solver_output.unsat).str()+"\n";
+      case SF_JSON:
+        return std::string("{\"type\":\"status\",\"status\":\"")+
+          (status==SolverInstance::SUCCESS ? "COMPLETE" : "UNSATISFIABLE")+"\"}\n";
+      default:
+      {
+        BinaryWriter w;
+        w.writeByte(SR_STATUS);
+        w.writeByte(static_cast<unsigned char>(status));
+        return lengthPrefixed(w);
+      }
+    }
+  }
+
+  std::string
+  messageRecord(const std::string& s, SolutionFormat f) {
+    switch (f) {
+      case SF_TEXT:
+        return s;
+      case SF_JSON:
+        return "{\"type\":\"message\",\"message\":"+jsonString(s)+"}\n";
+      default:
+      {
+        BinaryWriter w;
+        w.writeByte(SR_MESSAGE);
+        w.writeString(s);
+        return lengthPrefixed(w);
+      }
+    }
+  }
+
+}
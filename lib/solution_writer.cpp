@@ -0,0 +1,101 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// <thread> has to be included before SafeInt3.hpp, which redefines nullptr
+#include <thread>
+
+#include <minizinc/solution_writer.hh>
+
+#include <condition_variable>
+#include <mutex>
+
+namespace MiniZinc {
+
+  class SolutionWriter::Impl {
+  public:
+    /// The stream that the text is written to
+    std::ostream& os;
+    /// Protects the fields below
+    std::mutex m;
+    /// Signalled when text has been added or the writer is stopped
+    std::condition_variable added;
+    /// Signalled when the writer thread has written its text
+    std::condition_variable written;
+    /// Text that has not been taken by the writer thread yet
+    std::string pending;
+    /// Whether the writer thread is currently writing
+    bool writing;
+    /// Whether the writer thread should stop once everything is written
+    bool done;
+    /// The writer thread
+    std::thread t;
+    /// Maximum size of the pending text before write waits for the writer thread
+    static const size_t limit = 1 << 22;
+
+    Impl(std::ostream& os0) : os(os0), writing(false), done(false) {
+      t = std::thread(&Impl::run, this);
+    }
+    /// Write the pending text until the writer is stopped
+    void run(void) {
+      std::string text;
+      std::unique_lock<std::mutex> lock(m);
+      for (;;) {
+        while (pending.empty() && !done)
+          added.wait(lock);
+        if (pending.empty())
+          break;
+        text.swap(pending);
+        writing = true;
+        written.notify_all();
+        lock.unlock();
+        os.write(text.c_str(), text.size());
+        os.flush();
+        text.clear();
+        lock.lock();
+        writing = false;
+        written.notify_all();
+      }
+    }
+  };
+
+  SolutionWriter::SolutionWriter(std::ostream& os) : _impl(new Impl(os)) {}
+
+  SolutionWriter::~SolutionWriter(void) {
+    {
+      std::lock_guard<std::mutex> lock(_impl->m);
+      _impl->done = true;
+    }
+    _impl->added.notify_one();
+    _impl->t.join();
+    delete _impl;
+  }
+
+  void
+  SolutionWriter::write(const std::string& s) {
+    if (s.empty())
+      return;
+    {
+      std::unique_lock<std::mutex> lock(_impl->m);
+      while (_impl->pending.size() >= Impl::limit)
+        _impl->written.wait(lock);
+      _impl->pending += s;
+    }
+    _impl->added.notify_one();
+  }
+
+  void
+  SolutionWriter::flush(void) {
+    std::unique_lock<std::mutex> lock(_impl->m);
+    while (!_impl->pending.empty() || _impl->writing)
+      _impl->written.wait(lock);
+  }
+
+}
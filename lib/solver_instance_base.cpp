@@ -81,6 +81,12 @@ namespace MiniZinc {
     return true;
   }
   
+  bool
+  NISolverInstanceBase::removeItems(const std::vector<Item*>& items) {
+    // the items are already removed from the flat model
+    return true;
+  }
+  
   KeepAlive 
   NISolverInstanceBase::deriveNoGoodsFromSolution(void) {
     Model* flat = env().flat();
@@ -0,0 +1,399 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <minizinc/stdlib_image.hh>
+#include <minizinc/binary_ast.hh>
+#include <minizinc/file_utils.hh>
+#include <minizinc/parser.hh>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace MiniZinc {
+
+  namespace {
+
+    /// MD5 message digest (RFC 1321)
+    class MD5 {
+    protected:
+      unsigned int _h[4];
+      unsigned char _block[64];
+      unsigned int _blockSize;
+      unsigned long long int _length;
+      static unsigned int rotl(unsigned int x, unsigned int c) {
+        return (x << c) | (x >> (32-c));
+      }
+      void transform(const unsigned char* b) {
+        static const unsigned int s[64] = {
+          7,12,17,22,7,12,17,22,7,12,17,22,7,12,17,22,
+          5,9,14,20,5,9,14,20,5,9,14,20,5,9,14,20,
+          4,11,16,23,4,11,16,23,4,11,16,23,4,11,16,23,
+          6,10,15,21,6,10,15,21,6,10,15,21,6,10,15,21
+        };
+        static const unsigned int k[64] = {
+          0xd76aa478,0xe8c7b756,0x242070db,0xc1bdceee,0xf57c0faf,0x4787c62a,0xa8304613,0xfd469501,
+          0x698098d8,0x8b44f7af,0xffff5bb1,0x895cd7be,0x6b901122,0xfd987193,0xa679438e,0x49b40821,
+          0xf61e2562,0xc040b340,0x265e5a51,0xe9b6c7aa,0xd62f105d,0x02441453,0xd8a1e681,0xe7d3fbc8,
+          0x21e1cde6,0xc33707d6,0xf4d50d87,0x455a14ed,0xa9e3e905,0xfcefa3f8,0x676f02d9,0x8d2a4c8a,
+          0xfffa3942,0x8771f681,0x6d9d6122,0xfde5380c,0xa4beea44,0x4bdecfa9,0xf6bb4b60,0xbebfbc70,
+          0x289b7ec6,0xeaa127fa,0xd4ef3085,0x04881d05,0xd9d4d039,0xe6db99e5,0x1fa27cf8,0xc4ac5665,
+          0xf4292244,0x432aff97,0xab9423a7,0xfc93a039,0x655b59c3,0x8f0ccc92,0xffeff47d,0x85845dd1,
+          0x6fa87e4f,0xfe2ce6e0,0xa3014314,0x4e0811a1,0xf7537e82,0xbd3af235,0x2ad7d2bb,0xeb86d391
+        };
+        unsigned int m[16];
+        for (unsigned int i=0; i<16; i++)
+          m[i] = b[4*i] | (b[4*i+1] << 8) | (b[4*i+2] << 16) |
+                 (static_cast<unsigned int>(b[4*i+3]) << 24);
+        unsigned int a = _h[0], bb = _h[1], c = _h[2], d = _h[3];
+        for (unsigned int i=0; i<64; i++) {
+          unsigned int f, g;
+          if (i < 16) {
+            f = (bb & c) | (~bb & d); g = i;
+          } else if (i < 32) {
+            f = (d & bb) | (~d & c); g = (5*i+1) % 16;
+          } else if (i < 48) {
+            f = bb ^ c ^ d; g = (3*i+5) % 16;
+          } else {
+            f = c ^ (bb | ~d); g = (7*i) % 16;
+          }
+          unsigned int tmp = d;
+          d = c;
+          c = bb;
+          bb = bb + rotl(a + f + k[i] + m[g], s[i]);
+          a = tmp;
+        }
+        _h[0] += a; _h[1] += bb; _h[2] += c; _h[3] += d;
+      }
+    public:
+      MD5(void) : _blockSize(0), _length(0) {
+        _h[0] = 0x67452301; _h[1] = 0xefcdab89;
+        _h[2] = 0x98badcfe; _h[3] = 0x10325476;
+      }
+      void update(unsigned char c) {
+        _block[_blockSize++] = c;
+        _length++;
+        if (_blockSize==64) {
+          transform(_block);
+          _blockSize = 0;
+        }
+      }
+      std::string hex(void) {
+        unsigned long long int bits = _length*8;
+        update(0x80);
+        while (_blockSize != 56)
+          update(0);
+        for (unsigned int i=0; i<8; i++)
+          update(static_cast<unsigned char>(bits >> (8*i)));
+        static const char* digits = "0123456789abcdef";
+        std::string ret;
+        for (unsigned int i=0; i<4; i++)
+          for (unsigned int j=0; j<4; j++) {
+            unsigned char c = static_cast<unsigned char>(_h[i] >> (8*j));
+            ret += digits[c >> 4];
+            ret += digits[c & 0xF];
+          }
+        return ret;
+      }
+    };
+
+    const char* const imageMagic = "MZNSTDIM";
+    const unsigned int imageVersion = 1;
+
+    /// Cache entry for a loaded image
+    struct CachedImage {
+      /// Modification time of the image file
+      time_t mtime;
+      /// Size of the image file
+      off_t size;
+      /// The image
+      StdlibImage::Ptr image;
+    };
+
+    /// Process-wide cache of loaded images
+    class ImageCache {
+    public:
+      std::mutex mutex;
+      std::map<std::string,CachedImage> images;
+    };
+
+    ImageCache& imageCache(void) {
+      static ImageCache cache;
+      return cache;
+    }
+
+    /// Collect all models included from \a m (including \a m)
+    void collectModels(Model* m, std::vector<Model*>& models) {
+      models.push_back(m);
+      for (unsigned int i=0; i<m->size(); i++) {
+        if (IncludeI* ii = (*m)[i]->dyn_cast<IncludeI>()) {
+          if (ii->own() && ii->m())
+            collectModels(ii->m(), models);
+        }
+      }
+    }
+
+  }
+
+  std::string
+  md5hex(const std::string& s) {
+    return md5hex(s.c_str(), s.size());
+  }
+
+  std::string
+  md5hex(const char* s, size_t n) {
+    MD5 md5;
+    for (size_t i=0; i<n; i++)
+      if (s[i] != '\r')
+        md5.update(static_cast<unsigned char>(s[i]));
+    return md5.hex();
+  }
+
+  StdlibImage::StdlibImage(void) : _data(NULL), _size(0), _mapped(false) {}
+
+  StdlibImage::~StdlibImage(void) {
+#ifndef _WIN32
+    if (_mapped)
+      munmap(const_cast<char*>(_data), _size);
+#endif
+  }
+
+  bool
+  StdlibImage::read(const std::string& filename) {
+#ifndef _WIN32
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size==0) {
+      close(fd);
+      return false;
+    }
+    void* p = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p==MAP_FAILED)
+      return false;
+    _data = static_cast<const char*>(p);
+    _size = static_cast<size_t>(st.st_size);
+    _mapped = true;
+#else
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if (!file.is_open())
+      return false;
+    std::stringstream ss;
+    ss << file.rdbuf();
+    _buf = ss.str();
+    _data = _buf.c_str();
+    _size = _buf.size();
+#endif
+    if (_size < 8 || memcmp(_data, imageMagic, 8) != 0)
+      return false;
+    try {
+      BinaryReader r(_data+8, _size-8);
+      if (r.readUInt() != imageVersion)
+        return false;
+      unsigned long long int n_ip = r.readUInt();
+      for (unsigned long long int i=0; i<n_ip; i++)
+        (void) r.readString();
+      unsigned long long int n_strings = r.readUInt();
+      _strings.resize(static_cast<size_t>(n_strings));
+      for (unsigned long long int i=0; i<n_strings; i++) {
+        size_t len = static_cast<size_t>(r.readUInt());
+        _strings[i].first = r.readBytes(len);
+        _strings[i].second = len;
+      }
+      unsigned long long int n_files = r.readUInt();
+      std::vector<std::pair<std::string,FileEntry> > files;
+      for (unsigned long long int i=0; i<n_files; i++) {
+        std::string fullname = r.readString();
+        FileEntry fe;
+        fe.md5 = r.readString();
+        fe.offset = static_cast<size_t>(r.readUInt());
+        fe.length = static_cast<size_t>(r.readUInt());
+        files.push_back(std::make_pair(fullname,fe));
+      }
+      size_t bodySize = static_cast<size_t>(r.readUInt());
+      const char* body = r.readBytes(bodySize);
+      for (unsigned int i=0; i<files.size(); i++) {
+        if (files[i].second.offset+files[i].second.length > bodySize)
+          return false;
+        files[i].second.offset += static_cast<size_t>(body-_data);
+        _files.insert(files[i]);
+      }
+    } catch (InternalError&) {
+      return false;
+    }
+    return true;
+  }
+
+  std::string
+  StdlibImage::filename(const std::vector<std::string>& includePaths) {
+    std::string paths;
+    std::string dir;
+    for (unsigned int i=0; i<includePaths.size(); i++) {
+      paths += includePaths[i]+"\n";
+      if (dir.empty() && FileUtils::file_exists(includePaths[i]+"stdlib.mzn"))
+        dir = includePaths[i];
+    }
+    if (dir.empty())
+      return "";
+    return dir+"stdlib-"+md5hex(paths).substr(0,8)+".mzi";
+  }
+
+  StdlibImage::Ptr
+  StdlibImage::load(const std::vector<std::string>& includePaths) {
+    std::string fn = filename(includePaths);
+    if (fn.empty())
+      return Ptr();
+    struct stat st;
+    if (stat(fn.c_str(), &st) != 0)
+      return Ptr();
+    ImageCache& cache = imageCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    std::map<std::string,CachedImage>::iterator it = cache.images.find(fn);
+    if (it != cache.images.end() &&
+        it->second.mtime==st.st_mtime && it->second.size==st.st_size)
+      return it->second.image;
+    std::shared_ptr<StdlibImage> image(new StdlibImage());
+    CachedImage ci;
+    ci.mtime = st.st_mtime;
+    ci.size = st.st_size;
+    if (image->read(fn))
+      ci.image = image;
+    cache.images[fn] = ci;
+    return ci.image;
+  }
+
+  bool
+  StdlibImage::contains(const std::string& fullname, const char* data, size_t size) const {
+    std::map<std::string,FileEntry>::const_iterator it = _files.find(fullname);
+    return it!=_files.end() && it->second.md5==md5hex(data, size);
+  }
+
+  bool
+  StdlibImage::decode(const std::string& fullname, const char* data, size_t size, Model* m) const {
+    if (!contains(fullname, data, size))
+      return false;
+    std::map<std::string,FileEntry>::const_iterator it = _files.find(fullname);
+    BinaryReader r(_data+it->second.offset, it->second.length);
+    ASTReader ar(r, _strings);
+    unsigned long long int n = r.readUInt();
+    for (unsigned long long int i=0; i<n; i++)
+      m->addItem(ar.readItem());
+    ar.finish();
+    return true;
+  }
+
+  bool
+  StdlibImage::write(const std::vector<std::string>& includePaths, std::ostream& err) {
+    std::string fn = filename(includePaths);
+    if (fn.empty()) {
+      err << "Error: cannot find stdlib.mzn in the include paths." << std::endl;
+      return false;
+    }
+    GCLock lock;
+    std::string text;
+    const char* roots[] = {"globals.mzn","minisearch.mzn"};
+    for (unsigned int i=0; i<sizeof(roots)/sizeof(roots[0]); i++) {
+      for (unsigned int j=0; j<includePaths.size(); j++) {
+        if (FileUtils::file_exists(includePaths[j]+roots[i])) {
+          text += std::string("include \"")+roots[i]+"\";\n";
+          break;
+        }
+      }
+    }
+    Model* m = parseFromString(text, "stdlib_image.mzn", includePaths, false, false, false, err);
+    if (m==NULL)
+      return false;
+
+    std::vector<Model*> models;
+    collectModels(m, models);
+    BinaryWriter body;
+    ASTWriter aw(body);
+    std::vector<std::pair<Model*,std::pair<size_t,size_t> > > files;
+    for (unsigned int i=0; i<models.size(); i++) {
+      std::string path = models[i]->filepath().str();
+      bool inLibrary = false;
+      for (unsigned int j=0; j<includePaths.size(); j++) {
+        if (path.compare(0, includePaths[j].size(), includePaths[j])==0) {
+          inLibrary = true;
+          break;
+        }
+      }
+      if (!inLibrary)
+        continue;
+      size_t offset = body.size();
+      body.writeUInt(models[i]->size());
+      for (unsigned int j=0; j<models[i]->size(); j++)
+        aw.write((*models[i])[j]);
+      files.push_back(std::make_pair(models[i], std::make_pair(offset, body.size()-offset)));
+    }
+
+    BinaryWriter out;
+    out.writeBytes(imageMagic, 8);
+    out.writeUInt(imageVersion);
+    out.writeUInt(includePaths.size());
+    for (unsigned int i=0; i<includePaths.size(); i++)
+      out.writeString(includePaths[i]);
+    out.writeUInt(aw.strings().size());
+    for (unsigned int i=0; i<aw.strings().size(); i++)
+      out.writeString(aw.strings()[i]);
+    out.writeUInt(files.size());
+    for (unsigned int i=0; i<files.size(); i++) {
+      std::string path = files[i].first->filepath().str();
+      std::ifstream file(path.c_str(), std::ios::binary);
+      std::stringstream ss;
+      ss << file.rdbuf();
+      out.writeString(path);
+      out.writeString(md5hex(ss.str()));
+      out.writeUInt(files[i].second.first);
+      out.writeUInt(files[i].second.second);
+    }
+    out.writeUInt(body.size());
+    out.append(body);
+    delete m;
+
+    std::string tmpname = fn+".tmp";
+    {
+      std::ofstream os(tmpname.c_str(), std::ios::binary);
+      os.write(out.str().c_str(), out.str().size());
+      if (!os) {
+        err << "Error: cannot write file '" << tmpname << "'." << std::endl;
+        std::remove(tmpname.c_str());
+        return false;
+      }
+    }
+#ifdef _WIN32
+    std::remove(fn.c_str());
+#endif
+    if (std::rename(tmpname.c_str(), fn.c_str()) != 0) {
+      err << "Error: cannot write file '" << fn << "'." << std::endl;
+      std::remove(tmpname.c_str());
+      return false;
+    }
+    return true;
+  }
+
+}
@@ -14,7 +14,9 @@
 #include <minizinc/astiterator.hh>
 #include <minizinc/astexception.hh>
 #include <minizinc/hash.hh>
+#include <minizinc/flatten_internal.hh>
 
+#include <set>
 #include <string>
 #include <sstream>
 
@@ -829,8 +831,46 @@ namespace MiniZinc {
     void vTIId(TIId& id) {}
   };
   
-  void typecheck(Env& env, Model* m, std::vector<TypeError>& typeErrors, bool ignoreUndefinedParameters) {
-    TopoSorter ts;
+  namespace {
+    /// Add the models included by \a m that are below one of the \a libraryPaths to \a library
+    void collectLibrary(Model* m, const std::vector<std::string>& libraryPaths,
+                        std::set<Model*>& library, std::set<Model*>& seen) {
+      if (!seen.insert(m).second)
+        return;
+      if (m->parent()) {
+        std::string path = m->filepath().str();
+        for (unsigned int i=0; i<libraryPaths.size(); i++) {
+          if (path.compare(0,libraryPaths[i].size(),libraryPaths[i])==0) {
+            library.insert(m);
+            break;
+          }
+        }
+      }
+      for (unsigned int i=0; i<m->size(); i++) {
+        if (IncludeI* ii = (*m)[i]->dyn_cast<IncludeI>()) {
+          if (ii->m())
+            collectLibrary(ii->m(), libraryPaths, library, seen);
+        }
+      }
+    }
+  }
+
+  void typecheck(Env& env, Model* m, std::vector<TypeError>& typeErrors, bool ignoreUndefinedParameters,
+                 const std::vector<std::string>* libraryPaths) {
+    LazyTypecheck* lazy = NULL;
+    std::set<Model*> library;
+    if (libraryPaths) {
+      if (env.envi().lazyTypecheck) {
+        env.envi().lazyTypecheck->checkAll(env.envi());
+        delete env.envi().lazyTypecheck;
+      }
+      lazy = new LazyTypecheck(m);
+      env.envi().lazyTypecheck = lazy;
+      std::set<Model*> seen;
+      collectLibrary(m, *libraryPaths, library, seen);
+    }
+    TopoSorter eagerTs;
+    TopoSorter& ts = lazy ? lazy->ts : eagerTs;
     
     std::vector<FunctionI*> functionItems;
     std::vector<AssignI*> assignItems;
@@ -878,7 +918,12 @@ namespace MiniZinc {
     public:
       EnvI& env;
       TopoSorter& ts;
-      TSV1(EnvI& env0, TopoSorter& ts0) : env(env0), ts(ts0) {}
+      LazyTypecheck* lazy;
+      const std::set<Model*>& library;
+      Model* cur;
+      TSV1(EnvI& env0, TopoSorter& ts0, LazyTypecheck* lazy0, const std::set<Model*>& library0)
+        : env(env0), ts(ts0), lazy(lazy0), library(library0), cur(NULL) {}
+      bool enterModel(Model* m0) { cur = m0; return true; }
       void vVarDeclI(VarDeclI* i) { ts.run(env,i->e()); }
       void vAssignI(AssignI* i) {}
       void vConstraintI(ConstraintI* i) { ts.run(env,i->e()); }
@@ -894,13 +939,18 @@ namespace MiniZinc {
           ts.run(env,fi->params()[i]);
         for (ExpressionSetIter it = fi->ann().begin(); it != fi->ann().end(); ++it)
           ts.run(env,*it);
+        if (lazy && fi->e() && library.count(cur)) {
+          // the body is checked when the first call is resolved to fi
+          lazy->pending.insert(fi);
+          return;
+        }
         for (unsigned int i=0; i<fi->params().size(); i++)
           ts.add(env,fi->params()[i],false);
         ts.run(env,fi->e());
         for (unsigned int i=0; i<fi->params().size(); i++)
           ts.remove(env,fi->params()[i]);
       }
-    } _tsv1(env.envi(),ts);
+    } _tsv1(env.envi(),ts,lazy,library);
     iterItems(_tsv1,m);
 
     m->sortFn();
@@ -939,6 +989,12 @@ namespace MiniZinc {
           bu_ty.run(functionItems[i]->params()[j]);
       }
     }
+    if (lazy) {
+      lazy->ready = true;
+      for (unsigned int i=0; i<lazy->deferred.size(); i++)
+        lazy->check(env.envi(), lazy->deferred[i]);
+      lazy->deferred.clear();
+    }
     
     {
       Typer<true> ty(env.envi(), m, typeErrors);
@@ -950,9 +1006,15 @@ namespace MiniZinc {
         Model* m;
         BottomUpIterator<Typer<true> >& bu_ty;
         std::vector<TypeError>& _typeErrors;
+        LazyTypecheck* lazy;
+        const std::set<Model*>& library;
+        Model* cur;
         TSV2(EnvI& env0, Model* m0,
              BottomUpIterator<Typer<true> >& b,
-             std::vector<TypeError>& typeErrors) : env(env0), m(m0), bu_ty(b), _typeErrors(typeErrors) {}
+             std::vector<TypeError>& typeErrors,
+             LazyTypecheck* lazy0, const std::set<Model*>& library0)
+          : env(env0), m(m0), bu_ty(b), _typeErrors(typeErrors), lazy(lazy0), library(library0), cur(NULL) {}
+        bool enterModel(Model* m0) { cur = m0; return true; }
         void vVarDeclI(VarDeclI* i) {
           bu_ty.run(i->e());
           if (i->e()->ti()->hasTiVariable()) {
@@ -1009,6 +1071,9 @@ namespace MiniZinc {
               throw TypeError(env, (*it)->loc(), "expected annotation, got `"+(*it)->type().toString()+"'");
           }
           bu_ty.run(i->ti());
+          // the bodies of library functions are checked by the LazyTypecheck
+          if (lazy && i->e() && library.count(cur))
+            return;
           bu_ty.run(i->e());
           if (i->e() && !i->e()->type().isSubtypeOf(i->ti()->type()))
             throw TypeError(env, i->e()->loc(), "return type of function does not match body, declared type is `"+i->ti()->type().toString()+
@@ -1016,7 +1081,7 @@ namespace MiniZinc {
           if (i->e())
             i->e(addCoercion(env, m, i->e(), i->ti()->type())());
         }
-      } _tsv2(env.envi(), m, bu_ty, typeErrors);
+      } _tsv2(env.envi(), m, bu_ty, typeErrors, lazy, library);
       iterItems(_tsv2,m);
     }
     
@@ -1064,6 +1129,68 @@ namespace MiniZinc {
     
   }
 
+  void typecheck_data(Env& env, Model* m, const std::vector<AssignI*>& ais,
+                      std::vector<TypeError>& typeErrors) {
+    TopoSorter ts;
+
+    class TSVD : public ItemVisitor {
+    public:
+      EnvI& env;
+      TopoSorter& ts;
+      std::vector<VarDecl*>& decls;
+      TSVD(EnvI& env0, TopoSorter& ts0, std::vector<VarDecl*>& decls0)
+        : env(env0), ts(ts0), decls(decls0) {}
+      void vVarDeclI(VarDeclI* i) {
+        ts.add(env, i->e(), true);
+        // the model has already been sorted, so do not visit the declaration again
+        ts.pos.insert(std::pair<VarDecl*,int>(i->e(),decls.size()));
+        decls.push_back(i->e());
+      }
+    };
+    std::vector<VarDecl*> decls;
+    TSVD _tsvd(env.envi(),ts,decls);
+    iterItems(_tsvd,m);
+
+    Typer<true> ty(env.envi(), m, typeErrors);
+    BottomUpIterator<Typer<true> > bu_ty(ty);
+    for (unsigned int i=0; i<ais.size(); i++) {
+      AssignI* ai = ais[i];
+      VarDecl* vd = ts.get(env.envi(),ai->id(),ai->loc());
+      if (vd->e() && !(vd->type().isopt() && vd->e()==constants().absent))
+        throw TypeError(env.envi(),ai->loc(),"multiple assignment to the same variable");
+      ts.run(env.envi(), ai->e());
+      for (unsigned int j=0; j<ts.decls.size(); j++)
+        ts.decls[j]->payload(0);
+      ts.decls.clear();
+      ai->decl(vd);
+      bu_ty.run(ai->e());
+      if (!ai->e()->type().isSubtypeOf(vd->ti()->type())) {
+        typeErrors.push_back(TypeError(env.envi(), ai->e()->loc(),
+                                       "assignment value for `"+vd->id()->str().str()+"' has invalid type-inst: expected `"+
+                                       vd->ti()->type().toString()+"', actual `"+ai->e()->type().toString()+"'"));
+        // Assign to "true" constant to avoid generating further errors that the parameter
+        // is undefined
+        vd->e(constants().lit_true);
+      } else {
+        vd->e(addCoercion(env.envi(), m, ai->e(), vd->type())());
+      }
+      ai->remove();
+    }
+
+    for (unsigned int i=0; i<decls.size(); i++) {
+      if (decls[i]->toplevel() &&
+          decls[i]->type().ispar() && !decls[i]->type().isann() && decls[i]->e()==NULL) {
+        if (decls[i]->type().isopt()) {
+          decls[i]->e(constants().absent);
+        } else {
+          typeErrors.push_back(TypeError(env.envi(), decls[i]->loc(),
+                                         "  symbol error: variable `" + decls[i]->id()->str().str()
+                                         + "' must be defined (did you forget to specify a data file?)"));
+        }
+      }
+    }
+  }
+
   void typecheck_fzn(Env& env, Model* m) {
     ASTStringMap<int>::t declMap;
     for (unsigned int i=0; i<m->size(); i++) {
@@ -1109,4 +1236,54 @@ namespace MiniZinc {
     }
   }
   
+  void
+  LazyTypecheck::check(EnvI& env, FunctionI* fi) {
+    UNORDERED_NAMESPACE::unordered_set<FunctionI*>::iterator it = pending.find(fi);
+    if (it==pending.end())
+      return;
+    if (!ready) {
+      deferred.push_back(fi);
+      return;
+    }
+    pending.erase(it);
+    GCLock lock;
+    unsigned int first = ts.decls.size();
+    for (unsigned int i=0; i<fi->params().size(); i++)
+      ts.add(env,fi->params()[i],false);
+    ts.run(env,fi->e());
+    for (unsigned int i=0; i<fi->params().size(); i++)
+      ts.remove(env,fi->params()[i]);
+    // checking these declarations may resolve calls, which can check other
+    // bodies and add further declarations
+    unsigned int last = ts.decls.size();
+    std::vector<TypeError> typeErrors;
+    {
+      Typer<false> ty(env, m, typeErrors);
+      BottomUpIterator<Typer<false> > bu_ty(ty);
+      for (unsigned int i=first; i<last; i++) {
+        ts.decls[i]->payload(0);
+        bu_ty.run(ts.decls[i]->ti());
+        ty.vVarDecl(*ts.decls[i]);
+      }
+    }
+    {
+      Typer<true> ty(env, m, typeErrors);
+      BottomUpIterator<Typer<true> > bu_ty(ty);
+      bu_ty.run(fi->e());
+    }
+    if (!typeErrors.empty())
+      throw typeErrors[0];
+    if (!fi->e()->type().isSubtypeOf(fi->ti()->type()))
+      throw TypeError(env, fi->e()->loc(), "return type of function does not match body, declared type is `"+fi->ti()->type().toString()+
+                      "', body type is `"+fi->e()->type().toString()+"'");
+    fi->e(addCoercion(env, m, fi->e(), fi->ti()->type())());
+  }
+
+  void
+  LazyTypecheck::checkAll(EnvI& env) {
+    std::vector<FunctionI*> fis(pending.begin(), pending.end());
+    for (unsigned int i=0; i<fis.size(); i++)
+      check(env, fis[i]);
+  }
+
 }
@@ -18,9 +18,215 @@ namespace MiniZinc {
   const IntVal IntVal::maxint(void) { return IntVal(INT_MAX); }
   const IntVal IntVal::infinity(void) { return IntVal(1,true); }
  
-  IntSetVal::IntSetVal(IntVal m, IntVal n) : ASTChunk(sizeof(Range)) {
+  IntSetVal::IntSetVal(IntVal m, IntVal n) : ASTChunk(rangesSize(1)) {
     get(0).min = m;
     get(0).max = n;
+    initCard();
+  }
+
+  void
+  IntSetVal::initCard(void) {
+    try {
+      cachedCard() = computeCard();
+      _flag_1 = true;
+    } catch (ArithmeticError&) {
+      _flag_1 = false;
+    }
+  }
+
+  namespace {
+
+    /// Merge kernel for the union of two sets
+    class UnionKernel {
+    public:
+      template<class Out>
+      static void run(const IntSetVal* x, const IntSetVal* y, Out& out) {
+        int xs = x->size();
+        int ys = y->size();
+        int i = 0;
+        int j = 0;
+        while (i < xs || j < ys) {
+          IntVal mi;
+          IntVal ma;
+          if (j==ys || (i < xs && x->min(i) <= y->min(j))) {
+            mi = x->min(i); ma = x->max(i); i++;
+          } else {
+            mi = y->min(j); ma = y->max(j); j++;
+          }
+          for (;;) {
+            if (i < xs && x->min(i) <= ma.plus(1)) {
+              ma = std::max(ma,x->max(i)); i++;
+            } else if (j < ys && y->min(j) <= ma.plus(1)) {
+              ma = std::max(ma,y->max(j)); j++;
+            } else {
+              break;
+            }
+          }
+          out(mi,ma);
+        }
+      }
+    };
+
+    /// Merge kernel for the intersection of two sets
+    class InterKernel {
+    public:
+      template<class Out>
+      static void run(const IntSetVal* x, const IntSetVal* y, Out& out) {
+        int xs = x->size();
+        int ys = y->size();
+        int i = 0;
+        int j = 0;
+        while (i < xs && j < ys) {
+          if (x->max(i) < y->min(j)) {
+            i++;
+          } else if (y->max(j) < x->min(i)) {
+            j++;
+          } else {
+            out(std::max(x->min(i),y->min(j)), std::min(x->max(i),y->max(j)));
+            if (x->max(i) < y->max(j))
+              i++;
+            else
+              j++;
+          }
+        }
+      }
+    };
+
+    /// Merge kernel for the difference of two sets
+    class DiffKernel {
+    public:
+      template<class Out>
+      static void run(const IntSetVal* x, const IntSetVal* y, Out& out) {
+        int xs = x->size();
+        int ys = y->size();
+        int j = 0;
+        for (int i=0; i<xs; i++) {
+          IntVal mi = x->min(i);
+          IntVal ma = x->max(i);
+          while (j < ys && y->max(j) < mi)
+            j++;
+          bool consumed = false;
+          // Ranges of y that end inside [mi..ma] cannot overlap later ranges of x
+          while (j < ys && y->min(j) <= ma) {
+            if (y->min(j) > mi)
+              out(mi,y->min(j).minus(1));
+            if (y->max(j) >= ma) {
+              consumed = true;
+              break;
+            }
+            mi = y->max(j).plus(1);
+            j++;
+          }
+          if (!consumed)
+            out(mi,ma);
+        }
+      }
+    };
+
+    /// Output that counts the ranges and compares them to two sets
+    class CountRanges {
+    public:
+      const IntSetVal* x;
+      const IntSetVal* y;
+      int n;
+      bool eqX;
+      bool eqY;
+      CountRanges(const IntSetVal* x0, const IntSetVal* y0)
+        : x(x0), y(y0), n(0), eqX(true), eqY(true) {}
+      void operator ()(const IntVal& mi, const IntVal& ma) {
+        eqX = eqX && n < x->size() && x->min(n)==mi && x->max(n)==ma;
+        eqY = eqY && n < y->size() && y->min(n)==mi && y->max(n)==ma;
+        n++;
+      }
+    };
+
+    /// Output that writes the ranges into consecutive memory
+    class WriteRanges {
+    public:
+      IntSetVal::Range* r;
+      WriteRanges(IntSetVal::Range* r0) : r(r0) {}
+      void operator ()(const IntVal& mi, const IntVal& ma) {
+        *r++ = IntSetVal::Range(mi,ma);
+      }
+    };
+
+  }
+
+  template<class M>
+  IntSetVal*
+  IntSetVal::merge(IntSetVal* x, IntSetVal* y) {
+    CountRanges cr(x,y);
+    M::run(x,y,cr);
+    if (cr.eqX && cr.n==x->size())
+      return x;
+    if (cr.eqY && cr.n==y->size())
+      return y;
+    IntSetVal* r = alloc(cr.n);
+    if (cr.n > 0) {
+      WriteRanges wr(&r->get(0));
+      M::run(x,y,wr);
+    }
+    r->initCard();
+    return r;
+  }
+
+  IntSetVal*
+  IntSetVal::unite(IntSetVal* x, IntSetVal* y) {
+    if (y->size()==0)
+      return x;
+    if (x->size()==0)
+      return y;
+    return merge<UnionKernel>(x,y);
+  }
+
+  IntSetVal*
+  IntSetVal::intersect(IntSetVal* x, IntSetVal* y) {
+    if (x->size()==0)
+      return x;
+    if (y->size()==0)
+      return y;
+    if (y->size()==1)
+      return intersect(x,y->min(0),y->max(0));
+    if (x->size()==1)
+      return intersect(y,x->min(0),x->max(0));
+    return merge<InterKernel>(x,y);
+  }
+
+  IntSetVal*
+  IntSetVal::intersect(IntSetVal* x, IntVal min, IntVal max) {
+    if (min > max)
+      return a();
+    int xs = x->size();
+    int first = 0;
+    while (first < xs && x->max(first) < min)
+      first++;
+    int last = xs-1;
+    while (last >= first && x->min(last) > max)
+      last--;
+    if (last < first)
+      return a();
+    if (first==0 && last==xs-1 && x->min(0) >= min && x->max(xs-1) <= max)
+      return x;
+    IntSetVal* r = alloc(last-first+1);
+    for (int i=first; i<=last; i++) {
+      r->get(i-first).min = i==first ? std::max(x->min(i),min) : x->min(i);
+      r->get(i-first).max = i==last ? std::min(x->max(i),max) : x->max(i);
+    }
+    r->initCard();
+    return r;
+  }
+
+  IntSetVal*
+  IntSetVal::diff(IntSetVal* x, IntSetVal* y) {
+    if (x->size()==0 || y->size()==0 ||
+        y->max(y->size()-1) < x->min(0) || x->max(x->size()-1) < y->min(0))
+      return x;
+    return merge<DiffKernel>(x,y);
+  }
+
+  IntSetVal*
+  IntSetVal::symdiff(IntSetVal* x, IntSetVal* y) {
+    return unite(diff(x,y),diff(y,x));
   }
 
 }
\ No newline at end of file
@@ -35,6 +35,7 @@
 #else
 #include <unistd.h>
 #include <sys/select.h>
+#include <sys/resource.h>
 #endif
 
 
@@ -161,15 +162,15 @@ namespace MiniZinc {
         delete cmdstr;
 
         if (_canPipe) {
-          DWORD dwRead, dwWritten;
+          DWORD dwWritten;
+          std::ostringstream ss;
+          MiniZinc::Printer p(ss,0);
           for (Model::iterator it = _flat->begin(); it != _flat->end(); ++it) {
-            std::stringstream ss;
-            Item* item = *it;
-            ss << *item;
-            std::string str = ss.str();
-            bSuccess = WriteFile(g_hChildStd_IN_Wr, str.c_str(),
-              dwRead, &dwWritten, NULL);
+            p.print(*it);
           }
+          std::string str = ss.str();
+          bSuccess = WriteFile(g_hChildStd_IN_Wr, str.c_str(),
+            static_cast<DWORD>(str.size()), &dwWritten, NULL);
         }
 
         // Stop ReadFile from blocking
@@ -253,12 +254,17 @@ namespace MiniZinc {
           close(pipes[0][0]);
           close(pipes[1][1]);
           if (_canPipe) {
+            std::ostringstream ss;
+            MiniZinc::Printer p(ss,0);
             for (Model::iterator it = _flat->begin(); it != _flat->end(); ++it) {
-              std::stringstream ss;
-              Item* item = *it;
-              ss << *item;
-              std::string str = ss.str();
-              write(pipes[0][1], str.c_str(), str.size());
+              p.print(*it);
+            }
+            std::string str = ss.str();
+            for (size_t done = 0; done < str.size();) {
+              ssize_t n = write(pipes[0][1], str.c_str()+done, str.size()-done);
+              if (n <= 0)
+                break;
+              done += n;
             }
           }
           close(pipes[0][1]);
@@ -272,10 +278,12 @@ namespace MiniZinc {
           struct timeval starttime;
           gettimeofday(&starttime, NULL);
 
-          int timeout_sec = 10;
+          long long int timeout_ms = 10000;
+          if(opt.hasParam(constants().solver_options.time_limit_ms.str()))
+            timeout_ms = opt.getIntParam(constants().solver_options.time_limit_ms.str());
 
-          timeout.tv_sec = timeout_sec;
-          timeout.tv_usec = 0;
+          timeout.tv_sec = timeout_ms / 1000;
+          timeout.tv_usec = (timeout_ms % 1000) * 1000;
 
           bool done = false;
           while (!done) {
@@ -301,12 +309,15 @@ namespace MiniZinc {
                   elapsed.tv_sec--;
                   elapsed.tv_usec += 1000000;
                 }
-                timeout.tv_sec = timeout_sec - elapsed.tv_sec;
-                if (elapsed.tv_usec > 0)
-                  timeout.tv_sec--;
-                timeout.tv_usec = 1000000 - elapsed.tv_usec;
-                if (timeout.tv_sec <= 0 && timeout.tv_usec <= 0)
+                long long int remaining_ms = timeout_ms -
+                  (static_cast<long long int>(elapsed.tv_sec)*1000 + elapsed.tv_usec/1000);
+                if (remaining_ms <= 0) {
+                  kill(childPID, SIGKILL);
                   done = true;
+                } else {
+                  timeout.tv_sec = remaining_ms / 1000;
+                  timeout.tv_usec = (remaining_ms % 1000) * 1000;
+                }
               }
               else {
                 done = true;
@@ -320,6 +331,7 @@ namespace MiniZinc {
             }
           }
           close(pipes[1][0]);
+          waitpid(childPID, NULL, 0); // reap the solver process
           if (!_canPipe) {
             remove(fznFile.c_str());
           }
@@ -336,13 +348,22 @@ namespace MiniZinc {
           close(pipes[1][0]);
           close(pipes[0][1]);
 
+          if(opt.hasParam(constants().solver_options.memory_limit_mb.str())) {
+            // limit the address space of the solver process
+            rlim_t limit = static_cast<rlim_t>(opt.getIntParam(constants().solver_options.memory_limit_mb.str()))*1024*1024;
+            struct rlimit rl;
+            rl.rlim_cur = limit;
+            rl.rlim_max = limit;
+            setrlimit(RLIMIT_AS, &rl);
+          }
+
           //char* argv[] = {strdup(_fzncmd.c_str()),strdup("-a"),strdup("-"),0}; 
           int status = executeCommand(opt,fznFile);
                   
           if(status != 0) {
-            std::stringstream ssm;
-            ssm << "FznProcess::run: cannot execute command: " << _fzncmd.c_str();
-            throw InternalError(ssm.str());
+            // do not return into the (possibly multi-threaded) parent program
+            std::cerr << "FznProcess::run: cannot execute command: " << _fzncmd << std::endl;
+            _exit(EXIT_FAILURE);
           }
         }
         assert(false);
@@ -650,7 +671,6 @@ namespace MiniZinc {
     }
     solveI->remove();
     _fzn->addItem(objective);
-    _env.flat()->compact();
     //std::cerr << "DEBUG: printing modified fzn model for BEST:\n";
     //debugprint(_fzn);
     //std::cerr << "====================================\n";
@@ -0,0 +1,166 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <minizinc/json.hh>
+
+using namespace MiniZinc;
+using namespace std;
+
+/// Write \a s to \a fd, returns false on failure
+bool writeAll(int fd, const std::string& s) {
+  size_t done = 0;
+  while (done < s.size()) {
+    ssize_t n = write(fd, s.c_str()+done, s.size()-done);
+    if (n < 0 && errno==EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    done += n;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  string socketPath;
+  vector<string> files;
+  bool quiet = false;
+
+  for (int i=1; i<argc; i++) {
+    string arg(argv[i]);
+    if (arg=="-h" || arg=="--help") {
+      goto usage;
+    } else if (arg=="--socket") {
+      if (++i==argc)
+        goto usage;
+      socketPath = argv[i];
+    } else if (arg=="-q" || arg=="--quiet") {
+      quiet = true;
+    } else {
+      files.push_back(arg);
+    }
+  }
+  if (socketPath.empty())
+    goto usage;
+
+  {
+    // Collect the requests first, so that errors in the files are found before sending
+    std::string requests;
+    unsigned int nRequests = 0;
+    if (files.empty())
+      files.push_back("-");
+    for (unsigned int i=0; i<files.size(); i++) {
+      std::ifstream file;
+      if (files[i] != "-") {
+        file.open(files[i].c_str());
+        if (!file.is_open()) {
+          std::cerr << "Error: cannot open request file '" << files[i] << "'." << std::endl;
+          std::exit(EXIT_FAILURE);
+        }
+      }
+      std::istream& is = files[i]=="-" ? std::cin : file;
+      std::string line;
+      while (std::getline(is, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+          continue;
+        requests += line+"\n";
+        nRequests++;
+      }
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+      std::cerr << "Error: socket path too long." << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    strcpy(addr.sun_path, socketPath.c_str());
+    if (sock < 0 || connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+      std::cerr << "Error: cannot connect to '" << socketPath << "': "
+                << strerror(errno) << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    if (!writeAll(sock, requests)) {
+      std::cerr << "Error: cannot send requests: " << strerror(errno) << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    // The server closes the connection when all requests have been answered
+    shutdown(sock, SHUT_WR);
+
+    unsigned int done = 0;
+    unsigned int failed = 0;
+    std::string pending;
+    char buf[4096];
+    for (;;) {
+      ssize_t n = read(sock, buf, sizeof(buf));
+      if (n < 0 && errno==EINTR)
+        continue;
+      if (n <= 0)
+        break;
+      pending.append(buf, n);
+      size_t nl;
+      while ((nl = pending.find('\n')) != std::string::npos) {
+        std::string line = pending.substr(0,nl);
+        pending.erase(0,nl+1);
+        if (!quiet)
+          std::cout << line << std::endl;
+        try {
+          JSONValue v = parseJSON(line);
+          const JSONValue* type = v.get("type");
+          if (type && type->s=="done") {
+            done++;
+            const JSONValue* status = v.get("status");
+            if (status==NULL || status->s != "ok")
+              failed++;
+          }
+        } catch (JSONError& e) {
+          std::cerr << "Error: invalid response: " << e.msg() << std::endl;
+          failed++;
+        }
+      }
+    }
+    close(sock);
+    if (done < nRequests) {
+      std::cerr << "Error: " << (nRequests-done) << " of " << nRequests
+                << " requests were not answered." << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    if (failed > 0) {
+      std::cerr << failed << " of " << nRequests << " requests failed." << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    return 0;
+  }
+
+usage:
+  std::cerr << "Usage: "<< argv[0]
+  << " --socket <path> [-q] [<request file> ...]" << std::endl
+  << std::endl
+  << "Sends the requests in the given files (or standard input), one JSON object" << std::endl
+  << "per line, to the server listening on <path>, and prints the responses." << std::endl
+  << "Exits with an error if a request failed or was not answered." << std::endl
+  << std::endl
+  << "  -q, --quiet\n    Do not print the responses" << std::endl;
+  exit(EXIT_FAILURE);
+}
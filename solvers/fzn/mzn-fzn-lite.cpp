@@ -28,8 +28,10 @@
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 #include <ctime>
 #include <iomanip>
+#include <thread>
 
 #include <minizinc/model.hh>
 #include <minizinc/parser.hh>
@@ -41,6 +43,10 @@
 #include <minizinc/optimize.hh>
 #include <minizinc/builtins.hh>
 #include <minizinc/file_utils.hh>
+#include <minizinc/stdlib_image.hh>
+#include <minizinc/binary_fzn.hh>
+#include <minizinc/batch.hh>
+#include <minizinc/flatten_parallel.hh>
 
 #include <minizinc/solver_instance.hh>
 #include <minizinc/solvers/fzn_solverinstance.hh>
@@ -68,10 +74,22 @@ int main(int argc, char** argv) {
   vector<string> includePaths;
   bool flag_ignoreStdlib = false;
   bool flag_typecheck = true;
+  bool flag_strict_typecheck = false;
   bool flag_verbose = false;
   bool flag_newfzn = false;
   bool flag_optimize = true;
   bool flag_werror = false;
+  bool flag_write_stdlib_image = false;
+  unsigned int flag_parse_threads = std::max(1u, std::thread::hardware_concurrency());
+  bool flag_batch = false;
+  string flag_batch_list;
+  string flag_batch_output_dir;
+  unsigned int flag_batch_workers = 1;
+  unsigned int flag_flatten_threads = 0;
+  unsigned int flag_flatten_chunk_size = 1000;
+  long long int flag_instance_time_limit = 0;
+  string flag_solver;
+  string flag_solution_format = "text";
   
   clock_t starttime = std::clock();
   clock_t lasttime = std::clock();
@@ -88,6 +106,7 @@ int main(int argc, char** argv) {
   string flag_output_ozn;
   bool flag_output_fzn_stdout = false;
   bool flag_output_ozn_stdout = false;
+  string flag_output_binary_fzn;
   bool flag_instance_check_only = false;
   FlatteningOptions fopts;
   Options options; // for solving
@@ -119,6 +138,8 @@ int main(int argc, char** argv) {
       flag_ignoreStdlib = true;
     } else if (string(argv[i])==string("--no-typecheck")) {
       flag_typecheck = false;
+    } else if (string(argv[i])==string("--strict-typecheck")) {
+      flag_strict_typecheck = true;
     } else if (string(argv[i])==string("--instance-check-only")) {
       flag_instance_check_only = true;
     } else if (string(argv[i])==string("-v") || string(argv[i])==string("--verbose")) {
@@ -193,6 +214,7 @@ int main(int argc, char** argv) {
       if (i==argc)
         goto error;
       options.setStringParam("solver",argv[i]);            
+      flag_solver = argv[i];
     } else if (string(argv[i])=="--stdlib-dir") {
       i++;
       if (i==argc)
@@ -234,8 +256,69 @@ int main(int argc, char** argv) {
       globals_dir = argv[i];
     } else if (string(argv[i])=="--only-range-domains") {
       fopts.onlyRangeDomains = true;
+    } else if (string(argv[i])=="--memoize-par-calls") {
+      fopts.memoizeParCalls = true;
     } else if (string(argv[i])=="-Werror") {
       flag_werror = true;
+    } else if (string(argv[i])=="--solution-format") {
+      i++;
+      if (i==argc)
+        goto error;
+      flag_solution_format = argv[i];
+      if (flag_solution_format != "text" && flag_solution_format != "json" && flag_solution_format != "binary")
+        goto error;
+      options.setStringParam(constants().opts.solutionFormat.str(),flag_solution_format);
+    } else if (string(argv[i])=="--output-binary-fzn") {
+      i++;
+      if (i==argc)
+        goto error;
+      flag_output_binary_fzn = argv[i];
+    } else if (string(argv[i])=="--parse-threads") {
+      i++;
+      if (i==argc)
+        goto error;
+      flag_parse_threads = atoi(argv[i]);
+      if (flag_parse_threads < 1)
+        goto error;
+    } else if (string(argv[i])=="--write-stdlib-image") {
+      flag_write_stdlib_image = true;
+    } else if (string(argv[i])=="--batch") {
+      flag_batch = true;
+    } else if (string(argv[i])=="--batch-list") {
+      i++;
+      if (i==argc)
+        goto error;
+      flag_batch = true;
+      flag_batch_list = argv[i];
+    } else if (string(argv[i])=="--batch-output-dir") {
+      i++;
+      if (i==argc)
+        goto error;
+      flag_batch_output_dir = argv[i];
+    } else if (string(argv[i])=="--batch-workers") {
+      i++;
+      if (i==argc)
+        goto error;
+      flag_batch_workers = atoi(argv[i]);
+      if (flag_batch_workers < 1)
+        goto error;
+    } else if (string(argv[i])=="--flatten-threads") {
+      i++;
+      if (i==argc)
+        goto error;
+      flag_flatten_threads = atoi(argv[i]);
+    } else if (string(argv[i])=="--flatten-chunk-size") {
+      i++;
+      if (i==argc)
+        goto error;
+      flag_flatten_chunk_size = atoi(argv[i]);
+      if (flag_flatten_chunk_size < 1)
+        goto error;
+    } else if (string(argv[i])=="--instance-time-limit") {
+      i++;
+      if (i==argc)
+        goto error;
+      flag_instance_time_limit = atoll(argv[i]);
     } else {
       std::string input_file(argv[i]);
       if (input_file.length()<=4) {
@@ -259,7 +342,7 @@ int main(int argc, char** argv) {
     }
   }
   
-  if (filename=="") {
+  if (filename=="" && !flag_write_stdlib_image) {
     std::cerr << "Error: no model file given." << std::endl;
     goto error;
   }
@@ -296,6 +379,89 @@ int main(int argc, char** argv) {
     }
   }
   
+  if (flag_write_stdlib_image) {
+    if (!StdlibImage::write(includePaths, std::cerr))
+      std::exit(EXIT_FAILURE);
+    if (flag_verbose)
+      std::cerr << "Wrote " << StdlibImage::filename(includePaths) << std::endl;
+    std::exit(EXIT_SUCCESS);
+  }
+  
+  if (flag_batch) {
+    vector<string> commonData;
+    vector<BatchInstance> instances;
+    for (unsigned int i=0; i<datafiles.size(); i++) {
+      if (beginswith(datafiles[i],"cmd:/")) {
+        commonData.push_back(datafiles[i]);
+      } else {
+        instances.push_back(BatchInstance());
+        instances.back().datafiles.push_back(datafiles[i]);
+      }
+    }
+    if (flag_batch_list != "") {
+      std::ifstream list(flag_batch_list.c_str());
+      if (!list.is_open()) {
+        std::cerr << "Error: cannot open file '" << flag_batch_list << "'." << std::endl;
+        std::exit(EXIT_FAILURE);
+      }
+      string line;
+      while (std::getline(list, line)) {
+        std::istringstream iss(line);
+        BatchInstance inst;
+        string datafile;
+        while (iss >> datafile)
+          inst.datafiles.push_back(datafile);
+        if (!inst.datafiles.empty())
+          instances.push_back(inst);
+      }
+    }
+    for (unsigned int i=0; i<instances.size(); i++) {
+      BatchInstance& inst = instances[i];
+      if (flag_batch_output_dir != "") {
+        string base = inst.datafiles[0];
+        size_t slash = base.find_last_of("/\\");
+        if (slash != string::npos)
+          base = base.substr(slash+1);
+        if (base.length() > 4 && base.substr(base.length()-4,string::npos)==".dzn")
+          base = base.substr(0,base.length()-4);
+        inst.outputFile = flag_batch_output_dir+"/"+base+".out";
+      }
+      inst.datafiles.insert(inst.datafiles.end(), commonData.begin(), commonData.end());
+    }
+    BatchOptions bopts;
+    bopts.includePaths = includePaths;
+    bopts.fopts = fopts;
+    bopts.ignoreStdlib = flag_ignoreStdlib;
+    bopts.verbose = flag_verbose;
+    bopts.optimize = flag_optimize;
+    bopts.newfzn = flag_newfzn;
+    bopts.workers = flag_batch_workers;
+    bopts.timeLimit = flag_instance_time_limit;
+    bopts.flattenThreads = flag_flatten_threads;
+    bopts.flattenChunkSize = flag_flatten_chunk_size;
+    unsigned int failures =
+      solveBatch(filename, instances, bopts,
+                 [&](Env& env, std::ostream& out, long long int timeLimit) {
+                   // Options have to be created in the thread that solves the instance
+                   Options opts;
+                   if (flag_solver != "")
+                     opts.setStringParam("solver",flag_solver);
+                   opts.setBoolParam(constants().opts.verbose.str(),flag_verbose);
+                   opts.setStringParam(constants().opts.solutionFormat.str(),flag_solution_format);
+                   SearchHandler sh(out);
+                   if (timeLimit > 0)
+                     sh.setTimeLimit(timeLimit);
+                   sh.search<FZNSolverInstance>(env,opts);
+                 }, std::cerr);
+    if (flag_verbose)
+      std::cerr << "Done (overall time " << stoptime(starttime) << ")." << std::endl;
+    if (failures > 0) {
+      std::cerr << failures << " of " << instances.size() << " instances failed." << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    return 0;
+  }
+  
   if (flag_output_base == "") {
     flag_output_base = filename.substr(0,filename.length()-4);
   }
@@ -311,7 +477,7 @@ int main(int argc, char** argv) {
     if (flag_verbose)
       std::cerr << "Parsing '" << filename << "' ...";
     if (Model* m = parse(filename, datafiles, includePaths, flag_ignoreStdlib, false,
-                         flag_verbose, errstream)) {
+                         flag_verbose, errstream, NULL, flag_parse_threads)) {
       try {
         if (flag_typecheck) {
           if (flag_verbose)
@@ -320,7 +486,8 @@ int main(int argc, char** argv) {
             std::cerr << "Typechecking ...";
           vector<TypeError> typeErrors;
           Env env(m,fopts);
-          MiniZinc::typecheck(env, m, typeErrors);
+          MiniZinc::typecheck(env, m, typeErrors, false,
+                              flag_strict_typecheck ? NULL : &includePaths);
           if (typeErrors.size() > 0) {
             for (unsigned int i=0; i<typeErrors.size(); i++) {
               if (flag_verbose)
@@ -339,7 +506,18 @@ int main(int argc, char** argv) {
               std::cerr << "Flattening ...";
             
             try {
-              flatten(env,fopts);
+              if (flag_flatten_threads > 0) {
+                BatchOptions bopts;
+                bopts.includePaths = includePaths;
+                bopts.fopts = fopts;
+                bopts.ignoreStdlib = flag_ignoreStdlib;
+                bopts.flattenThreads = flag_flatten_threads;
+                bopts.flattenChunkSize = flag_flatten_chunk_size;
+                PreparedModel pm(filename, bopts);
+                flattenParallel(env, pm, datafiles, bopts);
+              } else {
+                flatten(env,fopts);
+              }
             } catch (LocationException& e) {
               if (flag_verbose)
                 std::cerr << std::endl;
@@ -360,6 +538,16 @@ int main(int argc, char** argv) {
             //            Model* flat = env.flat();
             if (flag_verbose)
               std::cerr << " done (" << stoptime(lasttime) << ")" << std::endl;
+            if (flag_verbose && fopts.memoizeParCalls) {
+              FlatModelStatistics stats = statistics(env);
+              std::cerr << "Memoised par calls: " << stats.n_par_call_hits << " hits, "
+                        << stats.n_par_call_misses << " misses" << std::endl;
+            }
+            if (flag_verbose) {
+              FlatModelStatistics stats = statistics(env);
+              std::cerr << "Bounds cache: " << stats.n_bounds_hits << " hits, "
+                        << stats.n_bounds_misses << " misses" << std::endl;
+            }
             
             if (flag_optimize) {
               if (flag_verbose)
@@ -383,6 +571,15 @@ int main(int argc, char** argv) {
               env.flat()->compact();
             }
             
+            if (flag_output_binary_fzn != "") {
+              std::ofstream os(flag_output_binary_fzn.c_str(), std::ios::binary);
+              writeBinaryFlatZinc(env.flat(), os);
+              if (!os) {
+                std::cerr << "Error: cannot write file '" << flag_output_binary_fzn << "'." << std::endl;
+                exit(EXIT_FAILURE);
+              }
+            }
+            
             {              
               //options.getStringParam("solver","flatzinc"); // set flatzinc to default solver
               options.setBoolParam(constants().opts.verbose.str(),flag_verbose); // Quick fix until we switched to new CLI
@@ -430,12 +627,14 @@ error:
   << "  --solver <executable>\n    Solve the model using the fzn-solver <executable> that is in the path" << std::endl
   << "  --ignore-stdlib\n    Ignore the standard libraries stdlib.mzn and builtins.mzn" << std::endl
   << "  -v, --verbose\n    Print progress statements" << std::endl
+  << "  --strict-typecheck\n    Type check the bodies of all library functions, not only the ones\n    that the model uses" << std::endl
   << "  --instance-check-only\n    Check the model instance (including data) for errors, but do not\n    convert to FlatZinc." << std::endl
   << "  --no-optimize\n    Do not optimize the FlatZinc\n    Currently does nothing (only available for compatibility with 1.6)" << std::endl
   << "  -d <file>, --data <file>\n    File named <file> contains data used by the model." << std::endl
   << "  -D <data>, --cmdline-data <data>\n    Include the given data in the model." << std::endl
   << "  --stdlib-dir <dir>\n    Path to MiniZinc standard library directory" << std::endl
   << "  -G --globals-dir --mzn-globals-dir\n    Search for included files in <stdlib>/<dir>." << std::endl
+  << "  --memoize-par-calls\n    Cache the results of calls to pure par functions during flattening" << std::endl
   << std::endl
   << "Output options:" << std::endl << std::endl
   << "  --no-output-ozn, -O-\n    Do not output ozn file" << std::endl
@@ -444,7 +643,20 @@ error:
   << "  --output-ozn-to-file <file>\n    Filename for model output specification" << std::endl
   << "  --output-to-stdout, --output-fzn-to-stdout\n    Print generated FlatZinc to standard output" << std::endl
   << "  --output-ozn-to-stdout\n    Print model output specification to standard output" << std::endl
+  << "  --output-binary-fzn <file>\n    Write the FlatZinc model in binary format to <file>" << std::endl
+  << "  --solution-format <format>\n    Write solutions as text (the output item, default), as one JSON object\n    per line (json), or as length-prefixed binary records (binary)" << std::endl
   << "  -Werror\n    Turn warnings into errors" << std::endl
+  << "  --parse-threads <n>\n    Parse included files using <n> threads (default: number of cores)" << std::endl
+  << "  --write-stdlib-image\n    Write a precompiled image of the library files for the given include\n    paths, which speeds up parsing of later runs" << std::endl
+  << std::endl
+  << "Batch options:" << std::endl << std::endl
+  << "  --batch\n    Solve each data file as a separate instance of the model, parsing and\n    type checking the model only once (data given with -D is used for all\n    instances)" << std::endl
+  << "  --batch-list <file>\n    Solve the instances listed in <file>, one instance per line given as a\n    list of data files (implies --batch)" << std::endl
+  << "  --batch-output-dir <dir>\n    Write the solutions of each instance to <dir>/<data>.out instead of\n    standard output" << std::endl
+  << "  --batch-workers <n>\n    Solve <n> instances in parallel" << std::endl
+  << "  --flatten-threads <n>\n    Flatten the constraints of each instance using <n> threads" << std::endl
+  << "  --flatten-chunk-size <n>\n    Minimum number of constraints flattened as one unit of work by\n    --flatten-threads (default 1000)" << std::endl
+  << "  --instance-time-limit <ms>\n    Time limit for each instance in milliseconds" << std::endl
   ;
   
   exit(EXIT_FAILURE);
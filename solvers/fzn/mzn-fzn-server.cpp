@@ -0,0 +1,530 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/*
+ *  Main authors:
+ *     Guido Tack <guido.tack@monash.edu>
+ */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// <thread> has to be included before SafeInt3.hpp, which redefines nullptr
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <minizinc/cli.hh>
+#include <minizinc/batch.hh>
+#include <minizinc/json.hh>
+#include <minizinc/search.hh>
+#include <minizinc/timer.hh>
+#include <minizinc/solvers/fzn_solverinstance.hh>
+
+using namespace MiniZinc;
+using namespace std;
+
+namespace {
+
+  /// Return the current wall clock time in milliseconds since the epoch
+  long long int epoch_ms(void) {
+    timeval now;
+    gettimeofday(&now, NULL);
+    return static_cast<long long int>(now.tv_sec)*1000+now.tv_usec/1000;
+  }
+
+  /**
+   * \brief Destination of the responses to the requests of one client
+   *
+   * Responses are complete lines, written under a lock so that workers
+   * answering requests of the same client do not interleave. The
+   * descriptor is closed when the last reference to the connection is
+   * gone, i.e., when all requests of the client have been answered.
+   */
+  class Connection {
+  protected:
+    int _fd;
+    bool _close;
+    std::mutex _mutex;
+  public:
+    Connection(int fd, bool close) : _fd(fd), _close(close) {}
+    ~Connection(void) {
+      if (_close)
+        close(_fd);
+    }
+    /// Send \a line (which must end in a newline)
+    void send(const std::string& line) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      size_t done = 0;
+      while (done < line.size()) {
+        ssize_t n = write(_fd, line.c_str()+done, line.size()-done);
+        if (n < 0 && errno==EINTR)
+          continue;
+        if (n <= 0)
+          return; // client has gone away
+        done += n;
+      }
+    }
+  };
+
+  /// A request line together with the connection to answer on
+  struct Request {
+    std::string line;
+    std::shared_ptr<Connection> conn;
+  };
+
+  /// Queue of requests that have not been picked up by a worker yet
+  class RequestQueue {
+  protected:
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::deque<Request> _requests;
+  public:
+    void push(const Request& r) {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _requests.push_back(r);
+      }
+      _cv.notify_one();
+    }
+    Request pop(void) {
+      std::unique_lock<std::mutex> lock(_mutex);
+      while (_requests.empty())
+        _cv.wait(lock);
+      Request r = _requests.front();
+      _requests.pop_front();
+      return r;
+    }
+  };
+
+  /// Configuration and state shared by all workers
+  struct ServerState {
+    /// Command line arguments prepended to the arguments of each request
+    std::vector<std::string> baseArgs;
+    /// Default time limit per request in milliseconds (0 for none)
+    long long int timeLimit;
+    /// Default memory limit of the solver in megabytes (0 for none)
+    long long int memoryLimit;
+    /// Number of prepared models each worker keeps
+    unsigned int cacheSize;
+    RequestQueue queue;
+    /// Sources shared by all workers
+    SharedSources sources;
+    /// Modification times of the models in \a sources
+    std::map<std::string,time_t> sourceTimes;
+    std::mutex sourceMutex;
+    ServerState(void) : timeLimit(0), memoryLimit(0), cacheSize(4) {}
+    /// Make sure the shared sources do not contain an older version of \a model
+    void checkSource(const std::string& model, time_t mtime) {
+      std::lock_guard<std::mutex> lock(sourceMutex);
+      std::map<std::string,time_t>::iterator it = sourceTimes.find(model);
+      if (it != sourceTimes.end() && it->second != mtime) {
+        sources.clear();
+        sourceTimes.clear();
+      }
+      sourceTimes[model] = mtime;
+    }
+  };
+
+  /**
+   * \brief Stream buffer that sends each solution as soon as it is complete
+   *
+   * Text written to the buffer is collected until a solution delimiter
+   * line, and then sent as a solution message. The text following the
+   * last solution (e.g. the search status) is returned by rest().
+   */
+  class SolutionStreamBuf : public std::streambuf {
+  protected:
+    Connection& _conn;
+    const std::string& _id;
+    std::string _text;
+    size_t _lineStart;
+  public:
+    SolutionStreamBuf(Connection& conn, const std::string& id)
+      : _conn(conn), _id(id), _lineStart(0) {}
+    std::string rest(void) const { return _text; }
+  protected:
+    virtual int overflow(int c) {
+      if (c==EOF)
+        return 0;
+      _text += static_cast<char>(c);
+      if (c=='\n') {
+        if (_text.compare(_lineStart, std::string::npos,
+                          constants().solver_output.solution_delimiter.str()+"\n")==0) {
+          _conn.send("{\"id\":"+_id+",\"type\":\"solution\",\"output\":"+
+                     jsonString(_text.substr(0,_lineStart))+"}\n");
+          _text.clear();
+        }
+        _lineStart = _text.size();
+      }
+      return c;
+    }
+  };
+
+  /// A model prepared by a worker
+  struct CachedModel {
+    /// Model file, include paths and library flag
+    std::string key;
+    /// Modification time of the model file
+    time_t mtime;
+    std::shared_ptr<PreparedModel> pm;
+  };
+
+  /// Worker that answers requests until the server is terminated
+  class ServerWorker {
+  protected:
+    ServerState& _s;
+    CLISParser _cp;
+    /// Prepared models, most recently used first
+    std::list<CachedModel> _cache;
+    /**
+     * \brief Return the prepared model for \a filename with options \a bopts
+     *
+     * Returns an empty pointer and prints the errors to \a err if the
+     * model cannot be prepared.
+     */
+    std::shared_ptr<PreparedModel> prepared(const std::string& filename,
+                                            const BatchOptions& bopts, std::ostream& err);
+    /// Answer request \a r
+    void answer(const Request& r);
+  public:
+    ServerWorker(ServerState& s) : _s(s) {}
+    void run(void) {
+      for (;;)
+        answer(_s.queue.pop());
+    }
+  };
+
+  std::shared_ptr<PreparedModel>
+  ServerWorker::prepared(const std::string& filename, const BatchOptions& bopts, std::ostream& err) {
+    std::ostringstream key;
+    key << filename << "\n" << bopts.ignoreStdlib;
+    for (unsigned int i=0; i<bopts.includePaths.size(); i++)
+      key << "\n" << bopts.includePaths[i];
+    struct stat st;
+    time_t mtime = stat(filename.c_str(), &st)==0 ? st.st_mtime : 0;
+    for (std::list<CachedModel>::iterator it = _cache.begin(); it != _cache.end(); ++it) {
+      if (it->key==key.str()) {
+        if (it->mtime==mtime) {
+          _cache.splice(_cache.begin(), _cache, it);
+          return _cache.front().pm;
+        }
+        _cache.erase(it);
+        break;
+      }
+    }
+    _s.checkSource(filename, mtime);
+    std::shared_ptr<PreparedModel> pm(new PreparedModel(filename, bopts, &_s.sources));
+    if (!pm->prepare(err))
+      return std::shared_ptr<PreparedModel>();
+    CachedModel cm;
+    cm.key = key.str();
+    cm.mtime = mtime;
+    cm.pm = pm;
+    _cache.push_front(cm);
+    if (_cache.size() > _s.cacheSize)
+      _cache.pop_back();
+    return pm;
+  }
+
+  /// Return the array of strings \a v (which may be absent) as a vector
+  std::vector<std::string> stringArray(const JSONValue* v, const std::string& name) {
+    std::vector<std::string> r;
+    if (v==NULL)
+      return r;
+    if (v->kind != JSONValue::JV_ARRAY)
+      throw JSONError("'"+name+"' must be an array of strings");
+    for (unsigned int i=0; i<v->a.size(); i++) {
+      if (v->a[i].kind != JSONValue::JV_STRING)
+        throw JSONError("'"+name+"' must be an array of strings");
+      r.push_back(v->a[i].s);
+    }
+    return r;
+  }
+
+  /// Return the number \a v (which may be absent) as an integer
+  long long int intField(const JSONValue* v, const std::string& name, long long int def) {
+    if (v==NULL)
+      return def;
+    if (v->kind != JSONValue::JV_NUMBER)
+      throw JSONError("'"+name+"' must be a number");
+    return static_cast<long long int>(v->n);
+  }
+
+  void
+  ServerWorker::answer(const Request& r) {
+    Timer timer;
+    std::string id = "null";
+    std::ostringstream err;
+    std::string output;
+    bool ok = false;
+    try {
+      JSONValue req = parseJSON(r.line);
+      if (req.kind != JSONValue::JV_OBJECT)
+        throw JSONError("request must be an object");
+      if (const JSONValue* idv = req.get("id")) {
+        if (idv->kind==JSONValue::JV_STRING) {
+          id = jsonString(idv->s);
+        } else if (idv->kind==JSONValue::JV_NUMBER) {
+          std::ostringstream oss;
+          oss << static_cast<long long int>(idv->n);
+          id = oss.str();
+        }
+      }
+      const JSONValue* model = req.get("model");
+      if (model==NULL || model->kind != JSONValue::JV_STRING)
+        throw JSONError("'model' must be a string");
+      std::vector<std::string> data = stringArray(req.get("data"),"data");
+      std::vector<std::string> args = stringArray(req.get("args"),"args");
+      long long int timeLimit = intField(req.get("time_limit"),"time_limit",_s.timeLimit);
+      long long int deadline = intField(req.get("deadline"),"deadline",0);
+      long long int memoryLimit = intField(req.get("memory_limit"),"memory_limit",_s.memoryLimit);
+
+      // Parse the options like the command line of a front-end
+      std::vector<std::string> argv;
+      argv.push_back("minisearch-server");
+      argv.insert(argv.end(), _s.baseArgs.begin(), _s.baseArgs.end());
+      for (unsigned int i=0; i<args.size(); i++) {
+        if (args[i]==constants().cli.help_str.str() || args[i]==constants().cli.help_short_str.str() ||
+            args[i]==constants().cli.version_str.str())
+          throw CLIError("option "+args[i]+" cannot be used in a request");
+        argv.push_back(args[i]);
+      }
+      argv.push_back(model->s);
+      argv.insert(argv.end(), data.begin(), data.end());
+      std::vector<char*> cargv;
+      for (unsigned int i=0; i<argv.size(); i++)
+        cargv.push_back(const_cast<char*>(argv[i].c_str()));
+      std::unique_ptr<CLIOptions> opts(_cp.parseArgs(static_cast<int>(cargv.size()), &cargv[0]));
+
+      BatchOptions bopts;
+      bopts.includePaths = opts->getStringVectorParam(constants().opts.includePaths.str());
+      bopts.ignoreStdlib = opts->getBoolParam(constants().opts.ignoreStdlib.str());
+      bopts.verbose = opts->getBoolParam(constants().opts.verbose.str());
+      bopts.optimize = opts->getBoolParam(constants().opts.optimize.str());
+      bopts.newfzn = opts->getBoolParam(constants().opts.newfzn.str());
+      bopts.fopts.onlyRangeDomains = opts->getBoolParam(constants().opts.rangeDomainsOnly.str());
+      std::vector<std::string> datafiles;
+      if (opts->hasParam(constants().opts.datafiles.str()))
+        datafiles = opts->getStringVectorParam(constants().opts.datafiles.str());
+      std::string cmdlineData = opts->getStringParam(constants().opts.cmdlineData.str());
+      if (cmdlineData != "")
+        datafiles.push_back("cmd:/"+cmdlineData);
+      if (memoryLimit > 0)
+        opts->setIntParam(constants().solver_options.memory_limit_mb.str(), memoryLimit);
+
+      std::string filename = opts->getStringParam(constants().opts.model.str());
+      std::shared_ptr<PreparedModel> pm = prepared(filename, bopts, err);
+      // The deadline includes the time spent preparing the model
+      long long int remaining = deadline > 0 ? deadline - epoch_ms() : 0;
+      if (pm && deadline > 0 && remaining <= 0) {
+        err << "Error: deadline passed before the request could be solved" << std::endl;
+      } else if (pm) {
+        if (deadline > 0 && (timeLimit <= 0 || remaining < timeLimit))
+          timeLimit = remaining;
+        bopts.timeLimit = timeLimit;
+        SolutionStreamBuf sb(*r.conn, id);
+        std::ostream out(&sb);
+        CLIOptions& o = *opts;
+        ok = pm->solve(datafiles, bopts,
+                       [&o](Env& env, std::ostream& out, long long int timeLimit) {
+                         SearchHandler sh(out);
+                         if (timeLimit > 0)
+                           sh.setTimeLimit(timeLimit);
+                         sh.search<FZNSolverInstance>(env,o);
+                       }, out, err);
+        out.flush();
+        output = sb.rest();
+      }
+    } catch (Exception& e) {
+      err << e.what() << ": " << e.msg() << std::endl;
+      ok = false;
+    }
+    std::ostringstream resp;
+    resp << "{\"id\":" << id << ",\"type\":\"done\",\"status\":" << (ok ? "\"ok\"" : "\"error\"")
+         << ",\"output\":" << jsonString(output) << ",\"errors\":" << jsonString(err.str())
+         << ",\"time_ms\":" << static_cast<long long int>(timer.ms()) << "}\n";
+    r.conn->send(resp.str());
+  }
+
+  /// Read requests from the socket of one client
+  void readRequests(ServerState& s, int fd) {
+    std::shared_ptr<Connection> conn(new Connection(fd, true));
+    std::string pending;
+    char buf[4096];
+    for (;;) {
+      ssize_t n = read(fd, buf, sizeof(buf));
+      if (n < 0 && errno==EINTR)
+        continue;
+      if (n <= 0)
+        break;
+      pending.append(buf, n);
+      size_t nl;
+      while ((nl = pending.find('\n')) != std::string::npos) {
+        Request r;
+        r.line = pending.substr(0,nl);
+        r.conn = conn;
+        pending.erase(0,nl+1);
+        if (r.line.find_first_not_of(" \t\r") != std::string::npos)
+          s.queue.push(r);
+      }
+    }
+  }
+
+}
+
+int main(int argc, char** argv) {
+  ServerState state;
+  string socketPath;
+  string fifoPath;
+  unsigned int workers = 1;
+
+  for (int i=1; i<argc; i++) {
+    string arg(argv[i]);
+    if (arg=="-h" || arg=="--help") {
+      goto usage;
+    } else if (arg=="--socket") {
+      if (++i==argc)
+        goto usage;
+      socketPath = argv[i];
+    } else if (arg=="--fifo") {
+      if (++i==argc)
+        goto usage;
+      fifoPath = argv[i];
+    } else if (arg=="--workers") {
+      if (++i==argc)
+        goto usage;
+      workers = atoi(argv[i]);
+      if (workers < 1)
+        goto usage;
+    } else if (arg=="--time-limit") {
+      if (++i==argc)
+        goto usage;
+      state.timeLimit = atoll(argv[i]);
+    } else if (arg=="--memory-limit") {
+      if (++i==argc)
+        goto usage;
+      state.memoryLimit = atoll(argv[i]);
+    } else if (arg=="--models-per-worker") {
+      if (++i==argc)
+        goto usage;
+      state.cacheSize = atoi(argv[i]);
+      if (state.cacheSize < 1)
+        goto usage;
+    } else {
+      state.baseArgs.push_back(arg);
+    }
+  }
+  if (socketPath.empty()==fifoPath.empty())
+    goto usage;
+
+  // Writing to a client that has gone away must not terminate the server
+  signal(SIGPIPE, SIG_IGN);
+
+  for (unsigned int i=0; i<workers; i++) {
+    std::thread([&state] {
+      ServerWorker w(state);
+      w.run();
+    }).detach();
+  }
+
+  if (!socketPath.empty()) {
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+      std::cerr << "Error: socket path too long." << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    strcpy(addr.sun_path, socketPath.c_str());
+    unlink(socketPath.c_str());
+    if (sock < 0 || ::bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(sock, 16) != 0) {
+      std::cerr << "Error: cannot listen on socket '" << socketPath << "': "
+                << strerror(errno) << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    for (;;) {
+      int fd = accept(sock, NULL, NULL);
+      if (fd < 0) {
+        if (errno==EINTR)
+          continue;
+        std::cerr << "Error: accept failed: " << strerror(errno) << std::endl;
+        std::exit(EXIT_FAILURE);
+      }
+      std::thread(readRequests, std::ref(state), fd).detach();
+    }
+  } else {
+    struct stat st;
+    if (stat(fifoPath.c_str(), &st) != 0 && mkfifo(fifoPath.c_str(), 0600) != 0) {
+      std::cerr << "Error: cannot create FIFO '" << fifoPath << "': "
+                << strerror(errno) << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    // Responses to requests from the FIFO are written to standard output
+    std::shared_ptr<Connection> conn(new Connection(STDOUT_FILENO, false));
+    for (;;) {
+      // Opening blocks until a writer opens the FIFO, reopen when all writers are done
+      std::ifstream fifo(fifoPath.c_str());
+      if (!fifo.is_open()) {
+        std::cerr << "Error: cannot open FIFO '" << fifoPath << "'." << std::endl;
+        std::exit(EXIT_FAILURE);
+      }
+      Request r;
+      r.conn = conn;
+      while (std::getline(fifo, r.line)) {
+        if (r.line.find_first_not_of(" \t\r") != std::string::npos)
+          state.queue.push(r);
+      }
+    }
+  }
+  return 0;
+
+usage:
+  std::cerr << "Usage: "<< argv[0]
+  << " (--socket <path> | --fifo <path>) [<server options>] [<options>]" << std::endl
+  << std::endl
+  << "Solves requests from clients, keeping the parsed models and the library" << std::endl
+  << "loaded between requests. Each request is a line containing a JSON object" << std::endl
+  << std::endl
+  << "  {\"id\": <id>, \"model\": <file>, \"data\": [<file>, ...], \"args\": [<option>, ...]," << std::endl
+  << "   \"time_limit\": <ms>, \"deadline\": <ms since epoch>, \"memory_limit\": <MB>}" << std::endl
+  << std::endl
+  << "where only \"model\" is required, and \"args\" are command line options as" << std::endl
+  << "accepted by the MiniZinc front-end (e.g. --solver). The server answers with" << std::endl
+  << "a line {\"id\": <id>, \"type\": \"solution\", \"output\": <text>} for each solution" << std::endl
+  << "and a final line {\"id\": <id>, \"type\": \"done\", \"status\": \"ok\"|\"error\"," << std::endl
+  << "\"output\": <text>, \"errors\": <text>, \"time_ms\": <ms>}." << std::endl
+  << std::endl
+  << "Server options:" << std::endl
+  << "  --socket <path>\n    Accept clients on the UNIX domain socket <path>" << std::endl
+  << "  --fifo <path>\n    Read requests from the FIFO <path> (created if it does not exist) and\n    write the responses to standard output" << std::endl
+  << "  --workers <n>\n    Solve <n> requests in parallel" << std::endl
+  << "  --time-limit <ms>\n    Default time limit per request" << std::endl
+  << "  --memory-limit <MB>\n    Default memory limit of the solver process per request" << std::endl
+  << "  --models-per-worker <n>\n    Number of prepared models kept by each worker (default 4)" << std::endl
+  << std::endl
+  << "All other options (e.g. --stdlib-dir, -G, --solver) are added to the options" << std::endl
+  << "of each request." << std::endl;
+  exit(EXIT_FAILURE);
+}
@@ -13,6 +13,8 @@
 #include <minizinc/exception.hh>
 #include <minizinc/ast.hh>
 #include <minizinc/eval_par.hh>
+#include <minizinc/solution_record.hh>
+#include <minizinc/solution_writer.hh>
 
 #include <minizinc/solvers/gecode_solverinstance.hh>
 #include <minizinc/solvers/gecode/gecode_constraints.hh>
@@ -1014,15 +1016,15 @@ namespace MiniZinc {
     prepareEngine(combinators,optimize);
 
     // find the best solution
+    SolutionFormat format = solutionFormat(_options.getStringParam(constants().opts.solutionFormat.str(),"text"));
+    SolutionWriter writer(std::cout);
     while (FznSpace* next_sol = engine->next()) {
       if(_solution) delete _solution;
       //else env().hasSolution(true); // we need to do this here since we cannot do it on interpretor level
       _solution = next_sol;
       assignSolutionToOutput(); 
-      if(print) {
-        env().evalOutput(std::cout);      
-        std::cout << constants().solver_output.solution_delimiter << std::endl;   
-      }      
+      if(print)
+        writer.write(solutionRecord(env(), format, -1.0, statistics()));
     } 
             
     _objVar = NULL; // reset objective variable
@@ -1140,6 +1142,16 @@ namespace MiniZinc {
     }
   }
 
+  Statistics*
+  GecodeSolverInstance::statistics(void) {
+    if (engine==NULL)
+      return NULL;
+    Gecode::Search::Statistics stat = engine->statistics();
+    _statistics.nodes(stat.node);
+    _statistics.failures(stat.fail);
+    return &_statistics;
+  }
+
   void GecodeSolverInstance::print_stats(){
       Gecode::Search::Statistics stat = engine->statistics();
       std::cerr << "%%  variables:     " 
@@ -1164,14 +1176,14 @@ namespace MiniZinc {
     if (_current_space->_solveType == MiniZinc::SolveI::SolveType::ST_SAT) {
       _solution = engine->next();
     } else {
+      SolutionFormat format = solutionFormat(_options.getStringParam(constants().opts.solutionFormat.str(),"text"));
+      SolutionWriter writer(std::cout);
       while (FznSpace* next_sol = engine->next()) {
         if(_solution) delete _solution;        
         _solution = next_sol;
         // HACK: Andrea: just for experiments to show intermediate solutions (or make it a VERBOSE option)        
         assignSolutionToOutput(); // remove this after experiments
-        env().evalOutput(std::cout); // remove this after experiments
-        std::cout << constants().solver_output.solution_delimiter << std::endl;
-        std::cout.flush();
+        writer.write(solutionRecord(env(), format, -1.0, statistics())); // remove this after experiments
       }
     }        
     SolverInstance::Status status = SolverInstance::SUCCESS;
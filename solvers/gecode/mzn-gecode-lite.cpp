@@ -79,6 +79,7 @@ int main(int argc, char** argv) {
   bool flag_output_fzn_stdout = false;
   bool flag_output_ozn_stdout = false;
   bool flag_instance_check_only = false;
+  string flag_solution_format = "text";
   FlatteningOptions fopts;
   
   if (argc < 2)
@@ -220,6 +221,13 @@ int main(int argc, char** argv) {
       fopts.onlyRangeDomains = true;
     } else if (string(argv[i])=="-Werror") {
       flag_werror = true;
+    } else if (string(argv[i])=="--solution-format") {
+      i++;
+      if (i==argc)
+        goto error;
+      flag_solution_format = argv[i];
+      if (flag_solution_format != "text" && flag_solution_format != "json" && flag_solution_format != "binary")
+        goto error;
     } else {
       std::string input_file(argv[i]);
       if (input_file.length()<=4) {
@@ -374,6 +382,7 @@ int main(int argc, char** argv) {
             {            
 
               Options options;
+              options.setStringParam(constants().opts.solutionFormat.str(),flag_solution_format);
               SearchHandler* sh = new SearchHandler();
               sh->search<GecodeSolverInstance>(env,options);
             }
@@ -431,6 +440,7 @@ error:
     << "  --output-ozn-to-file <file>\n    Filename for model output specification" << std::endl
     << "  --output-to-stdout, --output-fzn-to-stdout\n    Print generated FlatZinc to standard output" << std::endl
     << "  --output-ozn-to-stdout\n    Print model output specification to standard output" << std::endl
+    << "  --solution-format <format>\n    Write solutions as text (the output item, default), as one JSON object\n    per line (json), or as length-prefixed binary records (binary)" << std::endl
     << "  -Werror\n    Turn warnings into errors" << std::endl
     ;
 